@@ -0,0 +1,481 @@
+/**
+ * Benchmarks for the hot paths of bigrig, with machine readable results.
+ *
+ * Every benchmark is run for each combination of the requested trees, region
+ * counts and rate regimes that it depends on. The results are written as JSON,
+ * so that runs of different versions can be compared.
+ */
+#include "trees.hpp"
+
+#include "clioptions.hpp"
+#include "dist.hpp"
+#include "io.hpp"
+#include "split.hpp"
+#include "tree.hpp"
+
+#include "pcg_random.hpp"
+
+#include <CLI/App.hpp>
+#include <CLI/Config.hpp>
+#include <CLI/Formatter.hpp>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <logger.hpp>
+#include <nlohmann/json.hpp>
+#include <unistd.h>
+
+namespace {
+
+constexpr int BENCH_FORMAT_VERSION = 1;
+
+/**
+ * Endpoint mode is exponential in the number of regions, so it is only
+ * benchmarked for small region counts.
+ */
+constexpr size_t ENDPOINT_BENCH_MAX_REGIONS = 10;
+
+/* The number of random ranges cycled through by the spread and split benches */
+constexpr size_t DIST_POOL_SIZE = 1024;
+
+/**
+ * A named set of model parameters. The regimes differ in how many events
+ * happen on a branch, which is what decides how the time is split between the
+ * branches and the splits.
+ */
+struct regime_t {
+  std::string                   name;
+  bigrig::rate_params_t         rates;
+  bigrig::cladogenesis_params_t clado;
+};
+
+const std::vector<regime_t> REGIMES{
+    {"low",
+     {.dis = 0.1, .ext = 0.1},
+     {.allopatry = 1.0, .sympatry = 1.0, .copy = 1.0, .jump = 0.0}},
+    {"medium",
+     {.dis = 1.0, .ext = 1.0},
+     {.allopatry = 1.0, .sympatry = 1.0, .copy = 1.0, .jump = 0.5}},
+    {"high",
+     {.dis = 10.0, .ext = 5.0},
+     {.allopatry = 1.0, .sympatry = 2.0, .copy = 1.0, .jump = 1.0}},
+};
+
+/**
+ * The output formats which are benchmarked. Without a format, only the phylip
+ * and annotated tree files are written.
+ */
+const std::vector<std::pair<std::string, std::optional<output_format_type_e>>>
+    WRITER_FORMATS{{"phylip", {}},
+                   {"yaml", output_format_type_e::YAML},
+                   {"json", output_format_type_e::JSON},
+                   {"csv", output_format_type_e::CSV},
+                   {"binary", output_format_type_e::BINARY}};
+
+struct bench_options_t {
+  std::vector<size_t>                  taxa{64, 1024, 16384};
+  std::vector<std::string>             shapes{"balanced", "caterpillar",
+                                                "yule"};
+  std::vector<std::filesystem::path>   tree_files;
+  std::vector<size_t>                  regions{4, 8, 16, 32};
+  std::vector<std::string>             regimes{"low", "medium", "high"};
+  std::vector<std::string>             filters;
+  size_t                               periods  = 4;
+  double                               min_time = 0.1;
+  uint64_t                             seed     = 42;
+  std::optional<std::filesystem::path> output;
+};
+
+struct named_tree_t {
+  std::string    name;
+  bigrig::tree_t tree;
+};
+
+struct measurement_t {
+  size_t iterations;
+  double seconds;
+};
+
+/**
+ * Run `f` until it has taken at least `min_time` seconds, growing the number
+ * of iterations each round, so that the clock is only read once per round.
+ */
+template <typename F> measurement_t measure(double min_time, F &&f) {
+  using clock = std::chrono::steady_clock;
+
+  size_t iterations = 1;
+  while (true) {
+    auto start = clock::now();
+    for (size_t i = 0; i < iterations; ++i) { f(); }
+    double seconds
+        = std::chrono::duration<double>(clock::now() - start).count();
+    if (seconds >= min_time || iterations >= (1ul << 40)) {
+      return {iterations, seconds};
+    }
+
+    double growth = seconds > 0.0 ? 1.2 * min_time / seconds : 10.0;
+    growth        = std::clamp(growth, 2.0, 10.0);
+    iterations    = static_cast<size_t>(
+        std::ceil(static_cast<double>(iterations) * growth));
+  }
+}
+
+/**
+ * Keeps the compiler from dropping the work of a benchmark.
+ */
+template <typename T> void do_not_optimize(const T &value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+class bench_runner_t {
+public:
+  explicit bench_runner_t(const bench_options_t &options)
+      : _options{options} {}
+
+  bool enabled(std::string_view bench) const {
+    if (_options.filters.empty()) { return true; }
+    return std::any_of(
+        _options.filters.begin(),
+        _options.filters.end(),
+        [bench](const auto &f) { return bench.find(f) != bench.npos; });
+  }
+
+  /**
+   * Measure `f`, and record the result with `params`. Each call of `f` is one
+   * operation, e.g. one spread, or one whole tree.
+   */
+  template <typename F>
+  void run(const std::string &bench, nlohmann::json params, F &&f) {
+    auto m     = measure(_options.min_time, std::forward<F>(f));
+    auto total = static_cast<double>(m.iterations);
+
+    params["bench"]          = bench;
+    params["iterations"]     = m.iterations;
+    params["seconds"]        = m.seconds;
+    params["ns_per_op"]      = m.seconds * 1e9 / total;
+    params["ops_per_second"] = total / std::max(m.seconds, 1e-12);
+    LOG_INFO("%-10s %s: %.1f ns/op",
+             bench.c_str(),
+             params.dump().c_str(),
+             params["ns_per_op"].get<double>());
+    _results.push_back(std::move(params));
+  }
+
+  nlohmann::json &last() { return _results.back(); }
+
+  const nlohmann::json &results() const { return _results; }
+
+private:
+  const bench_options_t &_options;
+  nlohmann::json         _results = nlohmann::json::array();
+};
+
+std::vector<regime_t> select_regimes(const std::vector<std::string> &names) {
+  std::vector<regime_t> regimes;
+  for (const auto &name : names) {
+    auto itr = std::find_if(REGIMES.begin(), REGIMES.end(), [&](const auto &r) {
+      return r.name == name;
+    });
+    if (itr == REGIMES.end()) {
+      LOG_ERROR("Unknown rate regime '%s'", name.c_str());
+      return {};
+    }
+    regimes.push_back(*itr);
+  }
+  return regimes;
+}
+
+/**
+ * Periods which split the height of the tree evenly, all with the same model.
+ */
+std::vector<bigrig::period_t>
+make_periods(const regime_t &regime, size_t count, double height) {
+  std::vector<bigrig::period_t> periods;
+  for (size_t i = 0; i < count; ++i) {
+    double start  = height * static_cast<double>(i) / count;
+    double length = i + 1 == count ? std::numeric_limits<double>::infinity()
+                                   : height / count;
+    periods.emplace_back(start, length, regime.rates, regime.clado, false, i);
+  }
+  return periods;
+}
+
+double tree_height(const bigrig::tree_t &tree) {
+  double height = 0.0;
+  for (size_t index = 0; index < tree.node_count(); ++index) {
+    height = std::max(height, tree.abs_time(index));
+  }
+  return height;
+}
+
+std::vector<bigrig::dist_t> make_dist_pool(size_t regions, pcg64_fast &gen) {
+  std::vector<bigrig::dist_t> pool;
+  pool.reserve(DIST_POOL_SIZE);
+  for (size_t i = 0; i < DIST_POOL_SIZE; ++i) {
+    pool.push_back(bigrig::make_random_dist(regions, gen));
+  }
+  return pool;
+}
+
+void bench_spread_and_split(bench_runner_t              &runner,
+                            const std::vector<size_t>   &region_counts,
+                            const std::vector<regime_t> &regimes,
+                            pcg64_fast                  &gen) {
+  for (auto regions : region_counts) {
+    auto pool = make_dist_pool(regions, gen);
+    for (const auto &regime : regimes) {
+      bigrig::biogeo_model_t model{regime.rates, regime.clado, false};
+      model.set_region_count(regions);
+      nlohmann::json params{{"regions", regions}, {"regime", regime.name}};
+
+      size_t i = 0;
+      if (runner.enabled("spread")) {
+        runner.run("spread", params, [&] {
+          auto t = bigrig::spread_analytic(
+              pool[i++ % DIST_POOL_SIZE], model, gen);
+          do_not_optimize(t.waiting_time);
+        });
+      }
+      if (runner.enabled("split")) {
+        runner.run("split", params, [&] {
+          auto s = bigrig::split_dist_fast(
+              pool[i++ % DIST_POOL_SIZE], model, gen);
+          do_not_optimize(s.type);
+        });
+      }
+    }
+  }
+}
+
+/**
+ * Simulate the whole tree in each of the modes. The number of events per
+ * second is recorded as well, since the time per tree mostly depends on it.
+ */
+void bench_simulate(bench_runner_t              &runner,
+                    named_tree_t                &named,
+                    const std::vector<size_t>   &region_counts,
+                    const std::vector<regime_t> &regimes,
+                    size_t                       period_count,
+                    pcg64_fast                  &gen) {
+  auto  &tree   = named.tree;
+  double height = tree_height(tree);
+  for (auto regions : region_counts) {
+    for (const auto &regime : regimes) {
+      auto periods = make_periods(regime, period_count, height);
+      for (auto &p : periods) { p.model_ptr()->set_region_count(regions); }
+
+      nlohmann::json params{{"tree", named.name},
+                            {"taxa", tree.leaf_count()},
+                            {"regions", regions},
+                            {"regime", regime.name},
+                            {"periods", period_count}};
+      auto root = bigrig::make_random_dist(regions, gen);
+
+      if (runner.enabled("periods")) {
+        runner.run("periods", params, [&] { tree.set_periods(periods); });
+      }
+      if (!runner.enabled("simulate")) { continue; }
+
+      tree.set_mode(bigrig::operation_mode_e::FAST);
+      tree.set_periods(periods);
+
+      bigrig::sim_result_t result;
+      size_t               events = 0, trees = 0;
+      auto                 count  = [&] {
+        ++trees;
+        for (size_t index = 0; index < tree.node_count(); ++index) {
+          events += result.transition_count(index);
+        }
+      };
+
+      params["mode"] = "fast";
+      runner.run("simulate", params, [&] {
+        tree.simulate(root, result, gen);
+        count();
+      });
+      runner.last()["events_per_tree"] = static_cast<double>(events) / trees;
+
+      params["mode"] = "stats-only";
+      result.set_stats_only(true);
+      runner.run("simulate", params, [&] { tree.simulate(root, result, gen); });
+      result.set_stats_only(false);
+
+      if (regions <= ENDPOINT_BENCH_MAX_REGIONS) {
+        params["mode"] = "endpoint";
+        tree.set_mode(bigrig::operation_mode_e::ENDPOINT);
+        runner.run(
+            "simulate", params, [&] { tree.simulate(root, result, gen); });
+        tree.set_mode(bigrig::operation_mode_e::FAST);
+      }
+    }
+  }
+}
+
+/**
+ * Write one replicate per op, with each of the output formats. The files are
+ * written to a scratch directory, which is removed afterwards.
+ */
+void bench_writers(bench_runner_t              &runner,
+                   named_tree_t                &named,
+                   const std::vector<size_t>   &region_counts,
+                   const regime_t              &regime,
+                   size_t                       period_count,
+                   pcg64_fast                  &gen) {
+  auto scratch = std::filesystem::temp_directory_path()
+               / ("bigrig_bench." + std::to_string(getpid()));
+  std::filesystem::create_directories(scratch);
+
+  auto &tree    = named.tree;
+  auto  periods = make_periods(regime, period_count, tree_height(tree));
+  for (auto regions : region_counts) {
+    for (auto &p : periods) { p.model_ptr()->set_region_count(regions); }
+    tree.set_mode(bigrig::operation_mode_e::FAST);
+    tree.set_periods(periods);
+
+    bigrig::sim_result_t result;
+    auto                 root = bigrig::make_random_dist(regions, gen);
+    tree.simulate(root, result, gen);
+
+    for (const auto &[name, format] : WRITER_FORMATS) {
+      cli_options_t cli_options;
+      cli_options.prefix             = scratch / name;
+      cli_options.output_format_type = format;
+      cli_options.root_range         = root;
+
+      nlohmann::json params{{"tree", named.name},
+                            {"taxa", tree.leaf_count()},
+                            {"regions", regions},
+                            {"regime", regime.name},
+                            {"format", name}};
+
+      program_stats_t stats{std::chrono::duration<double>{0.0}};
+      size_t          replicate = 0;
+      output_files_t  files{cli_options};
+      runner.run("write", params, [&] {
+        files.write_replicate(tree, result, periods, stats, replicate++);
+      });
+    }
+  }
+  std::filesystem::remove_all(scratch);
+}
+
+std::vector<named_tree_t> make_trees(const bench_options_t &options) {
+  std::vector<named_tree_t> trees;
+  for (const auto &name : options.shapes) {
+    auto shape = bench::parse_tree_shape(name);
+    if (!shape.has_value()) {
+      LOG_ERROR("Unknown tree shape '%s'", name.c_str());
+      return {};
+    }
+    for (auto taxa : options.taxa) {
+      trees.push_back(
+          {name, bench::make_tree(shape.value(), taxa, options.seed)});
+    }
+  }
+  for (const auto &filename : options.tree_files) {
+    trees.push_back({filename.filename().string(), bigrig::tree_t{filename}});
+  }
+  return trees;
+}
+} // namespace
+
+int main() {
+  logger::get_log_states().add_stream(
+      stderr,
+      logger::log_level::info | logger::log_level::warning
+          | logger::log_level::error);
+
+  CLI::App        app{"Benchmarks for the hot paths of bigrig."};
+  bench_options_t options;
+
+  app.add_option("--taxa", options.taxa, "Tip counts of the generated trees.");
+  app.add_option("--shapes",
+                 options.shapes,
+                 "Shapes of the generated trees: balanced, caterpillar or "
+                 "yule. Pass 'none' to only use the trees from --tree.");
+  app.add_option("--tree",
+                 options.tree_files,
+                 "Newick files with real trees to benchmark, as well.");
+  app.add_option("--regions", options.regions, "Region counts.");
+  app.add_option("--regimes",
+                 options.regimes,
+                 "Rate regimes: low, medium or high.");
+  app.add_option("--periods", options.periods, "Number of periods.");
+  app.add_option("--filter",
+                 options.filters,
+                 "Only run the benchmarks which contain one of these: spread, "
+                 "split, periods, simulate or write.");
+  app.add_option("--min-time",
+                 options.min_time,
+                 "Minimum time to run each benchmark for, in seconds.");
+  app.add_option("--seed", options.seed, "Seed for the trees and the RNG.");
+  app.add_option("--output",
+                 options.output,
+                 "File to write the JSON results to, instead of stdout.");
+
+  CLI11_PARSE(app);
+
+  if (options.shapes.size() == 1 && options.shapes.front() == "none") {
+    options.shapes.clear();
+  }
+  std::erase_if(options.regions, [](size_t r) {
+    if (r == 0 || r >= bigrig::dist_t::MAX_REGIONS) {
+      LOG_WARNING("Skipping %lu regions, this build supports 1 to %lu",
+                  r,
+                  bigrig::dist_t::MAX_REGIONS - 1);
+      return true;
+    }
+    return false;
+  });
+
+  auto regimes = select_regimes(options.regimes);
+  auto trees   = make_trees(options);
+  if (regimes.empty() || options.periods == 0
+      || (trees.empty() && !options.shapes.empty())) {
+    return 1;
+  }
+
+  pcg64_fast     gen{options.seed};
+  bench_runner_t runner{options};
+
+  bench_spread_and_split(runner, options.regions, regimes, gen);
+  for (auto &named : trees) {
+    if (!named.tree.is_valid()) {
+      LOG_ERROR("The tree '%s' is not valid, skipping it", named.name.c_str());
+      continue;
+    }
+    bench_simulate(
+        runner, named, options.regions, regimes, options.periods, gen);
+    if (runner.enabled("write")) {
+      bench_writers(runner,
+                    named,
+                    options.regions,
+                    regimes.front(),
+                    options.periods,
+                    gen);
+    }
+  }
+
+  nlohmann::json report{
+      {"version", BENCH_FORMAT_VERSION},
+      {"dist_words", BIGRIG_DIST_WORDS},
+      {"seed", options.seed},
+      {"min_time", options.min_time},
+      {"results", runner.results()},
+  };
+
+  if (options.output.has_value()) {
+    std::ofstream file(options.output.value());
+    file << report.dump(2) << "\n";
+    if (!file) {
+      LOG_ERROR("Failed to write the results to '%s'",
+                options.output->c_str());
+      return 1;
+    }
+  } else {
+    std::cout << report.dump(2) << "\n";
+  }
+  return 0;
+}
@@ -0,0 +1,94 @@
+#include "trees.hpp"
+
+#include "pcg_random.hpp"
+
+#include <algorithm>
+#include <array>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace bench {
+
+namespace {
+constexpr std::array<std::string_view, 3> TREE_SHAPE_NAMES{
+    "balanced", "caterpillar", "yule"};
+
+/**
+ * The number of tips in the left subtree of an inner node with `taxa` tips.
+ * For a Yule tree, this is uniform over `[1, taxa - 1]`.
+ */
+size_t left_taxa(tree_shape_e shape, size_t taxa, pcg64_fast &gen) {
+  switch (shape) {
+  case tree_shape_e::BALANCED:
+    return taxa / 2;
+  case tree_shape_e::CATERPILLAR:
+    return 1;
+  case tree_shape_e::YULE:
+    return std::uniform_int_distribution<size_t>(1, taxa - 1)(gen);
+  }
+  return 1;
+}
+} // namespace
+
+std::optional<tree_shape_e> parse_tree_shape(std::string_view name) {
+  auto itr = std::find(TREE_SHAPE_NAMES.begin(), TREE_SHAPE_NAMES.end(), name);
+  if (itr == TREE_SHAPE_NAMES.end()) { return {}; }
+  return static_cast<tree_shape_e>(itr - TREE_SHAPE_NAMES.begin());
+}
+
+std::string_view to_string(tree_shape_e shape) {
+  return TREE_SHAPE_NAMES[static_cast<size_t>(shape)];
+}
+
+/**
+ * Make a binary tree with `taxa` tips. The nodes are made straight into the
+ * preorder arrays, with a stack instead of recursion, so that very deep trees
+ * are fine. The branch lengths are random, and then scaled so that the deepest
+ * tip is at time 1, which keeps the number of events comparable between the
+ * shapes.
+ */
+bigrig::tree_t make_tree(tree_shape_e shape, size_t taxa, uint64_t seed) {
+  pcg64_fast                             gen{seed};
+  std::uniform_real_distribution<double> brlen_dist(0.5, 1.5);
+
+  std::vector<size_t>      parents;
+  std::vector<double>      brlens;
+  std::vector<double>      depths;
+  std::vector<std::string> labels;
+
+  /* The parent and the number of tips of every subtree still to be made */
+  std::vector<std::pair<size_t, size_t>> stack{
+      {bigrig::tree_t::no_parent, std::max<size_t>(taxa, 2)}};
+
+  size_t tip_count = 0;
+  while (!stack.empty()) {
+    auto [parent, count] = stack.back();
+    stack.pop_back();
+
+    size_t index = parents.size();
+    double brlen = parent == bigrig::tree_t::no_parent ? 0.0 : brlen_dist(gen);
+    parents.push_back(parent);
+    brlens.push_back(brlen);
+    depths.push_back(parent == bigrig::tree_t::no_parent
+                         ? 0.0
+                         : depths[parent] + brlen);
+
+    if (count == 1) {
+      labels.push_back("t" + std::to_string(tip_count++));
+      continue;
+    }
+    labels.emplace_back();
+
+    /* The left subtree goes on the stack last, so it is the next node */
+    auto left = left_taxa(shape, count, gen);
+    stack.emplace_back(index, count - left);
+    stack.emplace_back(index, left);
+  }
+
+  double height = *std::max_element(depths.begin(), depths.end());
+  for (auto &b : brlens) { b /= height; }
+
+  return {std::move(parents), std::move(brlens), std::move(labels)};
+}
+} // namespace bench
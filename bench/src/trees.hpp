@@ -0,0 +1,29 @@
+#pragma once
+
+#include "tree.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+namespace bench {
+
+/**
+ * The shapes of the generated trees.
+ *
+ * - `BALANCED`: every inner node splits its tips in half, so the depth is
+ *   logarithmic in the number of tips.
+ * - `CATERPILLAR`: every inner node has a tip as a child, so the depth is
+ *   linear in the number of tips. The worst case for anything recursive.
+ * - `YULE`: a pure birth tree, which is what real trees look like, more or
+ *   less.
+ */
+enum class tree_shape_e { BALANCED, CATERPILLAR, YULE };
+
+std::optional<tree_shape_e> parse_tree_shape(std::string_view name);
+
+std::string_view to_string(tree_shape_e shape);
+
+bigrig::tree_t make_tree(tree_shape_e shape, size_t taxa, uint64_t seed);
+} // namespace bench
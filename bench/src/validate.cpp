@@ -0,0 +1,761 @@
+/**
+ * Statistical validation of the samplers of bigrig, with their throughput.
+ *
+ * Every sampler is run for a large number of samples, split over all of the
+ * cores, and the outcomes are tested against the exact distribution with a
+ * chi-squared goodness of fit test. There are three groups of tests:
+ *
+ * - `spread`: the region and the waiting time of one transition, from
+ *   `spread_rejection` and `spread_analytic`.
+ * - `split`: the left and right ranges of a split, from
+ *   `split_dist_rejection_method`, `split_dist_fast` and `split_dist_exact`.
+ * - `branch`: the range at the end of a branch, from simulating the path in
+ *   SIM mode and in FAST mode, and from the endpoint sampler.
+ *
+ * Each test is run for every region count, model and starting range, and the
+ * verdict is reported next to the samples per second of the sampler.
+ */
+#include "dist.hpp"
+#include "endpoint.hpp"
+#include "period.hpp"
+#include "split.hpp"
+
+#include "pcg_random.hpp"
+
+#include <CLI/App.hpp>
+#include <CLI/Config.hpp>
+#include <CLI/Formatter.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <logger.hpp>
+#include <nlohmann/json.hpp>
+#include <span>
+#include <thread>
+
+namespace {
+
+constexpr int VALIDATE_FORMAT_VERSION = 1;
+
+/**
+ * The rejection splitter only accepts a small part of its draws once there are
+ * more than a few regions, so it is skipped past this.
+ */
+constexpr size_t SPLIT_REJECTION_MAX_REGIONS = 6;
+
+/**
+ * The branch test has a category for every range, so it is only run for small
+ * region counts. This is also below the limit of the endpoint sampler.
+ */
+constexpr size_t BRANCH_MAX_REGIONS = 8;
+
+/* The waiting times of the spread test are binned into equally likely bins */
+constexpr size_t WAITING_TIME_BINS = 8;
+
+/* Categories with fewer expected samples than this are pooled together */
+constexpr double MIN_EXPECTED_COUNT = 5.0;
+
+/**
+ * The samples of a thread are drawn in batches, and only the drawing is timed,
+ * so the throughput doesn't include sorting the outcomes into categories.
+ */
+constexpr size_t BATCH_SIZE = 4096;
+
+struct model_params_t {
+  std::string                   name;
+  bigrig::rate_params_t         rates;
+  bigrig::cladogenesis_params_t clado;
+};
+
+const std::vector<model_params_t> MODELS{
+    {"dec",
+     {.dis = 1.0, .ext = 1.0},
+     {.allopatry = 1.0, .sympatry = 1.0, .copy = 1.0, .jump = 0.0}},
+    {"dec+j",
+     {.dis = 0.5, .ext = 0.25},
+     {.allopatry = 1.0, .sympatry = 1.0, .copy = 1.0, .jump = 1.0}},
+    {"fast-rates",
+     {.dis = 10.0, .ext = 5.0},
+     {.allopatry = 1.0, .sympatry = 2.0, .copy = 1.0, .jump = 1.0}},
+};
+
+struct validate_options_t {
+  std::vector<size_t>                  regions{2, 4, 8, 16, 32};
+  std::vector<std::string>             models{"dec", "dec+j", "fast-rates"};
+  std::vector<std::string>             filters;
+  size_t                               samples       = 1'000'000;
+  size_t                               threads       = 0;
+  size_t                               random_ranges = 2;
+  double                               branch_length = 1.0;
+  double                               alpha         = 1e-5;
+  uint64_t                             seed          = 42;
+  std::optional<std::filesystem::path> output;
+};
+
+/**
+ * The regularized upper incomplete gamma function, `Q(s, x)`. A series is
+ * used below `s + 1`, and a continued fraction above it.
+ */
+double upper_incomplete_gamma(double s, double x) {
+  constexpr size_t MAX_ITERATIONS = 1000;
+  constexpr double EPSILON        = 1e-15;
+  constexpr double TINY           = 1e-300;
+
+  if (x <= 0.0) { return 1.0; }
+  double log_prefix = s * std::log(x) - x - std::lgamma(s);
+
+  if (x < s + 1.0) {
+    double term = 1.0 / s, sum = term;
+    for (size_t n = 1; n < MAX_ITERATIONS; ++n) {
+      term *= x / (s + n);
+      sum  += term;
+      if (term < sum * EPSILON) { break; }
+    }
+    return 1.0 - sum * std::exp(log_prefix);
+  }
+
+  /* Lentz's method */
+  double b = x + 1.0 - s, c = 1.0 / TINY, d = 1.0 / b, h = d;
+  for (size_t n = 1; n < MAX_ITERATIONS; ++n) {
+    double an  = -static_cast<double>(n) * (n - s);
+    b         += 2.0;
+    d          = an * d + b;
+    d          = std::abs(d) < TINY ? TINY : d;
+    c          = b + an / c;
+    c          = std::abs(c) < TINY ? TINY : c;
+    d          = 1.0 / d;
+    double del = d * c;
+    h         *= del;
+    if (std::abs(del - 1.0) < EPSILON) { break; }
+  }
+  return std::exp(log_prefix) * h;
+}
+
+struct fit_t {
+  double chi2;
+  size_t df;
+  double p;
+  size_t impossible;
+};
+
+/**
+ * Chi-squared test of the counts against the probabilities of the categories.
+ * An outcome with a probability of 0 can't be explained by chance, so those
+ * are counted separately, and fail the test on their own.
+ */
+fit_t goodness_of_fit(const std::vector<uint64_t> &counts,
+                      const std::vector<double>   &probs) {
+  uint64_t total = 0;
+  for (auto c : counts) { total += c; }
+
+  fit_t  fit{.chi2 = 0.0, .df = 0, .p = 1.0, .impossible = 0};
+  double pooled_expected = 0.0, pooled_observed = 0.0;
+  size_t bins = 0;
+  for (size_t i = 0; i < counts.size(); ++i) {
+    double expected = probs[i] * static_cast<double>(total);
+    double observed = static_cast<double>(counts[i]);
+    if (probs[i] <= 0.0) {
+      fit.impossible += counts[i];
+      continue;
+    }
+    if (expected < MIN_EXPECTED_COUNT) {
+      pooled_expected += expected;
+      pooled_observed += observed;
+      continue;
+    }
+    fit.chi2 += (observed - expected) * (observed - expected) / expected;
+    ++bins;
+  }
+  if (pooled_expected > 0.0) {
+    fit.chi2 += (pooled_observed - pooled_expected)
+              * (pooled_observed - pooled_expected) / pooled_expected;
+    ++bins;
+  }
+
+  fit.df = bins > 0 ? bins - 1 : 0;
+  fit.p  = fit.df > 0 ? upper_incomplete_gamma(fit.df / 2.0, fit.chi2 / 2.0)
+                      : 1.0;
+  if (fit.impossible > 0) { fit.p = 0.0; }
+  return fit;
+}
+
+struct engine_run_t {
+  std::vector<uint64_t> counts;
+  size_t                samples;
+  double                seconds;
+  double                samples_per_second;
+};
+
+/**
+ * Draw `samples` outcomes on `threads` threads, and count the category of each
+ * one. `draw` fills a batch, and `key` gives the category of an outcome. Every
+ * thread gets its own stream, by advancing the generator of the seed.
+ *
+ * The throughput is the sum of the throughput of the threads, with only the
+ * time spent in `draw`.
+ */
+template <typename R>
+engine_run_t run_engine(
+    size_t                                                  samples,
+    size_t                                                  threads,
+    size_t                                                  categories,
+    uint64_t                                                seed,
+    size_t                                                  stream,
+    const std::function<void(pcg64_fast &, std::span<R>)> &draw,
+    const std::function<size_t(const R &)>                 &key) {
+  std::vector<std::vector<uint64_t>> counts(
+      threads, std::vector<uint64_t>(categories + 1, 0));
+  std::vector<double> seconds(threads, 0.0);
+
+  auto work = [&](size_t t) {
+    using clock = std::chrono::steady_clock;
+
+    pcg64_fast gen{seed};
+    gen.advance(static_cast<pcg_extras::pcg128_t>(stream * threads + t + 1)
+                << 64);
+
+    size_t         todo = samples / threads + (t < samples % threads ? 1 : 0);
+    std::vector<R> batch(BATCH_SIZE);
+    while (todo > 0) {
+      size_t n     = std::min(todo, BATCH_SIZE);
+      auto   start = clock::now();
+      draw(gen, std::span{batch.data(), n});
+      seconds[t] += std::chrono::duration<double>(clock::now() - start).count();
+      for (size_t i = 0; i < n; ++i) {
+        /* anything which is not an outcome goes in the last category */
+        counts[t][std::min(key(batch[i]), categories)] += 1;
+      }
+      todo -= n;
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (size_t t = 1; t < threads; ++t) { workers.emplace_back(work, t); }
+  work(0);
+  for (auto &w : workers) { w.join(); }
+
+  engine_run_t run{.counts             = std::vector<uint64_t>(categories + 1),
+                   .samples            = samples,
+                   .seconds            = 0.0,
+                   .samples_per_second = 0.0};
+  for (size_t t = 0; t < threads; ++t) {
+    for (size_t c = 0; c <= categories; ++c) { run.counts[c] += counts[t][c]; }
+    size_t thread_samples = samples / threads + (t < samples % threads ? 1 : 0);
+    run.seconds           = std::max(run.seconds, seconds[t]);
+    run.samples_per_second
+        += static_cast<double>(thread_samples) / std::max(seconds[t], 1e-12);
+  }
+  return run;
+}
+
+/**
+ * A sampler under test. `run` draws the samples, and gives the counts of the
+ * categories of the test.
+ */
+struct engine_t {
+  std::string                                name;
+  std::function<engine_run_t(size_t stream)> run;
+};
+
+/**
+ * One distribution, with the exact probability of each category, and the
+ * samplers which should all follow it.
+ */
+struct test_case_t {
+  std::string           test;
+  std::string           model;
+  size_t                regions;
+  bigrig::dist_t        init_dist;
+  std::vector<double>   probs;
+  std::vector<engine_t> engines;
+};
+
+class validator_t {
+public:
+  explicit validator_t(const validate_options_t &options)
+      : _options{options} {}
+
+  bool enabled(std::string_view test) const {
+    if (_options.filters.empty()) { return true; }
+    return std::any_of(
+        _options.filters.begin(),
+        _options.filters.end(),
+        [test](const auto &f) { return test.find(f) != test.npos; });
+  }
+
+  void run(const test_case_t &test_case) {
+    for (const auto &engine : test_case.engines) {
+      auto run = engine.run(_stream++);
+
+      /* the last category is for outcomes which are not in the test */
+      auto probs = test_case.probs;
+      probs.push_back(0.0);
+      auto fit  = goodness_of_fit(run.counts, probs);
+      bool pass = fit.p >= _options.alpha;
+      _ok      &= pass;
+
+      LOG_INFO("%-6s %-9s %-10s regions %2lu range %s: chi2 %.1f df %lu "
+               "p %.3g %s, %.3g samples/s",
+               test_case.test.c_str(),
+               engine.name.c_str(),
+               test_case.model.c_str(),
+               test_case.regions,
+               test_case.init_dist.to_str().c_str(),
+               fit.chi2,
+               fit.df,
+               fit.p,
+               pass ? "pass" : "FAIL",
+               run.samples_per_second);
+      if (fit.impossible > 0) {
+        LOG_ERROR("The %s engine made %lu impossible outcomes",
+                  engine.name.c_str(),
+                  fit.impossible);
+      }
+
+      _results.push_back({{"test", test_case.test},
+                          {"engine", engine.name},
+                          {"model", test_case.model},
+                          {"regions", test_case.regions},
+                          {"range", test_case.init_dist.to_str()},
+                          {"samples", run.samples},
+                          {"seconds", run.seconds},
+                          {"samples_per_second", run.samples_per_second},
+                          {"chi2", fit.chi2},
+                          {"df", fit.df},
+                          {"p", fit.p},
+                          {"impossible", fit.impossible},
+                          {"pass", pass}});
+    }
+  }
+
+  bool ok() const { return _ok; }
+
+  const nlohmann::json &results() const { return _results; }
+
+private:
+  const validate_options_t &_options;
+  size_t                    _stream  = 0;
+  bool                      _ok      = true;
+  nlohmann::json            _results = nlohmann::json::array();
+};
+
+/**
+ * The category of a transition is the flipped region, and the bin of the
+ * waiting time. The bins are quantiles of the exponential distribution of the
+ * waiting time, so every bin has the same probability.
+ */
+size_t spread_key(const bigrig::transition_t &t, double total_weight) {
+  auto flipped = t.initial_state ^ t.final_state;
+  if (flipped.full_region_count() != 1) { return ~0ul; }
+
+  double quantile = -std::expm1(-total_weight * t.waiting_time);
+  size_t bin      = std::min(static_cast<size_t>(quantile * WAITING_TIME_BINS),
+                        WAITING_TIME_BINS - 1);
+  return flipped.set_index(0) * WAITING_TIME_BINS + bin;
+}
+
+test_case_t
+make_spread_case(const model_params_t                          &params,
+                 const std::shared_ptr<bigrig::biogeo_model_t> &model,
+                 bigrig::dist_t                                 init_dist,
+                 const validate_options_t                      &options) {
+  using transition_t = bigrig::transition_t;
+
+  size_t regions = init_dist.regions();
+  auto [d, e]    = params.rates;
+  double total   = model->total_rate_weight(init_dist);
+
+  test_case_t test_case{.test      = "spread",
+                        .model     = params.name,
+                        .regions   = regions,
+                        .init_dist = init_dist,
+                        .probs     = std::vector<double>(
+                            regions * WAITING_TIME_BINS, 0.0),
+                        .engines   = {}};
+  for (size_t r = 0; r < regions; ++r) {
+    double rate = init_dist[r] ? (init_dist.singleton() ? 0.0 : e) : d;
+    for (size_t b = 0; b < WAITING_TIME_BINS; ++b) {
+      test_case.probs[r * WAITING_TIME_BINS + b]
+          = rate / total / WAITING_TIME_BINS;
+    }
+  }
+
+  auto key = [total](const transition_t &t) { return spread_key(t, total); };
+
+  size_t categories = test_case.probs.size();
+  auto   add        = [&](std::string name, auto &&spread) {
+    test_case.engines.push_back(
+        {std::move(name), [=, &options](size_t stream) {
+           return run_engine<transition_t>(
+               options.samples,
+               options.threads,
+               categories,
+               options.seed,
+               stream,
+               [=](pcg64_fast &gen, std::span<transition_t> out) {
+                 for (auto &t : out) { t = spread(init_dist, *model, gen); }
+               },
+               key);
+         }});
+  };
+  add("rejection", [](auto dist, const auto &m, auto &gen) {
+    return bigrig::spread_rejection(dist, m, gen);
+  });
+  add("analytic", [](auto dist, const auto &m, auto &gen) {
+    return bigrig::spread_analytic(dist, m, gen);
+  });
+  return test_case;
+}
+
+/**
+ * The category of a split. Every split is one range and a single region, as
+ * the left or the right child, except for a copy. So the category is the kind
+ * of split, which side the single region is on, and the region.
+ *
+ * An allopatric split of two regions is two single regions, so the right side
+ * is tried first, to give each outcome one category.
+ */
+size_t split_key(const bigrig::split_t &split) {
+  enum { SYMPATRY, JUMP, ALLOPATRY, KINDS };
+
+  const auto &top     = split.top;
+  size_t      regions = top.regions();
+  if (split.left == split.right) {
+    return split.left == top ? 0 : ~0ul;
+  }
+
+  for (size_t side = 0; side < 2; ++side) {
+    const auto &big   = side == 0 ? split.left : split.right;
+    const auto &small = side == 0 ? split.right : split.left;
+    if (!small.singleton()) { continue; }
+
+    size_t region = small.set_index(0);
+    size_t kind   = KINDS;
+    if (big == top) {
+      kind = top[region] ? SYMPATRY : JUMP;
+    } else if ((big | small) == top && (big & small).empty() && !big.empty()) {
+      kind = ALLOPATRY;
+    }
+    if (kind != KINDS) { return 1 + ((kind * 2 + side) * regions + region); }
+  }
+  return ~0ul;
+}
+
+/**
+ * The probability of every category of a split, from the weights of the
+ * kinds of split of the model. Inside of a kind, every outcome is equally
+ * likely.
+ */
+std::vector<double> split_probs(const bigrig::biogeo_model_t &model,
+                                bigrig::dist_t                init_dist) {
+  size_t regions = init_dist.regions();
+  auto   weights = model.normalized_cladogenesis_params(init_dist);
+  size_t full    = init_dist.full_region_count();
+  size_t empty   = init_dist.empty_region_count();
+
+  std::vector<double> probs(1 + 6 * regions, 0.0);
+  auto add = [&](bigrig::dist_t left, bigrig::dist_t right, double prob) {
+    bigrig::split_t split{
+        left, right, init_dist, bigrig::split_type_e::invalid, 0};
+    probs[split_key(split)] += prob;
+  };
+
+  probs[0] += weights.copy;
+  for (size_t r = 0; r < regions; ++r) {
+    auto single = bigrig::dist_t{static_cast<uint16_t>(regions)}.flip_region(r);
+    if (init_dist[r] && !init_dist.singleton()) {
+      auto rest = init_dist.flip_region(r);
+      add(rest, single, weights.allopatry / (2.0 * full));
+      add(single, rest, weights.allopatry / (2.0 * full));
+      add(init_dist, single, weights.sympatry / (2.0 * full));
+      add(single, init_dist, weights.sympatry / (2.0 * full));
+    } else if (!init_dist[r]) {
+      add(init_dist, single, weights.jump / (2.0 * empty));
+      add(single, init_dist, weights.jump / (2.0 * empty));
+    }
+  }
+  return probs;
+}
+
+test_case_t
+make_split_case(const model_params_t                          &params,
+                const std::shared_ptr<bigrig::biogeo_model_t> &model,
+                bigrig::dist_t                                 init_dist,
+                const validate_options_t                      &options) {
+  using split_t = bigrig::split_t;
+
+  test_case_t test_case{.test      = "split",
+                        .model     = params.name,
+                        .regions   = init_dist.regions(),
+                        .init_dist = init_dist,
+                        .probs     = split_probs(*model, init_dist),
+                        .engines   = {}};
+
+  size_t categories = test_case.probs.size();
+  auto   add        = [&](std::string name, auto &&split) {
+    test_case.engines.push_back(
+        {std::move(name), [=, &options](size_t stream) {
+           return run_engine<split_t>(
+               options.samples,
+               options.threads,
+               categories,
+               options.seed,
+               stream,
+               [=](pcg64_fast &gen, std::span<split_t> out) {
+                 for (auto &s : out) { s = split(init_dist, *model, gen); }
+               },
+               split_key);
+         }});
+  };
+  /*
+   * The rejection method counts a copy as one outcome, instead of two, so it
+   * doesn't follow the model for singletons once there are jumps.
+   */
+  if (init_dist.regions() <= SPLIT_REJECTION_MAX_REGIONS
+      && !init_dist.singleton()) {
+    add("rejection", [](auto dist, const auto &m, auto &gen) {
+      return bigrig::split_dist_rejection_method(dist, m, gen);
+    });
+  }
+  add("fast", [](auto dist, const auto &m, auto &gen) {
+    return bigrig::split_dist_fast(dist, m, gen);
+  });
+  add("exact", [](auto dist, const auto &m, auto &gen) {
+    return bigrig::split_dist_exact(dist, m, gen);
+  });
+  return test_case;
+}
+
+/* The category of a range at the end of a branch is the range itself */
+size_t range_key(const bigrig::dist_t &dist) {
+  size_t key = 0;
+  for (size_t r = 0; r < dist.regions(); ++r) { key |= size_t{dist[r]} << r; }
+  return key;
+}
+
+/**
+ * The probability of every range at the end of the branch, from `exp(Q t)` of
+ * the endpoint distribution. Every range with the same number of initial and
+ * new regions is equally likely.
+ */
+std::vector<double>
+branch_probs(const bigrig::endpoint_distribution_t &endpoint,
+             bigrig::dist_t                         init_dist) {
+  auto choose = [](size_t n, size_t k) {
+    return std::exp(std::lgamma(n + 1.0) - std::lgamma(k + 1.0)
+                    - std::lgamma(n - k + 1.0));
+  };
+
+  size_t              regions = init_dist.regions();
+  size_t              full    = init_dist.full_region_count();
+  std::vector<double> probs(size_t{1} << regions, 0.0);
+  for (size_t key = 1; key < probs.size(); ++key) {
+    bigrig::dist_t range{key, static_cast<uint16_t>(regions)};
+    size_t         a = (range & init_dist).full_region_count();
+    size_t         b = range.full_region_count() - a;
+    probs[key]       = endpoint.probability(a, b)
+               / (choose(full, a) * choose(regions - full, b));
+  }
+  return probs;
+}
+
+test_case_t make_branch_case(const model_params_t     &params,
+                             const bigrig::period_t   &period,
+                             bigrig::dist_t            init_dist,
+                             const validate_options_t &options) {
+  using dist_t = bigrig::dist_t;
+
+  double length   = options.branch_length;
+  auto   endpoint = std::make_shared<bigrig::endpoint_distribution_t>(
+      period.model(), length, init_dist.full_region_count(), init_dist.regions());
+
+  test_case_t test_case{.test      = "branch",
+                        .model     = params.name,
+                        .regions   = init_dist.regions(),
+                        .init_dist = init_dist,
+                        .probs     = branch_probs(*endpoint, init_dist),
+                        .engines   = {}};
+
+  size_t categories = test_case.probs.size();
+  auto   add        = [&](std::string name, auto &&draw) {
+    test_case.engines.push_back(
+        {std::move(name), [=, &options](size_t stream) {
+           return run_engine<dist_t>(options.samples,
+                                     options.threads,
+                                     categories,
+                                     options.seed,
+                                     stream,
+                                     draw,
+                                     range_key);
+         }});
+  };
+
+  auto path = [&period, init_dist, length](bigrig::operation_mode_e mode) {
+    return [&period, init_dist, length, mode](pcg64_fast       &gen,
+                                              std::span<dist_t> out) {
+      bigrig::branch_periods_t periods{std::span{&period, 1}, 0.0, length};
+      for (auto &d : out) {
+        d = bigrig::simulate_transitions(
+            init_dist, periods, gen, mode, [](const auto &) {});
+      }
+    };
+  };
+  add("sim-path", path(bigrig::operation_mode_e::SIM));
+  add("fast-path", path(bigrig::operation_mode_e::FAST));
+  add("endpoint", [endpoint, init_dist](pcg64_fast       &gen,
+                                        std::span<dist_t> out) {
+    for (auto &d : out) { d = endpoint->sample(init_dist, gen); }
+  });
+  return test_case;
+}
+
+/**
+ * The starting ranges for a region count: a singleton, the full range, and
+ * some random ones.
+ */
+std::vector<bigrig::dist_t>
+make_ranges(size_t regions, size_t random_count, pcg64_fast &gen) {
+  std::vector<bigrig::dist_t> ranges{bigrig::make_singleton_dist(regions),
+                                     bigrig::make_full_dist(regions)};
+  for (size_t i = 0; i < random_count; ++i) {
+    ranges.push_back(bigrig::make_random_dist(regions, gen));
+  }
+  std::sort(ranges.begin(), ranges.end(), [](auto a, auto b) {
+    return a.to_str() < b.to_str();
+  });
+  ranges.erase(std::unique(ranges.begin(), ranges.end()), ranges.end());
+  return ranges;
+}
+
+std::vector<model_params_t>
+select_models(const std::vector<std::string> &names) {
+  std::vector<model_params_t> models;
+  for (const auto &name : names) {
+    auto itr = std::find_if(MODELS.begin(), MODELS.end(), [&](const auto &m) {
+      return m.name == name;
+    });
+    if (itr == MODELS.end()) {
+      LOG_ERROR("Unknown model '%s'", name.c_str());
+      return {};
+    }
+    models.push_back(*itr);
+  }
+  return models;
+}
+} // namespace
+
+int main() {
+  logger::get_log_states().add_stream(
+      stderr,
+      logger::log_level::info | logger::log_level::warning
+          | logger::log_level::error);
+
+  CLI::App app{"Checks that the samplers of bigrig follow the distributions of "
+               "the model, and how fast they are."};
+  validate_options_t options;
+
+  app.add_option("--regions", options.regions, "Region counts.");
+  app.add_option(
+      "--models", options.models, "Models: dec, dec+j or fast-rates.");
+  app.add_option("--filter",
+                 options.filters,
+                 "Only run the tests which contain one of these: spread, "
+                 "split or branch.");
+  app.add_option("--samples",
+                 options.samples,
+                 "Number of samples of each sampler, for each test.");
+  app.add_option("--threads",
+                 options.threads,
+                 "Number of threads. Defaults to one per core.");
+  app.add_option("--random-ranges",
+                 options.random_ranges,
+                 "Number of random starting ranges, on top of a singleton and "
+                 "the full range.");
+  app.add_option("--branch-length",
+                 options.branch_length,
+                 "Length of the branch of the branch tests.");
+  app.add_option("--alpha",
+                 options.alpha,
+                 "A test fails if its p-value is below this.");
+  app.add_option("--seed", options.seed, "Seed for the ranges and the RNG.");
+  app.add_option("--output",
+                 options.output,
+                 "File to write the JSON results to, instead of stdout.");
+
+  CLI11_PARSE(app);
+
+  if (options.threads == 0) {
+    options.threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  std::erase_if(options.regions, [](size_t r) {
+    if (r < 2 || r >= bigrig::dist_t::MAX_REGIONS) {
+      LOG_WARNING("Skipping %lu regions, this build supports 2 to %lu",
+                  r,
+                  bigrig::dist_t::MAX_REGIONS - 1);
+      return true;
+    }
+    return false;
+  });
+
+  auto models = select_models(options.models);
+  if (models.empty() || options.samples == 0 || options.branch_length <= 0.0) {
+    return 1;
+  }
+
+  pcg64_fast  gen{options.seed};
+  validator_t validator{options};
+  for (auto regions : options.regions) {
+    auto ranges = make_ranges(regions, options.random_ranges, gen);
+    for (const auto &params : models) {
+      bigrig::period_t period{
+          0.0, options.branch_length, params.rates, params.clado, false, 0};
+      auto model = period.model_ptr();
+      model->set_region_count(regions);
+
+      for (auto init_dist : ranges) {
+        if (validator.enabled("spread")) {
+          validator.run(make_spread_case(params, model, init_dist, options));
+        }
+        if (validator.enabled("split")) {
+          validator.run(make_split_case(params, model, init_dist, options));
+        }
+        if (validator.enabled("branch") && regions <= BRANCH_MAX_REGIONS) {
+          validator.run(make_branch_case(params, period, init_dist, options));
+        }
+      }
+    }
+  }
+
+  nlohmann::json report{
+      {"version", VALIDATE_FORMAT_VERSION},
+      {"dist_words", BIGRIG_DIST_WORDS},
+      {"seed", options.seed},
+      {"samples", options.samples},
+      {"threads", options.threads},
+      {"alpha", options.alpha},
+      {"pass", validator.ok()},
+      {"results", validator.results()},
+  };
+
+  if (options.output.has_value()) {
+    std::ofstream file(options.output.value());
+    file << report.dump(2) << "\n";
+    if (!file) {
+      LOG_ERROR("Failed to write the results to '%s'",
+                options.output->c_str());
+      return 1;
+    }
+  } else {
+    std::cout << report.dump(2) << "\n";
+  }
+
+  if (!validator.ok()) {
+    LOG_ERROR("Some of the samplers don't follow the model");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,408 @@
+#include "binary.hpp"
+
+#include "logger.hpp"
+
+namespace bigrig {
+
+namespace binary {
+std::string encode_header(const binary_header_t &header) {
+  std::string buffer;
+  buffer.append(MAGIC.data(), MAGIC.size());
+  put<uint32_t>(buffer, header.version);
+  put<uint32_t>(buffer, header.region_count);
+  put<uint32_t>(buffer, 0);
+
+  put<uint64_t>(buffer, header.nodes.size());
+  for (const auto &n : header.nodes) {
+    put<uint64_t>(buffer, n.parent);
+    put<uint64_t>(buffer, n.node_id);
+    put<double>(buffer, n.brlen);
+    put<uint32_t>(buffer, n.label.size());
+    buffer.append(n.label);
+  }
+
+  put<uint64_t>(buffer, header.periods.size());
+  for (const auto &p : header.periods) {
+    put<uint64_t>(buffer, p.index);
+    put<double>(buffer, p.start);
+    put<double>(buffer, p.length);
+    put<double>(buffer, p.rates.dis);
+    put<double>(buffer, p.rates.ext);
+    put<double>(buffer, p.clado.allopatry);
+    put<double>(buffer, p.clado.sympatry);
+    put<double>(buffer, p.clado.copy);
+    put<double>(buffer, p.clado.jump);
+  }
+  return buffer;
+}
+
+/**
+ * The absolute times are not stored, since they can be computed from the
+ * branch lengths. Parents always come before their children.
+ */
+void compute_abs_times(binary_header_t &header) {
+  for (auto &n : header.nodes) {
+    double parent_time = n.parent == tree_t::no_parent
+                           ? 0.0
+                           : header.nodes[n.parent].abs_time;
+    n.abs_time         = parent_time + n.brlen;
+  }
+}
+} // namespace binary
+
+namespace {
+/**
+ * Check that a range with this many regions fits in a `dist_t` of this build.
+ * A file from a build with wider dists, or a corrupt one, would otherwise be
+ * read past the end of the words of a dist.
+ */
+bool check_region_count(uint64_t region_count) {
+  if (region_count == 0 || region_count >= dist_t::MAX_REGIONS) {
+    LOG_ERROR("The binary file has %lu regions, but this build supports 1 to "
+              "%lu",
+              region_count,
+              dist_t::MAX_REGIONS - 1);
+    return false;
+  }
+  return true;
+}
+} // namespace
+
+bool binary_header_t::is_leaf(size_t index) const {
+  return index + 1 >= nodes.size() || nodes[index + 1].parent != index;
+}
+
+/**
+ * Build the header for a tree. The nodes are stored in the same order as the
+ * tree stores them, so the node indices in the records match the tree.
+ */
+binary_header_t make_binary_header(const tree_t                &tree,
+                                   const std::vector<period_t> &periods,
+                                   uint16_t                     region_count) {
+  binary_header_t header;
+  header.version      = binary::VERSION;
+  header.region_count = region_count;
+
+  header.nodes.reserve(tree.node_count());
+  for (size_t index = 0; index < tree.node_count(); ++index) {
+    header.nodes.push_back({.parent   = tree.parent(index),
+                            .node_id  = tree.node_id(index),
+                            .brlen    = tree.brlen(index),
+                            .label    = tree.label(index),
+                            .abs_time = tree.abs_time(index)});
+  }
+
+  for (const auto &p : periods) {
+    header.periods.push_back({.index  = p.index(),
+                              .start  = p.start(),
+                              .length = p.length(),
+                              .rates  = p.model().rates(),
+                              .clado  = p.model().cladogenesis_params()});
+  }
+  return header;
+}
+
+/**
+ * Recover the transitions on the branch leading to `node`, by replaying the
+ * flipped regions from the start of the branch.
+ */
+std::vector<transition_t>
+binary_replicate_t::transitions(const binary_header_t &header,
+                                size_t                 node) const {
+  const auto &n = header.nodes[node];
+
+  dist_t state = root_range;
+  if (n.parent != tree_t::no_parent) {
+    const auto &split = splits[n.parent];
+    state             = node == n.parent + 1 ? split.left : split.right;
+  }
+  double last_time = n.abs_time - n.brlen;
+
+  std::vector<transition_t> ret;
+  for (const auto &e : events) {
+    if (e.node != node) { continue; }
+    transition_t t{
+        e.abs_time - last_time, state, state.flip_region(e.flipped_region)};
+    t.period_index = e.period_index;
+    ret.push_back(t);
+
+    state     = t.final_state;
+    last_time = e.abs_time;
+  }
+  return ret;
+}
+
+/**
+ * Open a new file, and write the header.
+ */
+bool binary_writer_t::open(const std::filesystem::path &filename,
+                           const tree_t                &tree,
+                           const std::vector<period_t> &periods,
+                           uint16_t                     region_count) {
+  if (!check_region_count(region_count)) { return false; }
+  _region_count = region_count;
+  _file.open(filename, std::ios::binary | std::ios::trunc);
+  if (!_file) {
+    LOG_ERROR("Failed to open binary file '%s'", filename.c_str());
+    return false;
+  }
+  auto header = binary::encode_header(
+      make_binary_header(tree, periods, region_count));
+  _file.write(header.data(), header.size());
+  return true;
+}
+
+/**
+ * Open an existing file to append more replicates to it. The header of the
+ * file has to match the header we would write for this tree and periods.
+ */
+bool binary_writer_t::open_append(const std::filesystem::path &filename,
+                                  const tree_t                &tree,
+                                  const std::vector<period_t> &periods,
+                                  uint16_t                     region_count) {
+  if (!check_region_count(region_count)) { return false; }
+  auto expected = binary::encode_header(
+      make_binary_header(tree, periods, region_count));
+
+  std::ifstream existing(filename, std::ios::binary);
+  std::string   found(expected.size(), '\0');
+  existing.read(found.data(), found.size());
+  if (!existing || found != expected) {
+    LOG_ERROR("The binary file '%s' was written for a different tree or "
+              "periods, we can't append to it",
+              filename.c_str());
+    return false;
+  }
+
+  _region_count = region_count;
+  _file.open(filename, std::ios::binary | std::ios::app);
+  if (!_file) {
+    LOG_ERROR("Failed to open binary file '%s'", filename.c_str());
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Open a file for replicate records only, without a header. The records can be
+ * appended to a file with a header later, which is how the shards of a run are
+ * put back together.
+ */
+bool binary_writer_t::open_records(const std::filesystem::path &filename,
+                                   uint16_t                     region_count) {
+  if (!check_region_count(region_count)) { return false; }
+  _region_count = region_count;
+  _file.open(filename, std::ios::binary | std::ios::trunc);
+  if (!_file) {
+    LOG_ERROR("Failed to open binary file '%s'", filename.c_str());
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Append a replicate record to the file.
+ */
+void binary_writer_t::write(const tree_t       &tree,
+                            const sim_result_t &result,
+                            size_t              replicate,
+                            size_t              point) {
+  using binary::put;
+  using binary::put_dist;
+
+  auto width = binary::dist_width(_region_count);
+  _buffer.clear();
+
+  put<uint64_t>(_buffer, replicate);
+  put<uint64_t>(_buffer, point);
+  put_dist(_buffer, result.root_range(), width);
+  for (size_t index = 0; index < tree.node_count(); ++index) {
+    put_dist(_buffer, result.final_state(index), width);
+  }
+
+  for (size_t index = 0; index < tree.node_count(); ++index) {
+    if (tree.is_leaf(index)) { continue; }
+    const auto &split = result.node_split(index);
+    put_dist(_buffer, split.left, width);
+    put_dist(_buffer, split.right, width);
+    put<uint8_t>(_buffer, static_cast<uint8_t>(split.type));
+    put<uint32_t>(_buffer, split.period_index);
+  }
+
+  size_t event_count = 0;
+  for (size_t index = 0; index < tree.node_count(); ++index) {
+    event_count += result.transitions(index).size();
+  }
+  put<uint64_t>(_buffer, event_count);
+  for (size_t index = 0; index < tree.node_count(); ++index) {
+    double abs_time = tree.abs_time_at_start(index);
+    for (const auto &t : result.transitions(index)) {
+      abs_time    += t.waiting_time;
+      auto flipped = (t.initial_state ^ t.final_state).first_full_region();
+      put<double>(_buffer, abs_time);
+      put<uint32_t>(_buffer, index);
+      put<uint16_t>(_buffer, t.period_index);
+      put<uint8_t>(_buffer, flipped);
+      put<uint8_t>(_buffer, 0);
+    }
+  }
+
+  put<uint64_t>(_buffer, result.period_stats().size());
+  for (const auto &s : result.period_stats()) {
+    put<uint64_t>(_buffer, s.dispersions);
+    put<uint64_t>(_buffer, s.extinctions);
+    put<uint64_t>(_buffer, s.singleton_splits);
+    put<uint64_t>(_buffer, s.allopatric_splits);
+    put<uint64_t>(_buffer, s.sympatric_splits);
+    put<uint64_t>(_buffer, s.jump_splits);
+  }
+
+  std::string record_size;
+  put<uint64_t>(record_size, _buffer.size());
+  _file.write(record_size.data(), record_size.size());
+  _file.write(_buffer.data(), _buffer.size());
+}
+
+binary_reader_t::binary_reader_t(const std::filesystem::path &filename)
+    : _file{filename} {
+  if (!_file.ok()) { return; }
+  _data = _file.data();
+  _ok   = parse_header() && index_records();
+}
+
+bool binary_reader_t::parse_header() {
+  binary::cursor_t cursor{_data};
+
+  auto magic = cursor.get<std::array<char, 4>>();
+  if (!cursor.ok() || magic != binary::MAGIC) {
+    LOG_ERROR("The file is not a bigrig binary file");
+    return false;
+  }
+
+  /* Records from version 1 files don't have a point index */
+  _header.version = cursor.get<uint32_t>();
+  if (_header.version == 0 || _header.version > binary::VERSION) {
+    LOG_ERROR("Unsupported binary file version %u", _header.version);
+    return false;
+  }
+  /* Checked before the narrowing, so a huge count can't wrap into range */
+  auto region_count = cursor.get<uint32_t>();
+  if (!cursor.ok() || !check_region_count(region_count)) { return false; }
+  _header.region_count = static_cast<uint16_t>(region_count);
+  cursor.get<uint32_t>();
+
+  auto node_count = cursor.get<uint64_t>();
+  for (size_t i = 0; i < node_count && cursor.ok(); ++i) {
+    binary_node_t n;
+    n.parent  = cursor.get<uint64_t>();
+    n.node_id = cursor.get<uint64_t>();
+    n.brlen   = cursor.get<double>();
+    n.label   = cursor.get_string(cursor.get<uint32_t>());
+    if (n.parent != tree_t::no_parent && n.parent >= i) {
+      LOG_ERROR("The nodes in the binary file are not in preorder");
+      return false;
+    }
+    _header.nodes.push_back(n);
+  }
+
+  auto period_count = cursor.get<uint64_t>();
+  for (size_t i = 0; i < period_count && cursor.ok(); ++i) {
+    binary_period_t p;
+    p.index           = cursor.get<uint64_t>();
+    p.start           = cursor.get<double>();
+    p.length          = cursor.get<double>();
+    p.rates.dis       = cursor.get<double>();
+    p.rates.ext       = cursor.get<double>();
+    p.clado.allopatry = cursor.get<double>();
+    p.clado.sympatry  = cursor.get<double>();
+    p.clado.copy      = cursor.get<double>();
+    p.clado.jump      = cursor.get<double>();
+    _header.periods.push_back(p);
+  }
+
+  if (!cursor.ok()) {
+    LOG_ERROR("The header of the binary file is truncated");
+    return false;
+  }
+
+  binary::compute_abs_times(_header);
+  _header_size = cursor.pos();
+  return true;
+}
+
+/**
+ * Find the start of every replicate record. A partial record at the end of the
+ * file (e.g. from a run that was killed) is ignored.
+ */
+bool binary_reader_t::index_records() {
+  size_t offset = _header_size;
+  while (offset < _data.size()) {
+    binary::cursor_t cursor{_data.subspan(offset)};
+    auto             record_size = cursor.get<uint64_t>();
+    if (!cursor.ok() || record_size > _data.size() - offset - cursor.pos()) {
+      LOG_WARNING("Ignoring a truncated record at the end of the binary file");
+      break;
+    }
+    _record_offsets.push_back(offset + cursor.pos());
+    offset += cursor.pos() + record_size;
+  }
+  return true;
+}
+
+/**
+ * Decode a single replicate record. The index is the position of the record in
+ * the file, which is not necessarily the same as the replicate index stored in
+ * the record.
+ */
+binary_replicate_t binary_reader_t::replicate(size_t index) const {
+  binary::cursor_t cursor{_data.subspan(_record_offsets.at(index))};
+  auto             regions = _header.region_count;
+
+  binary_replicate_t rep;
+  rep.replicate  = cursor.get<uint64_t>();
+  if (_header.version >= 2) { rep.point = cursor.get<uint64_t>(); }
+  rep.root_range = cursor.get_dist(regions);
+
+  rep.final_states.resize(_header.nodes.size());
+  for (auto &fs : rep.final_states) { fs = cursor.get_dist(regions); }
+
+  rep.splits.resize(_header.nodes.size());
+  for (size_t node = 0; node < _header.nodes.size(); ++node) {
+    if (_header.is_leaf(node)) { continue; }
+    auto &split        = rep.splits[node];
+    split.left         = cursor.get_dist(regions);
+    split.right        = cursor.get_dist(regions);
+    split.top          = rep.final_states[node];
+    split.type         = static_cast<split_type_e>(cursor.get<uint8_t>());
+    split.period_index = cursor.get<uint32_t>();
+  }
+
+  auto event_count = cursor.get<uint64_t>();
+  for (size_t i = 0; i < event_count && cursor.ok(); ++i) {
+    binary_event_t e;
+    e.abs_time       = cursor.get<double>();
+    e.node           = cursor.get<uint32_t>();
+    e.period_index   = cursor.get<uint16_t>();
+    e.flipped_region = cursor.get<uint8_t>();
+    cursor.get<uint8_t>();
+    rep.events.push_back(e);
+  }
+
+  auto stats_count = cursor.get<uint64_t>();
+  for (size_t i = 0; i < stats_count && cursor.ok(); ++i) {
+    period_stats_t s;
+    s.dispersions       = cursor.get<uint64_t>();
+    s.extinctions       = cursor.get<uint64_t>();
+    s.singleton_splits  = cursor.get<uint64_t>();
+    s.allopatric_splits = cursor.get<uint64_t>();
+    s.sympatric_splits  = cursor.get<uint64_t>();
+    s.jump_splits       = cursor.get<uint64_t>();
+    rep.period_stats.push_back(s);
+  }
+
+  if (!cursor.ok()) {
+    LOG_ERROR("Replicate record %lu in the binary file is malformed", index);
+  }
+  return rep;
+}
+} // namespace bigrig
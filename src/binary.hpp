@@ -0,0 +1,215 @@
+#pragma once
+
+#include "bytes.hpp"
+#include "dist.hpp"
+#include "period.hpp"
+#include "result.hpp"
+#include "split.hpp"
+#include "tree.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace bigrig {
+
+/**
+ * A compact binary format for the results of a batch of simulations.
+ *
+ * The file starts with a header, which is shared by all of the replicates. The
+ * header holds everything that doesn't change between replicates: the nodes
+ * (parent, id, branch length and label), and the period table. After the
+ * header, each replicate is a self-contained record, which starts with its
+ * size in bytes. There is no footer, so records can be appended to a file at
+ * any time, and a reader finds the records by hopping over the sizes.
+ *
+ * Dists are stored as packed bitsets, using `(regions + 7) / 8` bytes each.
+ * Events are stored as fixed size records with the node, the absolute time,
+ * the region that was flipped, and the period. The full ranges for the events
+ * can be recovered by replaying the flips from the start of the branch.
+ *
+ * All values are stored little-endian.
+ *
+ * Header layout:
+ *
+ *     char[4]  magic "BGRG"
+ *     uint32   version
+ *     uint32   region count
+ *     uint32   reserved
+ *     uint64   node count
+ *     node count times:
+ *       uint64   parent index, or `tree_t::no_parent`
+ *       uint64   node id
+ *       float64  branch length
+ *       uint32   label length, followed by the label
+ *     uint64   period count
+ *     period count times:
+ *       uint64   period index
+ *       float64  start, length, dispersion, extinction, allopatry, sympatry,
+ *                copy, jump
+ *
+ * Replicate record layout:
+ *
+ *     uint64   record size, not including this field
+ *     uint64   replicate index
+ *     uint64   sweep point index, 0 when not sweeping (since version 2)
+ *     dist     root range
+ *     dist     final state, for every node
+ *     for every inner node:
+ *       dist     left, right
+ *       uint8    split type
+ *       uint32   period index
+ *     uint64   event count
+ *     event count times:
+ *       float64  absolute time
+ *       uint32   node index
+ *       uint16   period index
+ *       uint8    flipped region
+ *       uint8    reserved
+ *     uint64   period stats count
+ *     period stats count times:
+ *       uint64   dispersions, extinctions, singleton, allopatric, sympatric,
+ *                jump
+ *
+ * The period table in the header is the one the tree was prepared with. In a
+ * sweep, the parameters of each point are in the sweep table instead.
+ */
+namespace binary {
+constexpr std::array<char, 4> MAGIC   = {'B', 'G', 'R', 'G'};
+constexpr uint32_t            VERSION = 2;
+} // namespace binary
+
+/**
+ * A node, as it is stored in the header. The absolute time is not stored, it
+ * is computed from the branch lengths when the header is read.
+ */
+struct binary_node_t {
+  size_t      parent;
+  size_t      node_id;
+  double      brlen;
+  std::string label;
+  double      abs_time = 0.0;
+};
+
+/**
+ * A period, as it is stored in the header.
+ */
+struct binary_period_t {
+  size_t                index;
+  double                start;
+  double                length;
+  rate_params_t         rates;
+  cladogenesis_params_t clado;
+};
+
+struct binary_header_t {
+  uint32_t                     version;
+  uint16_t                     region_count;
+  std::vector<binary_node_t>   nodes;
+  std::vector<binary_period_t> periods;
+
+  bool is_leaf(size_t index) const;
+};
+
+/**
+ * A single event, as it is stored in a replicate record.
+ */
+struct binary_event_t {
+  double   abs_time;
+  uint32_t node;
+  uint16_t period_index;
+  uint8_t  flipped_region;
+};
+
+/**
+ * A decoded replicate record.
+ */
+struct binary_replicate_t {
+  size_t                      replicate;
+  size_t                      point = 0;
+  dist_t                      root_range;
+  std::vector<dist_t>         final_states;
+  std::vector<split_t>        splits;
+  std::vector<binary_event_t> events;
+  std::vector<period_stats_t> period_stats;
+
+  std::vector<transition_t> transitions(const binary_header_t &header,
+                                        size_t                 node) const;
+};
+
+/**
+ * Writes the binary format. The header is written when the writer is opened,
+ * and then each call to `write` appends a replicate record.
+ */
+class binary_writer_t {
+public:
+  binary_writer_t() = default;
+
+  bool open(const std::filesystem::path &filename,
+            const tree_t                &tree,
+            const std::vector<period_t> &periods,
+            uint16_t                     region_count);
+
+  bool open_append(const std::filesystem::path &filename,
+                   const tree_t                &tree,
+                   const std::vector<period_t> &periods,
+                   uint16_t                     region_count);
+
+  bool open_records(const std::filesystem::path &filename,
+                    uint16_t                     region_count);
+
+  void close() { _file.close(); }
+
+  void write(const tree_t       &tree,
+             const sim_result_t &result,
+             size_t              replicate,
+             size_t              point = 0);
+
+  bool is_open() const { return _file.is_open(); }
+
+private:
+  std::ofstream _file;
+  std::string   _buffer;
+  uint16_t      _region_count = 0;
+};
+
+/**
+ * Reads the binary format. The file is memory mapped, and the offsets of the
+ * replicate records are found when the file is opened, so any replicate can be
+ * read without reading the ones before it.
+ */
+class binary_reader_t {
+public:
+  explicit binary_reader_t(const std::filesystem::path &filename);
+
+  binary_reader_t(const binary_reader_t &)            = delete;
+  binary_reader_t &operator=(const binary_reader_t &) = delete;
+
+  bool ok() const { return _ok; }
+
+  const binary_header_t &header() const { return _header; }
+
+  size_t             replicate_count() const { return _record_offsets.size(); }
+  binary_replicate_t replicate(size_t index) const;
+
+private:
+  bool parse_header();
+  bool index_records();
+
+  mapped_file_t              _file;
+  std::span<const std::byte> _data;
+  size_t                     _header_size = 0;
+  binary_header_t            _header;
+  std::vector<size_t>        _record_offsets;
+  bool                       _ok = false;
+};
+
+binary_header_t make_binary_header(const tree_t                &tree,
+                                   const std::vector<period_t> &periods,
+                                   uint16_t                     region_count);
+} // namespace bigrig
@@ -0,0 +1,52 @@
+#include "bytes.hpp"
+
+#include "logger.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace bigrig {
+
+uint64_t binary::hash_bytes(std::span<const std::byte> data) {
+  constexpr uint64_t FNV_OFFSET = 0xcbf29ce484222325ull;
+  constexpr uint64_t FNV_PRIME  = 0x100000001b3ull;
+
+  uint64_t hash = FNV_OFFSET;
+  for (auto b : data) {
+    hash ^= static_cast<uint64_t>(b);
+    hash *= FNV_PRIME;
+  }
+  return hash;
+}
+
+mapped_file_t::mapped_file_t(const std::filesystem::path &filename) {
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    LOG_ERROR("Failed to open file '%s'", filename.c_str());
+    return;
+  }
+
+  struct stat st{};
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    LOG_ERROR("The file '%s' is empty", filename.c_str());
+    ::close(fd);
+    return;
+  }
+
+  auto size = static_cast<size_t>(st.st_size);
+  auto map  = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED) {
+    LOG_ERROR("Failed to map file '%s'", filename.c_str());
+    return;
+  }
+  _map  = map;
+  _size = size;
+}
+
+mapped_file_t::~mapped_file_t() {
+  if (_map != nullptr) { munmap(_map, _size); }
+}
+} // namespace bigrig
@@ -0,0 +1,145 @@
+#pragma once
+
+#include "dist.hpp"
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+static_assert(std::endian::native == std::endian::little,
+              "The binary files are only implemented for little-endian hosts");
+
+namespace bigrig {
+
+/*
+ * Helpers for reading and writing the binary files: the result format in
+ * `binary.hpp`, and the prepared tree cache in `prepared.hpp`. Values are
+ * written in the native byte order, which has to be little-endian.
+ */
+namespace binary {
+template <typename T> void put(std::string &buffer, T value) {
+  static_assert(std::is_trivially_copyable_v<T>);
+  const auto *bytes = reinterpret_cast<const char *>(&value);
+  buffer.append(bytes, sizeof(T));
+}
+
+template <typename T>
+void put_array(std::string &buffer, const std::vector<T> &values) {
+  static_assert(std::is_trivially_copyable_v<T>);
+  const auto *bytes = reinterpret_cast<const char *>(values.data());
+  buffer.append(bytes, values.size() * sizeof(T));
+}
+
+inline void put_dist(std::string &buffer, dist_t d, size_t width) {
+  for (size_t i = 0; i < width; ++i) {
+    auto byte = (d.word(i / 8) >> (8 * (i % 8))) & 0xff;
+    buffer.push_back(static_cast<char>(byte));
+  }
+}
+
+constexpr size_t dist_width(uint16_t region_count) {
+  return (region_count + 7) / 8;
+}
+
+/**
+ * Reads values out of a byte span. If we try to read past the end, the cursor
+ * goes bad and returns zeros from then on, which the caller should check with
+ * `ok()`.
+ */
+class cursor_t {
+public:
+  explicit cursor_t(std::span<const std::byte> data) : _data{data} {}
+
+  template <typename T> T get() {
+    static_assert(std::is_trivially_copyable_v<T>);
+    T value{};
+    if (!check(sizeof(T))) { return value; }
+    std::memcpy(&value, _data.data() + _pos, sizeof(T));
+    _pos += sizeof(T);
+    return value;
+  }
+
+  dist_t get_dist(uint16_t region_count) {
+    auto               width = dist_width(region_count);
+    dist_t::words_type words{};
+    if (!check(width)) { return {words, region_count}; }
+    for (size_t i = 0; i < width; ++i) {
+      words[i / 8] |= static_cast<uint64_t>(_data[_pos + i]) << (8 * (i % 8));
+    }
+    _pos += width;
+    return {words, region_count};
+  }
+
+  std::string get_string(size_t length) {
+    if (!check(length)) { return {}; }
+    std::string str(reinterpret_cast<const char *>(_data.data() + _pos),
+                    length);
+    _pos += length;
+    return str;
+  }
+
+  /**
+   * Read `count` values straight into a vector, for the large arrays.
+   */
+  template <typename T> std::vector<T> get_array(size_t count) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    if (count > _data.size() / sizeof(T) || !check(count * sizeof(T))) {
+      _ok = false;
+      return {};
+    }
+    std::vector<T> values(count);
+    std::memcpy(values.data(), _data.data() + _pos, count * sizeof(T));
+    _pos += count * sizeof(T);
+    return values;
+  }
+
+  size_t pos() const { return _pos; }
+  bool   ok() const { return _ok; }
+
+private:
+  bool check(size_t size) {
+    if (!_ok || _pos + size > _data.size()) { _ok = false; }
+    return _ok;
+  }
+
+  std::span<const std::byte> _data;
+  size_t                     _pos = 0;
+  bool                       _ok  = true;
+};
+
+/**
+ * 64 bit FNV-1a hash. Not a cryptographic hash, just enough to tell files
+ * apart.
+ */
+uint64_t hash_bytes(std::span<const std::byte> data);
+} // namespace binary
+
+/**
+ * A read only memory mapping of a whole file. If the file can't be mapped, an
+ * error is logged, and `ok()` is false.
+ */
+class mapped_file_t {
+public:
+  explicit mapped_file_t(const std::filesystem::path &filename);
+  ~mapped_file_t();
+
+  mapped_file_t(const mapped_file_t &)            = delete;
+  mapped_file_t &operator=(const mapped_file_t &) = delete;
+
+  bool ok() const { return _map != nullptr; }
+
+  std::span<const std::byte> data() const {
+    return {static_cast<const std::byte *>(_map), _size};
+  }
+
+private:
+  void  *_map  = nullptr;
+  size_t _size = 0;
+};
+} // namespace bigrig
@@ -14,55 +14,145 @@ bigrig::rng_wrapper_t &cli_options_t::get_rng_wrapper() {
 }
 
 std::filesystem::path cli_options_t::phylip_filename() const {
-  auto tmp  = prefix.value();
+  auto tmp  = file_prefix();
   tmp      += bigrig::util::PHYILP_EXT;
-  return tmp;
+  return compressed_filename(tmp);
+}
+
+std::filesystem::path cli_options_t::phylip_all_filename() const {
+  constexpr auto all_subprefix  = ".all";
+  auto           tmp            = file_prefix();
+  tmp                          += all_subprefix;
+  tmp                          += bigrig::util::PHYILP_EXT;
+  return compressed_filename(tmp);
+}
+
+std::filesystem::path cli_options_t::annotated_tree_filename() const {
+  constexpr auto annotated_subprefix  = ".annotated";
+  auto           tmp                  = file_prefix();
+  tmp                                += annotated_subprefix;
+  tmp                                += bigrig::util::NEWICK_EXT;
+  return compressed_filename(tmp);
 }
 
 std::filesystem::path cli_options_t::yaml_filename() const {
-  auto tmp  = prefix.value();
+  auto tmp  = file_prefix();
   tmp      += bigrig::util::YAML_EXT;
-  return tmp;
+  return compressed_filename(tmp);
 }
 
 std::filesystem::path cli_options_t::json_filename() const {
-  auto tmp  = prefix.value();
+  auto tmp  = file_prefix();
   tmp      += bigrig::util::JSON_EXT;
-  return tmp;
+  return compressed_filename(tmp);
 }
 
 std::filesystem::path cli_options_t::csv_splits_filename() const {
   constexpr auto splits_subprefix  = ".splits";
-  auto           tmp               = prefix.value();
+  auto           tmp               = file_prefix();
   tmp                             += splits_subprefix;
   tmp                             += bigrig::util::CSV_EXT;
-  return tmp;
+  return compressed_filename(tmp);
 }
 
 std::filesystem::path cli_options_t::csv_events_filename() const {
   constexpr auto events_subprefix  = ".events";
-  auto           tmp               = prefix.value();
+  auto           tmp               = file_prefix();
   tmp                             += events_subprefix;
   tmp                             += bigrig::util::CSV_EXT;
-  return tmp;
+  return compressed_filename(tmp);
 }
 
 std::filesystem::path cli_options_t::csv_periods_filename() const {
   constexpr auto state_subprefix  = ".periods";
-  auto           tmp              = prefix.value();
+  auto           tmp              = file_prefix();
   tmp                            += state_subprefix;
   tmp                            += bigrig::util::CSV_EXT;
-  return tmp;
+  return compressed_filename(tmp);
 }
 
 std::filesystem::path cli_options_t::csv_program_stats_filename() const {
   constexpr auto state_subprefix  = ".program-stats";
-  auto           tmp              = prefix.value();
+  auto           tmp              = file_prefix();
   tmp                            += state_subprefix;
   tmp                            += bigrig::util::CSV_EXT;
+  return compressed_filename(tmp);
+}
+
+std::filesystem::path cli_options_t::csv_stats_filename() const {
+  constexpr auto stats_subprefix  = ".stats";
+  auto           tmp              = file_prefix();
+  tmp                            += stats_subprefix;
+  tmp                            += bigrig::util::CSV_EXT;
+  return compressed_filename(tmp);
+}
+
+std::filesystem::path cli_options_t::csv_sweep_filename() const {
+  constexpr auto sweep_subprefix  = ".sweep";
+  auto           tmp              = file_prefix();
+  tmp                            += sweep_subprefix;
+  tmp                            += bigrig::util::CSV_EXT;
+  return compressed_filename(tmp);
+}
+
+std::filesystem::path cli_options_t::csv_roots_filename() const {
+  constexpr auto roots_subprefix  = ".roots";
+  auto           tmp              = file_prefix();
+  tmp                            += roots_subprefix;
+  tmp                            += bigrig::util::CSV_EXT;
+  return compressed_filename(tmp);
+}
+
+std::filesystem::path cli_options_t::binary_filename() const {
+  auto tmp  = file_prefix();
+  tmp      += bigrig::util::BINARY_EXT;
   return tmp;
 }
 
+/**
+ * The index of the shards of a run. Unlike the result files, there is only one
+ * for all of the shards.
+ */
+std::filesystem::path cli_options_t::csv_shards_filename() const {
+  constexpr auto shards_subprefix  = ".shards";
+  auto           tmp               = prefix.value();
+  tmp                             += shards_subprefix;
+  tmp                             += bigrig::util::CSV_EXT;
+  return tmp;
+}
+
+/**
+ * The prefix of the result files. When the run is a shard of a larger run,
+ * the files of each shard get the index of the shard added to the prefix.
+ */
+std::filesystem::path cli_options_t::file_prefix() const {
+  auto tmp = prefix.value();
+  if (shard_mode()) { tmp += ".shard" + std::to_string(shard_index.value()); }
+  return tmp;
+}
+
+/**
+ * The options of the full run that this shard is a part of.
+ */
+cli_options_t cli_options_t::unsharded() const {
+  auto tmp = *this;
+  tmp.shard_index.reset();
+  tmp.shard_count.reset();
+  tmp.merge_shards.reset();
+  return tmp;
+}
+
+/**
+ * Add the extension for the compression type to a text result file.
+ */
+std::filesystem::path
+cli_options_t::compressed_filename(std::filesystem::path filename) const {
+  if (compression() == bigrig::compression_type_e::gzip) {
+    filename += bigrig::util::GZIP_EXT;
+  }
+  return filename;
+}
+
 /**
  * Checks if all the required args for the CLI have been specified.
  */
@@ -92,12 +182,135 @@ bool cli_options_t::csv_file_set() const {
       && output_format_type.value() == output_format_type_e::CSV;
 }
 
+/**
+ * Checks if the output format is the compact binary format. See `binary.hpp`
+ * for the layout.
+ */
+bool cli_options_t::binary_file_set() const {
+  return output_format_type.has_value()
+      && output_format_type.value() == output_format_type_e::BINARY;
+}
+
+/**
+ * Checks if we are running a batch of replicates. In this case, the output
+ * files contain the results of every replicate, and are tagged with the
+ * replicate index.
+ */
+bool cli_options_t::batch_mode() const { return replicates.has_value(); }
+
+/**
+ * Checks if we only need the summary statistics. In this case, the events on
+ * the branches are counted instead of stored.
+ */
+bool cli_options_t::stats_only_mode() const {
+  return stats_only.value_or(false);
+}
+
+/**
+ * Checks if the events are regenerated when they are written, instead of
+ * being stored during the simulation.
+ */
+bool cli_options_t::lazy_events_mode() const {
+  return lazy_events.value_or(false) || !event_replicates.empty();
+}
+
+/**
+ * Checks if the events of a replicate are written. In lazy events mode, this
+ * is only the replicates which were asked for.
+ */
+bool cli_options_t::writes_events(size_t replicate) const {
+  if (!lazy_events_mode()) { return true; }
+  return std::find(event_replicates.begin(), event_replicates.end(), replicate)
+         != event_replicates.end();
+}
+
+/**
+ * Checks if the threads are used inside of each replicate. This changes the
+ * random streams, so the results are different from the normal mode.
+ */
+bool cli_options_t::parallel_tree_mode() const {
+  return parallel_tree.value_or(false);
+}
+
+/**
+ * Checks if this run is only one shard of the jobs. The results are the same
+ * as the results of those jobs in the full run.
+ */
+bool cli_options_t::shard_mode() const { return shard_count.value_or(1) > 1; }
+
+/**
+ * Checks if this shard writes the index of the shards. Only the first shard
+ * does, and only when the shards are not merged at the end of the run.
+ */
+bool cli_options_t::writes_shard_index() const {
+  return shard_mode() && shard_index.value_or(0) == 0
+      && !merge_shards.value_or(false);
+}
+
+/**
+ * Checks if the result files get headers. Only the first shard writes them, so
+ * that the files of the shards can be joined by concatenating them in order.
+ */
+bool cli_options_t::writes_headers() const {
+  return shard_index.value_or(0) == 0;
+}
+
+/**
+ * Checks if the options are shared by the jobs of a jobs file, instead of
+ * being a run of their own.
+ */
+bool cli_options_t::jobs_mode() const { return jobs_file.has_value(); }
+
+/**
+ * Checks if the results are written on their own thread. This doesn't change
+ * the results, only when they are written.
+ */
+bool cli_options_t::writer_thread_mode() const {
+  return writer_thread.value_or(false);
+}
+
+/**
+ * Checks if we are sweeping over model parameters. In this case, every point
+ * is simulated for every replicate, and the results are tagged with the index
+ * of the point.
+ */
+bool cli_options_t::sweep_mode() const {
+  return sweep_table.has_value() || !sweep_axes.empty();
+}
+
+/**
+ * Checks if we are simulating several root ranges, from a prior or every range.
+ * In this case, every root range is simulated for every replicate, and the
+ * results are tagged with the index of the root range.
+ */
+bool cli_options_t::root_mode() const {
+  return root_prior.has_value() || all_root_ranges.value_or(false);
+}
+
+/**
+ * Checks if the simulations are conditioned on the tip ranges.
+ */
+bool cli_options_t::conditioned_mode() const {
+  return conditions_file.has_value();
+}
+
+bigrig::restart_mode_e cli_options_t::restart_mode() const {
+  return restart_subtree.value_or(false) ? bigrig::restart_mode_e::SUBTREE
+                                         : bigrig::restart_mode_e::TREE;
+}
+
+bigrig::compression_type_e cli_options_t::compression() const {
+  return compress.value_or(false) ? bigrig::compression_type_e::gzip
+                                  : bigrig::compression_type_e::none;
+}
+
 /**
  * Merges a `cli_options_t` with the current value. Specifically, it overwrites
  * the current values with the values from the passed `cli_options_t`. Values
  * affected are:
  *  - `config_filename`
  *  - `tree_filename`
+ *  - `tree_cache`
  *  - `debug_log`
  *  - `output_format_type`
  *  - `root_distribution`
@@ -105,6 +318,21 @@ bool cli_options_t::csv_file_set() const {
  *  - `extinction_rate`
  *  - `redo`
  *  - `two_region_duplicity`
+ *  - `replicates`
+ *  - `threads`
+ *  - `parallel_tree`
+ *  - `writer_thread`
+ *  - `stats_only`
+ *  - `lazy_events`
+ *  - `event_replicates`
+ *  - `compress`
+ *  - `sweep_table`
+ *  - `sweep_axes`
+ *  - `root_prior`
+ *  - `all_root_ranges`
+ *  - `conditions_file`
+ *  - `restart_subtree`
+ *  - `max_restarts`
  */
 
 void print_config_cli_warning(const char *option_name) {
@@ -128,6 +356,7 @@ void merge_variable(std::optional<T>       &ours,
 
 void cli_options_t::merge(const cli_options_t &other) {
   merge_variable(tree_filename, other.tree_filename, "tree");
+  merge_variable(tree_cache, other.tree_cache, "tree-cache");
   merge_variable(prefix, other.prefix, "prefix");
   merge_variable(debug_log, other.debug_log, "debug-log");
   merge_variable(output_format_type, other.output_format_type, "output-format");
@@ -148,6 +377,37 @@ void cli_options_t::merge(const cli_options_t &other) {
       two_region_duplicity, other.two_region_duplicity, "two-region-duplicity");
   merge_variable(mode, other.mode, "mode");
   merge_variable(rng_seed, other.rng_seed, "seed");
+  merge_variable(replicates, other.replicates, "replicates");
+  merge_variable(threads, other.threads, "threads");
+  merge_variable(parallel_tree, other.parallel_tree, "parallel-tree");
+  merge_variable(writer_thread, other.writer_thread, "writer-thread");
+  merge_variable(stats_only, other.stats_only, "stats-only");
+  merge_variable(lazy_events, other.lazy_events, "lazy-events");
+
+  if (!other.event_replicates.empty()) {
+    if (!event_replicates.empty()) {
+      print_config_cli_warning("event-replicates");
+    } else {
+      event_replicates = other.event_replicates;
+    }
+  }
+
+  merge_variable(compress, other.compress, "compress");
+  merge_variable(sweep_table, other.sweep_table, "sweep-table");
+
+  if (!other.sweep_axes.empty()) {
+    if (!sweep_axes.empty()) {
+      print_config_cli_warning("sweep");
+    } else {
+      sweep_axes = other.sweep_axes;
+    }
+  }
+
+  merge_variable(root_prior, other.root_prior, "root-prior");
+  merge_variable(all_root_ranges, other.all_root_ranges, "all-root-ranges");
+  merge_variable(conditions_file, other.conditions_file, "conditions");
+  merge_variable(restart_subtree, other.restart_subtree, "restart-subtree");
+  merge_variable(max_restarts, other.max_restarts, "max-restarts");
 }
 
 std::filesystem::path cli_options_t::get_tree_filename(const YAML::Node &yaml) {
@@ -155,6 +415,13 @@ std::filesystem::path cli_options_t::get_tree_filename(const YAML::Node &yaml) {
   return yaml[TREE_KEY].as<std::string>();
 }
 
+std::optional<std::filesystem::path>
+cli_options_t::get_tree_cache(const YAML::Node &yaml) {
+  constexpr auto TREE_CACHE_KEY = "tree-cache";
+  if (yaml[TREE_CACHE_KEY]) { return yaml[TREE_CACHE_KEY].as<std::string>(); }
+  return {};
+}
+
 std::optional<std::filesystem::path>
 cli_options_t::get_prefix(const YAML::Node &yaml) {
   constexpr auto PREFIX_KEY = "prefix";
@@ -181,6 +448,7 @@ cli_options_t::get_output_format(const YAML::Node &yaml) {
     if (value == "json") { return output_format_type_e::JSON; }
     if (value == "yaml") { return output_format_type_e::YAML; }
     if (value == "csv") { return output_format_type_e::CSV; }
+    if (value == "binary") { return output_format_type_e::BINARY; }
   }
   return {};
 }
@@ -367,6 +635,8 @@ cli_options_t::get_mode(const YAML::Node &yaml) {
       return bigrig::operation_mode_e::FAST;
     } else if (value == "sim") {
       return bigrig::operation_mode_e::SIM;
+    } else if (value == "endpoint") {
+      return bigrig::operation_mode_e::ENDPOINT;
     } else {
       throw cli_option_invalid_parameter{
           "Failed to recognize the run mode in the config file"};
@@ -381,6 +651,141 @@ std::optional<uint64_t> cli_options_t::get_seed(const YAML::Node &yaml) {
   return {};
 }
 
+std::optional<size_t> cli_options_t::get_replicates(const YAML::Node &yaml) {
+  constexpr auto REPLICATES_KEY = "replicates";
+  if (yaml[REPLICATES_KEY]) { return yaml[REPLICATES_KEY].as<size_t>(); }
+  return {};
+}
+
+std::optional<size_t> cli_options_t::get_threads(const YAML::Node &yaml) {
+  constexpr auto THREADS_KEY = "threads";
+  if (yaml[THREADS_KEY]) { return yaml[THREADS_KEY].as<size_t>(); }
+  return {};
+}
+
+std::optional<bool>
+cli_options_t::get_parallel_tree(const YAML::Node &yaml) {
+  constexpr auto PARALLEL_TREE_KEY = "parallel-tree";
+  if (yaml[PARALLEL_TREE_KEY]) { return yaml[PARALLEL_TREE_KEY].as<bool>(); }
+  return {};
+}
+
+std::optional<bool>
+cli_options_t::get_writer_thread(const YAML::Node &yaml) {
+  constexpr auto WRITER_THREAD_KEY = "writer-thread";
+  if (yaml[WRITER_THREAD_KEY]) { return yaml[WRITER_THREAD_KEY].as<bool>(); }
+  return {};
+}
+
+std::optional<bool> cli_options_t::get_stats_only(const YAML::Node &yaml) {
+  constexpr auto STATS_ONLY_KEY = "stats-only";
+  if (yaml[STATS_ONLY_KEY]) { return yaml[STATS_ONLY_KEY].as<bool>(); }
+  return {};
+}
+
+std::optional<bool> cli_options_t::get_lazy_events(const YAML::Node &yaml) {
+  constexpr auto LAZY_EVENTS_KEY = "lazy-events";
+  if (yaml[LAZY_EVENTS_KEY]) { return yaml[LAZY_EVENTS_KEY].as<bool>(); }
+  return {};
+}
+
+std::vector<size_t>
+cli_options_t::get_event_replicates(const YAML::Node &yaml) {
+  constexpr auto EVENT_REPLICATES_KEY = "event-replicates";
+  if (yaml[EVENT_REPLICATES_KEY]) {
+    return yaml[EVENT_REPLICATES_KEY].as<std::vector<size_t>>();
+  }
+  return {};
+}
+
+std::optional<bool> cli_options_t::get_compress(const YAML::Node &yaml) {
+  constexpr auto COMPRESS_KEY = "compress";
+  if (yaml[COMPRESS_KEY]) { return yaml[COMPRESS_KEY].as<bool>(); }
+  return {};
+}
+
+constexpr auto SWEEP_KEY = "sweep";
+
+std::optional<std::filesystem::path>
+cli_options_t::get_sweep_table(const YAML::Node &yaml) {
+  constexpr auto TABLE_KEY = "table";
+  if (yaml[SWEEP_KEY] && yaml[SWEEP_KEY][TABLE_KEY]) {
+    return yaml[SWEEP_KEY][TABLE_KEY].as<std::string>();
+  }
+  return {};
+}
+
+/**
+ * Each parameter of a grid sweep is either a list of values, or a range given
+ * as `from`, `to` and `steps`. The axes are kept in the order of the file.
+ */
+std::vector<bigrig::sweep_axis_t>
+cli_options_t::get_sweep_axes(const YAML::Node &yaml) {
+  std::vector<bigrig::sweep_axis_t> axes;
+  if (!yaml[SWEEP_KEY]) { return axes; }
+
+  for (const auto &entry : yaml[SWEEP_KEY]) {
+    auto name = entry.first.as<std::string>();
+    if (name == "table") { continue; }
+
+    auto param = bigrig::parse_sweep_param(name);
+    if (!param.has_value()) {
+      throw YAML::Exception(entry.first.Mark(),
+                            "Unknown sweep parameter '" + name + "'");
+    }
+
+    const auto          &values = entry.second;
+    bigrig::sweep_axis_t axis{.param = param.value(), .values = {}};
+    if (values.IsSequence()) {
+      for (const auto &v : values) { axis.values.push_back(v.as<double>()); }
+    } else if (values.IsMap()) {
+      axis.values = bigrig::make_sweep_range(values["from"].as<double>(),
+                                             values["to"].as<double>(),
+                                             values["steps"].as<size_t>());
+    } else {
+      axis.values.push_back(values.as<double>());
+    }
+    axes.push_back(std::move(axis));
+  }
+  return axes;
+}
+
+std::optional<std::filesystem::path>
+cli_options_t::get_root_prior(const YAML::Node &yaml) {
+  constexpr auto ROOT_PRIOR_KEY = "root-prior";
+  if (yaml[ROOT_PRIOR_KEY]) { return yaml[ROOT_PRIOR_KEY].as<std::string>(); }
+  return {};
+}
+
+std::optional<bool> cli_options_t::get_all_root_ranges(const YAML::Node &yaml) {
+  constexpr auto ALL_ROOT_RANGES_KEY = "all-root-ranges";
+  if (yaml[ALL_ROOT_RANGES_KEY]) {
+    return yaml[ALL_ROOT_RANGES_KEY].as<bool>();
+  }
+  return {};
+}
+
+std::optional<std::filesystem::path>
+cli_options_t::get_conditions_file(const YAML::Node &yaml) {
+  constexpr auto CONDITIONS_KEY = "conditions";
+  if (yaml[CONDITIONS_KEY]) { return yaml[CONDITIONS_KEY].as<std::string>(); }
+  return {};
+}
+
+std::optional<bool> cli_options_t::get_restart_subtree(const YAML::Node &yaml) {
+  constexpr auto RESTART_SUBTREE_KEY = "restart-subtree";
+  if (yaml[RESTART_SUBTREE_KEY]) {
+    return yaml[RESTART_SUBTREE_KEY].as<bool>();
+  }
+  return {};
+}
+
+std::optional<size_t> cli_options_t::get_max_restarts(const YAML::Node &yaml) {
+  constexpr auto MAX_RESTARTS_KEY = "max-restarts";
+  if (yaml[MAX_RESTARTS_KEY]) { return yaml[MAX_RESTARTS_KEY].as<size_t>(); }
+  return {};
+}
+
 template <typename T>
 [[nodiscard]] bool check_passed_cli_parameter(const std::optional<T> &o,
                                               const char             *name) {
@@ -415,6 +820,7 @@ cli_options_t::convert_cli_parameters(std::optional<double> dis,
   if (ok) {
     period_params_t period;
     period.start = 0.0;
+    period.index = 0;
     period.rates = {.dis = dis.value(), .ext = ext.value()};
     period.clado = {.allopatry = allo.value(),
                     .sympatry  = ext.value(),
@@ -439,6 +845,7 @@ std::vector<bigrig::period_t> cli_options_t::make_periods() const {
          .jump      = cli_period.clado.jump},
         two_region_duplicity.value_or(true),
         cli_period.index};
+    period.model_ptr()->set_region_count(root_range.value().regions());
     if (!period.model().check_ok(root_range.value().regions())) {
       LOG_ERROR("There is an issue with the model for period '%lu', we can't "
                 "continue",
@@ -1,9 +1,13 @@
 #pragma once
 
+#include "condition.hpp"
 #include "dist.hpp"
+#include "instrument.hpp"
 #include "model.hpp"
 #include "period.hpp"
 #include "rng.hpp"
+#include "sink.hpp"
+#include "sweep.hpp"
 
 #include <CLI/App.hpp>
 #include <CLI/Config.hpp>
@@ -19,7 +23,7 @@
 /**
  * Type-safe enum for the output file format.
  */
-enum class output_format_type_e { JSON, YAML, CSV };
+enum class output_format_type_e { JSON, YAML, CSV, BINARY };
 
 class cli_option_missing_required_yaml_option : std::invalid_argument {
 public:
@@ -42,7 +46,27 @@ struct period_params_t {
 
 struct program_stats_t {
   double execution_time_in_seconds() const { return execution_time.count(); }
+
+  /**
+   * The number of transitions simulated per second of wall time, if the
+   * transitions were counted.
+   */
+  std::optional<double> events_per_second() const {
+    if (!counts.has_value() || execution_time.count() <= 0.0) { return {}; }
+    return counts->count(bigrig::counter_e::TRANSITIONS)
+         / execution_time.count();
+  }
+
   std::chrono::duration<double> execution_time;
+  size_t                        replicates = 1;
+
+  /*
+   * Only set when the instrumentation is compiled in. For a replicate, these
+   * are the counts of the simulation of the replicate, for a run they are the
+   * counts and phase times of all of the threads.
+   */
+  std::optional<bigrig::instrument_counts_t> counts      = {};
+  std::optional<size_t>                      peak_memory = {};
 };
 
 /**
@@ -70,6 +94,12 @@ struct cli_options_t {
    */
   std::optional<std::filesystem::path> tree_filename;
 
+  /**
+   * Directory holding prepared trees. If set, the tree is loaded from here when
+   * it has been prepared before, and saved here when it hasn't.
+   */
+  std::optional<std::filesystem::path> tree_cache;
+
   /**
    * Prefix used for output files. If its not specified on the CLI, it will be
    * instead be the tree filename.
@@ -85,6 +115,8 @@ struct cli_options_t {
    * Output format enum. Right now valid options are
    * - JSON
    * - YAML
+   * - CSV
+   * - BINARY
    */
   std::optional<output_format_type_e> output_format_type;
 
@@ -123,7 +155,136 @@ struct cli_options_t {
 
   std::optional<uint64_t> rng_seed;
 
+  /**
+   * Number of simulations to run on the tree. The tree and periods are only
+   * prepared once, and the results of every replicate are appended to the same
+   * set of output files.
+   */
+  std::optional<size_t> replicates;
+
+  /**
+   * Number of threads used to simulate replicates.
+   */
+  std::optional<size_t> threads;
+
+  /**
+   * Use the threads to simulate the subtrees of each replicate in parallel,
+   * instead of simulating the replicates in parallel.
+   */
+  std::optional<bool> parallel_tree;
+
+  /**
+   * Write the results on their own thread, while the worker threads go on
+   * simulating the next replicates.
+   */
+  std::optional<bool> writer_thread;
+
+  /**
+   * Only run one contiguous shard of the jobs, out of `shard_count` shards.
+   * Only set from the command line, or from the MPI rank.
+   */
+  std::optional<size_t> shard_index;
+  std::optional<size_t> shard_count;
+
+  /**
+   * The files of the shards are merged into the files of the full run at the
+   * end, so there is no index of the shards. Only set from the MPI rank.
+   */
+  std::optional<bool> merge_shards;
+
+  /**
+   * A JSON lines file of jobs, which are run one after the other with the
+   * same tree. See `jobs.hpp` for the format. Only set from the command line.
+   */
+  std::optional<std::filesystem::path> jobs_file;
+
+  /**
+   * Only compute summary statistics: the final ranges, and the number of
+   * events and splits in each period. The individual events are not stored or
+   * written.
+   */
+  std::optional<bool> stats_only;
+
+  /**
+   * Don't store the events during the simulation, only where the random
+   * stream of each branch starts. The events are regenerated for the
+   * replicates in `event_replicates` when they are written.
+   */
+  std::optional<bool> lazy_events;
+
+  /**
+   * The replicates to regenerate the events for in lazy events mode. Setting
+   * this turns on lazy events.
+   */
+  std::vector<size_t> event_replicates;
+
+  /**
+   * Compress the text result files with gzip. The compressed files get an
+   * extra `.gz` extension.
+   */
+  std::optional<bool> compress;
+
+  /**
+   * A file with a table of parameter points to sweep over. See `sweep.hpp` for
+   * the format.
+   */
+  std::optional<std::filesystem::path> sweep_table;
+
+  /**
+   * The values of each parameter for a grid sweep. Only set from the config
+   * file.
+   */
+  std::vector<bigrig::sweep_axis_t> sweep_axes;
+
+  /**
+   * The points of the sweep, made from the table or the grid once the options
+   * are validated. Every point is simulated for every replicate.
+   */
+  std::vector<bigrig::sweep_point_t> sweep_points;
+
+  /**
+   * A file with a prior over the root ranges. See `sweep.hpp` for the format.
+   */
+  std::optional<std::filesystem::path> root_prior;
+
+  /**
+   * Simulate every possible root range, with the same weight. Only for small
+   * region counts.
+   */
+  std::optional<bool> all_root_ranges;
+
+  /**
+   * The root ranges to simulate, made from the prior or from every range once
+   * the options are validated. Every root range is simulated for every
+   * replicate of every point.
+   */
+  std::vector<bigrig::root_prior_t> roots;
+
+  /**
+   * A file with conditions on the tip ranges. See `condition.hpp` for the
+   * format.
+   */
+  std::optional<std::filesystem::path> conditions_file;
+
+  /**
+   * When a condition fails, only simulate the clade of the condition again,
+   * instead of the whole tree.
+   */
+  std::optional<bool> restart_subtree;
+
+  /**
+   * The most restarts for a single replicate, before it is given up on.
+   */
+  std::optional<size_t> max_restarts;
+
+  /**
+   * The conditions, read from the file once the options are validated.
+   */
+  std::vector<bigrig::condition_t> conditions;
+
   std::filesystem::path phylip_filename() const;
+  std::filesystem::path phylip_all_filename() const;
+  std::filesystem::path annotated_tree_filename() const;
 
   std::filesystem::path yaml_filename() const;
 
@@ -133,6 +294,17 @@ struct cli_options_t {
   std::filesystem::path csv_events_filename() const;
   std::filesystem::path csv_periods_filename() const;
   std::filesystem::path csv_program_stats_filename() const;
+  std::filesystem::path csv_stats_filename() const;
+  std::filesystem::path csv_sweep_filename() const;
+  std::filesystem::path csv_roots_filename() const;
+
+  std::filesystem::path binary_filename() const;
+
+  std::filesystem::path csv_shards_filename() const;
+
+  std::filesystem::path file_prefix() const;
+
+  cli_options_t unsharded() const;
 
   pcg64_fast            &get_rng();
   bigrig::rng_wrapper_t &get_rng_wrapper();
@@ -145,6 +317,38 @@ struct cli_options_t {
 
   bool csv_file_set() const;
 
+  bool binary_file_set() const;
+
+  bool batch_mode() const;
+
+  bool stats_only_mode() const;
+
+  bool lazy_events_mode() const;
+
+  bool writes_events(size_t replicate) const;
+
+  bool parallel_tree_mode() const;
+
+  bool writer_thread_mode() const;
+
+  bool shard_mode() const;
+
+  bool writes_shard_index() const;
+
+  bool writes_headers() const;
+
+  bool jobs_mode() const;
+
+  bool sweep_mode() const;
+
+  bool root_mode() const;
+
+  bool conditioned_mode() const;
+
+  bigrig::restart_mode_e restart_mode() const;
+
+  bigrig::compression_type_e compression() const;
+
   void merge(const cli_options_t &other);
 
   [[nodiscard]] bool convert_cli_parameters(std::optional<double> dis,
@@ -164,6 +368,7 @@ struct cli_options_t {
    */
   cli_options_t(const YAML::Node &yaml)
       : tree_filename{get_tree_filename(yaml)},
+        tree_cache{get_tree_cache(yaml)},
         prefix{get_prefix(yaml)},
         debug_log{get_debug_log(yaml)},
         output_format_type{get_output_format(yaml)},
@@ -173,10 +378,29 @@ struct cli_options_t {
         redo{get_redo(yaml)},
         two_region_duplicity{get_two_region_duplicity(yaml)},
         mode{get_mode(yaml)},
-        rng_seed{get_seed(yaml)} {}
+        rng_seed{get_seed(yaml)},
+        replicates{get_replicates(yaml)},
+        threads{get_threads(yaml)},
+        parallel_tree{get_parallel_tree(yaml)},
+        writer_thread{get_writer_thread(yaml)},
+        stats_only{get_stats_only(yaml)},
+        lazy_events{get_lazy_events(yaml)},
+        event_replicates{get_event_replicates(yaml)},
+        compress{get_compress(yaml)},
+        sweep_table{get_sweep_table(yaml)},
+        sweep_axes{get_sweep_axes(yaml)},
+        root_prior{get_root_prior(yaml)},
+        all_root_ranges{get_all_root_ranges(yaml)},
+        conditions_file{get_conditions_file(yaml)},
+        restart_subtree{get_restart_subtree(yaml)},
+        max_restarts{get_max_restarts(yaml)} {}
 
 private:
+  std::filesystem::path compressed_filename(std::filesystem::path) const;
+
   static std::filesystem::path get_tree_filename(const YAML::Node &);
+  static std::optional<std::filesystem::path>
+  get_tree_cache(const YAML::Node &);
   static std::optional<std::filesystem::path> get_prefix(const YAML::Node &);
   static std::optional<bool>                  get_debug_log(const YAML::Node &);
   static std::optional<output_format_type_e>
@@ -196,4 +420,26 @@ private:
   static std::optional<bool>                     get_redo(const YAML::Node &);
   static std::optional<bigrig::operation_mode_e> get_mode(const YAML::Node &);
   static std::optional<uint64_t>                 get_seed(const YAML::Node &);
+  static std::optional<size_t> get_replicates(const YAML::Node &yaml);
+  static std::optional<size_t> get_threads(const YAML::Node &yaml);
+  static std::optional<bool>   get_parallel_tree(const YAML::Node &yaml);
+  static std::optional<bool>   get_writer_thread(const YAML::Node &yaml);
+  static std::optional<bool>   get_stats_only(const YAML::Node &yaml);
+  static std::optional<bool>   get_lazy_events(const YAML::Node &yaml);
+  static std::vector<size_t>   get_event_replicates(const YAML::Node &yaml);
+  static std::optional<bool>   get_compress(const YAML::Node &yaml);
+
+  static std::optional<std::filesystem::path>
+  get_sweep_table(const YAML::Node &yaml);
+  static std::vector<bigrig::sweep_axis_t>
+  get_sweep_axes(const YAML::Node &yaml);
+
+  static std::optional<std::filesystem::path>
+                             get_root_prior(const YAML::Node &yaml);
+  static std::optional<bool> get_all_root_ranges(const YAML::Node &yaml);
+
+  static std::optional<std::filesystem::path>
+                               get_conditions_file(const YAML::Node &yaml);
+  static std::optional<bool>   get_restart_subtree(const YAML::Node &yaml);
+  static std::optional<size_t> get_max_restarts(const YAML::Node &yaml);
 };
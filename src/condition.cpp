@@ -0,0 +1,221 @@
+#include "condition.hpp"
+
+#include "logger.hpp"
+#include "tree.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <unordered_map>
+
+namespace bigrig {
+
+std::string range_pattern_t::to_str() const {
+  std::string str(present.regions(), '?');
+  for (size_t i = 0; i < present.regions(); ++i) {
+    size_t region = present.regions() - i - 1;
+    if (present[region]) { str[i] = '1'; }
+    if (absent[region]) { str[i] = '0'; }
+  }
+  return str;
+}
+
+/**
+ * Parse a range pattern. Like a range, the first character is the highest
+ * region.
+ */
+std::optional<range_pattern_t> parse_range_pattern(std::string_view str) {
+  if (str.empty() || str.size() >= dist_t::MAX_REGIONS
+      || str.find_first_not_of("01?") != std::string_view::npos) {
+    return {};
+  }
+  std::string present(str.size(), '0'), absent(str.size(), '0');
+  for (size_t i = 0; i < str.size(); ++i) {
+    if (str[i] == '1') { present[i] = '1'; }
+    if (str[i] == '0') { absent[i] = '1'; }
+  }
+  return range_pattern_t{.present = dist_t{present}, .absent = dist_t{absent}};
+}
+
+/**
+ * Read the conditions from a table. Every line is a condition, with the labels
+ * of the clade separated by spaces, then a comma, and then the pattern for the
+ * tips of the clade. Empty lines, and lines starting with '#', are skipped.
+ */
+std::optional<std::vector<condition_t>>
+read_conditions(const std::filesystem::path &filename) {
+  std::ifstream file(filename);
+  if (!file) {
+    LOG_ERROR("Failed to open the conditions '%s'", filename.c_str());
+    return {};
+  }
+
+  std::vector<condition_t> conditions;
+  std::string              line;
+  size_t                   line_number = 0;
+  while (std::getline(file, line)) {
+    ++line_number;
+    auto trimmed = util::trim(line);
+    if (trimmed.empty() || trimmed.front() == '#') { continue; }
+
+    auto fields = util::split_fields(trimmed);
+    if (fields.size() != 2) {
+      LOG_ERROR("Line %lu of the conditions '%s' has %lu fields, but there "
+                "should be the labels and a pattern",
+                line_number,
+                filename.c_str(),
+                fields.size());
+      return {};
+    }
+
+    condition_t condition;
+    for (auto label : util::split_fields(fields[0], ' ')) {
+      if (!label.empty()) { condition.labels.emplace_back(label); }
+    }
+    if (condition.labels.empty()) {
+      LOG_ERROR("Line %lu of the conditions '%s' has no labels",
+                line_number,
+                filename.c_str());
+      return {};
+    }
+
+    auto pattern = parse_range_pattern(fields[1]);
+    if (!pattern.has_value()) {
+      LOG_ERROR("Failed to parse the pattern '%.*s' on line %lu of the "
+                "conditions '%s'",
+                static_cast<int>(fields[1].size()),
+                fields[1].data(),
+                line_number,
+                filename.c_str());
+      return {};
+    }
+    condition.pattern = pattern.value();
+    conditions.push_back(std::move(condition));
+  }
+
+  if (conditions.empty()) {
+    LOG_ERROR("The conditions '%s' are empty", filename.c_str());
+    return {};
+  }
+  return conditions;
+}
+
+size_t conditions_t::conditioned_tip_count() const {
+  return static_cast<size_t>(
+      std::count(_conditioned.begin(), _conditioned.end(), true));
+}
+
+namespace {
+/**
+ * Find the smallest clade with all of the nodes in it. Since the nodes are in
+ * preorder, a node is in the clade of `index` if it is in
+ * `[index, index + subtree_size)`.
+ */
+size_t find_clade(const tree_t &tree, const std::vector<size_t> &nodes) {
+  size_t clade = nodes.front();
+  for (auto n : nodes) {
+    while (n < clade || n >= clade + tree.subtree_size(clade)) {
+      clade = tree.parent(clade);
+    }
+  }
+  return clade;
+}
+} // namespace
+
+/**
+ * Attach the conditions to the nodes of a tree. Fails if a label is not in the
+ * tree, or is in it more than once, if a pattern has the wrong number of
+ * regions, or if the conditions of a tip contradict each other.
+ */
+std::optional<conditions_t>
+make_conditions(const tree_t                   &tree,
+                const std::vector<condition_t> &conditions,
+                size_t                          region_count,
+                restart_mode_e                  mode) {
+  constexpr size_t                        duplicate = tree_t::no_parent;
+  std::unordered_map<std::string, size_t> label_indices;
+  for (size_t index = 0; index < tree.node_count(); ++index) {
+    if (tree.label(index).empty()) { continue; }
+    auto [itr, inserted] = label_indices.emplace(tree.label(index), index);
+    if (!inserted) { itr->second = duplicate; }
+  }
+
+  dist_t       none{static_cast<uint16_t>(region_count)};
+  conditions_t ret;
+  ret._patterns.assign(tree.node_count(), {.present = none, .absent = none});
+  ret._conditioned.assign(tree.node_count(), false);
+  ret._restart_roots.assign(tree.node_count(), false);
+
+  bool                ok = true;
+  std::vector<size_t> clades;
+  for (const auto &condition : conditions) {
+    if (condition.pattern.present.regions() != region_count) {
+      LOG_ERROR("The pattern '%s' has %u regions, but the simulation has %lu",
+                condition.pattern.to_str().c_str(),
+                condition.pattern.present.regions(),
+                region_count);
+      ok = false;
+      continue;
+    }
+
+    std::vector<size_t> nodes;
+    for (const auto &label : condition.labels) {
+      auto itr = label_indices.find(label);
+      if (itr == label_indices.end()) {
+        LOG_ERROR("The label '%s' of a condition is not in the tree",
+                  label.c_str());
+        ok = false;
+      } else if (itr->second == duplicate) {
+        LOG_ERROR("The label '%s' of a condition is in the tree more than once",
+                  label.c_str());
+        ok = false;
+      } else {
+        nodes.push_back(itr->second);
+      }
+    }
+    if (nodes.size() != condition.labels.size()) { continue; }
+
+    size_t clade = find_clade(tree, nodes);
+    clades.push_back(clade);
+    for (size_t index = clade; index < clade + tree.subtree_size(clade);
+         ++index) {
+      if (!tree.is_leaf(index)) { continue; }
+      auto &pattern            = ret._patterns[index];
+      pattern.present         |= condition.pattern.present;
+      pattern.absent          |= condition.pattern.absent;
+      ret._conditioned[index]  = true;
+    }
+  }
+  if (!ok) { return {}; }
+
+  for (size_t index = 0; index < tree.node_count(); ++index) {
+    const auto &pattern = ret._patterns[index];
+    if (!(pattern.present & pattern.absent).empty()) {
+      LOG_ERROR("The conditions of the tip '%s' contradict each other",
+                tree.string_id(index).c_str());
+      ok = false;
+    } else if (ret._conditioned[index] && pattern.absent.full()) {
+      LOG_ERROR("The conditions of the tip '%s' don't allow any range",
+                tree.string_id(index).c_str());
+      ok = false;
+    }
+  }
+  if (!ok) { return {}; }
+
+  if (mode == restart_mode_e::TREE) {
+    ret._restart_roots[0] = !clades.empty();
+    return ret;
+  }
+
+  /* Only keep the clades which are not inside of another clade */
+  std::sort(clades.begin(), clades.end());
+  size_t end = 0;
+  for (auto clade : clades) {
+    if (clade < end) { continue; }
+    ret._restart_roots[clade] = true;
+    end                       = clade + tree.subtree_size(clade);
+  }
+  return ret;
+}
+
+} // namespace bigrig
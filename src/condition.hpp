@@ -0,0 +1,104 @@
+#pragma once
+
+#include "dist.hpp"
+
+#include <cstddef>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace bigrig {
+
+class tree_t;
+
+/**
+ * A constraint on a range. Every region in `present` has to be in the range,
+ * and no region in `absent` can be. Written like a range, but with a '?' for
+ * the regions which are free, e.g. `1??0`.
+ */
+struct range_pattern_t {
+  dist_t present;
+  dist_t absent;
+
+  bool matches(dist_t range) const {
+    return (range & present) == present && (range & absent).empty();
+  }
+
+  std::string to_str() const;
+};
+
+std::optional<range_pattern_t> parse_range_pattern(std::string_view str);
+
+/**
+ * A condition on the tips of a clade. The clade is the smallest one with all
+ * of the labels in it, so a single tip label is just that tip. Every tip of
+ * the clade has to match the pattern.
+ */
+struct condition_t {
+  std::vector<std::string> labels;
+  range_pattern_t          pattern;
+};
+
+std::optional<std::vector<condition_t>>
+read_conditions(const std::filesystem::path &filename);
+
+/**
+ * What is simulated again when a tip doesn't match its condition.
+ *
+ * `TREE` starts the replicate again, which samples exactly from the tree
+ * conditioned on the tips. The tips are checked as soon as they are
+ * simulated, so a failed attempt stops at the first tip that fails.
+ *
+ * `SUBTREE` only simulates the clade of the failed condition again, starting
+ * from the same split of its parent. This is much faster when the conditions
+ * are strict, but the ranges outside of the conditioned clades are not
+ * weighted by how likely the conditions are from them, so it is an
+ * approximation of the conditioned tree.
+ */
+enum class restart_mode_e { TREE, SUBTREE };
+
+/**
+ * The default for the most restarts of a conditioned replicate, before it is
+ * given up on.
+ */
+constexpr size_t DEFAULT_MAX_RESTARTS = 100'000;
+
+/**
+ * The conditions, attached to the nodes of a tree. Each tip gets the patterns
+ * of all of its conditions combined, and the nodes which are simulated again
+ * when one of their tips fails are marked as restart roots. The restart roots
+ * are the outermost conditioned clades, so their subtrees never overlap.
+ */
+class conditions_t {
+public:
+  conditions_t() = default;
+
+  bool is_restart_root(size_t index) const { return _restart_roots[index]; }
+
+  bool accepts(size_t index, dist_t range) const {
+    return !_conditioned[index] || _patterns[index].matches(range);
+  }
+
+  size_t conditioned_tip_count() const;
+
+  friend std::optional<conditions_t>
+  make_conditions(const tree_t                   &tree,
+                  const std::vector<condition_t> &conditions,
+                  size_t                          region_count,
+                  restart_mode_e                  mode);
+
+private:
+  std::vector<range_pattern_t> _patterns;
+  std::vector<bool>            _conditioned;
+  std::vector<bool>            _restart_roots;
+};
+
+std::optional<conditions_t>
+make_conditions(const tree_t                   &tree,
+                const std::vector<condition_t> &conditions,
+                size_t                          region_count,
+                restart_mode_e                  mode);
+
+} // namespace bigrig
@@ -1,39 +1,121 @@
 #pragma once
 
+#include "dist_fwd.hpp"
 #include "model.hpp"
 #include "util.hpp"
 #include "period.hpp"
 
+#include <algorithm>
+#include <array>
+#include <concepts>
 #include <cstdint>
+#include <limits>
 #include <logger.hpp>
 #include <random>
+#include <span>
 #include <stdexcept>
 #include <string>
+#include <type_traits>
 #include <vector>
 
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+
 namespace bigrig {
 
-enum class operation_mode_e { FAST, SIM };
+namespace bits {
+/**
+ * Portable version of `select`. Finds the byte which contains the bit with a
+ * broadword prefix popcount, and then finds the bit inside of that byte.
+ */
+constexpr size_t select_broadword(uint64_t x, size_t k) {
+  constexpr uint64_t MASK_1      = 0x5555555555555555ull;
+  constexpr uint64_t MASK_2      = 0x3333333333333333ull;
+  constexpr uint64_t MASK_4      = 0x0F0F0F0F0F0F0F0Full;
+  constexpr uint64_t ONES_STEP_8 = 0x0101010101010101ull;
+  constexpr uint64_t MSBS_STEP_8 = 0x8080808080808080ull;
+
+  uint64_t pairs   = x - ((x >> 1) & MASK_1);
+  uint64_t nibbles = (pairs & MASK_2) + ((pairs >> 2) & MASK_2);
+  uint64_t bytes   = (nibbles + (nibbles >> 4)) & MASK_4;
+
+  /* byte i is now the number of set bits in bytes 0 to i */
+  uint64_t prefix = bytes * ONES_STEP_8;
+
+  /* the number of bytes that end with at most k bits set gives the byte */
+  uint64_t at_most = ((k * ONES_STEP_8 | MSBS_STEP_8) - prefix) & MSBS_STEP_8;
+  size_t   byte    = static_cast<size_t>(__builtin_popcountll(at_most)) * 8;
+
+  k                  -= ((prefix << 8) >> byte) & 0xFF;
+  uint64_t remaining  = (x >> byte) & 0xFF;
+  for (; k > 0; --k) { remaining &= remaining - 1; }
+  return byte + static_cast<size_t>(__builtin_ctzll(remaining));
+}
+
+/**
+ * Returns the index of the `k`th (counting from 0) set bit of `x`. `x` has to
+ * have more than `k` bits set.
+ *
+ * With BMI2, this is a `pdep` to move a single bit to the position of the
+ * `k`th set bit, and then a count of the trailing zeros to get its index.
+ */
+constexpr size_t select(uint64_t x, size_t k) {
+#ifdef __BMI2__
+  if (!std::is_constant_evaluated()) {
+    return static_cast<size_t>(__builtin_ctzll(_pdep_u64(1ull << k, x)));
+  }
+#endif
+  return select_broadword(x, k);
+}
+} // namespace bits
+
+/**
+ * How branches are simulated. `FAST` and `SIM` sample every event along a
+ * branch, `ENDPOINT` only samples the range at the end of each period. See
+ * `endpoint.hpp`.
+ */
+enum class operation_mode_e { FAST, SIM, ENDPOINT };
 
 typedef uint64_t dist_base_t;
 
-class dist_t {
+/**
+ * A range, stored as a bitset over the regions. The bits are stored in `W` 64
+ * bit words, so a dist can have up to `64 * W - 1` regions. Bit `i` of the
+ * range is bit `i % 64` of word `i / 64`.
+ *
+ * The loops over the words have a fixed trip count, so for a single word they
+ * compile down to the same code as a plain `uint64_t`, and for wider dists the
+ * compiler is free to vectorize them.
+ */
+template <size_t W> class basic_dist_t {
 public:
-  dist_t() = default;
+  static constexpr size_t WORDS       = W;
+  static constexpr size_t MAX_REGIONS = 64 * W;
 
-  dist_t(const std::string &);
+  using words_type = std::array<uint64_t, W>;
 
-  constexpr dist_t(const dist_t &) = default;
-  constexpr dist_t(dist_t &&)      = default;
+  basic_dist_t() = default;
 
-  constexpr dist_t &operator=(const dist_t &) = default;
-  constexpr dist_t &operator=(dist_t &&)      = default;
+  basic_dist_t(const std::string &);
 
-  dist_t &operator|=(const dist_t &d);
+  constexpr basic_dist_t(const basic_dist_t &) = default;
+  constexpr basic_dist_t(basic_dist_t &&)      = default;
 
-  constexpr dist_t(uint64_t d, uint16_t s) : _dist{d}, _regions{s} {}
+  constexpr basic_dist_t &operator=(const basic_dist_t &) = default;
+  constexpr basic_dist_t &operator=(basic_dist_t &&)      = default;
 
-  constexpr explicit dist_t(uint16_t r) : _dist{0}, _regions{r} {}
+  basic_dist_t &operator|=(const basic_dist_t &d);
+
+  /**
+   * Make a dist from the first 64 regions. The rest of the regions are empty.
+   */
+  constexpr basic_dist_t(uint64_t d, uint16_t s) : _dist{d}, _regions{s} {}
+
+  constexpr basic_dist_t(const words_type &d, uint16_t s)
+      : _dist{d}, _regions{s} {}
+
+  constexpr explicit basic_dist_t(uint16_t r) : _dist{}, _regions{r} {}
 
   /**
    * Returns the number of occupied (I.E. full) regions.
@@ -56,19 +138,41 @@ public:
    * Returns true if all regions are empty. Hypothetically, we should never
    * return a region with this being true but it's good to have anyways.
    */
-  inline constexpr bool empty() const { return _dist == 0; }
+  inline constexpr bool empty() const {
+    for (size_t i = 0; i < W; ++i) {
+      if (_dist[i]) { return false; }
+    }
+    return true;
+  }
 
   /**
    * Returns the highest or last full region (by index) for the current dist.
    */
   inline constexpr size_t last_full_region() const { return log2(); }
 
+  /**
+   * Returns the index of the lowest full region.
+   */
+  inline constexpr size_t first_full_region() const {
+    for (size_t i = 0; i < W; ++i) {
+      if (_dist[i]) {
+        return i * 64 + static_cast<size_t>(__builtin_ctzll(_dist[i]));
+      }
+    }
+    return regions();
+  }
+
   /**
    * Returns the number of regions for the current dist. This is _not_ the
    * number of full regions, but the number of possible regions.
    */
   inline constexpr uint16_t regions() const { return _regions; }
 
+  /**
+   * Returns the `i`th word of the bitset.
+   */
+  inline constexpr uint64_t word(size_t i) const { return _dist[i]; }
+
   /**
    * Check if the dist is valid, constrained to a given number of regions.
    */
@@ -83,8 +187,10 @@ public:
    * no regions other than the ones allowed.
    */
   inline bool valid_dist() const {
-    auto mask = valid_region_mask();
-    return !static_cast<uint64_t>(*this & (~mask));
+    for (size_t i = 0; i < W; ++i) {
+      if (_dist[i] & ~valid_region_mask(i)) { return false; }
+    }
+    return true;
   }
 
   inline constexpr uint64_t operator[](size_t i) const { return bextr(i); }
@@ -92,84 +198,111 @@ public:
   /**
    * Compute the symmetric difference, I.E. the xor of the set.
    */
-  constexpr inline dist_t region_symmetric_difference(dist_t d) const {
+  constexpr inline basic_dist_t
+  region_symmetric_difference(basic_dist_t d) const {
     return *this ^ d;
   }
 
   /**
    * Compute the size of the symmetric difference, efficiently.
    */
-  constexpr inline size_t region_symmetric_difference_size(dist_t d) const {
+  constexpr inline size_t
+  region_symmetric_difference_size(basic_dist_t d) const {
     return region_symmetric_difference(d).popcount();
   }
 
-  constexpr inline dist_t operator^(dist_t d) const {
-    return {_dist ^ d._dist, std::max(_regions, d._regions)};
+  constexpr inline basic_dist_t operator^(basic_dist_t d) const {
+    basic_dist_t ret{std::max(_regions, d._regions)};
+    for (size_t i = 0; i < W; ++i) { ret._dist[i] = _dist[i] ^ d._dist[i]; }
+    return ret;
   }
 
   /**
    * Compute the union of the dists.
    */
-  constexpr inline dist_t region_union(dist_t d) { return *this | d; }
+  constexpr inline basic_dist_t region_union(basic_dist_t d) {
+    return *this | d;
+  }
 
-  constexpr inline dist_t operator|(dist_t d) const {
-    return {_dist | d._dist, std::max(_regions, d._regions)};
+  constexpr inline basic_dist_t operator|(basic_dist_t d) const {
+    basic_dist_t ret{std::max(_regions, d._regions)};
+    for (size_t i = 0; i < W; ++i) { ret._dist[i] = _dist[i] | d._dist[i]; }
+    return ret;
   }
 
-  constexpr inline dist_t region_intersection(dist_t d) { return *this & d; }
+  constexpr inline basic_dist_t region_intersection(basic_dist_t d) {
+    return *this & d;
+  }
 
   /**
    * Returns true if the difference between two dists is exactly one region.
    */
-  constexpr inline bool one_region_off(dist_t d) {
+  constexpr inline bool one_region_off(basic_dist_t d) {
     return (*this ^ d).popcount() == 1;
   }
 
-  constexpr inline dist_t operator&(dist_t d) const {
-    return {_dist & d._dist, std::max(_regions, d._regions)};
+  constexpr inline basic_dist_t operator&(basic_dist_t d) const {
+    basic_dist_t ret{std::max(_regions, d._regions)};
+    for (size_t i = 0; i < W; ++i) { ret._dist[i] = _dist[i] & d._dist[i]; }
+    return ret;
   }
 
-  inline explicit operator uint64_t() const { return _dist; }
+  inline explicit operator uint64_t() const
+    requires(W == 1)
+  {
+    return _dist[0];
+  }
 
-  constexpr inline dist_t mask(uint64_t d) const { return *this & d; }
+  constexpr inline basic_dist_t mask(uint64_t d) const { return *this & d; }
 
   /**
-   * And operator for the purposes of masking the region.
+   * And operator for the purposes of masking the region. Only the first word
+   * is masked with `d`, the rest is cleared.
    */
-  constexpr inline dist_t operator&(uint64_t d) const {
-    return {_dist & d, _regions};
+  constexpr inline basic_dist_t operator&(uint64_t d) const {
+    return {_dist[0] & d, _regions};
   }
 
-  constexpr inline dist_t invert_dist() const { return ~*this; }
+  constexpr inline basic_dist_t invert_dist() const { return ~*this; }
 
-  constexpr inline dist_t operator~() const { return {~_dist, _regions}; }
+  constexpr inline basic_dist_t operator~() const {
+    basic_dist_t ret{_regions};
+    for (size_t i = 0; i < W; ++i) { ret._dist[i] = ~_dist[i]; }
+    return ret;
+  }
 
-  constexpr inline bool operator==(dist_t d) const {
+  constexpr inline bool operator==(basic_dist_t d) const {
     return d._dist == _dist && _regions == d._regions;
   }
 
-  constexpr inline bool operator!=(dist_t d) const { return !(d == *this); }
-
-  constexpr inline dist_t flip_region(size_t index) const {
-    return {_dist ^ (1ull << index), _regions};
+  constexpr inline bool operator!=(basic_dist_t d) const {
+    return !(d == *this);
   }
 
-  constexpr inline dist_t operator+(uint64_t d) const {
-    return {_dist + d, _regions};
+  constexpr inline basic_dist_t flip_region(size_t index) const {
+    basic_dist_t ret{*this};
+    ret._dist[index / 64] ^= 1ull << (index % 64);
+    return ret;
   }
 
-  constexpr inline explicit operator bool() const {
-    return static_cast<bool>(_dist);
+  constexpr inline basic_dist_t operator+(uint64_t d) const
+    requires(W == 1)
+  {
+    return {_dist[0] + d, _regions};
   }
 
+  constexpr inline explicit operator bool() const { return !empty(); }
+
   /**
    * Computes the index of the dist, given a maximum number of areas. We should
    * think about this dist being the ith dist in a a list ordered as if the dist
    * is a binary number, and this function returns i.
    * */
-  constexpr inline size_t index(size_t max_areas) const {
-    size_t skips = compute_skips(_dist, max_areas);
-    return _dist - skips;
+  constexpr inline size_t index(size_t max_areas) const
+    requires(W == 1)
+  {
+    size_t skips = compute_skips(_dist[0], max_areas);
+    return _dist[0] - skips;
   }
 
   /**
@@ -179,39 +312,31 @@ public:
    * not an index, and so we need  convert that number into an index. This
    * function does that.
    *
-   * Specifically, it computes the index if we want to turn an empty region into
-   * a full region.
+   * Specifically, it computes the index of the `index`th full region, which is
+   * the index we want if we are going to turn a full region into an empty one.
    */
   constexpr inline size_t set_index(size_t index) const {
-    size_t tmp_index = 0;
-    while (true) {
-      if (index == 0 && bextr(tmp_index)) { break; }
-      if (bextr(tmp_index)) { index -= 1; }
-      tmp_index++;
-    }
-    return tmp_index;
+    return select_index(_dist, index);
   }
 
-  constexpr inline dist_t set_by_count(size_t count) {
+  constexpr inline basic_dist_t set_by_count(size_t count) {
     auto index = set_index(count);
     return flip_region(index);
   }
 
   /**
-   * This is the version of `set_index` if we want to turn a full region into an
-   * empty region.
+   * This is the version of `set_index` for empty regions, so it gives the index
+   * if we want to turn an empty region into a full region.
    */
   constexpr inline size_t unset_index(size_t index) const {
-    size_t tmp_index = 0;
-    while (true) {
-      if (index == 0 && !bextr(tmp_index)) { break; }
-      if (!bextr(tmp_index)) { index -= 1; }
-      tmp_index++;
+    words_type empty;
+    for (size_t i = 0; i < W; ++i) {
+      empty[i] = ~_dist[i] & valid_region_mask(i);
     }
-    return tmp_index;
+    return select_index(empty, index);
   }
 
-  constexpr inline dist_t unset_by_count(size_t count) {
+  constexpr inline basic_dist_t unset_by_count(size_t count) {
     auto index = unset_index(count);
     return flip_region(index);
   }
@@ -219,7 +344,9 @@ public:
   /**
    * Computes the next valid dist, given a max number of regions.
    */
-  constexpr inline dist_t next_dist(uint32_t n) const {
+  constexpr inline basic_dist_t next_dist(uint32_t n) const
+    requires(W == 1)
+  {
     auto d = *this + 1;
     while (d.popcount() > n) { d = d + 1; }
     return d;
@@ -227,8 +354,19 @@ public:
 
   std::string to_str() const;
 
-  friend std::ostream &operator<<(std::ostream &os, dist_t dist) {
-    for (size_t i = dist._regions; i; --i) { os << dist.bextr(i - 1); }
+  /**
+   * Append the range to a buffer, in the same format as `to_str`.
+   */
+  void append_to(std::string &out) const {
+    for (size_t i = _regions; i; --i) {
+      out.push_back(bextr(i - 1) ? '1' : '0');
+    }
+  }
+
+  friend std::ostream &operator<<(std::ostream &os, basic_dist_t dist) {
+    for (size_t i = dist._regions; i; --i) {
+      os.put(dist.bextr(i - 1) ? '1' : '0');
+    }
     return os;
   }
 
@@ -237,15 +375,23 @@ private:
    * Computes the number of set bits. In this case, it is the region count.
    */
   inline constexpr size_t popcount() const {
-    return static_cast<size_t>(__builtin_popcountll(_dist));
+    size_t count = 0;
+    for (size_t i = 0; i < W; ++i) {
+      count += static_cast<size_t>(__builtin_popcountll(_dist[i]));
+    }
+    return count;
   }
 
   /**
    * Computes the number of unset bits, given the region count restriction.
    */
   inline constexpr size_t unpopcount() const {
-    return static_cast<size_t>(
-        __builtin_popcountll((~_dist) & valid_region_mask()));
+    size_t count = 0;
+    for (size_t i = 0; i < W; ++i) {
+      count += static_cast<size_t>(
+          __builtin_popcountll((~_dist[i]) & valid_region_mask(i)));
+    }
+    return count;
   }
 
   /**
@@ -253,29 +399,37 @@ private:
    * if the ith bit is unset, and 1 if it is set.
    */
   constexpr inline uint64_t bextr(size_t index) const {
-    return (_dist >> index) & 1ull;
+    return (_dist[index / 64] >> (index % 64)) & 1ull;
   }
 
   /**
    * Computes a fast log2 that is rounded down to the nearest integer.
    */
   inline constexpr size_t log2() const {
-    constexpr size_t BITS_IN_BYTE = 8;
-    return sizeof(_dist) * BITS_IN_BYTE - clz();
-  }
-
-  /**
-   * Count leading zeros
-   */
-  inline constexpr size_t clz() const {
-    return static_cast<size_t>(__builtin_clzll(_dist));
+    constexpr size_t BITS_IN_WORD = 64;
+    for (size_t i = W; i; --i) {
+      if (_dist[i - 1]) {
+        return i * BITS_IN_WORD
+             - static_cast<size_t>(__builtin_clzll(_dist[i - 1]));
+      }
+    }
+    return 0;
   }
 
   /**
-   * Count leading zeros, with a saftey for when _dist == 0
+   * Index of the `k`th set bit over all of the words.
    */
-  inline constexpr size_t clz_min() const {
-    return static_cast<size_t>(__builtin_clzll(_dist | 1ull));
+  static constexpr size_t select_index(const words_type &words, size_t k) {
+    if constexpr (W == 1) {
+      return bits::select(words[0], k);
+    } else {
+      for (size_t i = 0; i < W; ++i) {
+        auto count = static_cast<size_t>(__builtin_popcountll(words[i]));
+        if (k < count) { return i * 64 + bits::select(words[i], k); }
+        k -= count;
+      }
+      return MAX_REGIONS;
+    }
   }
 
   /**
@@ -305,25 +459,92 @@ private:
     return skips;
   }
 
-  constexpr uint64_t valid_region_mask() const {
-    uint64_t mask = (1ull << regions()) - 1;
-    return static_cast<uint64_t>(mask);
+  /**
+   * Mask of the valid regions in word `i`.
+   */
+  constexpr uint64_t valid_region_mask(size_t i) const {
+    if constexpr (W == 1) {
+      return (1ull << regions()) - 1;
+    } else {
+      size_t first = i * 64;
+      if (regions() <= first) { return 0; }
+      if (regions() - first >= 64) { return ~0ull; }
+      return (1ull << (regions() - first)) - 1;
+    }
   }
 
-  uint64_t _dist;
-  uint16_t _regions;
+  words_type _dist;
+  uint16_t   _regions;
 };
 
-dist_t make_full_dist(size_t regions);
-dist_t make_singleton_dist(size_t regions);
-dist_t make_random_dist(size_t                                  regions,
-                        std::uniform_random_bit_generator auto &gen) {
-  if (regions > 64) {
+template <size_t W>
+basic_dist_t<W>::basic_dist_t(const std::string &dist_string) {
+  if (dist_string.size() > MAX_REGIONS) {
+    throw std::runtime_error{"Tried to make a dist with too many regions"};
+  }
+  _regions = static_cast<uint16_t>(dist_string.size());
+  _dist    = {};
+
+  /* The string is big endian, so the first character is the highest region */
+  for (size_t i = 0; i < dist_string.size(); ++i) {
+    if (dist_string[dist_string.size() - i - 1] == '1') {
+      _dist[i / 64] |= 1ull << (i % 64);
+    }
+  }
+}
+
+template <size_t W>
+basic_dist_t<W> &basic_dist_t<W>::operator|=(const basic_dist_t &d) {
+  *this = *this | d;
+  return *this;
+}
+
+template <size_t W> std::string basic_dist_t<W>::to_str() const {
+  std::string str(_regions, '0');
+  for (size_t i = 0; i < _regions; ++i) {
+    if (bextr(_regions - i - 1)) { str[i] = '1'; }
+  }
+  return str;
+}
+
+template <size_t W = BIGRIG_DIST_WORDS>
+basic_dist_t<W> make_full_dist(size_t regions) {
+  if constexpr (W == 1) {
+    return {(1ul << regions) - 1, static_cast<uint16_t>(regions)};
+  } else {
+    typename basic_dist_t<W>::words_type words{};
+    for (size_t i = 0; i < regions; ++i) { words[i / 64] |= 1ull << (i % 64); }
+    return {words, static_cast<uint16_t>(regions)};
+  }
+}
+
+template <size_t W = BIGRIG_DIST_WORDS>
+basic_dist_t<W> make_singleton_dist(size_t regions) {
+  return {1ul, static_cast<uint16_t>(regions)};
+}
+
+template <size_t W = BIGRIG_DIST_WORDS>
+basic_dist_t<W>
+make_random_dist(size_t                                  regions,
+                 std::uniform_random_bit_generator auto &gen) {
+  if (regions >= basic_dist_t<W>::MAX_REGIONS) {
     throw std::invalid_argument{"Tried to generate a random distribution with "
                                 + std::to_string(regions)};
   }
-  std::uniform_int_distribution<uint64_t> dis(1ul, (1ul << regions) - 1);
-  return {dis(gen), static_cast<uint16_t>(regions)};
+  if constexpr (W == 1) {
+    std::uniform_int_distribution<uint64_t> dis(1ul, (1ul << regions) - 1);
+    return {dis(gen), static_cast<uint16_t>(regions)};
+  } else {
+    /* every range is equally likely, so just redo the empty range */
+    std::uniform_int_distribution<uint64_t> dis;
+    while (true) {
+      typename basic_dist_t<W>::words_type words;
+      for (auto &w : words) { w = dis(gen); }
+      auto ret = basic_dist_t<W>{words, static_cast<uint16_t>(regions)}
+               & make_full_dist<W>(regions);
+      if (ret) { return ret; }
+    }
+  }
 }
 
 /**
@@ -350,7 +571,7 @@ transition_t spread(dist_t                                  init_dist,
                     const biogeo_model_t                   &model,
                     std::uniform_random_bit_generator auto &gen,
                     operation_mode_e mode = operation_mode_e::FAST) {
-  if (mode == operation_mode_e::FAST) {
+  if (mode == operation_mode_e::FAST || mode == operation_mode_e::ENDPOINT) {
     return spread_analytic(init_dist, model, gen);
   } else if (mode == operation_mode_e::SIM) {
     return spread_rejection(init_dist, model, gen);
@@ -391,18 +612,51 @@ transition_t spread_rejection(dist_t                                  init_dist,
   return min_ele;
 }
 
+/**
+ * Pick the region which is flipped by a transition, from a roll in `[0,
+ * total_weight)`. The dispersions come first in the roll, and then the
+ * extinctions.
+ */
+inline size_t spread_region(dist_t        init_dist,
+                            rate_params_t rates,
+                            double        total_weight,
+                            double        region_roll) {
+  auto [d, e]        = rates;
+  size_t empty_count = init_dist.empty_region_count();
+  size_t full_count  = init_dist.full_region_count();
+  double dis_weight  = d * empty_count;
+
+  /* if extinction is impossible, the total is exactly the dispersion weight */
+  if (region_roll < dis_weight || total_weight == dis_weight) {
+    auto k = std::min(static_cast<size_t>(region_roll / d), empty_count - 1);
+    return init_dist.unset_index(k);
+  }
+  auto k = std::min(static_cast<size_t>((region_roll - dis_weight) / e),
+                    full_count - 1);
+  return init_dist.set_index(k);
+}
+
 /**
  * Samples a `transition_t` by combining the independent processes, and only
- * rolling once for the waiting time. There are 2 additional rolls, one for the
- * type, and one for the region.
+ * rolling once for the waiting time. There is one additional roll, for the
+ * region.
  *
- * Linear in the number of regions, due to the `[un]set_by_count` call
+ * The roll for the region is split into the dispersion part, which comes
+ * first, and the extinction part. Inside of a part, every region has the same
+ * weight, so the roll also gives which of the empty (or full) regions is
+ * flipped, and `[un]set_index` turns that into the index of the region. So,
+ * this is constant time in the number of regions.
  */
 transition_t spread_analytic(dist_t                                  init_dist,
                              const biogeo_model_t                   &model,
                              std::uniform_random_bit_generator auto &gen) {
   auto [d, e]         = model.rates();
-  double total_weight = model.total_rate_weight(init_dist);
+  double total_weight = model.lookup_rate_weight(init_dist.regions(),
+                                                 init_dist.full_region_count());
+  if (total_weight == 0.0) {
+    /* nothing can happen, so the next event never comes */
+    return {std::numeric_limits<double>::infinity(), init_dist, init_dist};
+  }
 
   std::exponential_distribution<double> wait_time_distribution(total_weight);
 
@@ -411,18 +665,8 @@ transition_t spread_analytic(dist_t                                  init_dist,
   std::uniform_real_distribution<double> region_dist(0, total_weight);
   double                                 region_roll = region_dist(gen);
 
-  for (size_t i = 0; i < init_dist.regions(); ++i) {
-    if (init_dist[i]) {
-      if (!init_dist.singleton()) { region_roll -= e; }
-    } else {
-      region_roll -= d;
-    }
-    if (region_roll <= 0) {
-      auto new_dist = init_dist.flip_region(i);
-      return {waiting_time, init_dist, new_dist};
-    }
-  }
-  throw std::runtime_error{"Failed to spread correctly"};
+  auto index = spread_region(init_dist, {d, e}, total_weight, region_roll);
+  return {waiting_time, init_dist, init_dist.flip_region(index)};
 }
 
 /**
@@ -432,15 +676,18 @@ transition_t spread_analytic(dist_t                                  init_dist,
  * waiting time from the branch length. If the branch length is still positive
  * or zero, then we record the sample and continue. The process repeats until
  * the branch length is negative.
+ *
+ * Every transition is passed to `record`, which can either store it (e.g. in
+ * the transition buffer of a `sim_result_t`), or just count it. Returns the
+ * final dist of the branch.
  */
-std::vector<transition_t>
-simulate_transitions(dist_t                                  init_dist,
-                     const std::vector<period_t>            &periods,
-                     std::uniform_random_bit_generator auto &gen,
-                     operation_mode_e                        mode) {
-  std::vector<transition_t> results;
-  results.reserve(util::VECTOR_INITIAL_RESERVE);
-  for (const auto &current_period : periods) {
+dist_t
+simulate_transitions(dist_t                                      init_dist,
+                     const branch_periods_t                     &periods,
+                     std::uniform_random_bit_generator auto     &gen,
+                     operation_mode_e                            mode,
+                     std::invocable<const transition_t &> auto &&record) {
+  for (auto current_period : periods) {
     double brlen = current_period.length();
     while (true) {
       auto r          = spread(init_dist, current_period.model(), gen, mode);
@@ -448,10 +695,10 @@ simulate_transitions(dist_t                                  init_dist,
       brlen          -= r.waiting_time;
       if (brlen < 0.0) { break; }
       init_dist = r.final_state;
-      results.push_back(r);
+      record(r);
     }
   }
-  return results;
+  return init_dist;
 }
 
 } // namespace bigrig
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+
+/*
+ * Number of 64 bit words used to store a range. Set by the `DIST_WORDS` CMake
+ * option.
+ */
+#ifndef BIGRIG_DIST_WORDS
+#define BIGRIG_DIST_WORDS 1
+#endif
+
+namespace bigrig {
+
+template <size_t W> class basic_dist_t;
+
+/**
+ * The dist used by the program. The width is picked at compile time, so that
+ * the usual case of 63 or fewer regions doesn't pay for wide dists.
+ */
+using dist_t = basic_dist_t<BIGRIG_DIST_WORDS>;
+} // namespace bigrig
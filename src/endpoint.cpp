@@ -0,0 +1,189 @@
+#include "endpoint.hpp"
+
+#include <cmath>
+
+namespace bigrig {
+
+namespace {
+/**
+ * A small dense, row major, square matrix. Only what is needed for `exp`.
+ */
+class matrix_t {
+public:
+  explicit matrix_t(size_t size) : _size{size}, _data(size * size, 0.0) {}
+
+  static matrix_t identity(size_t size) {
+    matrix_t m{size};
+    for (size_t i = 0; i < size; ++i) { m(i, i) = 1.0; }
+    return m;
+  }
+
+  double &operator()(size_t i, size_t j) { return _data[i * _size + j]; }
+  double  operator()(size_t i, size_t j) const { return _data[i * _size + j]; }
+
+  size_t size() const { return _size; }
+
+  matrix_t operator*(const matrix_t &other) const {
+    matrix_t ret{_size};
+    for (size_t i = 0; i < _size; ++i) {
+      for (size_t k = 0; k < _size; ++k) {
+        double lhs = (*this)(i, k);
+        if (lhs == 0.0) { continue; }
+        for (size_t j = 0; j < _size; ++j) { ret(i, j) += lhs * other(k, j); }
+      }
+    }
+    return ret;
+  }
+
+  matrix_t &operator+=(const matrix_t &other) {
+    for (size_t i = 0; i < _data.size(); ++i) { _data[i] += other._data[i]; }
+    return *this;
+  }
+
+  matrix_t &operator*=(double f) {
+    for (auto &v : _data) { v *= f; }
+    return *this;
+  }
+
+  /**
+   * The infinity norm, I.E. the largest absolute row sum.
+   */
+  double norm() const {
+    double ret = 0.0;
+    for (size_t i = 0; i < _size; ++i) {
+      double row = 0.0;
+      for (size_t j = 0; j < _size; ++j) { row += std::abs((*this)(i, j)); }
+      ret = std::max(ret, row);
+    }
+    return ret;
+  }
+
+private:
+  size_t              _size;
+  std::vector<double> _data;
+};
+
+/**
+ * Computes `exp(m)` by scaling and squaring. The matrix is scaled so that its
+ * norm is at most 1/2, where a short Taylor series is accurate to machine
+ * precision, and then the result is squared back up.
+ */
+matrix_t exp(matrix_t m) {
+  constexpr size_t TAYLOR_TERMS = 16;
+
+  int squarings = 0;
+  if (double norm = m.norm(); norm > 0.5) {
+    squarings = static_cast<int>(std::ceil(std::log2(norm / 0.5)));
+  }
+  m *= std::ldexp(1.0, -squarings);
+
+  auto ret  = matrix_t::identity(m.size());
+  auto term = matrix_t::identity(m.size());
+  for (size_t k = 1; k <= TAYLOR_TERMS; ++k) {
+    term  = term * m;
+    term *= 1.0 / static_cast<double>(k);
+    ret  += term;
+  }
+
+  for (int i = 0; i < squarings; ++i) { ret = ret * ret; }
+  return ret;
+}
+} // namespace
+
+/**
+ * Build the rate matrix of the lumped process, and get the row for the
+ * starting state out of `exp(Q t)`.
+ *
+ * The state `(a, b)` has index `a * (n1 + 1) + b`. The empty range `(0, 0)` is
+ * included to keep the indexing simple, but it can't be reached.
+ */
+endpoint_distribution_t::endpoint_distribution_t(const biogeo_model_t &model,
+                                                 double                length,
+                                                 size_t occupied_count,
+                                                 size_t region_count)
+    : _occupied_count{occupied_count},
+      _empty_count{region_count - occupied_count} {
+  auto [d, e] = model.rates();
+
+  size_t   width = _empty_count + 1;
+  matrix_t q{(_occupied_count + 1) * width};
+
+  auto add_rate = [&](size_t from, size_t to, double rate) {
+    q(from, to) += rate;
+    q(from, from) -= rate;
+  };
+
+  for (size_t a = 0; a <= _occupied_count; ++a) {
+    for (size_t b = 0; b <= _empty_count; ++b) {
+      if (a + b == 0) { continue; }
+      size_t state = a * width + b;
+      if (a < _occupied_count) {
+        add_rate(state, state + width, d * (_occupied_count - a));
+      }
+      if (b < _empty_count) {
+        add_rate(state, state + 1, d * (_empty_count - b));
+      }
+      if (a + b > 1) {
+        if (a > 0) { add_rate(state, state - width, e * a); }
+        if (b > 0) { add_rate(state, state - 1, e * b); }
+      }
+    }
+  }
+
+  q *= length;
+  auto p = exp(std::move(q));
+
+  size_t start = _occupied_count * width;
+  _cdf.resize(p.size());
+  double total = 0.0;
+  for (size_t state = 0; state < p.size(); ++state) {
+    /* rounding can leave tiny negative entries, which are really 0 */
+    total       += std::max(p(start, state), 0.0);
+    _cdf[state]  = total;
+  }
+}
+
+double endpoint_distribution_t::probability(size_t a, size_t b) const {
+  size_t state = a * (_empty_count + 1) + b;
+  double prev  = state == 0 ? 0.0 : _cdf[state - 1];
+  return (_cdf[state] - prev) / _cdf.back();
+}
+
+/**
+ * Get the distribution for a segment, building it if this is the first time
+ * it is needed. If the region count changes, the slot is cleared.
+ */
+std::shared_ptr<const endpoint_distribution_t>
+endpoint_cache_t::get(size_t                  slot,
+                      const period_segment_t &period,
+                      dist_t                  init_dist) {
+  auto &s = _slots[slot];
+
+  std::lock_guard<std::mutex> guard{s.lock};
+  if (s.regions != init_dist.regions()) {
+    s.regions = init_dist.regions();
+    s.dists.clear();
+    s.dists.resize(s.regions + 1);
+  }
+
+  size_t occupied = init_dist.full_region_count();
+  auto  &dist     = s.dists[occupied];
+  if (!dist) {
+    dist = std::make_shared<endpoint_distribution_t>(
+        period.model(), period.length(), occupied, init_dist.regions());
+  }
+  return dist;
+}
+
+/**
+ * Drop the distributions of a slot, e.g. when the model or the length of its
+ * segment changes. They are built again the next time they are needed.
+ */
+void endpoint_cache_t::clear(size_t slot) {
+  auto &s = _slots[slot];
+
+  std::lock_guard<std::mutex> guard{s.lock};
+  s.regions = 0;
+  s.dists.clear();
+}
+} // namespace bigrig
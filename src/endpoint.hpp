@@ -0,0 +1,150 @@
+#pragma once
+
+#include "dist.hpp"
+#include "period.hpp"
+
+#include <algorithm>
+#include <array>
+#include <concepts>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <span>
+#include <vector>
+
+namespace bigrig {
+
+/**
+ * The largest region count that the endpoint sampler supports. The cost of
+ * building a distribution grows with the cube of `(regions / 2 + 1)^2`, so
+ * past this point it stops being worth it.
+ */
+constexpr size_t ENDPOINT_MAX_REGIONS = 16;
+
+/**
+ * The distribution of the range at the end of a branch segment, for a given
+ * number of occupied regions at the start of the segment.
+ *
+ * Every region has the same dispersion and extinction rates, so the exact
+ * regions don't matter, only how many of the initially occupied regions are
+ * still occupied (`a`), and how many of the initially empty regions have been
+ * colonized (`b`). This lumped process has `(n0 + 1) * (n1 + 1)` states, where
+ * `n0` and `n1` are the number of occupied and empty regions at the start. The
+ * transition matrix of the lumped process is computed with `exp(Q t)`, using
+ * scaling and squaring, so the cost depends on the log of the rate times the
+ * length instead of the number of events.
+ *
+ * Given `(a, b)`, every range with that many initial and new regions is
+ * equally likely, so a range is sampled by picking the regions uniformly.
+ */
+class endpoint_distribution_t {
+public:
+  endpoint_distribution_t(const biogeo_model_t &model,
+                          double                length,
+                          size_t                occupied_count,
+                          size_t                region_count);
+
+  /**
+   * Sample the range at the end of the segment. `init_dist` has to have the
+   * same number of occupied regions as this distribution was built for.
+   */
+  dist_t sample(dist_t                                  init_dist,
+                std::uniform_random_bit_generator auto &gen) const {
+    std::uniform_real_distribution<double> roll_dist(0.0, _cdf.back());
+
+    auto   itr   = std::upper_bound(_cdf.begin(), _cdf.end(), roll_dist(gen));
+    size_t state = std::min<size_t>(itr - _cdf.begin(), _cdf.size() - 1);
+    size_t a     = state / (_empty_count + 1);
+    size_t b     = state % (_empty_count + 1);
+
+    std::array<size_t, ENDPOINT_MAX_REGIONS> occupied;
+    std::array<size_t, ENDPOINT_MAX_REGIONS> empty;
+    size_t                                   occupied_count = 0;
+    size_t                                   empty_count    = 0;
+    for (size_t i = 0; i < init_dist.regions(); ++i) {
+      if (init_dist[i]) {
+        occupied[occupied_count++] = i;
+      } else {
+        empty[empty_count++] = i;
+      }
+    }
+
+    uint64_t bits = 0;
+    bits |= pick_regions(std::span{occupied.data(), occupied_count}, a, gen);
+    bits |= pick_regions(std::span{empty.data(), empty_count}, b, gen);
+    return {bits, init_dist.regions()};
+  }
+
+  /**
+   * Probability of ending with `a` of the initial regions and `b` new ones.
+   */
+  double probability(size_t a, size_t b) const;
+
+private:
+  /**
+   * Pick `count` of the `regions` uniformly, with a partial Fisher-Yates
+   * shuffle, and return them as bits.
+   */
+  static uint64_t pick_regions(std::span<size_t>                       regions,
+                               size_t                                  count,
+                               std::uniform_random_bit_generator auto &gen) {
+    uint64_t bits = 0;
+    for (size_t i = 0; i < count; ++i) {
+      std::uniform_int_distribution<size_t> pick(i, regions.size() - 1);
+      std::swap(regions[i], regions[pick(gen)]);
+      bits |= 1ul << regions[i];
+    }
+    return bits;
+  }
+
+  std::vector<double> _cdf;
+  size_t              _occupied_count;
+  size_t              _empty_count;
+};
+
+/**
+ * Cache of endpoint distributions for a tree. There is one slot for every
+ * period of every branch, so the cache is keyed by the model and the length of
+ * the segment. Each slot holds a distribution for every starting number of
+ * occupied regions that has been seen so far.
+ *
+ * Distributions are built the first time they are needed, so the first few
+ * replicates are slow, and the rest only pay for the sampling. It is safe to
+ * use the cache from several threads at once.
+ */
+class endpoint_cache_t {
+public:
+  explicit endpoint_cache_t(size_t slot_count) : _slots(slot_count) {}
+
+  std::shared_ptr<const endpoint_distribution_t>
+  get(size_t slot, const period_segment_t &period, dist_t init_dist);
+
+  void clear(size_t slot);
+
+private:
+  struct slot_t {
+    std::mutex                                                  lock;
+    uint16_t                                                    regions = 0;
+    std::vector<std::shared_ptr<const endpoint_distribution_t>> dists;
+  };
+
+  std::vector<slot_t> _slots;
+};
+
+/**
+ * Sample the range at the end of a branch, without sampling the events along
+ * the way. `first_slot` is the cache slot of the first period of the branch.
+ */
+dist_t simulate_endpoint(dist_t                                  init_dist,
+                         const branch_periods_t                 &periods,
+                         size_t                                  first_slot,
+                         endpoint_cache_t                       &cache,
+                         std::uniform_random_bit_generator auto &gen) {
+  for (size_t i = 0; i < periods.size(); ++i) {
+    auto dist = cache.get(first_slot + i, periods[i], init_dist);
+    init_dist = dist->sample(init_dist, gen);
+  }
+  return init_dist;
+}
+} // namespace bigrig
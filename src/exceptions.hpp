@@ -8,4 +8,9 @@ class invalid_dist : public std::invalid_argument {
 public:
   invalid_dist(const std::string &msg) : std::invalid_argument{msg} {}
 };
+
+class invalid_buffer : public std::invalid_argument {
+public:
+  invalid_buffer(const std::string &msg) : std::invalid_argument{msg} {}
+};
 } // namespace bigrig
@@ -0,0 +1,146 @@
+#include "instrument.hpp"
+
+#include <algorithm>
+#include <mutex>
+#include <sys/resource.h>
+#include <vector>
+
+namespace bigrig {
+
+std::string_view to_string(phase_e phase) {
+  switch (phase) {
+  case phase_e::PARSE:
+    return "parse";
+  case phase_e::PERIODS:
+    return "periods";
+  case phase_e::SIMULATE:
+    return "simulate";
+  case phase_e::WRITE_PHYLIP:
+    return "write-phylip";
+  case phase_e::WRITE_NEWICK:
+    return "write-newick";
+  case phase_e::WRITE_YAML:
+    return "write-yaml";
+  case phase_e::WRITE_JSON:
+    return "write-json";
+  case phase_e::WRITE_CSV:
+    return "write-csv";
+  case phase_e::WRITE_BINARY:
+    return "write-binary";
+  case phase_e::COUNT:
+    break;
+  }
+  return "unknown";
+}
+
+std::string_view to_string(counter_e counter) {
+  switch (counter) {
+  case counter_e::TRANSITIONS:
+    return "transitions";
+  case counter_e::SPLITS:
+    return "splits";
+  case counter_e::REJECTION_SAMPLES:
+    return "rejection-samples";
+  case counter_e::RESTARTS:
+    return "restarts";
+  case counter_e::COUNT:
+    break;
+  }
+  return "unknown";
+}
+
+instrument_counts_t &
+instrument_counts_t::operator+=(const instrument_counts_t &other) {
+  for (size_t i = 0; i < PHASE_COUNT; ++i) {
+    phase_nanoseconds[i] += other.phase_nanoseconds[i];
+  }
+  for (size_t i = 0; i < COUNTER_COUNT; ++i) {
+    counters[i] += other.counters[i];
+  }
+  return *this;
+}
+
+instrument_counts_t &
+instrument_counts_t::operator-=(const instrument_counts_t &other) {
+  for (size_t i = 0; i < PHASE_COUNT; ++i) {
+    phase_nanoseconds[i] -= other.phase_nanoseconds[i];
+  }
+  for (size_t i = 0; i < COUNTER_COUNT; ++i) {
+    counters[i] -= other.counters[i];
+  }
+  return *this;
+}
+
+namespace {
+/**
+ * Every thread which has counted something. The registry is only locked when a
+ * thread starts or exits, and when the totals are read.
+ */
+struct instrument_registry_t {
+  std::mutex                                 mutex;
+  std::vector<detail::thread_instrument_t *> threads;
+  instrument_counts_t                        finished;
+};
+
+instrument_registry_t &registry() {
+  static instrument_registry_t instance;
+  return instance;
+}
+} // namespace
+
+namespace detail {
+thread_instrument_t::thread_instrument_t() {
+  auto           &r = registry();
+  std::lock_guard lock{r.mutex};
+  r.threads.push_back(this);
+}
+
+thread_instrument_t::~thread_instrument_t() {
+  auto           &r = registry();
+  std::lock_guard lock{r.mutex};
+  r.finished += counts();
+  r.threads.erase(std::find(r.threads.begin(), r.threads.end(), this));
+}
+
+instrument_counts_t thread_instrument_t::counts() const {
+  instrument_counts_t c;
+  for (size_t i = 0; i < PHASE_COUNT; ++i) {
+    c.phase_nanoseconds[i] = _phase_nanoseconds[i].load();
+  }
+  for (size_t i = 0; i < COUNTER_COUNT; ++i) {
+    c.counters[i] = _counters[i].load();
+  }
+  return c;
+}
+
+thread_instrument_t &thread_instrument() {
+  thread_local thread_instrument_t instance;
+  return instance;
+}
+} // namespace detail
+
+instrument_counts_t thread_instrument_counts() {
+  if constexpr (INSTRUMENT_ENABLED) {
+    return detail::thread_instrument().counts();
+  }
+  return {};
+}
+
+instrument_counts_t instrument_totals() {
+  if constexpr (!INSTRUMENT_ENABLED) { return {}; }
+
+  auto           &r = registry();
+  std::lock_guard lock{r.mutex};
+  auto            totals = r.finished;
+  for (const auto *t : r.threads) { totals += t->counts(); }
+  return totals;
+}
+
+std::optional<size_t> peak_memory_bytes() {
+  rusage usage{};
+  if (getrusage(RUSAGE_SELF, &usage) != 0) { return {}; }
+  /* Linux reports the peak in kilobytes */
+  return static_cast<size_t>(usage.ru_maxrss) * 1024;
+}
+
+} // namespace bigrig
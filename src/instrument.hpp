@@ -0,0 +1,177 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+namespace bigrig {
+
+/**
+ * The parts of a run which are timed. The phases are timed on the thread that
+ * runs them, so when the replicates are simulated on several threads, the
+ * times are summed over the threads.
+ */
+enum class phase_e : uint8_t {
+  PARSE,
+  PERIODS,
+  SIMULATE,
+  WRITE_PHYLIP,
+  WRITE_NEWICK,
+  WRITE_YAML,
+  WRITE_JSON,
+  WRITE_CSV,
+  WRITE_BINARY,
+  COUNT,
+};
+
+/**
+ * Things counted on the hot paths of the simulation.
+ */
+enum class counter_e : uint8_t {
+  TRANSITIONS,
+  SPLITS,
+  REJECTION_SAMPLES,
+  RESTARTS,
+  COUNT,
+};
+
+constexpr size_t PHASE_COUNT   = static_cast<size_t>(phase_e::COUNT);
+constexpr size_t COUNTER_COUNT = static_cast<size_t>(counter_e::COUNT);
+
+std::string_view to_string(phase_e phase);
+std::string_view to_string(counter_e counter);
+
+#ifdef BIGRIG_INSTRUMENT
+constexpr bool INSTRUMENT_ENABLED = true;
+#else
+constexpr bool INSTRUMENT_ENABLED = false;
+#endif
+
+/**
+ * A copy of the times and counts, either of one thread or of all of them.
+ * Taking the difference of two copies gives the counts of the work in between.
+ */
+struct instrument_counts_t {
+  std::array<uint64_t, PHASE_COUNT>   phase_nanoseconds{};
+  std::array<uint64_t, COUNTER_COUNT> counters{};
+
+  double seconds(phase_e phase) const {
+    return static_cast<double>(phase_nanoseconds[static_cast<size_t>(phase)])
+         * 1e-9;
+  }
+
+  uint64_t count(counter_e counter) const {
+    return counters[static_cast<size_t>(counter)];
+  }
+
+  instrument_counts_t &operator+=(const instrument_counts_t &other);
+  instrument_counts_t &operator-=(const instrument_counts_t &other);
+};
+
+inline instrument_counts_t operator-(instrument_counts_t        a,
+                                     const instrument_counts_t &b) {
+  return a -= b;
+}
+
+namespace detail {
+/**
+ * The counts of one thread. They are only ever written by the thread that owns
+ * them, so the relaxed load and store are just a normal add, but the counts can
+ * still be read from other threads. When the thread exits, its counts are added
+ * to the counts of the finished threads.
+ */
+class thread_instrument_t {
+public:
+  thread_instrument_t();
+  ~thread_instrument_t();
+
+  thread_instrument_t(const thread_instrument_t &)            = delete;
+  thread_instrument_t &operator=(const thread_instrument_t &) = delete;
+
+  void add_phase(phase_e phase, uint64_t nanoseconds) {
+    add(_phase_nanoseconds[static_cast<size_t>(phase)], nanoseconds);
+  }
+
+  void add_count(counter_e counter, uint64_t n) {
+    add(_counters[static_cast<size_t>(counter)], n);
+  }
+
+  instrument_counts_t counts() const;
+
+private:
+  static void add(std::atomic<uint64_t> &value, uint64_t n) {
+    value.store(value.load(std::memory_order_relaxed) + n,
+                std::memory_order_relaxed);
+  }
+
+  std::array<std::atomic<uint64_t>, PHASE_COUNT>   _phase_nanoseconds{};
+  std::array<std::atomic<uint64_t>, COUNTER_COUNT> _counters{};
+};
+
+thread_instrument_t &thread_instrument();
+} // namespace detail
+
+/**
+ * Add `n` to a counter of the calling thread. Compiles to nothing when the
+ * instrumentation is disabled.
+ */
+inline void count_event(counter_e counter, uint64_t n = 1) {
+  if constexpr (INSTRUMENT_ENABLED) {
+    detail::thread_instrument().add_count(counter, n);
+  }
+}
+
+/**
+ * Times a phase, from construction until the end of the scope. The timer is
+ * empty when the instrumentation is disabled.
+ */
+class scoped_phase_t {
+public:
+#ifdef BIGRIG_INSTRUMENT
+  explicit scoped_phase_t(phase_e phase)
+      : _phase{phase}, _start{std::chrono::steady_clock::now()} {}
+
+  ~scoped_phase_t() {
+    auto elapsed = std::chrono::steady_clock::now() - _start;
+    detail::thread_instrument().add_phase(
+        _phase,
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+  }
+#else
+  explicit scoped_phase_t(phase_e) {}
+#endif
+
+  scoped_phase_t(const scoped_phase_t &)            = delete;
+  scoped_phase_t &operator=(const scoped_phase_t &) = delete;
+
+#ifdef BIGRIG_INSTRUMENT
+private:
+  phase_e                               _phase;
+  std::chrono::steady_clock::time_point _start;
+#endif
+};
+
+/**
+ * The counts of the calling thread. All zero when the instrumentation is
+ * disabled.
+ */
+instrument_counts_t thread_instrument_counts();
+
+/**
+ * The counts of every thread, including the threads which have exited. The
+ * counts of threads which are still running are only up to date if they are
+ * not working, e.g. after the scheduler has returned.
+ */
+instrument_counts_t instrument_totals();
+
+/**
+ * The peak resident memory of the process, in bytes, if the platform reports
+ * it.
+ */
+std::optional<size_t> peak_memory_bytes();
+
+} // namespace bigrig
@@ -1,16 +1,19 @@
 #include "io.hpp"
 
 #include "clioptions.hpp"
+#include "endpoint.hpp"
 #include "logger.hpp"
 #include "model.hpp"
 
+#include <charconv>
 #include <filesystem>
+#include <format>
 #include <optional>
 #include <string_view>
 
 using namespace std::string_view_literals; // for the 'sv' suffix
 
-constexpr size_t MAX_REGIONS = 64;
+constexpr size_t MAX_REGIONS = bigrig::dist_t::MAX_REGIONS;
 
 void print_periods(const std::vector<period_params_t> &periods) {
   LOG_INFO("   Running with %lu periods:", periods.size());
@@ -51,9 +54,16 @@ void print_model_parameters(const period_params_t &period) {
 void write_header(const cli_options_t &cli_options) {
   MESSAGE_INFO("Running simulation with the following options:");
   LOG_INFO("   Tree file: %s", cli_options.tree_filename.value().c_str());
+  if (cli_options.tree_cache.has_value()) {
+    LOG_INFO("   Tree cache: %s", cli_options.tree_cache.value().c_str());
+  }
   LOG_INFO("   Prefix: %s", cli_options.prefix.value().c_str());
-  LOG_INFO("   Root range: %s",
-           cli_options.root_range.value().to_str().c_str());
+  if (cli_options.root_mode()) {
+    LOG_INFO("   Root ranges: %lu", cli_options.roots.size());
+  } else {
+    LOG_INFO("   Root range: %s",
+             cli_options.root_range.value().to_str().c_str());
+  }
   LOG_INFO("   Region count: %u", cli_options.root_range->regions());
   if (cli_options.periods.size() == 1) {
     print_model_parameters(cli_options.periods.front());
@@ -63,36 +73,92 @@ void write_header(const cli_options_t &cli_options) {
   if (cli_options.rng_seed.has_value()) {
     LOG_INFO("   Seed: %lu", cli_options.rng_seed.value());
   }
+  if (cli_options.batch_mode()) {
+    LOG_INFO("   Replicates: %lu", cli_options.replicates.value());
+  }
+  if (cli_options.threads.has_value()) {
+    LOG_INFO("   Threads: %lu", cli_options.threads.value());
+  }
+  if (cli_options.parallel_tree_mode()) {
+    LOG_INFO("   Simulating the subtrees of each replicate in parallel");
+  }
+  if (cli_options.writer_thread_mode()) {
+    LOG_INFO("   Writing the results on their own thread");
+  }
+  if (cli_options.jobs_mode()) {
+    LOG_INFO("   Jobs file: %s", cli_options.jobs_file.value().c_str());
+  }
+  if (cli_options.shard_mode()) {
+    LOG_INFO("   Shard: %lu of %lu",
+             cli_options.shard_index.value(),
+             cli_options.shard_count.value());
+  }
+  if (cli_options.sweep_mode()) {
+    LOG_INFO("   Sweep points: %lu", cli_options.sweep_points.size());
+  }
+  if (cli_options.conditioned_mode()) {
+    LOG_INFO("   Conditions: %lu, restarting the %s when a tip fails",
+             cli_options.conditions.size(),
+             cli_options.restart_mode() == bigrig::restart_mode_e::SUBTREE
+                 ? "clade"
+                 : "tree");
+  }
+  if (cli_options.stats_only_mode()) {
+    LOG_INFO("   Only computing summary stats");
+  }
+  if (cli_options.lazy_events_mode()) {
+    LOG_INFO("   Regenerating the events of %lu replicates",
+             cli_options.event_replicates.size());
+  }
   if (cli_options.mode.has_value()
       && cli_options.mode.value() == bigrig::operation_mode_e::SIM) {
     MESSAGE_WARNING(
         "Setting the operation mode to simulation, results will be slow");
   }
+  if (cli_options.mode.has_value()
+      && cli_options.mode.value() == bigrig::operation_mode_e::ENDPOINT) {
+    MESSAGE_WARNING("Setting the operation mode to endpoint, events along the "
+                    "branches will not be recorded");
+  }
 }
 
 /**
- * Produce a phylip file as a string.
+ * Write a phylip file straight to a stream.
  */
-std::string to_phylip(const bigrig::tree_t &tree) {
-  std::ostringstream oss;
-  oss << std::to_string(tree.leaf_count()) << " " << tree.region_count()
-      << "\n";
+void write_phylip(std::ostream               &os,
+                  const bigrig::tree_t       &tree,
+                  const bigrig::sim_result_t &result) {
+  os << tree.leaf_count() << " " << result.region_count() << "\n";
+  tree.to_phylip_body(os, result);
+}
 
-  tree.to_phylip_body(oss);
+/**
+ * Write a phylip file straight to a stream, including inner nodes.
+ */
+void write_phylip_all_nodes(std::ostream               &os,
+                            const bigrig::tree_t       &tree,
+                            const bigrig::sim_result_t &result) {
+  os << tree.node_count() << " " << result.region_count() << "\n";
+  tree.to_phylip_body(os, result, true);
+}
 
+/**
+ * Produce a phylip file as a string.
+ */
+std::string to_phylip(const bigrig::tree_t       &tree,
+                      const bigrig::sim_result_t &result) {
+  std::ostringstream oss;
+  write_phylip(oss, tree, result);
   return oss.str();
 }
 
 /**
  * Produce a phylip file as a string, including inner nodes.
  */
-std::string to_phylip_all_nodes(const bigrig::tree_t &tree) {
+std::string to_phylip_all_nodes(const bigrig::tree_t       &tree,
+                                const bigrig::sim_result_t &result) {
   std::ostringstream oss;
-  oss << std::to_string(tree.node_count()) << " " << tree.region_count()
-      << "\n";
-
-  tree.to_phylip_body(oss, true);
-
+  write_phylip_all_nodes(oss, tree, result);
   return oss.str();
 }
 
@@ -178,6 +244,32 @@ std::string to_phylip_all_nodes(const bigrig::tree_t &tree) {
   return ok;
 }
 
+/**
+ * The tree cache is optional, but if it is given, it has to be a directory we
+ * can write to. It is made if it doesn't exist.
+ */
+[[nodiscard]] bool validate_and_make_tree_cache(
+    const std::optional<std::filesystem::path> &tree_cache_option) {
+  if (!tree_cache_option.has_value()) { return true; }
+  const auto &tree_cache = tree_cache_option.value();
+
+  if (!std::filesystem::exists(tree_cache)) {
+    try {
+      std::filesystem::create_directories(tree_cache);
+    } catch (const std::filesystem::filesystem_error &err) {
+      LOG_ERROR("%s", err.what());
+      return false;
+    }
+  } else if (!std::filesystem::is_directory(tree_cache)) {
+    LOG_ERROR("The tree cache '%s' is not a directory", tree_cache.c_str());
+    return false;
+  } else if (!verify_path_is_writable(tree_cache)) {
+    LOG_ERROR("The tree cache '%s' is not writable", tree_cache.c_str());
+    return false;
+  }
+  return true;
+}
+
 [[nodiscard]] bool validate_model_parameter(const std::optional<double> &param,
                                             const char                  *name) {
   bool ok = true;
@@ -236,6 +328,305 @@ validate_root_region(const std::optional<bigrig::dist_t> &root_range,
   return ok;
 }
 
+[[nodiscard]] bool
+validate_replicates(const std::optional<size_t> &replicates,
+                    const std::optional<size_t> &threads) {
+  bool ok = true;
+  if (replicates.has_value() && replicates.value() == 0) {
+    MESSAGE_ERROR("The number of replicates must be at least 1");
+    ok = false;
+  }
+  if (threads.has_value() && threads.value() == 0) {
+    MESSAGE_ERROR("The number of threads must be at least 1");
+    ok = false;
+  }
+  return ok;
+}
+
+/**
+ * A sweep is either a table or a grid, and the table has to be readable. The
+ * values themselves are checked once the points are made.
+ */
+[[nodiscard]] bool validate_sweep(const cli_options_t &cli_options) {
+  if (!cli_options.sweep_mode()) { return true; }
+  bool ok = true;
+  if (cli_options.sweep_table.has_value() && !cli_options.sweep_axes.empty()) {
+    MESSAGE_ERROR("A sweep can either use a table or a grid, but not both");
+    ok = false;
+  }
+  if (cli_options.sweep_table.has_value()) {
+    const auto &table = cli_options.sweep_table.value();
+    if (!std::filesystem::exists(table)) {
+      LOG_ERROR("The sweep table %s does not exist", table.c_str());
+      ok = false;
+    } else if (!verify_path_is_readable(table)) {
+      LOG_ERROR("We don't have the permissions to read the sweep table %s",
+                table.c_str());
+      ok = false;
+    }
+  }
+  for (const auto &axis : cli_options.sweep_axes) {
+    if (axis.values.empty()) {
+      LOG_ERROR("The sweep over '%s' has no values",
+                std::string{bigrig::to_string(axis.param)}.c_str());
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+/**
+ * Make the points of the sweep from the table or the grid, and check the
+ * values.
+ */
+[[nodiscard]] bool make_sweep_points(cli_options_t &cli_options) {
+  if (!cli_options.sweep_mode()) { return true; }
+  if (cli_options.sweep_table.has_value()) {
+    auto points = bigrig::read_sweep_table(cli_options.sweep_table.value());
+    if (!points.has_value()) { return false; }
+    cli_options.sweep_points = std::move(points.value());
+  } else {
+    cli_options.sweep_points = bigrig::make_sweep_grid(cli_options.sweep_axes);
+  }
+
+  bool ok = true;
+  for (const auto &point : cli_options.sweep_points) {
+    for (size_t i = 0; i < bigrig::SWEEP_PARAM_COUNT; ++i) {
+      auto param = static_cast<bigrig::sweep_param_e>(i);
+      auto value = point.get(param);
+      if (!value.has_value()) { continue; }
+      ok &= validate_model_parameter(
+          value, std::string{bigrig::to_string(param)}.c_str());
+    }
+  }
+  return ok;
+}
+
+/**
+ * The root ranges either come from a prior, or are every range, and replace
+ * the root range option. Every range needs to be enumerated, so that is only
+ * done for small region counts. The ranges of a prior are checked once they
+ * are read.
+ */
+[[nodiscard]] bool validate_roots(const cli_options_t &cli_options) {
+  if (!cli_options.root_mode()) { return true; }
+  bool ok  = true;
+  bool all = cli_options.all_root_ranges.value_or(false);
+  if (cli_options.root_prior.has_value() && all) {
+    MESSAGE_ERROR("The root ranges can either come from a prior or be every "
+                  "range, but not both");
+    ok = false;
+  }
+  if (cli_options.root_range.has_value()) {
+    MESSAGE_ERROR("A root range can't be given with a root prior or with "
+                  "all-root-ranges");
+    ok = false;
+  }
+  if (cli_options.root_prior.has_value()) {
+    const auto &prior = cli_options.root_prior.value();
+    if (!std::filesystem::exists(prior)) {
+      LOG_ERROR("The root prior %s does not exist", prior.c_str());
+      ok = false;
+    } else if (!verify_path_is_readable(prior)) {
+      LOG_ERROR("We don't have the permissions to read the root prior %s",
+                prior.c_str());
+      ok = false;
+    }
+  }
+  if (all && !cli_options.region_count.has_value()) {
+    MESSAGE_ERROR("Simulating every root range needs a region count");
+    ok = false;
+  }
+  if (all && cli_options.region_count.has_value()
+      && cli_options.region_count.value()
+             > bigrig::ALL_ROOT_RANGES_MAX_REGIONS) {
+    LOG_ERROR("Simulating every root range supports at most %lu regions, but "
+              "%lu regions were requested. Please use a root prior instead",
+              bigrig::ALL_ROOT_RANGES_MAX_REGIONS,
+              cli_options.region_count.value());
+    ok = false;
+  }
+  return ok;
+}
+
+[[nodiscard]] bool
+validate_mode(const std::optional<bigrig::operation_mode_e> &mode,
+              const std::optional<bigrig::dist_t>           &root_range,
+              const std::optional<size_t>                   &region_count) {
+  if (!mode.has_value()) { return true; }
+  size_t regions = root_range.has_value() ? root_range.value().regions()
+                                          : region_count.value_or(0);
+  if (mode.value() == bigrig::operation_mode_e::ENDPOINT
+      && regions > bigrig::ENDPOINT_MAX_REGIONS) {
+    LOG_ERROR("Endpoint mode supports at most %lu regions, but %lu regions "
+              "were requested",
+              bigrig::ENDPOINT_MAX_REGIONS,
+              regions);
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Make the root ranges from the prior or from every range, and check them like
+ * a root range option. The first range stands in for the root range option,
+ * e.g. for the region count.
+ */
+[[nodiscard]] bool make_root_ranges(cli_options_t &cli_options) {
+  if (!cli_options.root_mode()) { return true; }
+  if (cli_options.root_prior.has_value()) {
+    auto roots = bigrig::read_root_prior(cli_options.root_prior.value());
+    if (!roots.has_value()) { return false; }
+    cli_options.roots = std::move(roots.value());
+  } else {
+    cli_options.roots
+        = bigrig::make_all_root_ranges(cli_options.region_count.value());
+  }
+
+  bool ok = true;
+  for (const auto &root : cli_options.roots) {
+    ok &= validate_root_region(root.range, cli_options.region_count);
+    if (!ok) { break; }
+  }
+  const auto &first = cli_options.roots.front().range;
+  ok &= validate_mode(cli_options.mode, first, {});
+  cli_options.root_range = first;
+  return ok;
+}
+
+/**
+ * In lazy events mode, the replicates asked for have to exist.
+ */
+[[nodiscard]] bool validate_lazy_events(const cli_options_t &cli_options) {
+  if (!cli_options.lazy_events_mode()) { return true; }
+  bool   ok         = true;
+  size_t replicates = cli_options.replicates.value_or(1);
+  for (auto replicate : cli_options.event_replicates) {
+    if (replicate >= replicates) {
+      LOG_ERROR("Can't write the events of replicate %lu, there are only %lu "
+                "replicates",
+                replicate,
+                replicates);
+      ok = false;
+    }
+  }
+  if (cli_options.stats_only_mode()
+      || cli_options.mode.value_or(bigrig::operation_mode_e::FAST)
+             == bigrig::operation_mode_e::ENDPOINT) {
+    LOG_WARNING("Lazy events were asked for, but no events are simulated in "
+                "this mode, so there are none to regenerate");
+  }
+  return ok;
+}
+
+/**
+ * Conditioned replicates are simulated one node at a time, so they can't be
+ * simulated with the subtrees in parallel.
+ */
+[[nodiscard]] bool validate_conditions(const cli_options_t &cli_options) {
+  if (!cli_options.conditioned_mode()) {
+    if (cli_options.restart_subtree.has_value()
+        || cli_options.max_restarts.has_value()) {
+      LOG_WARNING("Restart options were given without any conditions, so "
+                  "they are ignored");
+    }
+    return true;
+  }
+  bool        ok       = true;
+  const auto &filename = cli_options.conditions_file.value();
+  if (!std::filesystem::exists(filename)) {
+    LOG_ERROR("The conditions file %s does not exist", filename.c_str());
+    ok = false;
+  } else if (!verify_path_is_readable(filename)) {
+    LOG_ERROR("We don't have the permissions to read the conditions file %s",
+              filename.c_str());
+    ok = false;
+  }
+  if (cli_options.parallel_tree_mode()) {
+    LOG_ERROR("Conditioned replicates can't be simulated with the parallel "
+              "tree mode");
+    ok = false;
+  }
+  return ok;
+}
+
+/**
+ * Read the conditions from their file. They are attached to the tree once it
+ * is parsed.
+ */
+[[nodiscard]] bool read_condition_file(cli_options_t &cli_options) {
+  if (!cli_options.conditioned_mode()) { return true; }
+  auto conditions
+      = bigrig::read_conditions(cli_options.conditions_file.value());
+  if (!conditions.has_value()) { return false; }
+  cli_options.conditions = std::move(conditions.value());
+  return true;
+}
+
+/**
+ * A shard needs both its index and the number of shards. Every shard has to
+ * draw from the same random streams, so the seed has to be given.
+ */
+[[nodiscard]] bool validate_shard(const cli_options_t &cli_options) {
+  if (!cli_options.shard_index.has_value()
+      && !cli_options.shard_count.has_value()) {
+    return true;
+  }
+  if (!cli_options.shard_index.has_value()
+      || !cli_options.shard_count.has_value()) {
+    LOG_ERROR("A shard needs both the shard index and the shard count");
+    return false;
+  }
+  bool ok = true;
+  if (cli_options.shard_count.value() == 0
+      || cli_options.shard_index.value() >= cli_options.shard_count.value()) {
+    LOG_ERROR("The shard index %lu is not less than the shard count %lu",
+              cli_options.shard_index.value(),
+              cli_options.shard_count.value());
+    ok = false;
+  }
+  if (cli_options.shard_mode() && !cli_options.rng_seed.has_value()) {
+    LOG_ERROR("A shard needs a seed, so that it gets the same results as the "
+              "full run");
+    ok = false;
+  }
+  return ok;
+}
+
+/**
+ * The jobs of a jobs file are each a whole run, so they can't be split into
+ * shards as well.
+ */
+[[nodiscard]] bool validate_jobs_file(const cli_options_t &cli_options) {
+  if (!cli_options.jobs_mode()) { return true; }
+  bool        ok       = true;
+  const auto &filename = cli_options.jobs_file.value();
+  if (!std::filesystem::exists(filename)) {
+    LOG_ERROR("The jobs file %s does not exist", filename.c_str());
+    ok = false;
+  } else if (!verify_path_is_readable(filename)) {
+    LOG_ERROR("We don't have the permissions to read the jobs file %s",
+              filename.c_str());
+    ok = false;
+  }
+  if (cli_options.shard_index.has_value()
+      || cli_options.shard_count.has_value()) {
+    LOG_ERROR("A jobs file can't be split into shards");
+    ok = false;
+  }
+  return ok;
+}
+
+[[nodiscard]] bool
+validate_compression(bigrig::compression_type_e compression) {
+  if (!bigrig::compression_supported(compression)) {
+    MESSAGE_ERROR("Compressed output was requested, but this build of bigrig "
+                  "does not support it. Rebuild with ENABLE_GZIP=ON");
+    return false;
+  }
+  return true;
+}
+
 /**
  * Check that the program options are valid
  *
@@ -249,7 +640,21 @@ validate_root_region(const std::optional<bigrig::dist_t> &root_range,
 
   ok &= validate_tree_filename(cli_options.tree_filename);
   ok &= validate_and_make_prefix(cli_options.prefix);
-  ok &= validate_root_region(cli_options.root_range, cli_options.region_count);
+  ok &= validate_and_make_tree_cache(cli_options.tree_cache);
+  if (!cli_options.root_mode()) {
+    ok &= validate_root_region(cli_options.root_range,
+                               cli_options.region_count);
+  }
+  ok &= validate_replicates(cli_options.replicates, cli_options.threads);
+  ok &= validate_mode(
+      cli_options.mode, cli_options.root_range, cli_options.region_count);
+  ok &= validate_compression(cli_options.compression());
+  ok &= validate_sweep(cli_options);
+  ok &= validate_roots(cli_options);
+  ok &= validate_conditions(cli_options);
+  ok &= validate_lazy_events(cli_options);
+  ok &= validate_shard(cli_options);
+  ok &= validate_jobs_file(cli_options);
 
   for (const auto &p : cli_options.periods) {
     ok &= validate_model_parameter(p.rates.dis, "dispersion");
@@ -296,6 +701,39 @@ bool normalize_paths(cli_options_t &cli_options) {
               err.what());
     ok = false;
   } catch (const std::bad_optional_access &err) { return false; }
+  if (cli_options.sweep_table.has_value()) {
+    try {
+      cli_options.sweep_table = std::filesystem::weakly_canonical(
+          std::filesystem::absolute(cli_options.sweep_table.value()));
+    } catch (const std::filesystem::filesystem_error &err) {
+      LOG_ERROR("Failed to canonicalize '%s' because '%s'",
+                cli_options.sweep_table.value().c_str(),
+                err.what());
+      ok = false;
+    }
+  }
+  if (cli_options.conditions_file.has_value()) {
+    try {
+      cli_options.conditions_file = std::filesystem::weakly_canonical(
+          std::filesystem::absolute(cli_options.conditions_file.value()));
+    } catch (const std::filesystem::filesystem_error &err) {
+      LOG_ERROR("Failed to canonicalize '%s' because '%s'",
+                cli_options.conditions_file.value().c_str(),
+                err.what());
+      ok = false;
+    }
+  }
+  if (cli_options.root_prior.has_value()) {
+    try {
+      cli_options.root_prior = std::filesystem::weakly_canonical(
+          std::filesystem::absolute(cli_options.root_prior.value()));
+    } catch (const std::filesystem::filesystem_error &err) {
+      LOG_ERROR("Failed to canonicalize '%s' because '%s'",
+                cli_options.root_prior.value().c_str(),
+                err.what());
+      ok = false;
+    }
+  }
   try {
     cli_options.prefix = std::filesystem::weakly_canonical(
         std::filesystem::absolute(cli_options.prefix.value()));
@@ -317,6 +755,36 @@ bool normalize_paths(cli_options_t &cli_options) {
 [[nodiscard]] bool check_existing_results(const cli_options_t &cli_options) {
   bool ok = true;
 
+  if (cli_options.sweep_mode()
+      && std::filesystem::exists(cli_options.csv_sweep_filename())) {
+    LOG_WARNING("Results file %s exists already",
+                cli_options.csv_sweep_filename().c_str());
+    ok = false;
+  }
+
+  if (cli_options.root_mode()
+      && std::filesystem::exists(cli_options.csv_roots_filename())) {
+    LOG_WARNING("Results file %s exists already",
+                cli_options.csv_roots_filename().c_str());
+    ok = false;
+  }
+
+  if (cli_options.writes_shard_index()
+      && std::filesystem::exists(cli_options.csv_shards_filename())) {
+    LOG_WARNING("Results file %s exists already",
+                cli_options.csv_shards_filename().c_str());
+    ok = false;
+  }
+
+  if (cli_options.binary_file_set()) {
+    if (std::filesystem::exists(cli_options.binary_filename())) {
+      LOG_WARNING("Results file %s exists already",
+                  cli_options.binary_filename().c_str());
+      ok = false;
+    }
+    return ok;
+  }
+
   if (std::filesystem::exists(cli_options.phylip_filename())) {
     LOG_WARNING("Results file %s exists already",
                 cli_options.phylip_filename().c_str());
@@ -381,8 +849,8 @@ void write_yaml_value(YAML::Emitter        &yaml,
   yaml << YAML::Key << label << YAML::Value << value.to_str();
 }
 
-void write_yaml_tree(YAML::Emitter &yaml, const bigrig::tree_t &tree) {
-  write_yaml_value(yaml, "tree", tree.to_newick());
+void write_yaml_tree(YAML::Emitter &yaml, const std::string &newick) {
+  write_yaml_value(yaml, "tree", newick);
 }
 
 void write_yaml_taxa(YAML::Emitter &yaml, const bigrig::tree_t &tree) {
@@ -398,52 +866,56 @@ void write_yaml_root_range(YAML::Emitter        &yaml,
   write_yaml_value(yaml, "root-range", root_dist);
 }
 
-void write_yaml_alignment(YAML::Emitter &yaml, const bigrig::tree_t &tree) {
+void write_yaml_alignment(YAML::Emitter              &yaml,
+                          const bigrig::tree_t       &tree,
+                          const bigrig::sim_result_t &result) {
   yaml << YAML::Key << "align";
   yaml << YAML::BeginMap;
 
   for (const auto &n : tree) {
-    yaml << YAML::Key << n->string_id() << YAML::Value
-         << n->final_state().to_str();
+    yaml << YAML::Key << n.string_id() << YAML::Value
+         << result.final_state(n.index()).to_str();
   }
   yaml << YAML::EndMap;
 }
 
-void write_yaml_splits(YAML::Emitter &yaml, const bigrig::tree_t &tree) {
+void write_yaml_splits(YAML::Emitter              &yaml,
+                       const bigrig::tree_t       &tree,
+                       const bigrig::sim_result_t &result) {
   yaml << YAML::Key << "splits";
   yaml << YAML::BeginMap;
   for (const auto &n : tree) {
-    if (n->is_leaf()) { continue; }
-    yaml << YAML::Key << n->node_id();
+    if (n.is_leaf()) { continue; }
+    const auto &split = result.node_split(n.index());
+    yaml << YAML::Key << n.node_id();
     yaml << YAML::BeginMap;
-    yaml << YAML::Key << "left" << YAML::Value << n->node_split().left.to_str();
-    yaml << YAML::Key << "right" << YAML::Value
-         << n->node_split().right.to_str();
-    yaml << YAML::Key << "type" << YAML::Value
-         << n->node_split().to_type_string();
-    yaml << YAML::Key << "period" << YAML::Value
-         << n->node_split().period_index;
+    yaml << YAML::Key << "left" << YAML::Value << split.left.to_str();
+    yaml << YAML::Key << "right" << YAML::Value << split.right.to_str();
+    yaml << YAML::Key << "type" << YAML::Value << split.to_type_string();
+    yaml << YAML::Key << "period" << YAML::Value << split.period_index;
     yaml << YAML::EndMap;
   }
   yaml << YAML::EndMap;
 }
 
-void write_yaml_events(YAML::Emitter &yaml, const bigrig::tree_t &tree) {
+void write_yaml_events(YAML::Emitter              &yaml,
+                       const bigrig::tree_t       &tree,
+                       const bigrig::sim_result_t &result) {
   yaml << YAML::Key << "events";
   yaml << YAML::BeginMap;
   for (auto const &n : tree) {
-    if (n->is_leaf()) { continue; }
+    if (n.is_leaf()) { continue; }
 
-    for (const auto &c : n->children()) {
+    for (const auto &c : n.children()) {
       yaml << YAML::Key
-           << std::format("{} -> {}", n->string_id(), c->string_id());
+           << std::format("{} -> {}", n.string_id(), c.string_id());
       yaml << YAML::BeginSeq;
       double total_time = 0;
-      for (auto const &t : c->transitions()) {
+      for (auto const &t : result.transitions(c.index())) {
         total_time += t.waiting_time;
         yaml << YAML::BeginMap;
         yaml << YAML::Key << "abs-time" << YAML::Value
-             << n->abs_time() + total_time;
+             << n.abs_time() + total_time;
         yaml << YAML::Key << "waiting-time" << YAML::Value << t.waiting_time;
         yaml << YAML::Key << "initial-state" << YAML::Value
              << t.initial_state.to_str();
@@ -458,6 +930,39 @@ void write_yaml_events(YAML::Emitter &yaml, const bigrig::tree_t &tree) {
   yaml << YAML::EndMap;
 }
 
+/**
+ * The event counts for a period, or all zeros if nothing happened in it.
+ */
+bigrig::period_stats_t
+get_period_stats(const bigrig::sim_result_t &result, size_t period_index) {
+  const auto &stats = result.period_stats();
+  if (period_index < stats.size()) { return stats[period_index]; }
+  return {};
+}
+
+void write_yaml_event_counts(YAML::Emitter                       &yaml,
+                             const bigrig::sim_result_t          &result,
+                             const std::vector<bigrig::period_t> &periods) {
+  yaml << YAML::Key << "event-counts";
+  yaml << YAML::BeginSeq;
+  for (const auto &p : periods) {
+    auto stats = get_period_stats(result, p.index());
+    yaml << YAML::BeginMap;
+    yaml << YAML::Key << "period" << YAML::Value << p.index();
+    yaml << YAML::Key << "dispersions" << YAML::Value << stats.dispersions;
+    yaml << YAML::Key << "extinctions" << YAML::Value << stats.extinctions;
+    yaml << YAML::Key << "splits";
+    yaml << YAML::BeginMap;
+    yaml << YAML::Key << "singleton" << YAML::Value << stats.singleton_splits;
+    yaml << YAML::Key << "allopatric" << YAML::Value << stats.allopatric_splits;
+    yaml << YAML::Key << "sympatric" << YAML::Value << stats.sympatric_splits;
+    yaml << YAML::Key << "jump" << YAML::Value << stats.jump_splits;
+    yaml << YAML::EndMap;
+    yaml << YAML::EndMap;
+  }
+  yaml << YAML::EndSeq;
+}
+
 void write_yaml_period(YAML::Emitter &yaml, const bigrig::period_t &period) {
   auto &model = period.model();
   yaml << YAML::BeginMap;
@@ -499,7 +1004,7 @@ void write_yaml_period(YAML::Emitter &yaml, const bigrig::period_t &period) {
   yaml << YAML::Value << jump;
   yaml << YAML::EndMap;
 
-  yaml << YAML::EndSeq;
+  yaml << YAML::EndMap;
 }
 
 void write_yaml_period_list(YAML::Emitter                       &yaml,
@@ -510,6 +1015,33 @@ void write_yaml_period_list(YAML::Emitter                       &yaml,
 
   for (const auto &p : periods) { write_yaml_period(yaml, p); }
 
+  yaml << YAML::EndSeq;
+}
+
+/**
+ * Write the counters, and the time of each phase which was run. The phases
+ * only have times in the stats of a whole run.
+ */
+void write_yaml_instrument_counts(YAML::Emitter                     &yaml,
+                                  const bigrig::instrument_counts_t &counts) {
+  for (size_t i = 0; i < bigrig::COUNTER_COUNT; ++i) {
+    auto counter = static_cast<bigrig::counter_e>(i);
+    write_yaml_value(
+        yaml, std::string{bigrig::to_string(counter)}, counts.count(counter));
+  }
+
+  bool any_phase = false;
+  for (auto ns : counts.phase_nanoseconds) { any_phase |= ns != 0; }
+  if (!any_phase) { return; }
+
+  yaml << YAML::Key << "phases";
+  yaml << YAML::BeginMap;
+  for (size_t i = 0; i < bigrig::PHASE_COUNT; ++i) {
+    auto phase = static_cast<bigrig::phase_e>(i);
+    if (counts.phase_nanoseconds[i] == 0) { continue; }
+    write_yaml_value(
+        yaml, std::string{bigrig::to_string(phase)}, counts.seconds(phase));
+  }
   yaml << YAML::EndMap;
 }
 
@@ -520,191 +1052,467 @@ void write_yaml_program_stats(YAML::Emitter         &yaml,
   yaml << YAML::Key << "time";
   yaml << YAML::Value;
   yaml << program_stats.execution_time_in_seconds();
+  if (program_stats.counts.has_value()) {
+    write_yaml_instrument_counts(yaml, program_stats.counts.value());
+  }
+  if (auto rate = program_stats.events_per_second()) {
+    write_yaml_value(yaml, "events-per-second", rate.value());
+  }
+  if (program_stats.peak_memory.has_value()) {
+    write_yaml_value(yaml, "peak-memory", program_stats.peak_memory.value());
+  }
   yaml << YAML::EndMap;
 }
 
+void write_yaml_replicate(YAML::Emitter &yaml, size_t replicate) {
+  write_yaml_value(yaml, "replicate", replicate);
+}
+
 /**
  * Write the output as a YAML file.
+ *
+ * If a replicate index is given, the results are written as a separate YAML
+ * document, so that the results of a batch can be appended to the same file.
+ * The documents of a sweep are also tagged with the index of the point, and
+ * the documents of a root prior with the index of the root range.
+ *
+ * The emitter writes straight to the stream, so the document is never built in
+ * memory.
  */
 void write_yaml_file(std::ostream                        &os,
                      const bigrig::tree_t                &tree,
+                     const std::string                   &newick,
+                     const bigrig::sim_result_t          &result,
                      const std::vector<bigrig::period_t> &periods,
-                     const program_stats_t               &program_stats) {
-  YAML::Emitter yaml;
+                     const program_stats_t               &program_stats,
+                     std::optional<size_t>                replicate = {},
+                     std::optional<size_t>                point     = {},
+                     std::optional<size_t>                root      = {}) {
+  YAML::Emitter yaml{os};
+  if (replicate.has_value() || point.has_value() || root.has_value()) {
+    yaml << YAML::BeginDoc;
+  }
   yaml << YAML::BeginMap;
 
-  write_yaml_tree(yaml, tree);
-  write_yaml_regions(yaml, tree.region_count());
-  write_yaml_root_range(yaml, tree.get_root_range());
-  write_yaml_alignment(yaml, tree);
-  write_yaml_splits(yaml, tree);
-  write_yaml_events(yaml, tree);
+  if (point.has_value()) { write_yaml_value(yaml, "point", point.value()); }
+  if (root.has_value()) { write_yaml_value(yaml, "root", root.value()); }
+  if (replicate.has_value()) { write_yaml_replicate(yaml, replicate.value()); }
+  write_yaml_tree(yaml, newick);
+  write_yaml_regions(yaml, result.region_count());
+  write_yaml_root_range(yaml, result.root_range());
+  write_yaml_alignment(yaml, tree, result);
+  write_yaml_splits(yaml, tree, result);
+  if (result.stats_only()) {
+    write_yaml_event_counts(yaml, result, periods);
+  } else {
+    write_yaml_events(yaml, tree, result);
+  }
   write_yaml_period_list(yaml, periods);
   write_yaml_program_stats(yaml, program_stats);
 
   yaml << YAML::EndMap;
-  os << yaml.c_str() << std::endl;
+  os << "\n";
 }
 
-void write_json_file(std::ostream                        &os,
-                     const bigrig::tree_t                &tree,
-                     const std::vector<bigrig::period_t> &periods,
-                     const program_stats_t               &program_stats) {
-  nlohmann::json j;
+/**
+ * A small streaming JSON writer. It only remembers whether the next value needs
+ * a comma in front of it, so a document of any size is written in constant
+ * memory. Values are serialized by nlohmann, so they look exactly like they
+ * would with `json::dump()`.
+ */
+class json_stream_t {
+public:
+  explicit json_stream_t(std::ostream &os) : _os{os} {}
+
+  void begin_object() { open('{'); }
+  void end_object() { close('}'); }
+  void begin_array() { open('['); }
+  void end_array() { close(']'); }
+
+  void key(std::string_view key) {
+    separate();
+    _os << nlohmann::json(key) << ':';
+    _after_key = true;
+  }
 
-  j["tree"]          = tree.to_newick();
-  j["taxa"]          = tree.leaf_count();
-  j["regions"]       = tree.region_count();
-  j["root-range"]    = tree.get_root_range().to_str();
-  j["stats"]["time"] = program_stats.execution_time_in_seconds();
+  template <typename T> void value(const T &value) {
+    separate();
+    _os << nlohmann::json(value);
+  }
 
-  for (const auto &n : tree) {
-    j["align"][n->string_id()] = n->final_state().to_str();
+  template <typename T> void member(std::string_view key, const T &value) {
+    this->key(key);
+    this->value(value);
   }
 
-  for (const auto &n : tree) {
-    if (n->is_leaf()) { continue; }
-    auto split                  = n->node_split();
-    j["splits"][n->string_id()] = {
-        {"left", split.left.to_str()},
-        {"right", split.right.to_str()},
-        {"type", split.to_type_string()},
-        {"period", split.period_index},
-    };
+private:
+  void open(char c) {
+    separate();
+    _os << c;
+    _first = true;
   }
 
+  void close(char c) {
+    _os << c;
+    _first = false;
+  }
+
+  void separate() {
+    if (_after_key) {
+      _after_key = false;
+      return;
+    }
+    if (!_first) { _os << ','; }
+    _first = false;
+  }
+
+  std::ostream &_os;
+  bool          _first     = true;
+  bool          _after_key = false;
+};
+
+bool has_transitions(const bigrig::tree_t       &tree,
+                     const bigrig::sim_result_t &result) {
+  for (size_t index = 0; index < tree.node_count(); ++index) {
+    if (!result.transitions(index).empty()) { return true; }
+  }
+  return false;
+}
+
+/**
+ * Write the output as a JSON object, on a single line.
+ *
+ * If a replicate index is given, it is included in the object. The results of
+ * a batch are then a JSON lines file, with one object per replicate. The same
+ * goes for the index of the point in a sweep, and of the root range of a root
+ * prior.
+ *
+ * The object is written as the tree is walked. The top level keys are in the
+ * same order that nlohmann would put them in, but the nodes are in tree order.
+ */
+void write_json_file(std::ostream                        &os,
+                     const bigrig::tree_t                &tree,
+                     const std::string                   &newick,
+                     const bigrig::sim_result_t          &result,
+                     const std::vector<bigrig::period_t> &periods,
+                     const program_stats_t               &program_stats,
+                     std::optional<size_t>                replicate = {},
+                     std::optional<size_t>                point     = {},
+                     std::optional<size_t>                root      = {}) {
+  json_stream_t json{os};
+  json.begin_object();
+
+  json.key("align");
+  json.begin_object();
   for (const auto &n : tree) {
-    if (n->is_leaf()) { continue; }
-    for (const auto &c : n->children()) {
-      auto   node_key = std::format("{} -> {}", n->string_id(), c->string_id());
-      double total_time = 0;
-      for (const auto &t : c->transitions()) {
-        total_time += t.waiting_time;
-        j["events"][node_key].push_back({
-            {"abs-time", n->abs_time() + total_time},
-            {"waiting_time", t.waiting_time},
-            {"initial-state", t.initial_state.to_str()},
-            {"final-state", t.final_state.to_str()},
-            {"period", t.period_index},
-        });
+    json.member(n.string_id(), result.final_state(n.index()).to_str());
+  }
+  json.end_object();
+
+  if (result.stats_only() && !periods.empty()) {
+    json.key("event-counts");
+    json.begin_array();
+    for (const auto &p : periods) {
+      auto stats = get_period_stats(result, p.index());
+      json.value(nlohmann::json{
+          {"period", p.index()},
+          {"dispersions", stats.dispersions},
+          {"extinctions", stats.extinctions},
+          {"splits",
+           {
+               {"singleton", stats.singleton_splits},
+               {"allopatric", stats.allopatric_splits},
+               {"sympatric", stats.sympatric_splits},
+               {"jump", stats.jump_splits},
+           }},
+      });
+    }
+    json.end_array();
+  }
+
+  if (has_transitions(tree, result)) {
+    json.key("events");
+    json.begin_object();
+    for (const auto &n : tree) {
+      if (n.is_leaf()) { continue; }
+      for (const auto &c : n.children()) {
+        auto transitions = result.transitions(c.index());
+        if (transitions.empty()) { continue; }
+
+        json.key(std::format("{} -> {}", n.string_id(), c.string_id()));
+        json.begin_array();
+        double total_time = 0;
+        for (const auto &t : transitions) {
+          total_time += t.waiting_time;
+          json.value(nlohmann::json{
+              {"abs-time", n.abs_time() + total_time},
+              {"waiting_time", t.waiting_time},
+              {"initial-state", t.initial_state.to_str()},
+              {"final-state", t.final_state.to_str()},
+              {"period", t.period_index},
+          });
+        }
+        json.end_array();
       }
     }
+    json.end_object();
   }
 
-  for (const auto &p : periods) {
-    auto &model                   = p.model();
-    auto [dis, ext]               = model.rates();
-    auto [allo, symp, copy, jump] = model.cladogenesis_params();
+  if (!periods.empty()) {
+    json.key("periods");
+    json.begin_array();
+    for (const auto &p : periods) {
+      auto &model                   = p.model();
+      auto [dis, ext]               = model.rates();
+      auto [allo, symp, copy, jump] = model.cladogenesis_params();
+
+      json.value(nlohmann::json{{"start", p.start()},
+                                {"rates",
+                                 {
+                                     {"dispersion", dis},
+                                     {"extinction", ext},
+                                 }},
+                                {"cladogenesis",
+                                 {
+                                     {"allopatry", allo},
+                                     {"sympatry", symp},
+                                     {"copy", copy},
+                                     {"jump", jump},
+                                 }}});
+    }
+    json.end_array();
+  }
+
+  if (point.has_value()) { json.member("point", point.value()); }
+  json.member("regions", result.region_count());
+  if (replicate.has_value()) { json.member("replicate", replicate.value()); }
+  if (root.has_value()) { json.member("root", root.value()); }
+  json.member("root-range", result.root_range().to_str());
+
+  if (tree.node_count() > 1) {
+    json.key("splits");
+    json.begin_object();
+    for (const auto &n : tree) {
+      if (n.is_leaf()) { continue; }
+      const auto &split = result.node_split(n.index());
+      json.member(n.string_id(),
+                  nlohmann::json{
+                      {"left", split.left.to_str()},
+                      {"right", split.right.to_str()},
+                      {"type", split.to_type_string()},
+                      {"period", split.period_index},
+                  });
+    }
+    json.end_object();
+  }
 
-    j["periods"].push_back({{"start", p.start()},
-                            {"rates",
-                             {
-                                 {"dispersion", dis},
-                                 {"extinction", ext},
-                             }},
-                            {"cladogenesis",
-                             {
-                                 {"allopatry", allo},
-                                 {"sympatry", symp},
-                                 {"copy", copy},
-                                 {"jump", jump},
-                             }}});
+  json.key("stats");
+  json.begin_object();
+  json.member("time", program_stats.execution_time_in_seconds());
+  if (program_stats.counts.has_value()) {
+    const auto &counts = program_stats.counts.value();
+    for (size_t i = 0; i < bigrig::COUNTER_COUNT; ++i) {
+      auto counter = static_cast<bigrig::counter_e>(i);
+      json.member(bigrig::to_string(counter), counts.count(counter));
+    }
+  }
+  if (auto rate = program_stats.events_per_second()) {
+    json.member("events-per-second", rate.value());
   }
+  json.end_object();
+
+  json.member("taxa", tree.leaf_count());
+  json.member("tree", newick);
 
-  os << j.dump() << std::endl;
+  json.end_object();
+  os << "\n";
 }
 
-template <typename T, size_t N>
-inline std::string make_csv_row(const std::array<T, N> &entries) {
-  return std::accumulate(std::next(entries.begin()),
-                         entries.end(),
-                         std::string(*entries.begin()),
-                         [](const T &acc, const T &entry) -> std::string {
-                           return acc + ", " + entry;
-                         })
-       + "\n";
+inline void write_csv_field(std::ostream &os, std::string_view field) {
+  os << field;
 }
 
-template <size_t N>
-inline std::string make_csv_row(const std::array<std::string_view, N> &fields) {
-  return std::accumulate(
-             std::next(fields.begin()),
-             fields.end(),
-             std::string(*fields.begin()),
-             [](std::string acc, const std::string_view &entry) -> std::string {
-               acc += ", ";
-               acc += entry;
-               return acc;
-             })
-       + "\n";
+inline void write_csv_field(std::ostream &os, const std::string &field) {
+  os << field;
+}
+
+inline void write_csv_field(std::ostream &os, size_t field) { os << field; }
+
+/**
+ * Doubles are written like `std::to_string` does, but without making a string.
+ */
+inline void write_csv_field(std::ostream &os, double field) {
+  std::array<char, 512> buffer;
+  auto [end, ec] = std::to_chars(buffer.data(),
+                                 buffer.data() + buffer.size(),
+                                 field,
+                                 std::chars_format::fixed,
+                                 6);
+  if (ec != std::errc{}) {
+    os << std::to_string(field);
+    return;
+  }
+  os.write(buffer.data(), end - buffer.data());
+}
+
+inline void write_csv_field(std::ostream &os, bigrig::dist_t field) {
+  os << field;
+}
+
+/**
+ * The indices a CSV row is tagged with, if there are any.
+ */
+struct csv_tag_t {
+  std::optional<size_t> replicate;
+  std::optional<size_t> point;
+  std::optional<size_t> root;
+};
+
+/**
+ * Write a CSV row straight to the stream. The row is prefixed with the index
+ * of the sweep point, the root range and the replicate, if there are any.
+ */
+template <typename... Ts>
+inline void
+write_csv_row(std::ostream &os, const csv_tag_t &tag, const Ts &...fields) {
+  if (tag.point.has_value()) { os << tag.point.value() << ", "; }
+  if (tag.root.has_value()) { os << tag.root.value() << ", "; }
+  if (tag.replicate.has_value()) { os << tag.replicate.value() << ", "; }
+  const char *separator = "";
+  ((os << separator, write_csv_field(os, fields), separator = ", "), ...);
+  os << "\n";
 }
 
 template <size_t N>
-inline std::string make_csv_row(const std::array<double, N> &fields) {
-  return std::accumulate(
-             std::next(fields.begin()),
-             fields.end(),
-             std::to_string(*fields.begin()),
-             [](std::string acc, const double &entry) -> std::string {
-               acc += ", ";
-               acc += std::to_string(entry);
-               return acc;
-             })
-       + "\n";
+inline void init_csv(bigrig::output_sink_t                 &csv_file,
+                     const std::filesystem::path           &filename,
+                     const std::array<std::string_view, N> &fields,
+                     bigrig::compression_type_e             compression,
+                     bool replicate_column = false,
+                     bool point_column     = false,
+                     bool root_column      = false) {
+  csv_file.open(filename, compression);
+  if (point_column) { csv_file << "point, "; }
+  if (root_column) { csv_file << "root, "; }
+  if (replicate_column) { csv_file << "replicate, "; }
+  const char *separator = "";
+  for (const auto &field : fields) {
+    csv_file << separator << field;
+    separator = ", ";
+  }
+  csv_file << "\n";
 }
 
+/**
+ * Open a CSV file which gets rows from every replicate. Only the first shard of
+ * a run writes the header, so that the shards can be concatenated.
+ */
 template <size_t N>
-inline std::ofstream init_csv(const std::filesystem::path           &filename,
-                              const std::array<std::string_view, N> &fields) {
-  std::ofstream csv_file(filename);
-  csv_file << make_csv_row(fields);
-  return csv_file;
+void init_replicate_csv(bigrig::output_sink_t                 &csv_file,
+                        const std::filesystem::path           &filename,
+                        const std::array<std::string_view, N> &fields,
+                        const cli_options_t                   &cli_options) {
+  if (!cli_options.writes_headers()) {
+    csv_file.open(filename, cli_options.compression());
+    return;
+  }
+  init_csv(csv_file,
+           filename,
+           fields,
+           cli_options.compression(),
+           cli_options.batch_mode(),
+           cli_options.sweep_mode(),
+           cli_options.root_mode());
 }
 
-void write_split_csv_file(const cli_options_t  &cli_options,
-                          const bigrig::tree_t &tree) {
-  auto                 output_filename = cli_options.csv_splits_filename();
+void init_split_csv_file(bigrig::output_sink_t &csv_file,
+                         const cli_options_t   &cli_options) {
   constexpr std::array fields{
       "node"sv, "left"sv, "right"sv, "type"sv, "period"sv};
-  auto output_file = init_csv(output_filename, fields);
+  init_replicate_csv(
+      csv_file, cli_options.csv_splits_filename(), fields, cli_options);
+}
 
+void write_split_csv_rows(std::ostream               &output_file,
+                          const bigrig::tree_t       &tree,
+                          const bigrig::sim_result_t &result,
+                          const csv_tag_t            &tag) {
   for (const auto &n : tree) {
-    if (n->is_leaf()) { continue; }
-    auto split = n->node_split();
-
-    output_file << make_csv_row(std::array{n->string_id(),
-                                           split.left.to_str(),
-                                           split.right.to_str(),
-                                           split.to_type_string(),
-                                           std::to_string(split.period_index)});
+    if (n.is_leaf()) { continue; }
+    const auto &split = result.node_split(n.index());
+
+    write_csv_row(output_file,
+                  tag,
+                  n.string_id(),
+                  split.left,
+                  split.right,
+                  split.to_type_string(),
+                  split.period_index);
   };
 }
 
-void write_events_csv_file(const cli_options_t  &cli_options,
-                           const bigrig::tree_t &tree) {
-  auto                 output_filename = cli_options.csv_events_filename();
+void init_events_csv_file(bigrig::output_sink_t &csv_file,
+                          const cli_options_t   &cli_options) {
   constexpr std::array fields{"node"sv,
                               "waiting-time"sv,
                               "initial-state"sv,
                               "final-state"sv,
                               "period"sv};
-  auto                 output_file = init_csv(output_filename, fields);
+  init_replicate_csv(
+      csv_file, cli_options.csv_events_filename(), fields, cli_options);
+}
 
+void write_events_csv_rows(std::ostream               &output_file,
+                           const bigrig::tree_t       &tree,
+                           const bigrig::sim_result_t &result,
+                           const csv_tag_t            &tag) {
   for (const auto &n : tree) {
-    for (const auto &t : n->transitions()) {
-      output_file << make_csv_row(std::array{n->string_id(),
-                                             std::to_string(t.waiting_time),
-                                             t.initial_state.to_str(),
-                                             t.final_state.to_str(),
-                                             std::to_string(t.period_index)});
+    for (const auto &t : result.transitions(n.index())) {
+      write_csv_row(output_file,
+                    tag,
+                    n.string_id(),
+                    t.waiting_time,
+                    t.initial_state,
+                    t.final_state,
+                    t.period_index);
     }
   }
 }
 
+void init_stats_csv_file(bigrig::output_sink_t &csv_file,
+                         const cli_options_t   &cli_options) {
+  constexpr std::array fields{"period"sv,
+                              "dispersions"sv,
+                              "extinctions"sv,
+                              "singleton"sv,
+                              "allopatric"sv,
+                              "sympatric"sv,
+                              "jump"sv};
+  init_replicate_csv(
+      csv_file, cli_options.csv_stats_filename(), fields, cli_options);
+}
+
+void write_stats_csv_rows(std::ostream                        &output_file,
+                          const bigrig::sim_result_t          &result,
+                          const std::vector<bigrig::period_t> &periods,
+                          const csv_tag_t                     &tag) {
+  for (const auto &p : periods) {
+    auto stats = get_period_stats(result, p.index());
+    write_csv_row(output_file,
+                  tag,
+                  p.index(),
+                  stats.dispersions,
+                  stats.extinctions,
+                  stats.singleton_splits,
+                  stats.allopatric_splits,
+                  stats.sympatric_splits,
+                  stats.jump_splits);
+  }
+}
+
 void write_periods_csv_file(const cli_options_t                 &cli_options,
                             const std::vector<bigrig::period_t> &periods) {
-  auto                 output_filename = cli_options.csv_periods_filename();
-  constexpr std::array fields{"index"sv,
+  constexpr std::array  fields{"index"sv,
                               "start"sv,
                               "dispersion"sv,
                               "extinction"sv,
@@ -712,94 +1520,387 @@ void write_periods_csv_file(const cli_options_t                 &cli_options,
                               "sympatry"sv,
                               "copy"sv,
                               "jump"sv};
-  auto                 output_file = init_csv(output_filename, fields);
+  bigrig::output_sink_t output_file;
+  init_csv(output_file,
+           cli_options.csv_periods_filename(),
+           fields,
+           cli_options.compression());
 
   for (const auto &p : periods) {
     auto &model                   = p.model();
     auto [dis, ext]               = model.rates();
     auto [allo, symp, copy, jump] = model.cladogenesis_params();
 
-    output_file << make_csv_row(std::array{static_cast<double>(p.index()),
-                                           p.start(),
-                                           dis,
-                                           ext,
-                                           allo,
-                                           symp,
-                                           copy,
-                                           jump});
+    write_csv_row(output_file,
+                  {},
+                  static_cast<double>(p.index()),
+                  p.start(),
+                  dis,
+                  ext,
+                  allo,
+                  symp,
+                  copy,
+                  jump);
+  }
+}
+
+/**
+ * Write the parameters of every point of a sweep. Only the parameters which
+ * are set by at least one point get a column, and a parameter which is not set
+ * by a point is left empty.
+ */
+void write_sweep_csv_file(const cli_options_t &cli_options) {
+  std::vector<bigrig::sweep_param_e> columns;
+  for (size_t i = 0; i < bigrig::SWEEP_PARAM_COUNT; ++i) {
+    auto param = static_cast<bigrig::sweep_param_e>(i);
+    for (const auto &point : cli_options.sweep_points) {
+      if (point.get(param).has_value()) {
+        columns.push_back(param);
+        break;
+      }
+    }
+  }
+
+  bigrig::output_sink_t output_file;
+  output_file.open(cli_options.csv_sweep_filename(),
+                   cli_options.compression());
+  output_file << "point";
+  for (auto param : columns) { output_file << ", " << to_string(param); }
+  output_file << "\n";
+
+  for (size_t index = 0; index < cli_options.sweep_points.size(); ++index) {
+    const auto &point = cli_options.sweep_points[index];
+    output_file << index;
+    for (auto param : columns) {
+      output_file << ", ";
+      auto value = point.get(param);
+      if (value.has_value()) { write_csv_field(output_file, value.value()); }
+    }
+    output_file << "\n";
+  }
+}
+
+/**
+ * Write the root ranges of a root prior, with their normalized weights.
+ */
+void write_roots_csv_file(const cli_options_t &cli_options) {
+  constexpr std::array  fields{"root"sv, "range"sv, "weight"sv};
+  bigrig::output_sink_t output_file;
+  init_csv(output_file,
+           cli_options.csv_roots_filename(),
+           fields,
+           cli_options.compression());
+  for (size_t index = 0; index < cli_options.roots.size(); ++index) {
+    const auto &root = cli_options.roots[index];
+    write_csv_row(output_file, {}, index, root.range, root.weight);
   }
 }
 
 void write_program_stats_csv_file(const cli_options_t   &cli_options,
                                   const program_stats_t &program_stats) {
-  auto output_filename = cli_options.csv_program_stats_filename();
-  constexpr std::array fields{"stat"sv, "value"sv};
+  constexpr std::array  fields{"stat"sv, "value"sv};
+  bigrig::output_sink_t output_file;
+  init_csv(output_file,
+           cli_options.csv_program_stats_filename(),
+           fields,
+           cli_options.compression());
+  write_csv_row(output_file,
+                {},
+                "execution-time"sv,
+                program_stats.execution_time_in_seconds());
+  if (cli_options.batch_mode()) {
+    write_csv_row(output_file, {}, "replicates"sv, program_stats.replicates);
+  }
 
-  auto output_file = init_csv(output_filename, fields);
-  output_file << make_csv_row(std::array<std::string, 2>{
-      "execution-time",
-      std::to_string(program_stats.execution_time_in_seconds())});
+  if (program_stats.counts.has_value()) {
+    const auto &counts = program_stats.counts.value();
+    for (size_t i = 0; i < bigrig::PHASE_COUNT; ++i) {
+      auto phase = static_cast<bigrig::phase_e>(i);
+      if (counts.phase_nanoseconds[i] == 0) { continue; }
+      write_csv_row(output_file,
+                    {},
+                    std::format("time-{}", bigrig::to_string(phase)),
+                    counts.seconds(phase));
+    }
+    for (size_t i = 0; i < bigrig::COUNTER_COUNT; ++i) {
+      auto counter = static_cast<bigrig::counter_e>(i);
+      write_csv_row(
+          output_file, {}, bigrig::to_string(counter), counts.count(counter));
+    }
+  }
+  if (auto rate = program_stats.events_per_second()) {
+    write_csv_row(output_file, {}, "events-per-second"sv, rate.value());
+  }
+  if (program_stats.peak_memory.has_value()) {
+    write_csv_row(
+        output_file, {}, "peak-memory"sv, program_stats.peak_memory.value());
+  }
 }
 
-void write_csv_files(const cli_options_t                 &cli_options,
-                     const bigrig::tree_t                &tree,
-                     const std::vector<bigrig::period_t> &periods,
-                     const program_stats_t               &program_stats) {
-  write_split_csv_file(cli_options, tree);
-  write_events_csv_file(cli_options, tree);
-  write_periods_csv_file(cli_options, periods);
-  write_program_stats_csv_file(cli_options, program_stats);
+/**
+ * Open the result files. In binary mode, the binary file replaces all of the
+ * text files, and it is only opened when the first replicate is written, since
+ * the header needs the tree.
+ */
+output_files_t::output_files_t(const cli_options_t &cli_options)
+    : _cli_options{cli_options} {
+  if (cli_options.binary_file_set()) { return; }
+
+  auto compression = cli_options.compression();
+  _phylip_file.open(cli_options.phylip_filename(), compression);
+  _phylip_all_file.open(cli_options.phylip_all_filename(), compression);
+  _annotated_tree_file.open(cli_options.annotated_tree_filename(),
+                            compression);
+
+  if (cli_options.yaml_file_set()) {
+    _yaml_file.open(cli_options.yaml_filename(), compression);
+  }
+  if (cli_options.json_file_set()) {
+    _json_file.open(cli_options.json_filename(), compression);
+  }
+  if (cli_options.csv_file_set()) {
+    init_split_csv_file(_csv_splits_file, cli_options);
+    if (cli_options.stats_only_mode()) {
+      init_stats_csv_file(_csv_stats_file, cli_options);
+    } else {
+      init_events_csv_file(_csv_events_file, cli_options);
+    }
+  }
 }
 
 /**
- * Write the output files given a sampled tree and model.
+ * Append the results of a simulated tree to the output files.
  *
- * Automatically selects which outputs need to be created based on
- * `cli_options_t`.
+ * When running a batch, the phylip files contain one alignment per replicate,
+ * the annotated tree file one tree per line, and the remaining formats are
+ * tagged with the replicate index. When running a sweep, they are also tagged
+ * with the index of the point, and `periods` are the periods of the point.
+ * When running a root prior, they are tagged with the index of the root range.
  */
-void write_output_files(const cli_options_t                 &cli_options,
-                        const bigrig::tree_t                &tree,
-                        const std::vector<bigrig::period_t> &periods,
-                        const program_stats_t               &program_stats) {
-  auto          phylip_filename = cli_options.phylip_filename();
-  std::ofstream phylip_file(phylip_filename);
-  phylip_file << to_phylip(tree);
-
-  auto phylip_all_filename  = cli_options.prefix.value();
-  phylip_all_filename      += ".all.phy";
-  std::ofstream phylip_all_file(phylip_all_filename);
-  phylip_all_file << to_phylip_all_nodes(tree);
-
-  auto cb = [](std::ostream &os, bigrig::node_t n) {
-    os << n.string_id();
-    os << "[&&NHX:";
-    if (n.is_leaf()) {
-      os << "dist=" << n.final_state().to_str();
+void output_files_t::write_replicate(
+    const bigrig::tree_t                &tree,
+    const bigrig::sim_result_t          &result,
+    const std::vector<bigrig::period_t> &periods,
+    const program_stats_t               &program_stats,
+    size_t                               replicate_index,
+    std::optional<size_t>                point,
+    std::optional<size_t>                root) {
+  if (_cli_options.binary_file_set()) {
+    bigrig::scoped_phase_t timer{bigrig::phase_e::WRITE_BINARY};
+    if (!_binary_file.is_open() && _cli_options.writes_headers()) {
+      _binary_file.open(_cli_options.binary_filename(),
+                        tree,
+                        periods,
+                        result.region_count());
+    } else if (!_binary_file.is_open()) {
+      _binary_file.open_records(_cli_options.binary_filename(),
+                                result.region_count());
+    }
+    _binary_file.write(tree, result, replicate_index, point.value_or(0));
+    return;
+  }
+
+  std::optional<size_t> replicate;
+  if (_cli_options.batch_mode()) { replicate = replicate_index; }
+  csv_tag_t tag{.replicate = replicate, .point = point, .root = root};
+
+  {
+    bigrig::scoped_phase_t timer{bigrig::phase_e::WRITE_PHYLIP};
+    write_phylip(_phylip_file, tree, result);
+    write_phylip_all_nodes(_phylip_all_file, tree, result);
+  }
+
+  auto annotate = [&tree, &result](std::string &out, size_t index) {
+    out += tree.string_id(index);
+    out += "[&&NHX:";
+    if (tree.is_leaf(index)) {
+      out += "dist=";
+      result.final_state(index).append_to(out);
     } else {
-      os << n.node_split().to_nhx_string();
+      result.node_split(index).append_nhx(out);
     }
-    os << "]";
+    out += ']';
   };
 
-  auto annotated_tree_filename  = cli_options.prefix.value();
-  annotated_tree_filename      += ".annotated";
-  annotated_tree_filename      += bigrig::util::NEWICK_EXT;
-  std::ofstream annotated_tree_file(annotated_tree_filename);
-  annotated_tree_file << tree.to_newick(cb) << std::endl;
+  {
+    bigrig::scoped_phase_t timer{bigrig::phase_e::WRITE_NEWICK};
+    _newick_buffer.clear();
+    tree.append_newick(_newick_buffer, annotate);
+    _newick_buffer += '\n';
+    _annotated_tree_file.write(_newick_buffer.data(), _newick_buffer.size());
+  }
 
+  if (_cli_options.yaml_file_set()) {
+    bigrig::scoped_phase_t timer{bigrig::phase_e::WRITE_YAML};
+    write_yaml_file(_yaml_file,
+                    tree,
+                    tree_newick(tree),
+                    result,
+                    periods,
+                    program_stats,
+                    replicate,
+                    point,
+                    root);
+  }
+  if (_cli_options.json_file_set()) {
+    bigrig::scoped_phase_t timer{bigrig::phase_e::WRITE_JSON};
+    write_json_file(_json_file,
+                    tree,
+                    tree_newick(tree),
+                    result,
+                    periods,
+                    program_stats,
+                    replicate,
+                    point,
+                    root);
+  }
+  if (_cli_options.csv_file_set()) {
+    bigrig::scoped_phase_t timer{bigrig::phase_e::WRITE_CSV};
+    write_split_csv_rows(_csv_splits_file, tree, result, tag);
+    if (result.stats_only()) {
+      write_stats_csv_rows(_csv_stats_file, result, periods, tag);
+    } else {
+      write_events_csv_rows(_csv_events_file, tree, result, tag);
+    }
+  }
+}
+
+/**
+ * The newick string of the tree, made the first time it is needed, or when the
+ * replicates come from a different tree.
+ */
+const std::string &output_files_t::tree_newick(const bigrig::tree_t &tree) {
+  if (_newick_tree != &tree) {
+    _tree_newick = tree.to_newick();
+    _newick_tree = &tree;
+  }
+  return _tree_newick;
+}
+
+/**
+ * Write the files which are shared by all the replicates of a run. Should be
+ * called once, after the last replicate has been written.
+ */
+void output_files_t::write_summary(
+    const std::vector<bigrig::period_t> &periods,
+    const program_stats_t               &program_stats) {
+  write_summary_files(_cli_options, periods, program_stats);
+}
+
+void write_summary_files(const cli_options_t                 &cli_options,
+                         const std::vector<bigrig::period_t> &periods,
+                         const program_stats_t               &program_stats) {
+  if (cli_options.csv_file_set()) {
+    write_periods_csv_file(cli_options, periods);
+    write_program_stats_csv_file(cli_options, program_stats);
+  }
+  if (cli_options.sweep_mode()) { write_sweep_csv_file(cli_options); }
+  if (cli_options.root_mode()) { write_roots_csv_file(cli_options); }
+}
+
+/**
+ * Close the files, so that everything written to them is on disk.
+ */
+void output_files_t::close() {
+  _phylip_file.close();
+  _phylip_all_file.close();
+  _annotated_tree_file.close();
+  _yaml_file.close();
+  _json_file.close();
+  _csv_splits_file.close();
+  _csv_events_file.close();
+  _csv_stats_file.close();
+  _binary_file.close();
+}
+
+/**
+ * The files which get a part of every replicate, as opposed to the summary
+ * files. These are the files that the shards of a run are split over.
+ */
+std::vector<std::filesystem::path>
+replicate_filenames(const cli_options_t &cli_options) {
+  if (cli_options.binary_file_set()) { return {cli_options.binary_filename()}; }
+
+  std::vector<std::filesystem::path> filenames{
+      cli_options.phylip_filename(),
+      cli_options.phylip_all_filename(),
+      cli_options.annotated_tree_filename()};
   if (cli_options.yaml_file_set()) {
-    auto          output_yaml_filename = cli_options.yaml_filename();
-    std::ofstream output_yaml_file(output_yaml_filename);
-    write_yaml_file(output_yaml_file, tree, periods, program_stats);
+    filenames.push_back(cli_options.yaml_filename());
   }
   if (cli_options.json_file_set()) {
-    auto          output_json_filename = cli_options.json_filename();
-    std::ofstream output_json_file(output_json_filename);
-    write_json_file(output_json_file, tree, periods, program_stats);
+    filenames.push_back(cli_options.json_filename());
   }
   if (cli_options.csv_file_set()) {
-    write_csv_files(cli_options, tree, periods, program_stats);
+    filenames.push_back(cli_options.csv_splits_filename());
+    filenames.push_back(cli_options.stats_only_mode()
+                            ? cli_options.csv_stats_filename()
+                            : cli_options.csv_events_filename());
   }
+  return filenames;
+}
+
+/**
+ * The files which are written once for the whole run, by `write_summary`.
+ */
+std::vector<std::filesystem::path>
+summary_filenames(const cli_options_t &cli_options) {
+  std::vector<std::filesystem::path> filenames;
+  if (cli_options.csv_file_set()) {
+    filenames.push_back(cli_options.csv_periods_filename());
+    filenames.push_back(cli_options.csv_program_stats_filename());
+  }
+  if (cli_options.sweep_mode()) {
+    filenames.push_back(cli_options.csv_sweep_filename());
+  }
+  if (cli_options.root_mode()) {
+    filenames.push_back(cli_options.csv_roots_filename());
+  }
+  return filenames;
+}
+
+/**
+ * Write the index of the shards of a run. For each shard, this is the prefix
+ * of its files, and the first and last result in it, counting the results in
+ * the order of the full run. The files of the shards are joined by
+ * concatenating them in the order of the index.
+ */
+void write_shards_csv_file(
+    const cli_options_t                          &cli_options,
+    const std::vector<std::pair<size_t, size_t>> &shard_results) {
+  constexpr std::array  fields{"shard"sv, "prefix"sv, "first"sv, "end"sv};
+  bigrig::output_sink_t output_file;
+  init_csv(output_file,
+           cli_options.csv_shards_filename(),
+           fields,
+           bigrig::compression_type_e::none);
+
+  auto shard_options = cli_options;
+  for (size_t shard = 0; shard < shard_results.size(); ++shard) {
+    shard_options.shard_index = shard;
+    write_csv_row(output_file,
+                  {},
+                  shard,
+                  shard_options.file_prefix().string(),
+                  shard_results[shard].first,
+                  shard_results[shard].second);
+  }
+}
+
+/**
+ * Write the output files given a sampled tree and model.
+ *
+ * Automatically selects which outputs need to be created based on
+ * `cli_options_t`.
+ */
+void write_output_files(const cli_options_t                 &cli_options,
+                        const bigrig::tree_t                &tree,
+                        const bigrig::sim_result_t          &result,
+                        const std::vector<bigrig::period_t> &periods,
+                        const program_stats_t               &program_stats) {
+  output_files_t output_files{cli_options};
+  output_files.write_replicate(tree, result, periods, program_stats, 0);
+  output_files.write_summary(periods, program_stats);
 }
 
 void finalize_options(cli_options_t &cli_options) {
@@ -842,7 +1943,9 @@ bool validate_and_finalize_options(cli_options_t &cli_options) {
 
   normalize_paths(cli_options);
 
-  if (!validate_cli_options(cli_options)) {
+  if (!validate_cli_options(cli_options) || !make_sweep_points(cli_options)
+      || !make_root_ranges(cli_options)
+      || !read_condition_file(cli_options)) {
     MESSAGE_ERROR(
         "We can't continue with the current options, exiting instead");
     return false;
@@ -852,7 +1955,8 @@ bool validate_and_finalize_options(cli_options_t &cli_options) {
 
   write_header(cli_options);
 
-  if (!check_existing_results(cli_options)) {
+  /* The jobs have their own files, which are checked once they are made */
+  if (!cli_options.jobs_mode() && !check_existing_results(cli_options)) {
     if (!cli_options.redo.value_or(false)) {
       MESSAGE_ERROR("Refusing to run with existing results. Please specify the "
                     "--redo option if you want to overwrite existing results");
@@ -1,20 +1,105 @@
 #pragma once
 
+#include "binary.hpp"
 #include "clioptions.hpp"
 #include "period.hpp"
+#include "sink.hpp"
 #include "tree.hpp"
 
-std::string to_phylip(const bigrig::tree_t &tree);
+#include <filesystem>
+#include <string>
+#include <utility>
+#include <vector>
 
-std::string to_phylip_all_nodes(const bigrig::tree_t &tree);
+void write_phylip(std::ostream               &os,
+                  const bigrig::tree_t       &tree,
+                  const bigrig::sim_result_t &result);
+
+void write_phylip_all_nodes(std::ostream               &os,
+                            const bigrig::tree_t       &tree,
+                            const bigrig::sim_result_t &result);
+
+std::string to_phylip(const bigrig::tree_t       &tree,
+                      const bigrig::sim_result_t &result);
+
+std::string to_phylip_all_nodes(const bigrig::tree_t       &tree,
+                                const bigrig::sim_result_t &result);
 
 [[nodiscard]] bool config_compatible(const cli_options_t &cli_options);
 
 bool validate_and_finalize_options(cli_options_t &cli_options);
 
+/**
+ * The result files of a run. The files are opened once, and the results of
+ * each replicate are appended to them as they become available.
+ */
+class output_files_t {
+public:
+  explicit output_files_t(const cli_options_t &cli_options);
+
+  void write_replicate(const bigrig::tree_t                &tree,
+                       const bigrig::sim_result_t          &result,
+                       const std::vector<bigrig::period_t> &periods,
+                       const program_stats_t               &program_stats,
+                       size_t                               replicate_index,
+                       std::optional<size_t>                point = {},
+                       std::optional<size_t>                root  = {});
+
+  void write_summary(const std::vector<bigrig::period_t> &periods,
+                     const program_stats_t               &program_stats);
+
+  void close();
+
+private:
+  const cli_options_t &_cli_options;
+
+  bigrig::output_sink_t _phylip_file;
+  bigrig::output_sink_t _phylip_all_file;
+  bigrig::output_sink_t _annotated_tree_file;
+  bigrig::output_sink_t _yaml_file;
+  bigrig::output_sink_t _json_file;
+  bigrig::output_sink_t _csv_splits_file;
+  bigrig::output_sink_t _csv_events_file;
+  bigrig::output_sink_t _csv_stats_file;
+
+  bigrig::binary_writer_t _binary_file;
+
+  /* The annotated tree of a replicate is formatted here, then written at once */
+  std::string _newick_buffer;
+
+  /*
+   * The plain newick of the tree, with the branch lengths, is the same for
+   * every replicate, so it is only made once for the YAML and JSON files.
+   */
+  const std::string &tree_newick(const bigrig::tree_t &tree);
+
+  const bigrig::tree_t *_newick_tree = nullptr;
+  std::string           _tree_newick;
+};
+
 void write_output_files(const cli_options_t                 &cli_options,
                         const bigrig::tree_t                &tree,
+                        const bigrig::sim_result_t          &result,
                         const std::vector<bigrig::period_t> &period,
                         const program_stats_t               &program_stats);
 
 void write_header(const cli_options_t &cli_options);
+
+[[nodiscard]] bool check_existing_results(const cli_options_t &cli_options);
+
+void write_summary_files(const cli_options_t                 &cli_options,
+                         const std::vector<bigrig::period_t> &periods,
+                         const program_stats_t               &program_stats);
+
+std::vector<std::filesystem::path>
+replicate_filenames(const cli_options_t &cli_options);
+
+std::vector<std::filesystem::path>
+summary_filenames(const cli_options_t &cli_options);
+
+[[nodiscard]] bool validate_and_make_prefix(
+    const std::optional<std::filesystem::path> &prefix_option);
+
+void write_shards_csv_file(
+    const cli_options_t                          &cli_options,
+    const std::vector<std::pair<size_t, size_t>> &shard_results);
@@ -1,24 +1,27 @@
 #pragma once
 #include "node.hpp"
 
-#include <stack>
+#include <vector>
 
 namespace bigrig {
 
+/**
+ * Iterates over the nodes of a tree in a precomputed order. The order is a
+ * preorder, so the parents are always visted before their children.
+ */
 class preorder_iterator {
 public:
   using difference_type = std::ptrdiff_t;
-  using value_type      = std::shared_ptr<node_t>;
+  using value_type      = node_t;
 
   preorder_iterator() = default;
-  explicit preorder_iterator(const std::shared_ptr<node_t> &n) {
-    _stack.push(n);
-  }
-  value_type         operator*() const { return _stack.top(); }
+  preorder_iterator(const tree_t                        &tree,
+                    std::vector<size_t>::const_iterator  itr)
+      : _tree{&tree}, _itr{itr} {}
+
+  value_type         operator*() const { return {*_tree, *_itr}; }
   preorder_iterator &operator++() {
-    auto tmp_node = _stack.top();
-    _stack.pop();
-    for (auto &c : tmp_node->children()) { _stack.push(c); }
+    ++_itr;
     return *this;
   }
   preorder_iterator operator++(int) {
@@ -27,16 +30,14 @@ public:
     return tmp;
   }
 
-  bool operator==(const preorder_iterator &it) const {
-    return (it._stack.empty() && _stack.empty())
-        || (!_stack.empty() && it._stack.top() == _stack.top());
-  }
+  bool operator==(const preorder_iterator &it) const { return it._itr == _itr; }
   bool operator!=(const preorder_iterator &it) const { return !(it == *this); }
 
-  std::shared_ptr<node_t> &node() { return _stack.top(); }
+  node_t node() const { return **this; }
 
 private:
-  std::stack<std::shared_ptr<node_t>> _stack;
+  const tree_t                       *_tree = nullptr;
+  std::vector<size_t>::const_iterator _itr;
 };
 
 } // namespace bigrig
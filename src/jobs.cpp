@@ -0,0 +1,225 @@
+#include "jobs.hpp"
+
+#include "io.hpp"
+#include "logger.hpp"
+#include "util.hpp"
+
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+/**
+ * Parse a single job. Unknown keys are an error, so that a typo doesn't
+ * silently run the job with the shared options instead.
+ */
+std::optional<job_spec_t>
+parse_job_spec(std::string_view             line,
+               size_t                       line_number,
+               const std::filesystem::path &filename) {
+  auto json = nlohmann::json::parse(line, nullptr, false);
+  if (json.is_discarded() || !json.is_object()) {
+    LOG_ERROR("Line %lu of the jobs file '%s' is not a JSON object",
+              line_number,
+              filename.c_str());
+    return {};
+  }
+
+  job_spec_t job;
+  bool       ok = true;
+  for (const auto &[key, value] : json.items()) {
+    if (key == "prefix" && value.is_string()) {
+      job.prefix = value.get<std::string>();
+    } else if (key == "seed" && value.is_number_unsigned()) {
+      job.seed = value.get<uint64_t>();
+    } else if (key == "replicates" && value.is_number_unsigned()) {
+      job.replicates = value.get<size_t>();
+    } else if (key == "root-range" && value.is_string()) {
+      auto range = value.get<std::string>();
+      if (range.empty() || range.size() >= bigrig::dist_t::MAX_REGIONS
+          || range.find_first_not_of("01") != std::string::npos) {
+        LOG_ERROR("The root range '%s' on line %lu of the jobs file '%s' is "
+                  "not a range",
+                  range.c_str(),
+                  line_number,
+                  filename.c_str());
+        ok = false;
+        continue;
+      }
+      job.root_range = bigrig::dist_t{range};
+    } else {
+      LOG_ERROR("Line %lu of the jobs file '%s' has an unknown key, or a key "
+                "with the wrong type: '%s'",
+                line_number,
+                filename.c_str(),
+                key.c_str());
+      ok = false;
+    }
+  }
+  if (job.prefix.empty()) {
+    LOG_ERROR("The job on line %lu of the jobs file '%s' has no prefix",
+              line_number,
+              filename.c_str());
+    ok = false;
+  }
+  if (!ok) { return {}; }
+  return job;
+}
+
+/**
+ * Every result file of a run, including the summary files.
+ */
+std::vector<std::filesystem::path>
+output_filenames(const cli_options_t &cli_options) {
+  auto filenames = replicate_filenames(cli_options);
+  for (auto &filename : summary_filenames(cli_options)) {
+    filenames.push_back(std::move(filename));
+  }
+  return filenames;
+}
+
+/**
+ * Check the prefixes of the jobs, and the results they would overwrite. Each
+ * directory is only looked at once, however many jobs are in it, so that the
+ * checks don't touch the filesystem for every file of every job.
+ */
+[[nodiscard]] bool check_job_outputs(const std::vector<cli_options_t> &jobs) {
+  bool                            ok = true;
+  std::unordered_set<std::string> prefixes;
+
+  /* The names of the files in the directory of each prefix */
+  std::unordered_map<std::string, std::unordered_set<std::string>> directories;
+
+  for (const auto &job : jobs) {
+    auto prefix = job.prefix.value();
+    if (!prefixes.insert(prefix.string()).second) {
+      LOG_ERROR("More than one job has the prefix '%s'", prefix.c_str());
+      ok = false;
+    }
+
+    auto [itr, inserted] = directories.try_emplace(prefix.parent_path().string());
+    if (!inserted) { continue; }
+    if (!validate_and_make_prefix(prefix)) {
+      ok = false;
+      continue;
+    }
+    std::error_code ec;
+    for (const auto &entry :
+         std::filesystem::directory_iterator(prefix.parent_path(), ec)) {
+      itr->second.insert(entry.path().filename().string());
+    }
+  }
+  if (!ok) { return false; }
+
+  bool existing = false;
+  for (const auto &job : jobs) {
+    const auto &files
+        = directories.at(job.prefix.value().parent_path().string());
+    if (files.empty()) { continue; }
+    for (const auto &filename : output_filenames(job)) {
+      if (files.contains(filename.filename().string())) {
+        LOG_WARNING("Results file %s exists already", filename.c_str());
+        existing = true;
+      }
+    }
+  }
+  if (existing && !jobs.front().redo.value_or(false)) {
+    MESSAGE_ERROR("Refusing to run with existing results. Please specify the "
+                  "--redo option if you want to overwrite existing results");
+    return false;
+  }
+  return true;
+}
+} // namespace
+
+/**
+ * Read the jobs from a JSON lines file, one job per line. Each job is an
+ * object with a `prefix`, and optionally a `seed`, `replicates` and a
+ * `root-range`. Empty lines are skipped.
+ */
+std::optional<std::vector<job_spec_t>>
+read_job_specs(const std::filesystem::path &filename) {
+  std::ifstream file(filename);
+  if (!file) {
+    LOG_ERROR("Failed to open the jobs file '%s'", filename.c_str());
+    return {};
+  }
+
+  std::vector<job_spec_t> jobs;
+  std::string             line;
+  size_t                  line_number = 0;
+  bool                    ok          = true;
+  while (std::getline(file, line)) {
+    ++line_number;
+    auto trimmed = bigrig::util::trim(line);
+    if (trimmed.empty()) { continue; }
+    auto job = parse_job_spec(trimmed, line_number, filename);
+    if (!job.has_value()) {
+      ok = false;
+      continue;
+    }
+    jobs.push_back(std::move(job.value()));
+  }
+  if (!ok) { return {}; }
+
+  if (jobs.empty()) {
+    LOG_ERROR("The jobs file '%s' has no jobs", filename.c_str());
+    return {};
+  }
+  return jobs;
+}
+
+/**
+ * Make the options of every job, from the shared options. The shared options
+ * have been validated already, so only what the jobs change is checked here.
+ * The root ranges of the jobs need the same number of regions as the shared
+ * one, since the tree, the sweep and the conditions are only made once.
+ */
+std::optional<std::vector<cli_options_t>>
+make_job_options(const cli_options_t           &cli_options,
+                 const std::vector<job_spec_t> &specs) {
+  bool                       ok      = true;
+  auto                       regions = cli_options.root_range->regions();
+  std::vector<cli_options_t> jobs;
+  jobs.reserve(specs.size());
+  for (const auto &spec : specs) {
+    auto &job  = jobs.emplace_back(cli_options);
+    job.prefix = std::filesystem::absolute(spec.prefix).lexically_normal();
+    if (spec.seed.has_value()) { job.rng_seed = spec.seed; }
+    if (spec.replicates.has_value()) { job.replicates = spec.replicates; }
+
+    if (spec.replicates.has_value() && spec.replicates.value() == 0) {
+      LOG_ERROR("The job '%s' has no replicates", job.prefix->c_str());
+      ok = false;
+    }
+    for (auto replicate : job.event_replicates) {
+      if (replicate >= job.replicates.value_or(1)) {
+        LOG_ERROR("The job '%s' doesn't have replicate %lu to write the "
+                  "events of",
+                  job.prefix->c_str(),
+                  replicate);
+        ok = false;
+      }
+    }
+
+    if (!spec.root_range.has_value()) { continue; }
+    if (cli_options.root_mode()) {
+      LOG_ERROR("The job '%s' has a root range, but the root ranges already "
+                "come from a root prior",
+                job.prefix->c_str());
+      ok = false;
+    } else if (spec.root_range->regions() != regions
+               || spec.root_range->empty()) {
+      LOG_ERROR("The root range %s of the job '%s' needs to be a non empty "
+                "range of %u regions",
+                spec.root_range->to_str().c_str(),
+                job.prefix->c_str(),
+                regions);
+      ok = false;
+    }
+    job.root_range = spec.root_range;
+  }
+  if (!ok || !check_job_outputs(jobs)) { return {}; }
+  return jobs;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "clioptions.hpp"
+#include "dist.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <vector>
+
+/**
+ * A job from a jobs file. A job is a run with the options of the command line
+ * and the config file, except for the ones it sets itself. Every job has to
+ * have its own prefix.
+ */
+struct job_spec_t {
+  std::filesystem::path         prefix;
+  std::optional<uint64_t>       seed;
+  std::optional<size_t>         replicates;
+  std::optional<bigrig::dist_t> root_range;
+};
+
+std::optional<std::vector<job_spec_t>>
+read_job_specs(const std::filesystem::path &filename);
+
+std::optional<std::vector<cli_options_t>>
+make_job_options(const cli_options_t           &cli_options,
+                 const std::vector<job_spec_t> &specs);
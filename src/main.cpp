@@ -1,19 +1,309 @@
 #include "clioptions.hpp"
 #include "dist.hpp"
+#include "instrument.hpp"
 #include "io.hpp"
+#include "jobs.hpp"
 #include "model.hpp"
 #include "pcg_random.hpp"
+#include "prepared.hpp"
+#include "rng.hpp"
+#include "scheduler.hpp"
+#include "sweep.hpp"
 
 #include <chrono>
 #include <corax/corax.hpp>
 #include <logger.hpp>
 
+#ifdef BIGRIG_MPI
+#include "mpi.hpp"
+#endif
+
+/**
+ * Parse the tree, and get it ready for simulation.
+ */
+bigrig::tree_t prepare_tree(const cli_options_t                 &cli_options,
+                            const std::vector<bigrig::period_t> &periods) {
+  auto tree = [&] {
+    bigrig::scoped_phase_t timer{bigrig::phase_e::PARSE};
+    return bigrig::tree_t(cli_options.tree_filename.value());
+  }();
+  bigrig::scoped_phase_t timer{bigrig::phase_e::PERIODS};
+  tree.set_periods(periods);
+  return tree;
+}
+
+/**
+ * Get the tree ready for simulation. If there is a tree cache, and the tree
+ * has been prepared before with the same period boundaries, the prepared tree
+ * is loaded instead of parsing the tree again. Otherwise, the newly prepared
+ * tree is added to the cache.
+ */
+bigrig::tree_t make_tree(const cli_options_t                 &cli_options,
+                         const std::vector<bigrig::period_t> &periods) {
+  auto mode = cli_options.mode.value_or(bigrig::operation_mode_e::FAST);
+
+  std::optional<bigrig::prepared_key_t> key;
+  if (cli_options.tree_cache.has_value()) {
+    key = bigrig::make_prepared_key(cli_options.tree_filename.value(), periods);
+  }
+  if (!key.has_value()) {
+    auto tree = prepare_tree(cli_options, periods);
+    tree.set_mode(mode);
+    return tree;
+  }
+
+  auto cache_filename = cli_options.tree_cache.value() / key->filename();
+  auto cached         = [&] {
+    bigrig::scoped_phase_t timer{bigrig::phase_e::PARSE};
+    return bigrig::read_prepared_tree(cache_filename, *key, periods);
+  }();
+  if (cached) {
+    LOG_INFO("Loaded the prepared tree from %s", cache_filename.c_str());
+    cached->set_mode(mode);
+    return std::move(*cached);
+  }
+
+  auto tree = prepare_tree(cli_options, periods);
+  tree.set_mode(mode);
+  if (tree.is_ready()
+      && bigrig::write_prepared_tree(cache_filename, tree, *key)) {
+    LOG_INFO("Saved the prepared tree to %s", cache_filename.c_str());
+  }
+  return tree;
+}
+
+/**
+ * Simulate the replicates of a run, and write their results. The tree, the
+ * sweep and the conditions can be shared by several runs. Returns the stats of
+ * the run, or nothing if it couldn't be run. The summary files are left to the
+ * caller.
+ */
+std::optional<program_stats_t>
+simulate_run(const cli_options_t                       &cli_options,
+             bigrig::tree_t                            &tree,
+             const std::vector<bigrig::period_t>       &periods,
+             std::optional<bigrig::sweep_tables_t>     &sweep,
+             const std::optional<bigrig::conditions_t> &conditions) {
+  size_t max_restarts
+      = cli_options.max_restarts.value_or(bigrig::DEFAULT_MAX_RESTARTS);
+
+  output_files_t output_files{cli_options};
+  size_t         replicates = cli_options.replicates.value_or(1);
+  size_t         points     = sweep ? sweep->point_count() : 1;
+  bool           root_mode  = cli_options.root_mode();
+  size_t         roots      = root_mode ? cli_options.roots.size() : 1;
+
+  /* Each job is one replicate of one point and root range */
+  size_t jobs = points * roots * replicates;
+
+  /*
+   * A shard only runs a contiguous range of the jobs. Since every job has its
+   * own random streams, the results are the same as in the full run.
+   */
+  size_t shard_count = cli_options.shard_count.value_or(1);
+  if (jobs < shard_count) {
+    MESSAGE_ERROR("There are fewer jobs than shards, exiting");
+    return {};
+  }
+  auto   shard      = bigrig::shard_range(
+      jobs, cli_options.shard_index.value_or(0), shard_count);
+  size_t job_begin  = shard.first;
+  size_t shard_jobs = shard.second - shard.first;
+
+  /*
+   * The threads either go to the replicates, or to the subtrees of each
+   * replicate, but not both.
+   */
+  bool   parallel_tree = cli_options.parallel_tree_mode();
+  size_t threads       = cli_options.threads.value_or(1);
+  size_t workers       = parallel_tree ? 1 : std::min(threads, shard_jobs);
+
+  /*
+   * With a writer thread, there is a queue of a finished job per worker, so
+   * that a slow write doesn't hold up the workers straight away.
+   */
+  bigrig::replicate_scheduler_t scheduler{
+      workers, cli_options.writer_thread_mode() ? workers : 0};
+  bigrig::task_pool_t tree_pool{parallel_tree ? threads : 1};
+
+  /*
+   * The tree is shared by all of the workers, and each slot of the scheduler
+   * gets a result to write into. The results are reused between replicates.
+   */
+  std::vector<bigrig::sim_result_t> results(scheduler.slot_count());
+  std::vector<program_stats_t>      slot_stats(scheduler.slot_count());
+  std::vector<char>                 slot_failed(scheduler.slot_count());
+  bool lazy_events = cli_options.lazy_events_mode();
+  for (auto &r : results) {
+    r.set_stats_only(cli_options.stats_only_mode());
+    r.set_lazy_events(lazy_events);
+  }
+
+  using table_ptr = std::shared_ptr<const bigrig::period_table_t>;
+  std::vector<table_ptr> slot_tables(scheduler.slot_count());
+
+  /* The point and root range of a job */
+  auto job_group = [&](size_t job) {
+    size_t group = job / replicates;
+    return std::make_pair(group / roots, group % roots);
+  };
+
+  size_t failed_replicates = 0;
+
+  const auto start_time{std::chrono::high_resolution_clock::now()};
+  /*
+   * The jobs are every replicate of every root range of every point, with the
+   * replicates of a root range next to each other, and the root ranges of a
+   * point next to each other. Each replicate gets its own random stream.
+   */
+  scheduler.run(
+      shard_jobs,
+      [&](size_t index, size_t slot) {
+        size_t job         = job_begin + index;
+        auto [point, root] = job_group(job);
+        auto  &result      = results[slot];
+
+        const auto &root_range = root_mode ? cli_options.roots[root].range
+                                           : cli_options.root_range.value();
+
+        table_ptr table;
+        if (sweep) { table = sweep->acquire(point); }
+        const auto &period_table = table ? *table : tree.period_table();
+
+        /*
+         * In parallel tree mode, the simulation is done by the pool, so the
+         * counts of every thread are needed. The pool is idle before and after
+         * the simulation.
+         */
+        auto counts = [&] {
+          return parallel_tree ? bigrig::instrument_totals()
+                               : bigrig::thread_instrument_counts();
+        };
+        const auto counts_start = counts();
+
+        bigrig::scoped_phase_t timer{bigrig::phase_e::SIMULATE};
+        const auto replicate_start{std::chrono::high_resolution_clock::now()};
+        auto gen = bigrig::rng_wrapper_t::replicate_rng(job);
+        if (parallel_tree) {
+          tree.simulate_parallel(
+              root_range, result, gen, tree_pool, period_table);
+        } else if (conditions) {
+          auto restarts = tree.simulate_conditioned(root_range,
+                                                    result,
+                                                    gen,
+                                                    period_table,
+                                                    *conditions,
+                                                    max_restarts);
+          slot_failed[slot] = !restarts.has_value();
+        } else {
+          tree.simulate(root_range, result, gen, period_table);
+        }
+        const auto replicate_end{std::chrono::high_resolution_clock::now()};
+        slot_stats[slot]  = {replicate_end - replicate_start};
+        slot_tables[slot] = std::move(table);
+
+        if (bigrig::INSTRUMENT_ENABLED) {
+          slot_stats[slot].counts = counts() - counts_start;
+        }
+      },
+      [&](size_t index, size_t slot) {
+        size_t job         = job_begin + index;
+        size_t replicate   = job % replicates;
+        auto [point, root] = job_group(job);
+
+        std::optional<size_t> point_index, root_index;
+        if (sweep) { point_index = point; }
+        if (root_mode) { root_index = root; }
+
+        /* A replicate which never met its conditions is left out */
+        auto &table  = slot_tables[slot];
+        auto &result = results[slot];
+        if (slot_failed[slot]) {
+          ++failed_replicates;
+        } else {
+          if (lazy_events && cli_options.writes_events(replicate)) {
+            tree.materialize_transitions(
+                result, table ? *table : tree.period_table());
+          }
+          output_files.write_replicate(tree,
+                                       result,
+                                       table ? table->periods : periods,
+                                       slot_stats[slot],
+                                       replicate,
+                                       point_index,
+                                       root_index);
+        }
+        table.reset();
+        if (sweep && root + 1 == roots && replicate + 1 == replicates) {
+          sweep->release(point);
+        }
+      });
+  const auto end_time{std::chrono::high_resolution_clock::now()};
+
+  if (failed_replicates > 0) {
+    LOG_WARNING("%lu replicates did not meet the conditions after %lu "
+                "restarts, and were left out of the results",
+                failed_replicates,
+                max_restarts);
+  }
+
+  /* A shard only counts the results it simulated itself */
+  program_stats_t program_stats{end_time - start_time,
+                                cli_options.shard_mode() ? shard_jobs
+                                                         : replicates};
+  if (bigrig::INSTRUMENT_ENABLED) {
+    program_stats.counts = bigrig::instrument_totals();
+  }
+  program_stats.peak_memory = bigrig::peak_memory_bytes();
+
+  /* The first shard writes the index of all of them */
+  if (cli_options.writes_shard_index()) {
+    std::vector<std::pair<size_t, size_t>> shard_results;
+    for (size_t shard = 0; shard < shard_count; ++shard) {
+      auto [begin, end] = bigrig::shard_range(jobs, shard, shard_count);
+      shard_results.emplace_back(begin, end);
+    }
+    write_shards_csv_file(cli_options, shard_results);
+  }
+
+  return program_stats;
+}
+
+#ifdef BIGRIG_MPI
+/**
+ * Make each rank a shard of the run.
+ */
+bool make_mpi_shard(const bigrig::mpi_session_t &mpi,
+                    cli_options_t               &cli_options) {
+  if (cli_options.shard_index.has_value()
+      || cli_options.shard_count.has_value()) {
+    MESSAGE_ERROR("The shards of an MPI run are the ranks, so they can't be "
+                  "given as well");
+    return false;
+  }
+  cli_options.shard_index  = mpi.rank();
+  cli_options.shard_count  = mpi.size();
+  cli_options.merge_shards = true;
+  LOG_INFO("Running on %lu MPI ranks", mpi.size());
+  return true;
+}
+#endif
+
 int main() {
-  logger::get_log_states().add_stream(
-      stdout,
-      logger::log_level::info | logger::log_level::warning
-          | logger::log_level::important | logger::log_level::error
-          | logger::log_level::progress);
+#ifdef BIGRIG_MPI
+  bigrig::mpi_session_t mpi;
+#endif
+
+  auto log_levels = logger::log_level::info | logger::log_level::warning
+                  | logger::log_level::important | logger::log_level::error
+                  | logger::log_level::progress;
+#ifdef BIGRIG_MPI
+  /* Only the first rank reports on the run, the others only report problems */
+  if (!mpi.root()) {
+    log_levels = logger::log_level::warning | logger::log_level::error;
+  }
+#endif
+  logger::get_log_states().add_stream(stdout, log_levels);
 
   CLI::App app{"A tool to simulate (ancestal) range distributions under the "
                "DEC[+J] model."};
@@ -28,6 +318,11 @@ int main() {
                  cli_options.tree_filename,
                  "[Required] A file containing a newick encoded tree which "
                  "will be used to perform the simulation.");
+  app.add_option("--tree-cache",
+                 cli_options.tree_cache,
+                 "[Optional] Directory for prepared trees. Runs with the same "
+                 "tree and period boundaries load the prepared tree from here, "
+                 "instead of parsing the tree again.");
   app.add_option("--prefix",
                  cli_options.prefix,
                  "[Optional] Prefix for the output files.");
@@ -66,6 +361,88 @@ int main() {
       jump,
       "[Required] The jump rate for cladogenesis for the simulation.");
   app.add_option("--seed", cli_options.rng_seed, "[Optional] Seed for the RNG");
+  app.add_option("--replicates",
+                 cli_options.replicates,
+                 "[Optional] Number of simulations to run on the tree. The "
+                 "results of all replicates are written to the same files.");
+  app.add_option("--sweep-table",
+                 cli_options.sweep_table,
+                 "[Optional] A table of model parameters to sweep over. Every "
+                 "row is simulated for every replicate, and the results are "
+                 "tagged with the row. See the README.md for the format.");
+  app.add_option("--root-prior",
+                 cli_options.root_prior,
+                 "[Optional] A table of root ranges, with optional weights. "
+                 "Every root range is simulated for every replicate, and the "
+                 "results are tagged with the root range. See the README.md "
+                 "for the format.");
+  app.add_flag("--all-root-ranges",
+               cli_options.all_root_ranges,
+               "[Optional] Simulate every root range for every replicate, "
+               "instead of a single root range. Needs region-count, and only "
+               "works for small region counts.");
+  app.add_option("--conditions",
+                 cli_options.conditions_file,
+                 "[Optional] A table of conditions on the tip ranges. Each "
+                 "replicate is simulated until its tips meet the conditions. "
+                 "See the README.md for the format.");
+  app.add_flag("--restart-subtree",
+               cli_options.restart_subtree,
+               "[Optional] When a condition fails, only simulate the clade of "
+               "the condition again, instead of the whole tree. Much faster, "
+               "but only approximately conditioned.");
+  app.add_option("--max-restarts",
+                 cli_options.max_restarts,
+                 "[Optional] The most restarts for one conditioned replicate, "
+                 "before it is left out of the results.");
+  app.add_option("--threads",
+                 cli_options.threads,
+                 "[Optional] Number of threads used to simulate replicates. "
+                 "Results do not depend on the number of threads.");
+  app.add_flag("--parallel-tree",
+               cli_options.parallel_tree,
+               "[Optional] Use the threads to simulate the subtrees of each "
+               "replicate in parallel, instead of the replicates. Useful for "
+               "very large trees. Results do not depend on the number of "
+               "threads, but differ from the results without this flag.");
+
+  app.add_option("--jobs",
+                 cli_options.jobs_file,
+                 "[Optional] A JSON lines file of jobs, which are all run with "
+                 "the same tree and model. Each job sets its own prefix, and "
+                 "optionally its seed, replicates and root range.");
+  app.add_option("--shard-index",
+                 cli_options.shard_index,
+                 "[Optional] Only simulate this shard of the replicates, out "
+                 "of --shard-count shards. Needs a seed. See the README.md for "
+                 "how to merge the shards.");
+  app.add_option("--shard-count",
+                 cli_options.shard_count,
+                 "[Optional] The number of shards the replicates are split "
+                 "into.");
+  app.add_flag("--writer-thread",
+               cli_options.writer_thread,
+               "[Optional] Write the results on their own thread, so that the "
+               "simulation doesn't wait for the output. Results are the same "
+               "as without this flag.");
+
+  app.add_flag("--stats-only",
+               cli_options.stats_only,
+               "[Optional] Only compute the final ranges, and the number of "
+               "events and splits in each period. Events are not stored.");
+  app.add_flag("--lazy-events",
+               cli_options.lazy_events,
+               "[Optional] Don't store the events while simulating, only what "
+               "is needed to regenerate them. The events are only written for "
+               "the replicates given to --event-replicates.");
+  app.add_option("--event-replicates",
+                 cli_options.event_replicates,
+                 "[Optional] The replicates to regenerate and write the events "
+                 "for, separated by commas. Implies --lazy-events.")
+      ->delimiter(',');
+  app.add_flag("--compress",
+               cli_options.compress,
+               "[Optional] Compress the text result files with gzip.");
 
   app.add_flag(
       "--redo", cli_options.redo, "[Optional] Ignore existing result files");
@@ -87,6 +464,14 @@ int main() {
         cli_options.output_format_type = output_format_type_e::YAML;
       },
       "[Optional] Output results in a YAML file.");
+  app.add_flag(
+      "--binary",
+      [&cli_options](std::int64_t count) {
+        (void)(count); // Silence a warning
+        cli_options.output_format_type = output_format_type_e::BINARY;
+      },
+      "[Optional] Output results in a single compact binary file, instead of "
+      "the text files.");
   app.add_flag("--two-region-duplicity",
                cli_options.two_region_duplicity,
                "[Optional] Allow for outcome duplicity in the case of 2 region "
@@ -106,6 +491,15 @@ int main() {
         cli_options.mode = bigrig::operation_mode_e::FAST;
       },
       "[Optional] Run in fast mode.");
+  app.add_flag(
+      "--endpoint",
+      [&cli_options](std::int64_t count) {
+        (void)(count);
+        cli_options.mode = bigrig::operation_mode_e::ENDPOINT;
+      },
+      "[Optional] Run in endpoint mode. Only the ranges at the nodes are "
+      "sampled, the events along the branches are not. Fast when the rates "
+      "are high.");
 
   CLI11_PARSE(app);
 
@@ -116,10 +510,25 @@ int main() {
     return 1;
   }
 
+#ifdef BIGRIG_MPI
+  if (mpi.size() > 1 && !make_mpi_shard(mpi, cli_options)) { return 1; }
+  bool options_ok = validate_and_finalize_options(cli_options);
+
+  /* The shards are merged into the files of the full run, so check those too */
+  if (options_ok && mpi.size() > 1 && mpi.root()
+      && !check_existing_results(cli_options.unsharded())
+      && !cli_options.redo.value_or(false)) {
+    MESSAGE_ERROR("Refusing to run with existing results. Please specify the "
+                  "--redo option if you want to overwrite existing results");
+    options_ok = false;
+  }
+  if (!mpi.all_ok(options_ok)) { return 1; }
+#else
   if (!validate_and_finalize_options(cli_options)) { return 1; }
+#endif
 
   if (cli_options.debug_log) {
-    std::filesystem::path debug_filename  = cli_options.prefix.value();
+    std::filesystem::path debug_filename  = cli_options.file_prefix();
     debug_filename                       += ".debug.log";
     LOG_INFO("Logging debug information to %s", debug_filename.c_str());
     logger::get_log_states().add_file_stream(
@@ -129,13 +538,23 @@ int main() {
             | logger::log_level::debug);
   }
 
-  MESSAGE_INFO("Parsing tree");
-  auto tree = bigrig::tree_t(cli_options.tree_filename.value());
-  tree.set_mode(cli_options.mode.value_or(bigrig::operation_mode_e::FAST));
+  std::vector<cli_options_t> job_options;
+  if (cli_options.jobs_mode()) {
+    auto specs = read_job_specs(cli_options.jobs_file.value());
+    auto jobs  = specs ? make_job_options(cli_options, specs.value())
+                       : std::nullopt;
+    if (!jobs) {
+      MESSAGE_ERROR("The jobs can't be run, exiting");
+      return 1;
+    }
+    job_options = std::move(jobs.value());
+  }
 
+  MESSAGE_INFO("Parsing tree");
   auto periods = cli_options.make_periods();
   if (periods.empty()) { return 1; }
-  tree.set_periods(periods);
+
+  auto tree = make_tree(cli_options, periods);
 
   if (!tree.is_ready()) {
     MESSAGE_ERROR("Could not use the tree provided, exiting");
@@ -144,17 +563,95 @@ int main() {
 
   LOG_INFO("Tree has %lu taxa", tree.leaf_count());
 
-  auto gen = cli_options.get_rng();
+  /*
+   * In a sweep, each point only gets its own copy of the models. The tree is
+   * prepared once, with the base periods.
+   */
+  std::optional<bigrig::sweep_tables_t> sweep;
+  if (cli_options.sweep_mode()) {
+    bool ok = true;
+    for (const auto &point : cli_options.sweep_points) {
+      ok &= bigrig::check_sweep_point(
+          periods, point, cli_options.root_range.value().regions());
+    }
+    if (!ok) {
+      MESSAGE_ERROR("The models of the sweep are not valid, exiting");
+      return 1;
+    }
+    bigrig::scoped_phase_t timer{bigrig::phase_e::PERIODS};
+    sweep.emplace(tree, periods, cli_options.sweep_points);
+  }
+
+  std::optional<bigrig::conditions_t> conditions;
+  if (cli_options.conditioned_mode()) {
+    conditions = bigrig::make_conditions(tree,
+                                         cli_options.conditions,
+                                         cli_options.root_range->regions(),
+                                         cli_options.restart_mode());
+    if (!conditions) {
+      MESSAGE_ERROR("The conditions don't fit the tree, exiting");
+      return 1;
+    }
+    LOG_INFO("Conditioning %lu tips", conditions->conditioned_tip_count());
+  }
 
   MESSAGE_INFO("Simulating ranges on the tree");
 
-  const auto start_time{std::chrono::high_resolution_clock::now()};
-  tree.simulate(cli_options.root_range.value(), gen);
-  const auto end_time{std::chrono::high_resolution_clock::now()};
-  program_stats_t program_stats{end_time - start_time};
+  /*
+   * The jobs share everything up to here. Only the output files, the seed and
+   * the replicates are made again for each job.
+   */
+  if (cli_options.jobs_mode()) {
+    for (const auto &job : job_options) {
+      if (job.rng_seed.has_value()) {
+        bigrig::rng_wrapper_t::seed(job.rng_seed.value());
+      } else {
+        bigrig::rng_wrapper_t::seed();
+      }
+      const auto counts_start = bigrig::instrument_totals();
+      auto program_stats = simulate_run(job, tree, periods, sweep, conditions);
+      if (!program_stats) { return 1; }
+      if (program_stats->counts) { *program_stats->counts -= counts_start; }
+      write_summary_files(job, periods, *program_stats);
+    }
+    LOG_INFO("Ran %lu jobs", job_options.size());
+    MESSAGE_INFO("Done!");
+    return 0;
+  }
+
+  auto program_stats
+      = simulate_run(cli_options, tree, periods, sweep, conditions);
+  if (!program_stats) { return 1; }
+
+#ifdef BIGRIG_MPI
+  /*
+   * The shards of the ranks are merged into the files of the full run. The
+   * program stats are the ones of the first rank, with the replicates of the
+   * full run.
+   */
+  if (mpi.size() > 1) {
+    auto merged_options   = cli_options.unsharded();
+    auto shard_filenames  = replicate_filenames(cli_options);
+    auto merged_filenames = replicate_filenames(merged_options);
+    bool ok               = true;
+    for (size_t i = 0; i < shard_filenames.size(); ++i) {
+      ok &= bigrig::merge_shard_file(
+          mpi, shard_filenames[i], merged_filenames[i]);
+    }
+    if (!ok) {
+      MESSAGE_ERROR("Failed to merge the shards of the ranks");
+      return 1;
+    }
+    if (mpi.root()) {
+      program_stats->replicates = merged_options.replicates.value_or(1);
+      write_summary_files(merged_options, periods, *program_stats);
+    }
+    MESSAGE_INFO("Done!");
+    return 0;
+  }
+#endif
 
-  MESSAGE_INFO("Writing results to files");
-  write_output_files(cli_options, tree, periods, program_stats);
+  write_summary_files(cli_options, periods, *program_stats);
 
   MESSAGE_INFO("Done!");
   return 0;
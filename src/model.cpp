@@ -2,6 +2,8 @@
 
 #include "dist.hpp"
 
+#include <algorithm>
+
 namespace bigrig {
 
 cladogenesis_params_t biogeo_model_t::normalized_cladogenesis_params() const {
@@ -138,8 +140,149 @@ double biogeo_model_t::total_nonsingleton_weight(const dist_t &dist) const {
   return sympatry_weight(dist) + allopatry_weight(dist) + jump_weight(dist);
 }
 
+namespace {
+/**
+ * A dist with `full_count` regions set. The weights only depend on the count,
+ * so this stands in for every dist with that many regions.
+ */
+dist_t make_counted_dist(size_t regions, size_t full_count) {
+  dist_t dist{static_cast<uint16_t>(regions)};
+  for (size_t i = 0; i < full_count; ++i) { dist = dist.flip_region(i); }
+  return dist;
+}
+} // namespace
+
+double biogeo_model_t::compute_rate_weight(size_t regions, size_t full) const {
+  return total_rate_weight(make_counted_dist(regions, full));
+}
+
+split_thresholds_t
+biogeo_model_t::compute_split_thresholds(size_t regions, size_t full) const {
+  auto   dist        = make_counted_dist(regions, full);
+  double allo_weight = allopatry_weight(dist);
+  return {.allopatry = allo_weight,
+          .sympatry  = allo_weight + sympatry_weight(dist),
+          .total     = total_nonsingleton_weight(dist)};
+}
+
+double
+biogeo_model_t::compute_singleton_jump_probability(size_t regions) const {
+  auto dist = make_singleton_dist(regions);
+  return jump_weight(dist) / total_singleton_weight(dist);
+}
+
+/**
+ * Build the outcome table of a split, with Vose's alias method. The outcomes of
+ * each class are counted the same way as the weights, so the split types have
+ * the same probabilities as in the fast splitter.
+ */
+split_outcome_table_t
+biogeo_model_t::compute_split_outcomes(size_t regions, size_t full) const {
+  constexpr size_t CLASSES = split_outcome_table_t::CLASSES;
+
+  auto                  dist = make_counted_dist(regions, full);
+  split_outcome_table_t table;
+  table.counts = {allopatry_count(dist),
+                  sympatry_count(dist),
+                  copy_count(dist),
+                  jump_count(dist)};
+
+  std::array<double, CLASSES> params{_clad_params.allopatry,
+                                     _clad_params.sympatry,
+                                     _clad_params.copy,
+                                     _clad_params.jump};
+  std::array<double, CLASSES> scaled;
+
+  double total = 0.0;
+  for (size_t k = 0; k < CLASSES; ++k) {
+    scaled[k]  = static_cast<double>(table.counts[k]) * params[k];
+    total     += scaled[k];
+  }
+  if (total == 0.0) {
+    /*
+     * Nothing can happen, e.g. a singleton without copies or jumps, so every
+     * draw is a copy, which is what the other splitters do as well
+     */
+    constexpr uint8_t COPY = 2;
+    table.counts[COPY]     = std::max<size_t>(table.counts[COPY], 1);
+    table.probs.fill(0.0);
+    table.aliases.fill(COPY);
+    return table;
+  }
+
+  /* Scale so that the mean is 1, and split into the small and large classes */
+  std::array<uint8_t, CLASSES> small, large;
+  size_t                       small_count = 0, large_count = 0;
+  for (size_t k = 0; k < CLASSES; ++k) {
+    scaled[k] *= CLASSES / total;
+    if (scaled[k] < 1.0) {
+      small[small_count++] = static_cast<uint8_t>(k);
+    } else {
+      large[large_count++] = static_cast<uint8_t>(k);
+    }
+  }
+
+  /* Each small class is topped up by a large one */
+  while (small_count > 0 && large_count > 0) {
+    auto s = small[--small_count];
+    auto l = large[--large_count];
+
+    table.probs[s]    = scaled[s];
+    table.aliases[s]  = l;
+    scaled[l]        += scaled[s] - 1.0;
+    if (scaled[l] < 1.0) {
+      small[small_count++] = l;
+    } else {
+      large[large_count++] = l;
+    }
+  }
+
+  /* Whatever is left is 1, up to rounding */
+  while (large_count > 0) {
+    auto l           = large[--large_count];
+    table.probs[l]   = 1.0;
+    table.aliases[l] = l;
+  }
+  while (small_count > 0) {
+    auto s           = small[--small_count];
+    table.probs[s]   = 1.0;
+    table.aliases[s] = s;
+  }
+  return table;
+}
+
+/**
+ * Rebuild the weight tables for the current parameters. Does nothing if the
+ * region count hasn't been set.
+ */
+void biogeo_model_t::build_weight_tables() {
+  _rate_weight_table.clear();
+  _split_table.clear();
+  _outcome_table.clear();
+  if (_table_regions == 0) { return; }
+
+  for (size_t full = 0; full <= _table_regions; ++full) {
+    _rate_weight_table.push_back(compute_rate_weight(_table_regions, full));
+    _split_table.push_back(compute_split_thresholds(_table_regions, full));
+    _outcome_table.push_back(compute_split_outcomes(_table_regions, full));
+  }
+  _singleton_jump_probability
+      = compute_singleton_jump_probability(_table_regions);
+}
+
+/**
+ * Set the number of regions that will be simulated with this model, and
+ * precompute the weight tables for it.
+ */
+biogeo_model_t &biogeo_model_t::set_region_count(size_t regions) {
+  _table_regions = regions;
+  build_weight_tables();
+  return *this;
+}
+
 biogeo_model_t &biogeo_model_t::set_params(rate_params_t p) {
   _rate_params = p;
+  build_weight_tables();
   return *this;
 }
 biogeo_model_t &biogeo_model_t::set_params(double d, double e) {
@@ -151,6 +294,7 @@ biogeo_model_t &biogeo_model_t::set_cladogenesis_params(double v,
                                                         double y,
                                                         double j) {
   _clad_params = {.allopatry = v, .sympatry = s, .copy = y, .jump = j};
+  build_weight_tables();
 
   return *this;
 }
@@ -158,12 +302,14 @@ biogeo_model_t &biogeo_model_t::set_cladogenesis_params(double v,
 biogeo_model_t &
 biogeo_model_t::set_cladogenesis_params(const cladogenesis_params_t &p) {
   _clad_params = p;
+  build_weight_tables();
 
   return *this;
 }
 
 biogeo_model_t &biogeo_model_t::set_two_region_duplicity(bool d) {
   _duplicity = d;
+  build_weight_tables();
   return *this;
 }
 
@@ -1,12 +1,15 @@
 #pragma once
 
+#include "dist_fwd.hpp"
+
+#include <array>
 #include <cstddef>
+#include <cstdint>
 #include <sstream>
+#include <vector>
 
 namespace bigrig {
 
-class dist_t;
-
 struct rate_params_t {
   double dis;
   double ext;
@@ -113,6 +116,32 @@ static_assert(offsetof(cladogenesis_params_t, jump)
                   + sizeof(cladogenesis_params_t::data_type)
               == sizeof(cladogenesis_params_t));
 
+/**
+ * The split type weights for a non-singleton dist, as cumulative thresholds. A
+ * roll in `[0, total)` is an allopatric split if it is at most `allopatry`, a
+ * sympatric split if it is at most `sympatry`, and a jump otherwise.
+ */
+struct split_thresholds_t {
+  double allopatry;
+  double sympatry;
+  double total;
+};
+
+/**
+ * The outcomes of a split, for the exact splitter of simulation mode. The
+ * outcomes are grouped into classes by split type, in the same order as the
+ * fields of `cladogenesis_params_t`, and every outcome in a class is equally
+ * likely. A split is sampled by picking a class with the alias method, and then
+ * one of the `counts` outcomes of the class.
+ */
+struct split_outcome_table_t {
+  static constexpr size_t CLASSES = cladogenesis_params_t::size();
+
+  std::array<size_t, CLASSES>  counts{};
+  std::array<double, CLASSES>  probs{};
+  std::array<uint8_t, CLASSES> aliases{};
+};
+
 /**
  * Class containing the model parameters, which includes:
  * - Rate parameters,
@@ -196,10 +225,54 @@ public:
   bool check_cladogenesis_params_ok(size_t region_count) const;
   bool check_ok(size_t region_count) const;
 
+  /*
+   * Lookups for the hot paths. All of the weights only depend on the number of
+   * full regions, so once the region count is set, they are precomputed into
+   * tables indexed by the full region count. If the table was built for a
+   * different region count, the weights are computed instead.
+   */
+
+  double lookup_rate_weight(size_t regions, size_t full_count) const {
+    if (regions == _table_regions) { return _rate_weight_table[full_count]; }
+    return compute_rate_weight(regions, full_count);
+  }
+
+  split_thresholds_t lookup_split_thresholds(size_t regions,
+                                             size_t full_count) const {
+    if (regions == _table_regions) { return _split_table[full_count]; }
+    return compute_split_thresholds(regions, full_count);
+  }
+
+  double lookup_singleton_jump_probability(size_t regions) const {
+    if (regions == _table_regions) { return _singleton_jump_probability; }
+    return compute_singleton_jump_probability(regions);
+  }
+
+  split_outcome_table_t lookup_split_outcomes(size_t regions,
+                                              size_t full_count) const {
+    if (regions == _table_regions) { return _outcome_table[full_count]; }
+    return compute_split_outcomes(regions, full_count);
+  }
+
 private:
+  double             compute_rate_weight(size_t regions, size_t full) const;
+  split_thresholds_t compute_split_thresholds(size_t regions,
+                                              size_t full) const;
+  double             compute_singleton_jump_probability(size_t regions) const;
+  void               build_weight_tables();
+
+  split_outcome_table_t compute_split_outcomes(size_t regions,
+                                               size_t full) const;
+
   rate_params_t         _rate_params;
   cladogenesis_params_t _clad_params;
 
   bool _duplicity = false;
+
+  size_t                             _table_regions = 0;
+  std::vector<double>                _rate_weight_table;
+  std::vector<split_thresholds_t>    _split_table;
+  std::vector<split_outcome_table_t> _outcome_table;
+  double                             _singleton_jump_probability = 0.0;
 };
 } // namespace bigrig
@@ -0,0 +1,98 @@
+#include "mpi.hpp"
+
+#include "logger.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <mpi.h>
+#include <vector>
+
+namespace bigrig {
+
+mpi_session_t::mpi_session_t() {
+  MPI_Init(nullptr, nullptr);
+  int rank, size;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+  _rank = static_cast<size_t>(rank);
+  _size = static_cast<size_t>(size);
+}
+
+mpi_session_t::~mpi_session_t() { MPI_Finalize(); }
+
+/**
+ * Checks if every rank is ok. Collective.
+ */
+bool mpi_session_t::all_ok(bool ok) const {
+  int local = ok, all = 0;
+  MPI_Allreduce(&local, &all, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+  return all != 0;
+}
+
+void mpi_session_t::barrier() const { MPI_Barrier(MPI_COMM_WORLD); }
+
+/**
+ * Join the shard files of every rank into a single file, in the order of the
+ * ranks, and remove the shard files. Collective.
+ *
+ * The offset of each shard in the merged file is the size of the shards
+ * before it, so every rank writes its own shard into the file at once, and
+ * nothing is sent between the ranks except the sizes. A shard that doesn't
+ * exist is taken to be empty.
+ */
+bool merge_shard_file(const mpi_session_t         &mpi,
+                      const std::filesystem::path &shard_filename,
+                      const std::filesystem::path &merged_filename) {
+  constexpr size_t CHUNK_SIZE = 1 << 24;
+
+  std::error_code ec;
+  uint64_t        size = std::filesystem::exists(shard_filename)
+                           ? std::filesystem::file_size(shard_filename, ec)
+                           : 0;
+  bool            ok   = !ec;
+
+  /* The result of the scan on the first rank is undefined */
+  uint64_t offset = 0;
+  MPI_Exscan(&size, &offset, 1, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+  if (mpi.root()) { offset = 0; }
+
+  /* Opening doesn't truncate the file, so an old one has to go first */
+  if (mpi.root()) { MPI_File_delete(merged_filename.c_str(), MPI_INFO_NULL); }
+  mpi.barrier();
+
+  MPI_File file;
+  bool     opened = MPI_File_open(MPI_COMM_WORLD,
+                              merged_filename.c_str(),
+                              MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                              MPI_INFO_NULL,
+                              &file)
+               == MPI_SUCCESS;
+  ok &= opened;
+
+  std::ifstream     shard(shard_filename, std::ios::binary);
+  std::vector<char> buffer(std::min<uint64_t>(size, CHUNK_SIZE));
+  for (uint64_t done = 0; ok && done < size;) {
+    size_t count = std::min<uint64_t>(CHUNK_SIZE, size - done);
+    ok           = static_cast<bool>(shard.read(buffer.data(), count))
+       && MPI_File_write_at(file,
+                            static_cast<MPI_Offset>(offset + done),
+                            buffer.data(),
+                            static_cast<int>(count),
+                            MPI_BYTE,
+                            MPI_STATUS_IGNORE)
+              == MPI_SUCCESS;
+    done += count;
+  }
+  if (opened) { MPI_File_close(&file); }
+
+  if (!ok) {
+    LOG_ERROR("Failed to merge the shard '%s' into '%s'",
+              shard_filename.c_str(),
+              merged_filename.c_str());
+  }
+  if (!mpi.all_ok(ok)) { return false; }
+  std::filesystem::remove(shard_filename, ec);
+  return true;
+}
+
+} // namespace bigrig
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+
+namespace bigrig {
+
+/**
+ * MPI, for the `bigrig_mpi` build. MPI is started when the session is made,
+ * and finalized when it is destroyed, so there should be exactly one, which
+ * lives for all of `main`.
+ *
+ * Each rank runs one shard of the jobs, and every rank has to take part in the
+ * collective calls, so the ranks have to agree on when to stop early. Use
+ * `all_ok` for that.
+ */
+class mpi_session_t {
+public:
+  mpi_session_t();
+  ~mpi_session_t();
+
+  mpi_session_t(const mpi_session_t &)            = delete;
+  mpi_session_t &operator=(const mpi_session_t &) = delete;
+
+  size_t rank() const { return _rank; }
+  size_t size() const { return _size; }
+  bool   root() const { return _rank == 0; }
+
+  bool all_ok(bool ok) const;
+  void barrier() const;
+
+private:
+  size_t _rank;
+  size_t _size;
+};
+
+bool merge_shard_file(const mpi_session_t         &mpi,
+                      const std::filesystem::path &shard_filename,
+                      const std::filesystem::path &merged_filename);
+
+} // namespace bigrig
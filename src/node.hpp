@@ -1,121 +1,98 @@
 #pragma once
 
-#include "dist.hpp"
-#include "model.hpp"
-#include "period.hpp"
-#include "split.hpp"
-
-#include <corax/tree/utree.h>
-#include <functional>
-#include <logger.hpp>
+#include <cstddef>
+#include <iterator>
+#include <span>
 #include <string>
-#include <vector>
 
 namespace bigrig {
 
+class tree_t;
+class child_range_t;
+
+/**
+ * A handle to a node of a `tree_t`.
+ *
+ * The tree stores the nodes as flat arrays, in preorder, so a node is just the
+ * tree and the index of the node into those arrays. This makes a `node_t`
+ * cheap to copy, but it is only valid as long as the tree it came from.
+ *
+ * The index is the position of the node in the arrays (and in a
+ * `sim_result_t`). The node id is the number that is used to label the inner
+ * nodes in the output.
+ */
 class node_t {
 public:
-  node_t() = default;
-
-  node_t(corax_unode_t *n);
-
-  void add_child(const std::shared_ptr<node_t> &n);
-
-  /**
-   * Run the simulation, given the initial distribution, model and RNG.
-   *
-   * Modifies the state of the node_t, so that once the function is finished,
-   * the _transitions vector is full, _final_state is occupied, and _split is
-   * computed.
-   *
-   * Also, this is a recursive function that is top down. After the results for
-   * this node are computed, the results for the children are computed.
-   */
-  void simulate(dist_t                                  initial_distribution,
-                std::uniform_random_bit_generator auto &gen,
-                operation_mode_e mode = operation_mode_e::FAST) {
-    LOG_DEBUG("Node sampling with initial_distribution = %s",
-              initial_distribution.to_str().c_str());
-    _transitions
-        = simulate_transitions(initial_distribution, _periods, gen, mode);
-    LOG_DEBUG("Finished sampling with %lu transitions", _transitions.size());
-    if (_transitions.size() == 0) {
-      _final_state = initial_distribution;
-    } else {
-      _final_state = _transitions.back().final_state;
-    }
-    _split = split_dist(_final_state, _periods.back().model(), gen, mode);
-    _split.period_index = _periods.back().index();
-
-    if (!is_leaf()) {
-      _children[0]->simulate(_split.left, gen, mode);
-      _children[1]->simulate(_split.right, gen, mode);
-    }
-  }
-
-  std::ostream &
-  to_newick(std::ostream                                       &os,
-            std::function<void(std::ostream &, const node_t &)> cb) const;
-
-  std::ostream &to_newick(std::ostream &os) const;
-
-  std::ostream &
-  to_phylip_line(std::ostream &os, size_t pad_to = 0, bool all = false) const;
-
-  inline bool is_leaf() const { return _children.size() == 0; }
-
-  size_t leaf_count() const;
-  size_t node_count() const;
+  node_t(const tree_t &tree, size_t index) : _tree{&tree}, _index{index} {}
 
-  bool is_binary() const;
-  bool is_valid() const;
-  bool validate_periods() const;
+  size_t index() const { return _index; }
 
-  void assign_periods(const std::vector<period_t> &periods);
-  void assign_id_root();
+  size_t             node_id() const;
+  const std::string &label() const;
+  const std::string &string_id() const;
 
-  size_t assign_id(size_t next);
+  double brlen() const;
+  double abs_time() const;
+  double abs_time_at_start() const;
 
-  size_t get_string_id_len_max(bool all);
+  bool          is_leaf() const;
+  child_range_t children() const;
 
-  size_t get_string_id_len_max(size_t max, bool all);
-
-  std::string label() const;
-  double      brlen() const;
-  double      abs_time() const;
-  double      abs_time_at_start() const;
-  size_t      node_id() const;
-  dist_t      final_state() const;
-  std::string string_id() const;
-
-  split_t node_split() const;
+private:
+  const tree_t *_tree;
+  size_t        _index;
+};
 
-  std::vector<std::shared_ptr<node_t>> &children();
+/**
+ * The children of a node. This is a view of the child list in the tree, so
+ * nothing is copied, and it is only valid as long as the tree.
+ */
+class child_range_t {
+public:
+  class iterator {
+  public:
+    using value_type        = node_t;
+    using difference_type   = std::ptrdiff_t;
+    using iterator_category = std::input_iterator_tag;
+
+    iterator() = default;
+    iterator(const tree_t *tree, const size_t *child)
+        : _tree{tree}, _child{child} {}
+
+    node_t    operator*() const { return {*_tree, *_child}; }
+    iterator &operator++() {
+      ++_child;
+      return *this;
+    }
+    iterator operator++(int) {
+      auto ret = *this;
+      ++_child;
+      return ret;
+    }
+    bool operator==(const iterator &other) const {
+      return _child == other._child;
+    }
 
-  std::vector<std::shared_ptr<node_t>> children() const;
+  private:
+    const tree_t *_tree  = nullptr;
+    const size_t *_child = nullptr;
+  };
 
-  std::vector<transition_t>  transitions() const;
-  std::vector<transition_t> &transitions();
+  child_range_t(const tree_t &tree, std::span<const size_t> children)
+      : _tree{&tree}, _children{children} {}
 
-  void assign_abs_time(double t);
+  size_t size() const { return _children.size(); }
+  bool   empty() const { return _children.empty(); }
 
-  void assign_abs_time_root();
+  node_t operator[](size_t i) const { return {*_tree, _children[i]}; }
 
-  void set_label(const std::string &str);
-  dist_t start_range() const;
+  iterator begin() const { return {_tree, _children.data()}; }
+  iterator end() const {
+    return {_tree, _children.data() + _children.size()};
+  }
 
 private:
-  void     parse_periods(const std::vector<period_t> &periods);
-  period_t clamp_period(const period_t &p) const;
-
-  double                               _brlen;
-  double                               _abs_time;
-  dist_t                               _final_state;
-  split_t                              _split;
-  std::string                          _label;
-  std::vector<std::shared_ptr<node_t>> _children;
-  std::vector<transition_t>            _transitions;
-  std::vector<period_t>                _periods;
-  size_t                               _node_id;
+  const tree_t           *_tree;
+  std::span<const size_t> _children;
 };
 } // namespace bigrig
@@ -2,7 +2,10 @@
 
 #include "model.hpp"
 
+#include <cstddef>
+#include <iterator>
 #include <memory>
+#include <span>
 
 namespace bigrig {
 
@@ -44,10 +47,105 @@ public:
 
   std::shared_ptr<biogeo_model_t> model_ptr() const { return _model; }
 
+  void set_model(std::shared_ptr<biogeo_model_t> model) {
+    _model = std::move(model);
+  }
+
 private:
   double                          _start;
   double                          _length;
   std::shared_ptr<biogeo_model_t> _model;
   size_t                          _index;
 };
+
+/**
+ * The part of a period which covers a branch. Only points at the period, so a
+ * segment is cheap to make and doesn't touch the reference count of the model.
+ */
+class period_segment_t {
+public:
+  period_segment_t(const period_t &period, double start, double length)
+      : _period{&period}, _start{start}, _length{length} {}
+
+  double start() const { return _start; }
+  double length() const { return _length; }
+  double end() const { return start() + length(); }
+  size_t index() const { return _period->index(); }
+
+  const biogeo_model_t &model() const { return _period->model(); }
+  const period_t       &period() const { return *_period; }
+
+private:
+  const period_t *_period;
+  double          _start;
+  double          _length;
+};
+
+/**
+ * The periods which cover a branch, as a range of the period table of the
+ * tree, and the start and end times of the branch. The first and last periods
+ * are clamped to the branch when they are read, so nothing is copied per node.
+ */
+class branch_periods_t {
+public:
+  class iterator {
+  public:
+    using value_type        = period_segment_t;
+    using difference_type   = std::ptrdiff_t;
+    using iterator_category = std::input_iterator_tag;
+
+    iterator() = default;
+    iterator(const branch_periods_t *view, size_t i) : _view{view}, _i{i} {}
+
+    period_segment_t operator*() const { return (*_view)[_i]; }
+    iterator        &operator++() {
+      ++_i;
+      return *this;
+    }
+    iterator operator++(int) {
+      auto ret = *this;
+      ++_i;
+      return ret;
+    }
+    bool operator==(const iterator &other) const { return _i == other._i; }
+
+  private:
+    const branch_periods_t *_view = nullptr;
+    size_t                  _i    = 0;
+  };
+
+  branch_periods_t(std::span<const period_t> periods, double start, double end)
+      : _periods{periods}, _start{start}, _end{end} {}
+
+  size_t size() const { return _periods.size(); }
+  bool   empty() const { return _periods.empty(); }
+
+  /**
+   * Clamp the period to the branch. This is done in the same order as the
+   * periods were clamped when they were copied per node, so that the lengths
+   * come out the same, to the bit.
+   */
+  period_segment_t operator[](size_t i) const {
+    const auto &p      = _periods[i];
+    double      start  = p.start();
+    double      length = p.length();
+    if (start < _start) {
+      length = length - (_start - start);
+      start  = _start;
+    }
+    if (start + length > _end) { length = _end - start; }
+    return {p, start, length};
+  }
+
+  period_segment_t front() const { return (*this)[0]; }
+  period_segment_t back() const { return (*this)[size() - 1]; }
+
+  iterator begin() const { return {this, 0}; }
+  iterator end() const { return {this, size()}; }
+
+private:
+  std::span<const period_t> _periods;
+  double                    _start;
+  double                    _end;
+};
 } // namespace bigrig
@@ -0,0 +1,206 @@
+#include "prepared.hpp"
+
+#include "bytes.hpp"
+#include "logger.hpp"
+
+#include <array>
+#include <cstdio>
+#include <fstream>
+#include <unistd.h>
+
+static_assert(sizeof(size_t) == sizeof(uint64_t),
+              "The prepared tree format stores indices as 64 bit values");
+
+namespace bigrig {
+
+namespace {
+size_t padding(size_t size) { return (8 - size % 8) % 8; }
+
+/**
+ * Check that the node arrays describe a tree in preorder, and that the period
+ * counts and label offsets fit the rest of the file.
+ */
+bool validate_arrays(const std::vector<size_t> &parents,
+                     const std::vector<size_t> &period_firsts,
+                     const std::vector<size_t> &period_counts,
+                     const std::vector<size_t> &label_offsets,
+                     size_t                     period_count,
+                     size_t                     label_bytes) {
+  if (parents.empty() || parents[0] != tree_t::no_parent) { return false; }
+  for (size_t index = 1; index < parents.size(); ++index) {
+    if (parents[index] >= index) { return false; }
+  }
+
+  for (size_t index = 0; index < parents.size(); ++index) {
+    if (period_counts[index] == 0 || period_firsts[index] >= period_count
+        || period_counts[index] > period_count - period_firsts[index]) {
+      return false;
+    }
+  }
+
+  for (size_t i = 1; i < label_offsets.size(); ++i) {
+    if (label_offsets[i] < label_offsets[i - 1]) { return false; }
+  }
+  return label_offsets.front() == 0 && label_offsets.back() == label_bytes;
+}
+} // namespace
+
+std::string prepared_key_t::filename() const {
+  std::array<char, 48> buffer;
+  std::snprintf(buffer.data(),
+                buffer.size(),
+                "%016lx-%016lx.bgpt",
+                tree_hash,
+                period_hash);
+  return buffer.data();
+}
+
+/**
+ * Hash the tree file, and the index, start and length of every period. The
+ * lengths are included, since the last period is open ended.
+ */
+std::optional<prepared_key_t>
+make_prepared_key(const std::filesystem::path &tree_filename,
+                  const std::vector<period_t> &periods) {
+  mapped_file_t tree_file{tree_filename};
+  if (!tree_file.ok()) { return {}; }
+
+  std::string boundaries;
+  for (const auto &p : periods) {
+    binary::put<uint64_t>(boundaries, p.index());
+    binary::put<double>(boundaries, p.start());
+    binary::put<double>(boundaries, p.length());
+  }
+
+  return prepared_key_t{
+      .tree_hash   = binary::hash_bytes(tree_file.data()),
+      .period_hash = binary::hash_bytes(std::as_bytes(std::span{boundaries})),
+  };
+}
+
+/**
+ * Write a prepared tree. The file is written under a temporary name first, and
+ * then renamed, so that runs started at the same time never see a partial file.
+ */
+bool write_prepared_tree(const std::filesystem::path &filename,
+                         const tree_t                &tree,
+                         const prepared_key_t        &key) {
+  using binary::put;
+  using binary::put_array;
+
+  std::vector<size_t> parents, firsts, counts, label_offsets{0};
+  std::vector<double> brlens;
+  std::string         labels;
+  for (size_t index = 0; index < tree.node_count(); ++index) {
+    parents.push_back(tree.parent(index));
+    brlens.push_back(tree.brlen(index));
+    firsts.push_back(tree.first_period(index));
+    counts.push_back(tree.node_periods(index).size());
+    labels += tree.label(index);
+    label_offsets.push_back(labels.size());
+  }
+
+  std::string buffer;
+  buffer.append(prepared::MAGIC.data(), prepared::MAGIC.size());
+  put<uint32_t>(buffer, prepared::VERSION);
+  put<uint64_t>(buffer, key.tree_hash);
+  put<uint64_t>(buffer, key.period_hash);
+  put<uint64_t>(buffer, tree.node_count());
+  put<uint64_t>(buffer, tree.periods().size());
+  put<uint64_t>(buffer, labels.size());
+  put_array(buffer, parents);
+  put_array(buffer, brlens);
+  put_array(buffer, firsts);
+  put_array(buffer, counts);
+  put_array(buffer, label_offsets);
+  buffer += labels;
+  buffer.append(padding(labels.size()), '\0');
+
+  auto temp_filename = filename;
+  temp_filename += ".tmp." + std::to_string(getpid());
+  {
+    std::ofstream file(temp_filename, std::ios::binary | std::ios::trunc);
+    file.write(buffer.data(), buffer.size());
+    if (!file) {
+      LOG_ERROR("Failed to write the prepared tree '%s'",
+                temp_filename.c_str());
+      std::filesystem::remove(temp_filename);
+      return false;
+    }
+  }
+
+  std::error_code ec;
+  std::filesystem::rename(temp_filename, filename, ec);
+  if (ec) {
+    LOG_ERROR("Failed to move the prepared tree to '%s'", filename.c_str());
+    std::filesystem::remove(temp_filename, ec);
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Load a prepared tree, and attach `periods` to it. Returns nothing if there is
+ * no usable prepared tree, in which case the caller should prepare the tree
+ * from scratch.
+ */
+std::optional<tree_t>
+read_prepared_tree(const std::filesystem::path &filename,
+                   const prepared_key_t        &key,
+                   const std::vector<period_t> &periods) {
+  if (!std::filesystem::exists(filename)) { return {}; }
+
+  mapped_file_t file{filename};
+  if (!file.ok()) { return {}; }
+
+  binary::cursor_t cursor{file.data()};
+
+  auto magic   = cursor.get<std::array<char, 4>>();
+  auto version = cursor.get<uint32_t>();
+  if (!cursor.ok() || magic != prepared::MAGIC
+      || version != prepared::VERSION) {
+    LOG_WARNING("The file '%s' is not a usable prepared tree, ignoring it",
+                filename.c_str());
+    return {};
+  }
+
+  prepared_key_t found{.tree_hash   = cursor.get<uint64_t>(),
+                       .period_hash = cursor.get<uint64_t>()};
+  if (found != key) {
+    LOG_WARNING("The prepared tree '%s' is for a different tree or periods, "
+                "ignoring it",
+                filename.c_str());
+    return {};
+  }
+
+  auto node_count   = cursor.get<uint64_t>();
+  auto period_count = cursor.get<uint64_t>();
+  auto label_bytes  = cursor.get<uint64_t>();
+
+  auto parents       = cursor.get_array<size_t>(node_count);
+  auto brlens        = cursor.get_array<double>(node_count);
+  auto firsts        = cursor.get_array<size_t>(node_count);
+  auto counts        = cursor.get_array<size_t>(node_count);
+  auto label_offsets = cursor.get_array<size_t>(node_count + 1);
+  auto label_data    = cursor.get_string(label_bytes);
+
+  if (!cursor.ok() || period_count != periods.size()
+      || !validate_arrays(
+          parents, firsts, counts, label_offsets, period_count, label_bytes)) {
+    LOG_WARNING("The prepared tree '%s' is malformed, ignoring it",
+                filename.c_str());
+    return {};
+  }
+
+  std::vector<std::string> labels;
+  labels.reserve(node_count);
+  for (size_t index = 0; index < node_count; ++index) {
+    labels.push_back(label_data.substr(
+        label_offsets[index], label_offsets[index + 1] - label_offsets[index]));
+  }
+
+  tree_t tree{std::move(parents), std::move(brlens), std::move(labels)};
+  tree.set_assigned_periods(periods, std::move(firsts), std::move(counts));
+  return tree;
+}
+} // namespace bigrig
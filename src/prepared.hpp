@@ -0,0 +1,72 @@
+#pragma once
+
+#include "period.hpp"
+#include "tree.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace bigrig {
+
+/**
+ * A cache of trees which have been parsed, and had their periods assigned.
+ *
+ * Parsing a large newick file and assigning the periods to every node is most
+ * of the start up time of a run, and it is the same for every run with the
+ * same tree and the same period boundaries. So, the converted node arrays and
+ * the period assignments can be written to a prepared tree file, and later
+ * runs load that instead. The periods of a node are stored as a range of the
+ * periods sorted by start time, the same way the tree stores them.
+ *
+ * A prepared tree is keyed by a hash of the contents of the tree file, and a
+ * hash of the period boundaries. The rates of the periods are not part of the
+ * key, since they don't change the assignment, so runs which only change the
+ * rates share a prepared tree. The file name is made from the key, so a cache
+ * directory can hold the prepared trees for many trees and periods.
+ *
+ * All values are stored little-endian, and every array is 8 byte aligned:
+ *
+ *     char[4]  magic "BGPT"
+ *     uint32   version
+ *     uint64   tree hash
+ *     uint64   period hash
+ *     uint64   node count
+ *     uint64   period count
+ *     uint64   label bytes
+ *     uint64   parent index, or `tree_t::no_parent`, for every node
+ *     float64  branch length, for every node
+ *     uint64   first period, for every node
+ *     uint64   number of periods, for every node
+ *     uint64   label offsets, for every node, plus one for the end
+ *     char     labels, padded to 8 bytes
+ */
+namespace prepared {
+constexpr std::array<char, 4> MAGIC   = {'B', 'G', 'P', 'T'};
+constexpr uint32_t            VERSION = 2;
+} // namespace prepared
+
+struct prepared_key_t {
+  uint64_t tree_hash;
+  uint64_t period_hash;
+
+  std::string filename() const;
+
+  bool operator==(const prepared_key_t &) const = default;
+};
+
+std::optional<prepared_key_t>
+make_prepared_key(const std::filesystem::path &tree_filename,
+                  const std::vector<period_t> &periods);
+
+bool write_prepared_tree(const std::filesystem::path &filename,
+                         const tree_t                &tree,
+                         const prepared_key_t        &key);
+
+std::optional<tree_t>
+read_prepared_tree(const std::filesystem::path &filename,
+                   const prepared_key_t        &key,
+                   const std::vector<period_t> &periods);
+} // namespace bigrig
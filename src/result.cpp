@@ -0,0 +1,146 @@
+#include "result.hpp"
+
+#include <algorithm>
+
+namespace bigrig {
+
+period_stats_t &period_stats_t::operator+=(const period_stats_t &other) {
+  dispersions       += other.dispersions;
+  extinctions       += other.extinctions;
+  singleton_splits  += other.singleton_splits;
+  allopatric_splits += other.allopatric_splits;
+  sympatric_splits  += other.sympatric_splits;
+  jump_splits       += other.jump_splits;
+  return *this;
+}
+
+/**
+ * Prepare the result for a new simulation on a tree with `node_count` nodes.
+ *
+ * Every node is overwritten by the simulation, so when the node count doesn't
+ * change, this is constant time. The transition buffer is cleared, but keeps
+ * its capacity.
+ */
+void sim_result_t::reset(size_t node_count, dist_t root_range) {
+  _root_range = root_range;
+  _final_states.resize(node_count);
+  _splits.resize(node_count);
+  _transition_offsets.resize(node_count);
+  _transition_counts.resize(node_count);
+  _transition_buffer.clear();
+  if (_lazy_events) { _branch_rngs.resize(node_count); }
+  for (auto &s : _period_stats) { s = {}; }
+  _node_key.reset();
+}
+
+void sim_result_t::clear_transitions() {
+  _transition_buffer.clear();
+  std::fill(_transition_offsets.begin(), _transition_offsets.end(), 0);
+  std::fill(_transition_counts.begin(), _transition_counts.end(), 0);
+}
+
+/**
+ * Copy the transitions which are still used to a new buffer, in node order.
+ * This is only done once less than half of the buffer is used, so that a run
+ * of small edits doesn't copy the whole buffer every time.
+ */
+void sim_result_t::compact_transitions() {
+  size_t used = 0;
+  for (auto count : _transition_counts) { used += count; }
+  if (used * 2 >= _transition_buffer.size()) { return; }
+
+  std::vector<transition_t> buffer;
+  buffer.reserve(used);
+  for (size_t index = 0; index < node_count(); ++index) {
+    auto t                     = transitions(index);
+    _transition_offsets[index] = buffer.size();
+    buffer.insert(buffer.end(), t.begin(), t.end());
+  }
+  _transition_buffer = std::move(buffer);
+}
+
+/**
+ * The range at the start of the branch leading to a node.
+ */
+dist_t sim_result_t::start_range(size_t index) const {
+  auto t = transitions(index);
+  if (t.empty()) { return _final_states[index]; }
+  return t.front().initial_state;
+}
+
+/**
+ * Get the shards ready for a parallel simulation, with one shard per worker.
+ * Like the transition buffer, the shards keep their memory between replicates.
+ */
+void sim_result_t::reset_shards(size_t count) {
+  _shards.resize(count);
+  for (auto &shard : _shards) {
+    shard._result = this;
+    shard._transitions.clear();
+    shard._nodes.clear();
+    for (auto &s : shard._period_stats) { s = {}; }
+  }
+}
+
+/**
+ * Move the transitions and counts from the shards into the result, and fix up
+ * the offsets of the nodes in each shard. Called once every node is done.
+ */
+void sim_result_t::merge_shards() {
+  for (auto &shard : _shards) {
+    size_t base = _transition_buffer.size();
+    _transition_buffer.insert(_transition_buffer.end(),
+                              shard._transitions.begin(),
+                              shard._transitions.end());
+    for (auto index : shard._nodes) { _transition_offsets[index] += base; }
+
+    for (size_t i = 0; i < shard._period_stats.size(); ++i) {
+      stats_for_period(_period_stats, i) += shard._period_stats[i];
+    }
+  }
+}
+
+/**
+ * Count a split for the period it happened in.
+ */
+void sim_result_t::count_split(std::vector<period_stats_t> &stats,
+                               const split_t               &s) {
+  auto &period = stats_for_period(stats, s.period_index);
+  switch (s.type) {
+  case split_type_e::singleton:
+    period.singleton_splits++;
+    break;
+  case split_type_e::allopatric:
+    period.allopatric_splits++;
+    break;
+  case split_type_e::sympatric:
+    period.sympatric_splits++;
+    break;
+  case split_type_e::jump:
+    period.jump_splits++;
+    break;
+  case split_type_e::invalid:
+    break;
+  }
+}
+
+/**
+ * A transition either adds a region (dispersion) or removes one (extinction).
+ */
+void sim_result_t::count_transition(std::vector<period_stats_t> &stats,
+                                    const transition_t          &t) {
+  auto &period = stats_for_period(stats, t.period_index);
+  if (t.final_state.full_region_count() > t.initial_state.full_region_count()) {
+    period.dispersions++;
+  } else {
+    period.extinctions++;
+  }
+}
+
+period_stats_t &
+sim_result_t::stats_for_period(std::vector<period_stats_t> &stats,
+                               size_t                       period_index) {
+  if (period_index >= stats.size()) { stats.resize(period_index + 1); }
+  return stats[period_index];
+}
+} // namespace bigrig
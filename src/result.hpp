@@ -0,0 +1,261 @@
+#pragma once
+
+#include "dist.hpp"
+#include "split.hpp"
+
+#include "pcg_random.hpp"
+
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace bigrig {
+
+/**
+ * Counts of the events which happened during a single period. Used when only
+ * summary statistics are needed.
+ */
+struct period_stats_t {
+  size_t dispersions       = 0;
+  size_t extinctions       = 0;
+  size_t singleton_splits  = 0;
+  size_t allopatric_splits = 0;
+  size_t sympatric_splits  = 0;
+  size_t jump_splits       = 0;
+
+  period_stats_t &operator+=(const period_stats_t &other);
+};
+
+/**
+ * The results of a single simulation (I.E. a replicate) on a tree.
+ *
+ * Only the results are stored here, everything is indexed by node index, and
+ * the topology lives in the `tree_t` which was simulated. This way, a tree can
+ * be simulated many times, even at the same time, as long as each simulation
+ * gets its own `sim_result_t`.
+ *
+ * The transitions for all of the branches are stored in one buffer, and each
+ * node only records where its transitions start and how many there are. The
+ * buffer keeps its memory between replicates, so after the first few
+ * replicates a simulation doesn't allocate at all.
+ *
+ * In stats only mode, the transitions are not stored at all. Instead, the
+ * transitions and the splits are counted per period as they are simulated, so
+ * the memory used is proportional to the number of nodes, not the number of
+ * events.
+ *
+ * In lazy events mode, the transitions are not stored either. Instead, the
+ * state of the generator at the start of each branch is saved, so the
+ * transitions can be regenerated later with `tree_t::materialize_transitions`,
+ * for just the replicates that need them.
+ *
+ * When the nodes of a tree are simulated in parallel, each worker records its
+ * transitions into its own shard, and the shards are merged into the result
+ * once every node is done.
+ */
+class sim_result_t {
+public:
+  /**
+   * The part of a result recorded by one worker. The final states and splits
+   * are written straight into the result, since every node is only written by
+   * one worker, but the transitions and counts go into the shard. The offsets
+   * of the nodes in a shard are relative to the shard until it is merged.
+   */
+  class shard_t {
+  public:
+    void start_transitions(size_t index) {
+      _result->_transition_offsets[index] = _transitions.size();
+      _nodes.push_back(index);
+    }
+
+    void add_transition(const transition_t &t) {
+      if (_result->_stats_only) {
+        count_transition(_period_stats, t);
+        return;
+      }
+      if (_result->_lazy_events) { return; }
+      _transitions.push_back(t);
+    }
+
+    void finish_transitions(size_t index) {
+      _result->_transition_counts[index]
+          = _transitions.size() - _result->_transition_offsets[index];
+    }
+
+    void count_split(const split_t &s) {
+      if (!_result->_stats_only) { return; }
+      sim_result_t::count_split(_period_stats, s);
+    }
+
+  private:
+    friend class sim_result_t;
+
+    sim_result_t               *_result = nullptr;
+    std::vector<transition_t>   _transitions;
+    std::vector<size_t>         _nodes;
+    std::vector<period_stats_t> _period_stats;
+  };
+
+  /**
+   * A point in a simulation that can be gone back to, when the nodes after it
+   * are simulated again. Only the transitions recorded since the checkpoint,
+   * and the counts in stats only mode, need to be undone, since the states and
+   * splits of the nodes are overwritten anyway.
+   */
+  struct checkpoint_t {
+    size_t                      transitions = 0;
+    std::vector<period_stats_t> period_stats;
+  };
+
+  sim_result_t() = default;
+
+  void reset(size_t node_count, dist_t root_range);
+
+  dist_t root_range() const { return _root_range; }
+  size_t region_count() const { return _root_range.regions(); }
+  size_t node_count() const { return _final_states.size(); }
+
+  dist_t final_state(size_t index) const { return _final_states[index]; }
+
+  const split_t &node_split(size_t index) const { return _splits[index]; }
+
+  /**
+   * The transitions on the branch leading to a node. Always empty in stats
+   * only mode, and empty in lazy events mode until they are materialized.
+   */
+  std::span<const transition_t> transitions(size_t index) const {
+    return {_transition_buffer.data() + _transition_offsets[index],
+            _transition_counts[index]};
+  }
+
+  size_t transition_count(size_t index) const {
+    return _transition_counts[index];
+  }
+
+  dist_t start_range(size_t index) const;
+
+  /**
+   * Start recording the transitions for the node at `index`. Every transition
+   * for the node is then passed to `add_transition`, and finally
+   * `finish_transitions` is called before starting on another node.
+   */
+  void start_transitions(size_t index) {
+    _transition_offsets[index] = _transition_buffer.size();
+  }
+
+  void add_transition(const transition_t &t) {
+    if (_stats_only) {
+      count_transition(_period_stats, t);
+      return;
+    }
+    if (_lazy_events) { return; }
+    _transition_buffer.push_back(t);
+  }
+
+  void finish_transitions(size_t index) {
+    _transition_counts[index]
+        = _transition_buffer.size() - _transition_offsets[index];
+  }
+
+  void set_final_state(size_t index, dist_t d) { _final_states[index] = d; }
+  void set_split(size_t index, const split_t &s) { _splits[index] = s; }
+
+  void count_split(const split_t &s) {
+    if (_stats_only) { count_split(_period_stats, s); }
+  }
+
+  /**
+   * Save the checkpoint into `checkpoint`, reusing its memory.
+   */
+  void save_checkpoint(checkpoint_t &checkpoint) const {
+    checkpoint.transitions = _transition_buffer.size();
+    if (_stats_only) { checkpoint.period_stats = _period_stats; }
+  }
+
+  void rewind(const checkpoint_t &checkpoint) {
+    _transition_buffer.resize(checkpoint.transitions);
+    if (_stats_only) { _period_stats = checkpoint.period_stats; }
+  }
+
+  /**
+   * Save the state of the generator at the start of the branch leading to a
+   * node. Only used in lazy events mode.
+   */
+  void save_branch_rng(size_t index, const pcg64_fast &gen) {
+    _branch_rngs[index] = gen;
+  }
+
+  const pcg64_fast &branch_rng(size_t index) const {
+    return _branch_rngs[index];
+  }
+
+  /**
+   * Drop any transitions, e.g. before they are regenerated.
+   */
+  void clear_transitions();
+
+  /**
+   * Drop the transitions which are no longer used by any node, once they are
+   * most of the buffer. Nodes which are simulated again leave their old
+   * transitions behind in the buffer.
+   */
+  void compact_transitions();
+
+  /**
+   * The key of the node generators, when every node was simulated on its own
+   * generator. Only results with a key can be simulated again after an edit.
+   */
+  void set_node_key(pcg_extras::pcg128_t key) { _node_key = key; }
+  std::optional<pcg_extras::pcg128_t> node_key() const { return _node_key; }
+
+  /**
+   * Put back the transitions of a node in lazy events mode. `replay` is called
+   * with a function which records a single transition.
+   */
+  void restore_transitions(size_t index, auto &&replay) {
+    _transition_offsets[index] = _transition_buffer.size();
+    replay([this](const transition_t &t) { _transition_buffer.push_back(t); });
+    _transition_counts[index]
+        = _transition_buffer.size() - _transition_offsets[index];
+  }
+
+  void     reset_shards(size_t count);
+  shard_t &shard(size_t worker) { return _shards[worker]; }
+  void     merge_shards();
+
+  void set_stats_only(bool stats_only) { _stats_only = stats_only; }
+  bool stats_only() const { return _stats_only; }
+
+  void set_lazy_events(bool lazy_events) { _lazy_events = lazy_events; }
+  bool lazy_events() const { return _lazy_events; }
+
+  /**
+   * Event counts, indexed by period index. Only filled in stats only mode.
+   */
+  const std::vector<period_stats_t> &period_stats() const {
+    return _period_stats;
+  }
+
+private:
+  static void count_transition(std::vector<period_stats_t> &stats,
+                               const transition_t          &t);
+  static void count_split(std::vector<period_stats_t> &stats,
+                          const split_t               &s);
+
+  static period_stats_t &stats_for_period(std::vector<period_stats_t> &stats,
+                                          size_t period_index);
+
+  dist_t                              _root_range;
+  std::vector<dist_t>                 _final_states;
+  std::vector<split_t>                _splits;
+  std::vector<transition_t>           _transition_buffer;
+  std::vector<size_t>                 _transition_offsets;
+  std::vector<size_t>                 _transition_counts;
+  std::vector<period_stats_t>         _period_stats;
+  std::vector<pcg64_fast>             _branch_rngs;
+  std::vector<shard_t>                _shards;
+  std::optional<pcg_extras::pcg128_t> _node_key;
+  bool                                _stats_only  = false;
+  bool                                _lazy_events = false;
+};
+} // namespace bigrig
@@ -3,6 +3,8 @@
 #include "pcg_extras.hpp"
 #include "pcg_random.hpp"
 
+#include <concepts>
+#include <cstdint>
 #include <memory>
 #include <random>
 
@@ -19,13 +21,89 @@ public:
 
   static void seed() {
     rng().seed(pcg_extras::seed_seq_from<std::random_device>{});
+    get_instance().save_seeded_state();
   }
 
-  static void seed(uint64_t seed) { rng().seed(seed); }
+  static void seed(uint64_t seed) {
+    rng().seed(seed);
+    get_instance().save_seeded_state();
+  }
+
+  /**
+   * Make the generator for a replicate.
+   *
+   * Each replicate gets its own stream, which is the freshly seeded generator
+   * advanced by `index + 1` strides of 2^64 draws. Stream 0 is left for the
+   * setup of the run (e.g. picking a random root range). Since the stream only
+   * depends on the seed and the replicate index, the results of a replicate
+   * don't depend on the thread, or the number of threads, used to simulate it.
+   */
+  static pcg64_fast replicate_rng(size_t index) {
+    constexpr size_t STREAM_STRIDE_BITS = 64;
+
+    pcg64_fast gen{*get_instance()._seeded_rng};
+    gen.advance(static_cast<pcg_extras::pcg128_t>(index + 1)
+                << STREAM_STRIDE_BITS);
+    return gen;
+  }
+
+  /**
+   * Draw the key used to make the node generators of one simulation.
+   */
+  static pcg_extras::pcg128_t
+  make_node_key(std::uniform_random_bit_generator auto &gen) {
+    auto hi = static_cast<uint64_t>(gen());
+    auto lo = static_cast<uint64_t>(gen());
+    return (static_cast<pcg_extras::pcg128_t>(hi) << 64) | lo;
+  }
+
+  /**
+   * Make the generator for a node, when the nodes of a tree are simulated in
+   * parallel. The state is a hash of the key and the node id, so every node
+   * gets its own stream, no matter which thread simulates it or when. This is
+   * much cheaper than advancing a generator per node.
+   */
+  static pcg64_fast node_rng(pcg_extras::pcg128_t key, size_t node_id) {
+    auto hi = mix(static_cast<uint64_t>(key >> 64) ^ node_id);
+    auto lo = mix(static_cast<uint64_t>(key) ^ mix(node_id));
+    return pcg64_fast{(static_cast<pcg_extras::pcg128_t>(hi) << 64) | lo};
+  }
+
+  /**
+   * Make the generator for one attempt at a subtree, when a conditioned
+   * simulation starts a subtree again. Like the node generators, every attempt
+   * gets its own stream, so the draws outside of the subtree don't depend on
+   * how many attempts the subtree took.
+   */
+  static pcg64_fast
+  subtree_rng(pcg_extras::pcg128_t key, size_t node_id, size_t attempt) {
+    auto hi = mix(attempt + 1);
+    auto lo = mix(hi);
+    return node_rng(key ^ ((static_cast<pcg_extras::pcg128_t>(hi) << 64) | lo),
+                    node_id);
+  }
 
 private:
-  rng_wrapper_t() { _rng = std::make_unique<pcg64_fast>(); }
+  /**
+   * The splitmix64 finalizer.
+   */
+  static uint64_t mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+  }
+
+  rng_wrapper_t() {
+    _rng        = std::make_unique<pcg64_fast>();
+    _seeded_rng = std::make_unique<pcg64_fast>(*_rng);
+  }
+
+  void save_seeded_state() { *_seeded_rng = *_rng; }
 
   std::unique_ptr<pcg64_fast> _rng;
+  std::unique_ptr<pcg64_fast> _seeded_rng;
 };
 } // namespace bigrig
@@ -0,0 +1,274 @@
+#include "scheduler.hpp"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+namespace bigrig {
+
+replicate_scheduler_t::replicate_scheduler_t(size_t thread_count,
+                                             size_t queue_size)
+    : _thread_count{std::max<size_t>(thread_count, 1)},
+      _queue_size{queue_size} {}
+
+size_t replicate_scheduler_t::thread_count() const { return _thread_count; }
+
+size_t replicate_scheduler_t::slot_count() const {
+  return _thread_count + _queue_size;
+}
+
+/**
+ * Run `replicate_count` replicates. Returns once every replicate has been
+ * committed. If a callback throws, the remaining replicates are abandoned and
+ * the exception is rethrown here.
+ */
+void replicate_scheduler_t::run(size_t        replicate_count,
+                                const task_t &simulate,
+                                const task_t &commit) {
+  _next_replicate = 0;
+  _next_commit    = 0;
+  _aborted        = false;
+  _exception      = nullptr;
+
+  size_t worker_count = std::min(_thread_count, replicate_count);
+
+  if (_queue_size > 0) {
+    run_queued(replicate_count, worker_count, simulate, commit);
+  } else if (worker_count <= 1) {
+    work(0, replicate_count, simulate, commit);
+  } else {
+    std::vector<std::thread> workers;
+    workers.reserve(worker_count);
+    for (size_t i = 0; i < worker_count; ++i) {
+      workers.emplace_back([this, i, replicate_count, &simulate, &commit]() {
+        work(i, replicate_count, simulate, commit);
+      });
+    }
+    for (auto &w : workers) { w.join(); }
+  }
+
+  if (_exception) { std::rethrow_exception(_exception); }
+}
+
+void replicate_scheduler_t::work(size_t        worker,
+                                 size_t        replicate_count,
+                                 const task_t &simulate,
+                                 const task_t &commit) {
+  try {
+    while (true) {
+      size_t replicate = _next_replicate++;
+      if (replicate >= replicate_count) { break; }
+
+      simulate(replicate, worker);
+
+      if (!wait_for_turn(replicate)) { break; }
+      commit(replicate, worker);
+      finish_turn();
+    }
+  } catch (...) { abort(std::current_exception()); }
+}
+
+/**
+ * Run the workers, and commit the replicates on this thread as they become
+ * ready, in order.
+ */
+void replicate_scheduler_t::run_queued(size_t        replicate_count,
+                                       size_t        worker_count,
+                                       const task_t &simulate,
+                                       const task_t &commit) {
+  _free_slots.resize(slot_count());
+  for (size_t slot = 0; slot < slot_count(); ++slot) {
+    _free_slots[slot] = slot_count() - slot - 1;
+  }
+  _ready_replicates.assign(slot_count(), no_replicate);
+
+  std::vector<std::thread> workers;
+  workers.reserve(worker_count);
+  for (size_t i = 0; i < worker_count; ++i) {
+    workers.emplace_back([this, replicate_count, &simulate]() {
+      work_queued(replicate_count, simulate);
+    });
+  }
+  commit_queued(replicate_count, commit);
+  for (auto &w : workers) { w.join(); }
+}
+
+/**
+ * Take a free slot, then the next replicate, so that every replicate which has
+ * been taken has a slot. This way, the next replicate to commit is always
+ * either ready, or being simulated, and the workers can't fill every slot with
+ * replicates that have to wait for it.
+ */
+void replicate_scheduler_t::work_queued(size_t        replicate_count,
+                                        const task_t &simulate) {
+  try {
+    while (true) {
+      size_t slot;
+      {
+        std::unique_lock lock{_commit_mutex};
+        _commit_cv.wait(
+            lock, [this]() { return _aborted || !_free_slots.empty(); });
+        if (_aborted) { break; }
+        slot = _free_slots.back();
+        _free_slots.pop_back();
+      }
+
+      size_t replicate = _next_replicate++;
+      if (replicate >= replicate_count) { break; }
+
+      simulate(replicate, slot);
+      {
+        std::lock_guard lock{_commit_mutex};
+        _ready_replicates[slot] = replicate;
+      }
+      _commit_cv.notify_all();
+    }
+  } catch (...) { abort(std::current_exception()); }
+}
+
+void replicate_scheduler_t::commit_queued(size_t        replicate_count,
+                                          const task_t &commit) {
+  try {
+    for (size_t replicate = 0; replicate < replicate_count; ++replicate) {
+      size_t slot = 0;
+      {
+        std::unique_lock lock{_commit_mutex};
+        _commit_cv.wait(lock, [&]() {
+          if (_aborted) { return true; }
+          auto itr = std::find(
+              _ready_replicates.begin(), _ready_replicates.end(), replicate);
+          slot = itr - _ready_replicates.begin();
+          return itr != _ready_replicates.end();
+        });
+        if (_aborted) { return; }
+      }
+
+      commit(replicate, slot);
+      {
+        std::lock_guard lock{_commit_mutex};
+        _ready_replicates[slot] = no_replicate;
+        _free_slots.push_back(slot);
+      }
+      _commit_cv.notify_all();
+    }
+  } catch (...) { abort(std::current_exception()); }
+}
+
+/**
+ * Block until all the previous replicates have been committed. Returns false if
+ * the run was aborted while waiting.
+ */
+bool replicate_scheduler_t::wait_for_turn(size_t replicate) {
+  std::unique_lock lock{_commit_mutex};
+  _commit_cv.wait(lock,
+                  [this, replicate]() {
+                    return _aborted || _next_commit == replicate;
+                  });
+  return !_aborted;
+}
+
+void replicate_scheduler_t::finish_turn() {
+  {
+    std::lock_guard lock{_commit_mutex};
+    _next_commit++;
+  }
+  _commit_cv.notify_all();
+}
+
+void replicate_scheduler_t::abort(std::exception_ptr e) {
+  {
+    std::lock_guard lock{_commit_mutex};
+    if (!_exception) { _exception = e; }
+    _aborted = true;
+  }
+  _commit_cv.notify_all();
+}
+
+task_pool_t::task_pool_t(size_t thread_count)
+    : _thread_count{std::max<size_t>(thread_count, 1)} {}
+
+size_t task_pool_t::thread_count() const { return _thread_count; }
+
+/**
+ * Run `root`, and every task spawned by it (or by those tasks), and return once
+ * they are all done. If a task throws, the tasks which haven't started yet are
+ * dropped, and the exception is rethrown here.
+ */
+void task_pool_t::run(task_t root) {
+  _tasks.clear();
+  _tasks.push_back(std::move(root));
+  _pending   = 1;
+  _aborted   = false;
+  _exception = nullptr;
+
+  if (_thread_count == 1) {
+    work(0);
+  } else {
+    std::vector<std::thread> workers;
+    workers.reserve(_thread_count);
+    for (size_t i = 0; i < _thread_count; ++i) {
+      workers.emplace_back([this, i]() { work(i); });
+    }
+    for (auto &w : workers) { w.join(); }
+  }
+
+  _tasks.clear();
+  if (_exception) { std::rethrow_exception(_exception); }
+}
+
+/**
+ * Queue a task. Only valid from inside a running task, since that is what keeps
+ * the pool alive until the new task is picked up.
+ */
+void task_pool_t::spawn(task_t task) {
+  {
+    std::lock_guard lock{_mutex};
+    _tasks.push_back(std::move(task));
+    _pending++;
+  }
+  _cv.notify_one();
+}
+
+/**
+ * Take tasks until there are none left, queued or running. The newest task is
+ * taken first, which keeps the queue short when tasks spawn more tasks.
+ */
+void task_pool_t::work(size_t worker) {
+  std::unique_lock lock{_mutex};
+  while (true) {
+    _cv.wait(lock, [this]() {
+      return _aborted || _pending == 0 || !_tasks.empty();
+    });
+    if (_aborted || _pending == 0) { break; }
+
+    auto task = std::move(_tasks.back());
+    _tasks.pop_back();
+    lock.unlock();
+
+    try {
+      task(worker);
+    } catch (...) {
+      abort(std::current_exception());
+      return;
+    }
+
+    lock.lock();
+    if (--_pending == 0) { _cv.notify_all(); }
+  }
+}
+
+void task_pool_t::abort(std::exception_ptr e) {
+  {
+    std::lock_guard lock{_mutex};
+    if (!_exception) { _exception = e; }
+    _aborted = true;
+  }
+  _cv.notify_all();
+}
+
+std::pair<size_t, size_t>
+shard_range(size_t job_count, size_t shard, size_t shard_count) {
+  return {job_count * shard / shard_count,
+          job_count * (shard + 1) / shard_count};
+}
+} // namespace bigrig
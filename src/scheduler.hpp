@@ -0,0 +1,121 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace bigrig {
+
+/**
+ * Schedules a batch of replicates over a pool of threads.
+ *
+ * Each worker repeatedly claims the next unclaimed replicate, simulates it, and
+ * then commits it. Simulation happens in parallel, but commits are serialized
+ * and happen in replicate order, so that the results can be written out as if
+ * the batch was run on a single thread.
+ *
+ * Both callbacks are passed the replicate index and the index of the slot it
+ * is in, so that the caller can keep per slot state (e.g. a result), without
+ * any locking. A replicate keeps its slot from the start of its simulation
+ * until it is committed.
+ *
+ * Without a queue, there is one slot per worker, and each worker commits its
+ * own replicates, so a worker which finishes early waits for its turn. With a
+ * queue, the commits are done by their own thread instead, and the workers go
+ * straight on to the next replicate. The queue is the number of extra slots,
+ * so it bounds how many simulated replicates can wait to be committed. When
+ * they are all waiting, the workers wait for the commits to catch up.
+ */
+class replicate_scheduler_t {
+public:
+  using task_t = std::function<void(size_t replicate, size_t slot)>;
+
+  explicit replicate_scheduler_t(size_t thread_count, size_t queue_size = 0);
+
+  void
+  run(size_t replicate_count, const task_t &simulate, const task_t &commit);
+
+  size_t thread_count() const;
+  size_t slot_count() const;
+
+private:
+  void work(size_t        worker,
+            size_t        replicate_count,
+            const task_t &simulate,
+            const task_t &commit);
+
+  void run_queued(size_t        replicate_count,
+                  size_t        worker_count,
+                  const task_t &simulate,
+                  const task_t &commit);
+  void work_queued(size_t replicate_count, const task_t &simulate);
+  void commit_queued(size_t replicate_count, const task_t &commit);
+
+  bool wait_for_turn(size_t replicate);
+  void finish_turn();
+  void abort(std::exception_ptr e);
+
+  static constexpr size_t no_replicate = static_cast<size_t>(-1);
+
+  size_t                  _thread_count;
+  size_t                  _queue_size;
+  std::atomic<size_t>     _next_replicate;
+  size_t                  _next_commit;
+  bool                    _aborted;
+  std::exception_ptr      _exception;
+  std::mutex              _commit_mutex;
+  std::condition_variable _commit_cv;
+
+  /* Only used with a queue */
+  std::vector<size_t> _free_slots;
+  std::vector<size_t> _ready_replicates;
+};
+
+/**
+ * Runs a set of tasks over a pool of threads, where the tasks can spawn more
+ * tasks. Used to simulate the independent subtrees of a single tree in
+ * parallel.
+ *
+ * Like the replicate scheduler, tasks are passed the index of the worker
+ * running them, so that the caller can keep per worker state without locking.
+ * A task always runs to completion on the worker that picked it up.
+ */
+class task_pool_t {
+public:
+  using task_t = std::function<void(size_t worker)>;
+
+  explicit task_pool_t(size_t thread_count);
+
+  void run(task_t root);
+  void spawn(task_t task);
+
+  size_t thread_count() const;
+
+private:
+  void work(size_t worker);
+  void abort(std::exception_ptr e);
+
+  size_t                  _thread_count;
+  std::deque<task_t>      _tasks;
+  size_t                  _pending;
+  bool                    _aborted;
+  std::exception_ptr      _exception;
+  std::mutex              _mutex;
+  std::condition_variable _cv;
+};
+
+/**
+ * The jobs `[begin, end)` of one shard, when `job_count` jobs are split into
+ * `shard_count` contiguous shards. The shards differ in size by at most one
+ * job, and are in order, so the results of the shards can be put back
+ * together by concatenating them.
+ */
+std::pair<size_t, size_t>
+shard_range(size_t job_count, size_t shard, size_t shard_count);
+} // namespace bigrig
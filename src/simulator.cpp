@@ -0,0 +1,112 @@
+#include "simulator.hpp"
+
+#include "exceptions.hpp"
+
+#include <format>
+
+namespace bigrig {
+
+simulator_t::simulator_t(std::shared_ptr<const tree_t> tree)
+    : _tree{std::move(tree)},
+      _base_periods{_tree->periods()},
+      _table{_tree->period_table()} {
+  for (size_t index = 0; index < _tree->node_count(); ++index) {
+    if (_tree->is_leaf(index)) { _tip_nodes.push_back(index); }
+  }
+}
+
+/**
+ * Replace the periods. They need the same boundaries as the periods of the
+ * tree, otherwise nothing is changed, and false is returned. The periods also
+ * become the base for `set_params`.
+ */
+bool simulator_t::set_periods(const std::vector<period_t> &periods) {
+  auto table = _tree->make_period_table(periods);
+  if (!table.has_value()) { return false; }
+  _base_periods = periods;
+  _table        = std::move(table.value());
+  return true;
+}
+
+/**
+ * Replace some of the parameters of every period, e.g. for one point of a
+ * sweep. The other parameters are taken from the last periods given to
+ * `set_periods`, or the periods of the tree.
+ */
+bool simulator_t::set_params(const sweep_point_t &point) {
+  auto table
+      = _tree->make_period_table(make_sweep_periods(_base_periods, point));
+  if (!table.has_value()) { return false; }
+  _table = std::move(table.value());
+  return true;
+}
+
+void simulator_t::check_tip_buffer(std::span<dist_t> tips) const {
+  if (tips.size() < tip_count()) {
+    throw invalid_buffer{std::format(
+        "The tip buffer has room for {} tips, but the tree has {}",
+        tips.size(),
+        tip_count())};
+  }
+}
+
+void simulator_t::copy_tips(std::span<dist_t> tips) const {
+  for (size_t i = 0; i < _tip_nodes.size(); ++i) {
+    tips[i] = _result.final_state(_tip_nodes[i]);
+  }
+}
+
+/**
+ * Simulate the tree, and only keep the tip ranges. The events are only
+ * counted, which is faster. Returns the number of events.
+ */
+size_t simulator_t::simulate(dist_t root_range, std::span<dist_t> tips) {
+  check_tip_buffer(tips);
+
+  _result.set_stats_only(true);
+  _tree->simulate(root_range, _result, _gen, _table);
+
+  copy_tips(tips);
+
+  size_t event_count = 0;
+  for (const auto &s : _result.period_stats()) {
+    event_count += s.dispersions + s.extinctions;
+  }
+  return event_count;
+}
+
+/**
+ * Simulate the tree, and keep the tip ranges and the events. Returns the
+ * number of events, which can be more than the size of `events`, in which case
+ * only the first events are written, like `snprintf` does.
+ */
+size_t simulator_t::simulate(dist_t             root_range,
+                             std::span<dist_t>  tips,
+                             std::span<event_t> events) {
+  check_tip_buffer(tips);
+
+  _result.set_stats_only(false);
+  _tree->simulate(root_range, _result, _gen, _table);
+
+  copy_tips(tips);
+
+  size_t event_count = 0;
+  for (size_t index = 0; index < _tree->node_count(); ++index) {
+    double abs_time = _tree->abs_time_at_start(index);
+    for (const auto &t : _result.transitions(index)) {
+      abs_time += t.waiting_time;
+      if (event_count < events.size()) {
+        events[event_count] = {
+            .abs_time      = abs_time,
+            .node          = static_cast<uint32_t>(index),
+            .period_index  = static_cast<uint32_t>(t.period_index),
+            .initial_state = t.initial_state,
+            .final_state   = t.final_state,
+        };
+      }
+      ++event_count;
+    }
+  }
+  return event_count;
+}
+} // namespace bigrig
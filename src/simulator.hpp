@@ -0,0 +1,85 @@
+#pragma once
+
+#include "dist.hpp"
+#include "period.hpp"
+#include "result.hpp"
+#include "sweep.hpp"
+#include "tree.hpp"
+
+#include "pcg_random.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+namespace bigrig {
+
+/**
+ * An event, as it is written into the event buffer of a `simulator_t`.
+ */
+struct event_t {
+  double   abs_time;
+  uint32_t node;
+  uint32_t period_index;
+  dist_t   initial_state;
+  dist_t   final_state;
+};
+
+/**
+ * A handle for running simulations from other programs, without any of the
+ * command line or file handling.
+ *
+ * A simulator is made from a prepared tree, which can be shared by many
+ * simulators, e.g. one per thread. Each simulator has its own models, its own
+ * generator, and its own result, which keeps its memory between simulations.
+ * So once the first few simulations are done, a simulation doesn't allocate.
+ *
+ * The results are written into buffers owned by the caller. Tip ranges are
+ * written in the order of `tip_nodes()`, and events in the order of the nodes,
+ * and then time. The full result of the last simulation can also be read with
+ * `result()`, which is a view into the simulator.
+ *
+ * A simulator is not thread safe, but different simulators can be used at the
+ * same time.
+ */
+class simulator_t {
+public:
+  explicit simulator_t(std::shared_ptr<const tree_t> tree);
+
+  const tree_t &tree() const { return *_tree; }
+
+  /**
+   * The node index of every tip, in the order they are written to the tip
+   * buffer.
+   */
+  std::span<const size_t> tip_nodes() const { return _tip_nodes; }
+  size_t                  tip_count() const { return _tip_nodes.size(); }
+
+  bool set_periods(const std::vector<period_t> &periods);
+  bool set_params(const sweep_point_t &point);
+
+  const std::vector<period_t> &periods() const { return _table.periods; }
+
+  void seed(uint64_t seed) { _gen.seed(seed); }
+
+  size_t simulate(dist_t root_range, std::span<dist_t> tips);
+  size_t simulate(dist_t             root_range,
+                  std::span<dist_t>  tips,
+                  std::span<event_t> events);
+
+  const sim_result_t &result() const { return _result; }
+
+private:
+  void check_tip_buffer(std::span<dist_t> tips) const;
+  void copy_tips(std::span<dist_t> tips) const;
+
+  std::shared_ptr<const tree_t> _tree;
+  std::vector<size_t>           _tip_nodes;
+  std::vector<period_t>         _base_periods;
+  period_table_t                _table;
+  sim_result_t                  _result;
+  pcg64_fast                    _gen;
+};
+} // namespace bigrig
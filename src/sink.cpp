@@ -0,0 +1,149 @@
+#include "sink.hpp"
+
+#include "logger.hpp"
+
+#include <cstring>
+
+#ifdef BIGRIG_GZIP
+#include <zlib.h>
+#endif
+
+namespace bigrig {
+
+/**
+ * Checks if this build can write the given compression type.
+ */
+bool compression_supported(compression_type_e compression) {
+  switch (compression) {
+  case compression_type_e::none:
+    return true;
+  case compression_type_e::gzip:
+#ifdef BIGRIG_GZIP
+    return true;
+#else
+    return false;
+#endif
+  }
+  return false;
+}
+
+sink_buffer_t::~sink_buffer_t() { close(); }
+
+bool sink_buffer_t::open(const std::filesystem::path &filename,
+                         compression_type_e           compression) {
+  close();
+  if (!compression_supported(compression)) {
+    LOG_ERROR("This build of bigrig does not support compressed output");
+    return false;
+  }
+
+  if (compression == compression_type_e::gzip) {
+#ifdef BIGRIG_GZIP
+    _gz_file = gzopen(filename.c_str(), "wb");
+    if (_gz_file != nullptr) {
+      gzbuffer(static_cast<gzFile>(_gz_file), BUFFER_SIZE);
+    }
+#endif
+  } else {
+    _file = std::fopen(filename.c_str(), "wb");
+  }
+
+  if (!is_open()) {
+    LOG_ERROR("Failed to open the file '%s'", filename.c_str());
+    return false;
+  }
+
+  _buffer.resize(BUFFER_SIZE);
+  setp(_buffer.data(), _buffer.data() + _buffer.size());
+  return true;
+}
+
+/**
+ * Write out whatever is left in the buffer, and close the file. Returns false
+ * if any of the writes failed.
+ */
+bool sink_buffer_t::close() {
+  if (!is_open()) { return true; }
+  bool ok = write_buffer();
+  if (_file != nullptr) {
+    ok    &= std::fclose(_file) == 0;
+    _file  = nullptr;
+  }
+#ifdef BIGRIG_GZIP
+  if (_gz_file != nullptr) {
+    ok       &= gzclose(static_cast<gzFile>(_gz_file)) == Z_OK;
+    _gz_file  = nullptr;
+  }
+#endif
+  setp(nullptr, nullptr);
+  return ok;
+}
+
+sink_buffer_t::int_type sink_buffer_t::overflow(int_type c) {
+  if (!is_open() || !write_buffer()) { return traits_type::eof(); }
+  if (!traits_type::eq_int_type(c, traits_type::eof())) {
+    *pptr() = traits_type::to_char_type(c);
+    pbump(1);
+  }
+  return traits_type::not_eof(c);
+}
+
+/**
+ * Large writes skip the buffer, since they would just be copied out of it
+ * again.
+ */
+std::streamsize sink_buffer_t::xsputn(const char *s, std::streamsize n) {
+  if (!is_open()) { return 0; }
+  if (n < epptr() - pptr()) {
+    std::memcpy(pptr(), s, n);
+    pbump(static_cast<int>(n));
+    return n;
+  }
+  if (!write_buffer() || !write_out(s, n)) { return 0; }
+  return n;
+}
+
+int sink_buffer_t::sync() {
+  if (!is_open() || !write_buffer()) { return -1; }
+  if (_file != nullptr) { return std::fflush(_file) == 0 ? 0 : -1; }
+#ifdef BIGRIG_GZIP
+  if (_gz_file != nullptr) {
+    return gzflush(static_cast<gzFile>(_gz_file), Z_SYNC_FLUSH) == Z_OK ? 0
+                                                                         : -1;
+  }
+#endif
+  return 0;
+}
+
+bool sink_buffer_t::write_buffer() {
+  bool ok = write_out(pbase(), pptr() - pbase());
+  setp(_buffer.data(), _buffer.data() + _buffer.size());
+  return ok;
+}
+
+bool sink_buffer_t::write_out(const char *s, size_t n) {
+  if (n == 0) { return true; }
+  if (_file != nullptr) { return std::fwrite(s, 1, n, _file) == n; }
+#ifdef BIGRIG_GZIP
+  if (_gz_file != nullptr) {
+    return gzwrite(static_cast<gzFile>(_gz_file), s, n)
+        == static_cast<int>(n);
+  }
+#endif
+  return false;
+}
+
+bool output_sink_t::open(const std::filesystem::path &filename,
+                         compression_type_e           compression) {
+  clear();
+  if (!_buffer.open(filename, compression)) {
+    setstate(std::ios::failbit);
+    return false;
+  }
+  return true;
+}
+
+void output_sink_t::close() {
+  if (!_buffer.close()) { setstate(std::ios::badbit); }
+}
+} // namespace bigrig
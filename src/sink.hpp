@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdio>
+#include <filesystem>
+#include <ostream>
+#include <streambuf>
+#include <vector>
+
+namespace bigrig {
+
+enum class compression_type_e { none, gzip };
+
+/**
+ * The buffer behind an `output_sink_t`. Collects the output in a fixed size
+ * buffer, and hands it to the file (or to zlib) when the buffer is full.
+ */
+class sink_buffer_t : public std::streambuf {
+public:
+  static constexpr size_t BUFFER_SIZE = 1 << 16;
+
+  sink_buffer_t() = default;
+  ~sink_buffer_t() override;
+
+  sink_buffer_t(const sink_buffer_t &)            = delete;
+  sink_buffer_t &operator=(const sink_buffer_t &) = delete;
+
+  bool open(const std::filesystem::path &filename,
+            compression_type_e           compression);
+  bool close();
+  bool is_open() const { return _file != nullptr || _gz_file != nullptr; }
+
+protected:
+  int_type        overflow(int_type c) override;
+  std::streamsize xsputn(const char *s, std::streamsize n) override;
+  int             sync() override;
+
+private:
+  bool write_buffer();
+  bool write_out(const char *s, size_t n);
+
+  std::vector<char> _buffer;
+  std::FILE        *_file    = nullptr;
+  void             *_gz_file = nullptr;
+};
+
+/**
+ * A buffered output file, which can optionally be gzip compressed. The writers
+ * in `io.cpp` write straight into one of these as they walk the tree, so the
+ * size of the output never has to fit into memory.
+ *
+ * The sink is flushed when it is closed or destroyed, and when `std::flush` is
+ * used. Flushing a compressed sink makes the compression worse, so writers
+ * should use `'\n'` rather than `std::endl`.
+ */
+class output_sink_t : public std::ostream {
+public:
+  output_sink_t() : std::ostream{&_buffer} {}
+
+  bool is_open() const { return _buffer.is_open(); }
+
+  bool open(const std::filesystem::path &filename,
+            compression_type_e compression = compression_type_e::none);
+  void close();
+
+private:
+  sink_buffer_t _buffer;
+};
+
+bool compression_supported(compression_type_e compression);
+} // namespace bigrig
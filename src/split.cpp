@@ -2,13 +2,24 @@
 
 namespace bigrig {
 std::string split_t::to_nhx_string() const {
-  std::ostringstream oss;
-  oss << "parent-range=" << top << ":"
-      << "left-range=" << left << ":"
-      << "right-range=" << right << ":";
-  oss << "split-type=" << to_type_string();
+  std::string str;
+  append_nhx(str);
+  return str;
+}
 
-  return oss.str();
+/**
+ * Append the NHX fields of the split to a buffer, e.g. when writing a whole
+ * annotated tree into one buffer.
+ */
+void split_t::append_nhx(std::string &out) const {
+  out += "parent-range=";
+  top.append_to(out);
+  out += ":left-range=";
+  left.append_to(out);
+  out += ":right-range=";
+  right.append_to(out);
+  out += ":split-type=";
+  out += type_string(type);
 }
 
 std::string type_string(const split_type_e &st) {
@@ -56,7 +67,7 @@ determine_split_type(dist_t init_dist, dist_t left_dist, dist_t right_dist) {
     if ((left_dist & right_dist).full_region_count() == 1) {
       return split_type_e::sympatric;
     }
-    if ((left_dist & right_dist).empty() == 0) {
+    if ((left_dist & right_dist).empty()) {
       return split_type_e::allopatric;
     }
   } else if (left_dist.singleton()
@@ -1,4 +1,7 @@
+#pragma once
+
 #include "dist.hpp"
+#include "instrument.hpp"
 
 #include <stdexcept>
 
@@ -18,6 +21,7 @@ struct split_t {
   size_t       period_index;
 
   std::string to_nhx_string() const;
+  void        append_nhx(std::string &out) const;
   std::string to_type_string() const;
 };
 
@@ -39,54 +43,42 @@ split_type_e roll_split_type(dist_t                                  init_dist,
                              const biogeo_model_t                   &model,
                              std::uniform_random_bit_generator auto &gen) {
   if (init_dist.singleton()) {
-    double total_weight = model.total_singleton_weight(init_dist);
-    double jump_weight  = model.jump_weight(init_dist);
-
-    jump_weight /= total_weight;
-
-    std::bernoulli_distribution jump_coin(jump_weight);
+    std::bernoulli_distribution jump_coin(
+        model.lookup_singleton_jump_probability(init_dist.regions()));
     if (jump_coin(gen)) { return split_type_e::jump; }
     return split_type_e::singleton;
   }
-  double allo_weight = model.allopatry_weight(init_dist);
-  double sym_weight  = model.sympatry_weight(init_dist);
-  double jump_weight = model.jump_weight(init_dist);
-
-  double total_weight = model.total_nonsingleton_weight(init_dist);
+  auto thresholds = model.lookup_split_thresholds(
+      init_dist.regions(), init_dist.full_region_count());
 
   /*
    * There is a function in the standard lib that will do this, but I
    * measured it to be slower than this... So we are just going to stick
    * with this method.
    */
-  double roll = std::uniform_real_distribution<double>(0, total_weight)(gen);
-
-  const std::array<const std::pair<double, split_type_e>, 3> options{
-      std::pair{allo_weight, split_type_e::allopatric},
-      std::pair{sym_weight, split_type_e::sympatric},
-      std::pair{jump_weight, split_type_e::jump}};
+  double roll
+      = std::uniform_real_distribution<double>(0, thresholds.total)(gen);
 
-  for (auto o : options) {
-    if (roll <= o.first) { return o.second; }
-    roll -= o.first;
-  }
+  if (roll <= thresholds.allopatry) { return split_type_e::allopatric; }
+  if (roll <= thresholds.sympatry) { return split_type_e::sympatric; }
+  if (roll <= thresholds.total) { return split_type_e::jump; }
 
-  LOG_ERROR("Rolled an invalid split. roll: %f, allo_weight: %f, sym_weight: "
-            "%f, jump_weight: %f",
+  LOG_ERROR("Rolled an invalid split. roll: %f, allo_threshold: %f, "
+            "sym_threshold: %f, total: %f",
             roll,
-            allo_weight,
-            sym_weight,
-            jump_weight);
+            thresholds.allopatry,
+            thresholds.sympatry,
+            thresholds.total);
   return split_type_e::invalid;
 }
 split_t split_dist(dist_t                                  init_dist,
                    const biogeo_model_t                   &model,
                    std::uniform_random_bit_generator auto &gen,
                    operation_mode_e mode = operation_mode_e::FAST) {
-  if (mode == operation_mode_e::FAST) {
+  if (mode == operation_mode_e::FAST || mode == operation_mode_e::ENDPOINT) {
     return split_dist_fast(init_dist, model, gen);
   } else if (mode == operation_mode_e::SIM) {
-    return split_dist_rejection_method(init_dist, model, gen);
+    return split_dist_exact(init_dist, model, gen);
   }
   throw std::runtime_error{"Could not recognize operation mode"};
 }
@@ -139,7 +131,7 @@ split_t split_dist_fast(dist_t                                  init_dist,
   if (type == split_type_e::allopatric) {
     left_dist = init_dist.flip_region(flipped_index);
   }
-  right_dist = {1ull << flipped_index, init_dist.regions()};
+  right_dist = dist_t{init_dist.regions()}.flip_region(flipped_index);
 
   std::bernoulli_distribution coin(0.5);
   if (coin(gen)) { std::swap(left_dist, right_dist); }
@@ -150,13 +142,75 @@ split_t split_dist_fast(dist_t                                  init_dist,
 split_type_e
 determine_split_type(dist_t init_dist, dist_t left_dist, dist_t right_dist);
 
+/**
+ * Split a dist by sampling one of the outcomes of the split directly, from the
+ * outcome table of the model (see `split_outcome_table_t`).
+ *
+ * This has the same distribution as the rejection method below, but it takes
+ * three draws for any number of regions, so simulation mode can be used with
+ * as many regions as fast mode. The outcomes are enumerated separately
+ * from the fast splitter, so it is still a check on the fast splitter.
+ *
+ * The outcomes of a class are numbered so that outcome `2 * i` and `2 * i + 1`
+ * are the two orientations of the split involving the `i`th region.
+ */
+split_t split_dist_exact(dist_t                                  init_dist,
+                         const biogeo_model_t                   &model,
+                         std::uniform_random_bit_generator auto &gen) {
+  constexpr size_t CLASSES = split_outcome_table_t::CLASSES;
+
+  if (!model.jumps_ok() && init_dist.singleton()) {
+    return {init_dist, init_dist, init_dist, split_type_e::singleton, 0};
+  }
+
+  auto table = model.lookup_split_outcomes(init_dist.regions(),
+                                           init_dist.full_region_count());
+
+  size_t column = std::uniform_int_distribution<size_t>(0, CLASSES - 1)(gen);
+  double coin   = std::uniform_real_distribution<double>(0.0, 1.0)(gen);
+  size_t cls    = coin < table.probs[column] ? column : table.aliases[column];
+  size_t outcome
+      = std::uniform_int_distribution<size_t>(0, table.counts[cls] - 1)(gen);
+  size_t rank = outcome / 2;
+
+  dist_t       left_dist{init_dist};
+  dist_t       right_dist{init_dist};
+  split_type_e type;
+  switch (cls) {
+  case 0: {
+    auto index = init_dist.set_index(rank);
+    left_dist  = init_dist.flip_region(index);
+    right_dist = dist_t{init_dist.regions()}.flip_region(index);
+    type       = split_type_e::allopatric;
+    break;
+  }
+  case 1:
+    right_dist = dist_t{init_dist.regions()}.flip_region(
+        init_dist.set_index(rank));
+    type = split_type_e::sympatric;
+    break;
+  case 2:
+    type = split_type_e::singleton;
+    break;
+  default:
+    right_dist = dist_t{init_dist.regions()}.flip_region(
+        init_dist.unset_index(rank));
+    type = split_type_e::jump;
+    break;
+  }
+
+  if (outcome % 2 == 1) { std::swap(left_dist, right_dist); }
+  return {left_dist, right_dist, init_dist, type, 0};
+}
+
 /**
  * Split a dist via a rejection method.
  *
  * In this type, we generate 2 _completely_ random dists, and then check to
  * see which kind of split this is. If it is a valid type, we return the
  * generated split with probability equal to the corresponding normalized
- * parameter.
+ * parameter. The acceptance rate falls off exponentially with the number of
+ * regions, so this is only kept as a reference for `split_dist_exact`.
  *
  * This function does _not_ support duplicity with allopatric and copy
  * splits. This is a good argument against duplicity. However, I could
@@ -203,6 +257,7 @@ split_dist_rejection_method(dist_t                                  init_dist,
     }
   }
   LOG_DEBUG("Splitting took %lu samples", sample_count);
+  count_event(counter_e::REJECTION_SAMPLES, sample_count);
   return {left_dist, right_dist, init_dist, split_type, 0};
 }
 } // namespace bigrig
@@ -0,0 +1,330 @@
+#include "sweep.hpp"
+
+#include "logger.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <set>
+#include <string>
+
+namespace bigrig {
+
+using util::parse_double;
+using util::split_fields;
+using util::trim;
+
+namespace {
+constexpr std::array<std::string_view, SWEEP_PARAM_COUNT> SWEEP_PARAM_NAMES{
+    "dispersion", "extinction", "allopatry", "sympatry", "copy", "jump"};
+} // namespace
+
+std::optional<sweep_param_e> parse_sweep_param(std::string_view name) {
+  auto itr
+      = std::find(SWEEP_PARAM_NAMES.begin(), SWEEP_PARAM_NAMES.end(), name);
+  if (itr == SWEEP_PARAM_NAMES.end()) { return {}; }
+  return static_cast<sweep_param_e>(itr - SWEEP_PARAM_NAMES.begin());
+}
+
+std::string_view to_string(sweep_param_e param) {
+  return SWEEP_PARAM_NAMES[static_cast<size_t>(param)];
+}
+
+/**
+ * Evenly spaced values from `from` to `to`, including both ends.
+ */
+std::vector<double> make_sweep_range(double from, double to, size_t steps) {
+  if (steps == 0) { return {}; }
+  if (steps == 1) { return {from}; }
+
+  std::vector<double> values;
+  values.reserve(steps);
+  double step = (to - from) / static_cast<double>(steps - 1);
+  for (size_t i = 0; i < steps - 1; ++i) { values.push_back(from + i * step); }
+  values.push_back(to);
+  return values;
+}
+
+/**
+ * Every combination of the values of the axes. The first axis changes the
+ * slowest, so the points are in the same order as nested loops over the axes.
+ */
+std::vector<sweep_point_t>
+make_sweep_grid(const std::vector<sweep_axis_t> &axes) {
+  if (axes.empty()) { return {}; }
+
+  std::vector<sweep_point_t> points{sweep_point_t{}};
+  for (const auto &axis : axes) {
+    std::vector<sweep_point_t> next;
+    next.reserve(points.size() * axis.values.size());
+    for (const auto &point : points) {
+      for (auto value : axis.values) {
+        next.push_back(point);
+        next.back().set(axis.param, value);
+      }
+    }
+    points = std::move(next);
+  }
+  return points;
+}
+
+/**
+ * Read the points of a sweep from a table. The first line names the
+ * parameters, and every line after it is a point. The fields are separated by
+ * commas, and an empty field leaves the parameter as it is in the periods.
+ * Empty lines, and lines starting with '#', are skipped.
+ */
+std::optional<std::vector<sweep_point_t>>
+read_sweep_table(const std::filesystem::path &filename) {
+  std::ifstream file(filename);
+  if (!file) {
+    LOG_ERROR("Failed to open the sweep table '%s'", filename.c_str());
+    return {};
+  }
+
+  std::vector<sweep_param_e> columns;
+  std::vector<sweep_point_t> points;
+  std::string                line;
+  size_t                     line_number = 0;
+  while (std::getline(file, line)) {
+    ++line_number;
+    auto trimmed = trim(line);
+    if (trimmed.empty() || trimmed.front() == '#') { continue; }
+
+    auto fields = split_fields(trimmed);
+    if (columns.empty()) {
+      for (auto field : fields) {
+        auto param = parse_sweep_param(field);
+        if (!param.has_value()) {
+          LOG_ERROR("Unknown parameter '%.*s' in the sweep table '%s'",
+                    static_cast<int>(field.size()),
+                    field.data(),
+                    filename.c_str());
+          return {};
+        }
+        columns.push_back(param.value());
+      }
+      continue;
+    }
+
+    if (fields.size() != columns.size()) {
+      LOG_ERROR("Line %lu of the sweep table '%s' has %lu fields, but there "
+                "are %lu columns",
+                line_number,
+                filename.c_str(),
+                fields.size(),
+                columns.size());
+      return {};
+    }
+
+    sweep_point_t point;
+    for (size_t i = 0; i < fields.size(); ++i) {
+      if (fields[i].empty()) { continue; }
+      auto value = parse_double(fields[i]);
+      if (!value.has_value()) {
+        LOG_ERROR("Failed to parse '%.*s' on line %lu of the sweep table '%s'",
+                  static_cast<int>(fields[i].size()),
+                  fields[i].data(),
+                  line_number,
+                  filename.c_str());
+        return {};
+      }
+      point.set(columns[i], value.value());
+    }
+    points.push_back(point);
+  }
+
+  if (points.empty()) {
+    LOG_ERROR("The sweep table '%s' has no points", filename.c_str());
+    return {};
+  }
+  return points;
+}
+
+/**
+ * Every non-empty range with `regions` regions, with the same weight.
+ */
+std::vector<root_prior_t> make_all_root_ranges(size_t regions) {
+  size_t count = (1ul << regions) - 1;
+
+  std::vector<root_prior_t> roots;
+  roots.reserve(count);
+  for (uint64_t i = 1; i <= count; ++i) {
+    roots.push_back({.range  = {i, static_cast<uint16_t>(regions)},
+                     .weight = 1.0 / static_cast<double>(count)});
+  }
+  return roots;
+}
+
+/**
+ * Read a root prior. Every line is a root range, written the same way as the
+ * `--root-range` option, optionally followed by a comma and the weight of the
+ * range. Ranges without a weight get a weight of 1, and the weights are
+ * normalized to sum to 1. Empty lines, and lines starting with '#', are
+ * skipped.
+ */
+std::optional<std::vector<root_prior_t>>
+read_root_prior(const std::filesystem::path &filename) {
+  std::ifstream file(filename);
+  if (!file) {
+    LOG_ERROR("Failed to open the root prior '%s'", filename.c_str());
+    return {};
+  }
+
+  std::vector<root_prior_t> roots;
+  std::set<std::string>     seen;
+  std::string               line;
+  size_t                    line_number = 0;
+  while (std::getline(file, line)) {
+    ++line_number;
+    auto trimmed = trim(line);
+    if (trimmed.empty() || trimmed.front() == '#') { continue; }
+
+    auto fields = split_fields(trimmed);
+    if (fields.size() > 2) {
+      LOG_ERROR("Line %lu of the root prior '%s' has %lu fields, but there "
+                "should be a range and at most one weight",
+                line_number,
+                filename.c_str(),
+                fields.size());
+      return {};
+    }
+
+    auto range_str = std::string{fields[0]};
+    if (range_str.empty() || range_str.size() >= dist_t::MAX_REGIONS
+        || range_str.find_first_not_of("01") != std::string::npos) {
+      LOG_ERROR("Failed to parse the range '%s' on line %lu of the root prior "
+                "'%s'",
+                range_str.c_str(),
+                line_number,
+                filename.c_str());
+      return {};
+    }
+    if (!roots.empty() && range_str.size() != roots.front().range.regions()) {
+      LOG_ERROR("The range '%s' on line %lu of the root prior '%s' has a "
+                "different number of regions than the first range",
+                range_str.c_str(),
+                line_number,
+                filename.c_str());
+      return {};
+    }
+    if (!seen.insert(range_str).second) {
+      LOG_ERROR("The range '%s' is in the root prior '%s' more than once",
+                range_str.c_str(),
+                filename.c_str());
+      return {};
+    }
+
+    double weight = 1.0;
+    if (fields.size() == 2) {
+      auto value = parse_double(fields[1]);
+      if (!value.has_value() || !std::isfinite(value.value())
+          || value.value() < 0.0) {
+        LOG_ERROR("Failed to parse the weight '%.*s' on line %lu of the root "
+                  "prior '%s'. Weights should be positive numbers",
+                  static_cast<int>(fields[1].size()),
+                  fields[1].data(),
+                  line_number,
+                  filename.c_str());
+        return {};
+      }
+      weight = value.value();
+    }
+    roots.push_back({.range = dist_t{range_str}, .weight = weight});
+  }
+
+  double total = 0.0;
+  for (const auto &root : roots) { total += root.weight; }
+  if (roots.empty() || total <= 0.0) {
+    LOG_ERROR("The root prior '%s' has no ranges with a weight",
+              filename.c_str());
+    return {};
+  }
+  for (auto &root : roots) { root.weight /= total; }
+  return roots;
+}
+
+/**
+ * Copy the periods, with the parameters of the point. Every period gets a new
+ * model, copied from the old one, so only the weight tables are rebuilt.
+ */
+std::vector<period_t> make_sweep_periods(const std::vector<period_t> &base,
+                                         const sweep_point_t         &point) {
+  auto take = [&point](double &value, sweep_param_e param) {
+    auto v = point.get(param);
+    if (!v.has_value()) { return false; }
+    value = v.value();
+    return true;
+  };
+
+  std::vector<period_t> periods;
+  periods.reserve(base.size());
+  for (const auto &period : base) {
+    auto model = std::make_shared<biogeo_model_t>(period.model());
+
+    auto rates     = model->rates();
+    bool new_rates = false;
+    new_rates     |= take(rates.dis, sweep_param_e::DISPERSION);
+    new_rates     |= take(rates.ext, sweep_param_e::EXTINCTION);
+    if (new_rates) { model->set_params(rates); }
+
+    auto clado     = model->cladogenesis_params();
+    bool new_clado = false;
+    new_clado     |= take(clado.allopatry, sweep_param_e::ALLOPATRY);
+    new_clado     |= take(clado.sympatry, sweep_param_e::SYMPATRY);
+    new_clado     |= take(clado.copy, sweep_param_e::COPY);
+    new_clado     |= take(clado.jump, sweep_param_e::JUMP);
+    if (new_clado) { model->set_cladogenesis_params(clado); }
+
+    periods.push_back(period);
+    periods.back().set_model(std::move(model));
+  }
+  return periods;
+}
+
+/**
+ * Check that the models of a point can be simulated with.
+ */
+bool check_sweep_point(const std::vector<period_t> &base,
+                       const sweep_point_t         &point,
+                       size_t                       region_count) {
+  bool ok = true;
+  for (const auto &period : make_sweep_periods(base, point)) {
+    ok &= period.model().check_ok(region_count);
+  }
+  return ok;
+}
+
+sweep_tables_t::sweep_tables_t(const tree_t              &tree,
+                               std::vector<period_t>      base,
+                               std::vector<sweep_point_t> points)
+    : _tree{tree},
+      _base{std::move(base)},
+      _points{std::move(points)},
+      _tables(_points.size()) {}
+
+/**
+ * Get the period table for a point, making it if this is the first replicate
+ * of the point.
+ */
+std::shared_ptr<const period_table_t> sweep_tables_t::acquire(size_t point) {
+  std::lock_guard lock{_mutex};
+  auto           &table = _tables[point];
+  if (!table) {
+    auto periods = make_sweep_periods(_base, _points[point]);
+    table        = std::make_shared<const period_table_t>(
+        _tree.make_period_table(periods).value());
+  }
+  return table;
+}
+
+/**
+ * Drop the table of a point, once every replicate of the point is done. Any
+ * replicate which still holds the table keeps it alive until it finishes.
+ */
+void sweep_tables_t::release(size_t point) {
+  std::lock_guard lock{_mutex};
+  _tables[point].reset();
+}
+} // namespace bigrig
@@ -0,0 +1,132 @@
+#pragma once
+
+#include "dist.hpp"
+#include "period.hpp"
+#include "tree.hpp"
+
+#include <array>
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+namespace bigrig {
+
+/**
+ * The model parameters which can be swept.
+ */
+enum class sweep_param_e {
+  DISPERSION,
+  EXTINCTION,
+  ALLOPATRY,
+  SYMPATRY,
+  COPY,
+  JUMP,
+};
+
+constexpr size_t SWEEP_PARAM_COUNT = 6;
+
+std::optional<sweep_param_e> parse_sweep_param(std::string_view name);
+
+std::string_view to_string(sweep_param_e param);
+
+/**
+ * One point of a parameter sweep. The parameters which are set replace that
+ * parameter in every period, and the rest are left as they are in the periods.
+ */
+class sweep_point_t {
+public:
+  void set(sweep_param_e param, double value) {
+    _values[static_cast<size_t>(param)] = value;
+  }
+
+  std::optional<double> get(sweep_param_e param) const {
+    return _values[static_cast<size_t>(param)];
+  }
+
+  bool operator==(const sweep_point_t &) const = default;
+
+private:
+  std::array<std::optional<double>, SWEEP_PARAM_COUNT> _values;
+};
+
+/**
+ * The values of one parameter in a grid sweep.
+ */
+struct sweep_axis_t {
+  sweep_param_e       param;
+  std::vector<double> values;
+};
+
+std::vector<double> make_sweep_range(double from, double to, size_t steps);
+
+std::vector<sweep_point_t>
+make_sweep_grid(const std::vector<sweep_axis_t> &axes);
+
+std::optional<std::vector<sweep_point_t>>
+read_sweep_table(const std::filesystem::path &filename);
+
+std::vector<period_t> make_sweep_periods(const std::vector<period_t> &base,
+                                         const sweep_point_t         &point);
+
+bool check_sweep_point(const std::vector<period_t> &base,
+                       const sweep_point_t         &point,
+                       size_t                       region_count);
+
+/**
+ * A root range of a root prior, and its weight. The weights of a prior sum to
+ * 1, so the tip ranges under the prior are the results of each root range,
+ * weighted by the weight of the root range.
+ */
+struct root_prior_t {
+  dist_t range;
+  double weight;
+};
+
+/**
+ * The largest region count for which every root range can be simulated, since
+ * there are `2^regions - 1` of them.
+ */
+constexpr size_t ALL_ROOT_RANGES_MAX_REGIONS = 16;
+
+std::vector<root_prior_t> make_all_root_ranges(size_t regions);
+
+std::optional<std::vector<root_prior_t>>
+read_root_prior(const std::filesystem::path &filename);
+
+/**
+ * The period tables for the points of a sweep, which are shared by the workers.
+ *
+ * The tree is only prepared once, with the base periods. Each point gets its
+ * own copy of the periods, with new models, so the only setup per point is
+ * rebuilding the weight tables of the models. A table is made when the first
+ * replicate of a point asks for it, and dropped once the point is released,
+ * so only the points which are being simulated are kept in memory. This
+ * matters in endpoint mode, where every table has a cache the size of the
+ * tree.
+ */
+class sweep_tables_t {
+public:
+  sweep_tables_t(const tree_t              &tree,
+                 std::vector<period_t>      base,
+                 std::vector<sweep_point_t> points);
+
+  size_t point_count() const { return _points.size(); }
+
+  const sweep_point_t &point(size_t index) const { return _points[index]; }
+
+  std::shared_ptr<const period_table_t> acquire(size_t point);
+  void                                  release(size_t point);
+
+private:
+  const tree_t              &_tree;
+  std::vector<period_t>      _base;
+  std::vector<sweep_point_t> _points;
+
+  std::mutex                                         _mutex;
+  std::vector<std::shared_ptr<const period_table_t>> _tables;
+};
+} // namespace bigrig
@@ -2,7 +2,9 @@
 
 #include "iterator.hpp"
 #include "logger.hpp"
+#include "util.hpp"
 
+#include <algorithm>
 #include <corax/core/common.h>
 
 namespace bigrig {
@@ -18,57 +20,145 @@ tree_t::tree_t(const std::string &tree_str) {
   convert_tree(corax_tree);
 }
 
+/**
+ * Build a tree straight from the node arrays, which have to be in preorder,
+ * with the first child of a node right after it. This is for trees which were
+ * converted before, e.g. from a prepared tree file.
+ */
+tree_t::tree_t(std::vector<size_t>      parents,
+               std::vector<double>      brlens,
+               std::vector<std::string> labels)
+    : _brlens{std::move(brlens)},
+      _parents{std::move(parents)},
+      _labels{std::move(labels)} {
+  finalize_nodes();
+}
+
 /**
  * Get a dist by "string_id" key. The string_id is either the label, if the node
  * has one, or a string version of the assigned id.
  */
 std::optional<dist_t>
-tree_t::get_dist_by_string_id(const std::string &key) const {
-  for (const auto &n : *this) {
-    if (n->string_id() == key) { return n->final_state(); }
-  }
-  return {};
+tree_t::get_dist_by_string_id(const std::string  &key,
+                              const sim_result_t &result) const {
+  auto index = find_string_id(key);
+  if (!index.has_value()) { return {}; }
+  return result.final_state(index.value());
+}
+
+/**
+ * Find a node by its string id. If several nodes have the same string id, the
+ * first one in preorder is found.
+ */
+std::optional<size_t> tree_t::find_string_id(std::string_view key) const {
+  auto itr = _string_id_index.find(key);
+  if (itr == _string_id_index.end()) { return {}; }
+  return itr->second;
 }
 
 std::string tree_t::to_newick() const {
-  std::stringstream oss;
-  _tree->to_newick(oss);
-  return oss.str();
+  std::string newick;
+  append_newick(newick, [this](std::string &out, size_t index) {
+    out += string_id(index);
+    out += ':';
+    util::append_number(out, brlen(index));
+  });
+  return newick;
 }
 
+/**
+ * Convert the tree into a newick string, with a formatting callback
+ *
+ * The callback is to format the label and branch length parameters, and any
+ * other information that needs to be included. For example, the callback can
+ * also construct NHX extension information.
+ */
 std::string tree_t::to_newick(
     std::function<void(std::ostream &, const node_t &)> cb) const {
-  std::stringstream oss;
-  _tree->to_newick(oss, cb);
+  std::ostringstream oss;
+  to_newick(oss, cb);
   return oss.str();
 }
 
-std::string tree_t::to_phylip_body() const {
+/**
+ * Write the newick string for the tree straight to a stream. There is no
+ * trailing semicolon or newline.
+ *
+ * The tree is walked with an explicit stack, which holds the node and the next
+ * child of that node to visit.
+ */
+std::ostream &tree_t::to_newick(
+    std::ostream                                       &os,
+    std::function<void(std::ostream &, const node_t &)> cb) const {
+  std::vector<std::pair<size_t, size_t>> stack{{0, 0}};
+  while (!stack.empty()) {
+    auto [index, next_child] = stack.back();
+    auto children            = this->children(index);
+
+    if (next_child < children.size()) {
+      os << (next_child == 0 ? "(" : ",");
+      stack.back().second++;
+      stack.emplace_back(children[next_child], 0);
+      continue;
+    }
+
+    if (!children.empty()) { os << ")"; }
+    cb(os, node_t{*this, index});
+    stack.pop_back();
+  }
+
+  return os;
+}
+
+std::string tree_t::to_phylip_body(const sim_result_t &result) const {
   std::stringstream oss;
-  to_phylip_body(oss);
+  to_phylip_body(oss, result);
   return oss.str();
 }
 
-std::string tree_t::to_phylip_body_extended() const {
+std::string tree_t::to_phylip_body_extended(const sim_result_t &result) const {
   std::stringstream oss;
-  to_phylip_body(oss, true);
+  to_phylip_body(oss, result, true);
   return oss.str();
 }
 
-std::ostream &tree_t::to_phylip_body(std::ostream &os, bool all) const {
-  size_t padding = _tree->get_string_id_len_max(all) + 1;
-  for (const auto &c : *this) { c->to_phylip_line(os, padding, all); }
-  // remove the last newline
-  os.seekp(-1, std::ios_base::end);
+/**
+ * Write the phylip rows for the tree. Each node in the tree becomes a row, with
+ * the label and the final state. If `all` is false, only the leaves are
+ * written. Every row, including the last one, ends with a newline.
+ */
+std::ostream &tree_t::to_phylip_body(std::ostream       &os,
+                                     const sim_result_t &result,
+                                     bool                all) const {
+  size_t padding = 0;
+  for (size_t index = 0; index < node_count(); ++index) {
+    if (is_leaf(index) || all) {
+      padding = std::max(padding, string_id(index).size());
+    }
+  }
+  padding += 1;
+
+  for (const auto &n : *this) {
+    if (!n.is_leaf() && !all) { continue; }
+    const auto &name = n.string_id();
+    os << name;
+    for (size_t i = name.size(); i < padding; ++i) { os << " "; }
+    os << result.final_state(n.index());
+    os << "\n";
+  }
   return os;
 }
 
-size_t tree_t::node_count() const { return _tree->node_count(); }
-size_t tree_t::leaf_count() const { return _tree->leaf_count(); }
+bool tree_t::is_binary() const {
+  for (size_t index = 0; index < node_count(); ++index) {
+    auto child_count = children(index).size();
+    if (child_count != 0 && child_count != 2) { return false; }
+  }
+  return true;
+}
 
-bool tree_t::is_binary() const { return _tree->is_binary(); }
 bool tree_t::is_valid() const {
-  if (!_tree) {
+  if (node_count() == 0) {
     MESSAGE_ERROR("The tree provided is not valid");
     return false;
   }
@@ -81,18 +171,45 @@ bool tree_t::is_valid() const {
 
 bool tree_t::is_ready() const {
   if (!is_valid()) { return false; }
-  if (!_tree->is_valid()) { return false; }
+  for (size_t index = 0; index < node_count(); ++index) {
+    if (!validate_periods(index)) {
+      LOG_ERROR("Failed to validate periods for node '%s'",
+                string_id(index).c_str());
+      return false;
+    }
+  }
   return true;
 }
 
-size_t tree_t::region_count() const { return _tree->final_state().regions(); }
+bool tree_t::validate_periods(size_t index) const {
+  if (_period_counts.size() != node_count() || _period_counts[index] == 0) {
+    LOG_ERROR("Period vector for node '%s' is empty", string_id(index).c_str());
+    return false;
+  }
+
+  constexpr double abstol       = 1e-9;
+  double           total_length = 0.0;
+  for (const auto &p : node_periods(index)) { total_length += p.length(); }
+  if (std::abs(total_length - brlen(index)) > abstol) {
+    LOG_ERROR("Total period length for node '%s' is incorrect",
+              string_id(index).c_str());
+    return false;
+  }
+
+  return true;
+}
 
-preorder_iterator tree_t::begin() const { return preorder_iterator(_tree); }
-preorder_iterator tree_t::end() const { return preorder_iterator(); }
+preorder_iterator tree_t::begin() const {
+  return {*this, _output_order.begin()};
+}
+preorder_iterator tree_t::end() const { return {*this, _output_order.end()}; }
 
 /**
  * Converts a coraxlib tree into a local tree.
  *
+ * The nodes are added in preorder, using an explicit stack so that deep trees
+ * (e.g. caterpillar trees) don't overflow the call stack.
+ *
  * Importantly, we don't try to resolve polytomies in this function. In reality,
  * once a tree is converted, we still need to check that it is binary.
  */
@@ -101,25 +218,460 @@ void tree_t::convert_tree(corax_utree_t *corax_tree) {
     LOG_ERROR("We failed to parse the tree: %s", corax_errmsg);
     return;
   }
-  _tree = std::make_unique<node_t>();
-  _tree->add_child(std::make_shared<node_t>(corax_tree->vroot->back));
-  _tree->add_child(std::make_shared<node_t>(corax_tree->vroot->next->back));
-  if (corax_tree->vroot->label) { _tree->set_label(corax_tree->vroot->label); }
-  _tree->assign_id_root();
-  _tree->assign_abs_time_root();
+
+  add_node(no_parent, 0.0, corax_tree->vroot->label);
+
+  /* Nodes are pushed in reverse, so that the first child is popped first */
+  std::vector<std::pair<corax_unode_t *, size_t>> stack{
+      {corax_tree->vroot->next->back, 0}, {corax_tree->vroot->back, 0}};
+  std::vector<corax_unode_t *> children;
+
+  while (!stack.empty()) {
+    auto [n, parent] = stack.back();
+    stack.pop_back();
+
+    size_t index = node_count();
+    add_node(parent, n->length, n->label);
+    if (n->next == nullptr) { continue; }
+
+    children.clear();
+    for (auto c = n->next; c != n; c = c->next) { children.push_back(c->back); }
+    for (auto itr = children.rbegin(); itr != children.rend(); ++itr) {
+      stack.emplace_back(*itr, index);
+    }
+  }
+
+  finalize_nodes();
 
   corax_utree_destroy(corax_tree, nullptr);
 }
 
-void tree_t::set_mode(operation_mode_e mode) { _mode = mode; }
+void tree_t::add_node(size_t parent, double brlen, const char *label) {
+  _parents.push_back(parent);
+  _brlens.push_back(brlen);
+  _labels.emplace_back(label ? label : "");
+}
+
+/**
+ * Compute everything that can be derived from the parents array: the child
+ * lists, the subtree sizes, the absolute times, the ids, and the output order.
+ */
+void tree_t::finalize_nodes() {
+  size_t count = node_count();
+
+  /* Child lists. Since children are added in order, the lists are in order */
+  _child_offsets.assign(count + 1, 0);
+  for (size_t index = 1; index < count; ++index) {
+    _child_offsets[_parents[index] + 1]++;
+  }
+  for (size_t index = 0; index < count; ++index) {
+    _child_offsets[index + 1] += _child_offsets[index];
+  }
+  _child_indices.resize(count > 0 ? count - 1 : 0);
+  std::vector<size_t> fill(_child_offsets.begin(), _child_offsets.end() - 1);
+  for (size_t index = 1; index < count; ++index) {
+    _child_indices[fill[_parents[index]]++] = index;
+  }
+
+  /* Subtree sizes. Children come after their parent, so go backwards */
+  _subtree_sizes.assign(count, 1);
+  for (size_t index = count; index-- > 1;) {
+    _subtree_sizes[_parents[index]] += _subtree_sizes[index];
+  }
+
+  /* Absolute times, measured from the root */
+  _abs_times.resize(count);
+  for (size_t index = 0; index < count; ++index) {
+    double parent_time
+        = _parents[index] == no_parent ? 0.0 : _abs_times[_parents[index]];
+    _abs_times[index] = parent_time + _brlens[index];
+  }
+
+  /*
+   * Inner nodes are numbered first, in preorder, and leaves are numbered
+   * after all of the inner nodes, also in preorder. The ids of the inner nodes
+   * are used as labels, so they are 0 to `inner node count - 1`.
+   */
+  _node_ids.resize(count);
+  size_t next_id = 0;
+  for (size_t index = 0; index < count; ++index) {
+    if (!is_leaf(index)) { _node_ids[index] = next_id++; }
+  }
+  _leaf_count = count - next_id;
+  for (size_t index = 0; index < count; ++index) {
+    if (is_leaf(index)) { _node_ids[index] = next_id++; }
+  }
+
+  /* The string ids of the inner nodes, by id, and the index of every id */
+  _inner_ids.resize(count - _leaf_count);
+  for (size_t id = 0; id < _inner_ids.size(); ++id) {
+    _inner_ids[id] = std::to_string(id);
+  }
+  _string_id_index.clear();
+  _string_id_index.reserve(count);
+  for (size_t index = 0; index < count; ++index) {
+    _string_id_index.emplace(string_id(index), index);
+  }
+
+  /*
+   * The order in which the nodes are written. This is also a preorder, but the
+   * last child is visited first.
+   */
+  _output_order.clear();
+  _output_order.reserve(count);
+  std::vector<size_t> stack{0};
+  while (!stack.empty() && count > 0) {
+    auto index = stack.back();
+    stack.pop_back();
+    _output_order.push_back(index);
+    for (auto c : children(index)) { stack.push_back(c); }
+  }
+}
+
+/**
+ * The initial dist for a node. For the root this is the root range, otherwise
+ * it is the side of the split of the parent that the node is on. Since the
+ * first child of a node is always the next node, it gets the left side.
+ */
+dist_t tree_t::start_dist(size_t              index,
+                          dist_t              root_dist,
+                          const sim_result_t &result) const {
+  auto parent = _parents[index];
+  if (parent == no_parent) { return root_dist; }
+  const auto &split = result.node_split(parent);
+  return index == parent + 1 ? split.left : split.right;
+}
+
+/**
+ * Simulate the nodes of the subtree rooted at `root`, in preorder. When we get
+ * to a node which should be simulated in parallel, it is spawned as a new task,
+ * and its whole subtree is skipped here. The split of its parent is already
+ * done by then, since the parent comes first.
+ */
+void tree_t::simulate_subtree(size_t                root,
+                              dist_t                root_dist,
+                              const period_table_t &table,
+                              sim_result_t         &result,
+                              pcg_extras::pcg128_t  key,
+                              task_pool_t          &pool,
+                              size_t                worker) const {
+  auto  &shard       = result.shard(worker);
+  size_t end         = root + _subtree_sizes[root];
+  size_t transitions = 0, nodes = 0;
+  for (size_t index = root; index < end;) {
+    if (index != root && is_parallel_root(index)) {
+      pool.spawn(
+          [this, index, root_dist, &table, &result, key, &pool](size_t w) {
+            simulate_subtree(index, root_dist, table, result, key, pool, w);
+          });
+      index += _subtree_sizes[index];
+      continue;
+    }
+
+    auto gen     = rng_wrapper_t::node_rng(key, _node_ids[index]);
+    transitions += simulate_node(index,
+                                 start_dist(index, root_dist, result),
+                                 table,
+                                 result,
+                                 shard,
+                                 gen);
+    ++nodes;
+    ++index;
+  }
+  count_event(counter_e::TRANSITIONS, transitions);
+  count_event(counter_e::SPLITS, nodes);
+}
+
+/**
+ * Simulate the nodes of a result again after an edit, and keep every other
+ * node as it was. `edited` are the nodes whose branches changed, which are
+ * returned by the edits, e.g. `set_period_model` or `set_brlen`.
+ *
+ * Every node is simulated on the same generator as before, so a node which
+ * wasn't edited, and starts from the same range, would come out the same. So,
+ * a node is only simulated again if it was edited, or if its parent split
+ * differently, and the result is the same as simulating the edited tree from
+ * scratch with `simulate_streams`.
+ *
+ * The result has to come from `simulate_streams` or `simulate_parallel`, and
+ * it can't be stats only, since the old counts can't be taken back out.
+ * Returns the number of nodes which were simulated again.
+ */
+std::optional<size_t> tree_t::resimulate(sim_result_t           &result,
+                                         std::span<const size_t> edited,
+                                         const period_table_t   &table) const {
+  auto key = result.node_key();
+  if (!key.has_value() || result.node_count() != node_count()) {
+    LOG_ERROR("Only a result simulated on this tree with node generators can "
+              "be simulated again");
+    return {};
+  }
+  if (result.stats_only()) {
+    LOG_ERROR("A stats only result can't be simulated again");
+    return {};
+  }
+
+  std::vector<char> redo(node_count(), false);
+  for (auto index : edited) { redo[index] = true; }
+
+  size_t transitions = 0, nodes = 0;
+  for (size_t index = 0; index < node_count(); ++index) {
+    if (!redo[index]) { continue; }
+    auto old_split  = result.node_split(index);
+    auto gen        = rng_wrapper_t::node_rng(key.value(), _node_ids[index]);
+    auto dist       = start_dist(index, result.root_range(), result);
+    transitions    += simulate_node(index, dist, table, result, result, gen);
+    ++nodes;
+
+    const auto &split = result.node_split(index);
+    if (split.left != old_split.left || split.right != old_split.right) {
+      for (auto child : children(index)) { redo[child] = true; }
+    }
+  }
+  result.compact_transitions();
+
+  count_event(counter_e::TRANSITIONS, transitions);
+  count_event(counter_e::SPLITS, nodes);
+  return nodes;
+}
+
+/**
+ * A subtree gets its own task if it is large enough, and the rest of the
+ * subtree of its parent is also large enough. Otherwise, a long chain of nodes
+ * with small subtrees hanging off of it (a caterpillar) would make a task for
+ * every node on the chain, with nothing to run in parallel.
+ */
+bool tree_t::is_parallel_root(size_t index) const {
+  auto parent = _parents[index];
+  if (parent == no_parent) { return false; }
 
+  size_t size = _subtree_sizes[index];
+  size_t rest = _subtree_sizes[parent] - 1 - size;
+  return size >= _parallel_cutoff && rest >= _parallel_cutoff;
+}
+
+void tree_t::set_mode(operation_mode_e mode) {
+  _mode = mode;
+  reset_endpoint_cache();
+}
+
+/**
+ * The endpoint cache has a slot for every period of every branch, which are
+ * numbered by `_period_offsets`, so it has to be rebuilt whenever the periods
+ * change.
+ */
+void tree_t::reset_endpoint_cache() {
+  _table.endpoint_cache = make_endpoint_cache();
+}
+
+std::shared_ptr<endpoint_cache_t> tree_t::make_endpoint_cache() const {
+  if (_mode != operation_mode_e::ENDPOINT) { return {}; }
+  size_t slots = 0;
+  for (auto c : _period_counts) { slots += c; }
+  return std::make_shared<endpoint_cache_t>(slots);
+}
+
+namespace {
+std::vector<period_t> sort_periods(std::vector<period_t> periods) {
+  std::stable_sort(
+      periods.begin(), periods.end(), [](const auto &a, const auto &b) {
+        return a.start() < b.start();
+      });
+  return periods;
+}
+} // namespace
+
+/**
+ * Make a period table for the tree from another set of periods, without
+ * assigning the periods to the nodes again. The periods have to have the same
+ * boundaries as the periods of the tree, since the nodes keep their period
+ * ranges. Should be called after the mode is set, since the table gets its own
+ * endpoint cache in endpoint mode.
+ */
+std::optional<period_table_t>
+tree_t::make_period_table(const std::vector<period_t> &periods) const {
+  auto sorted = sort_periods(periods);
+  if (sorted.size() != _table.periods.size()) {
+    LOG_ERROR("Expected %lu periods for the period table, but got %lu",
+              _table.periods.size(),
+              sorted.size());
+    return {};
+  }
+  for (size_t i = 0; i < sorted.size(); ++i) {
+    if (sorted[i].start() != _table.periods[i].start()
+        || sorted[i].length() != _table.periods[i].length()) {
+      LOG_ERROR("The boundaries of period %lu don't match the tree",
+                sorted[i].index());
+      return {};
+    }
+  }
+  return period_table_t{std::move(sorted), make_endpoint_cache()};
+}
+
+/**
+ * Assign the periods to every node. The tree keeps its own copy of the
+ * periods, sorted by start time, and each node only records the range of the
+ * periods which cover its branch.
+ */
 void tree_t::set_periods(const std::vector<period_t> &periods) {
-  _tree->assign_periods(periods);
+  _table.periods = sort_periods(periods);
+
+  _period_firsts.resize(node_count());
+  _period_counts.resize(node_count());
+  for (size_t index = 0; index < node_count(); ++index) {
+    assign_periods(index);
+  }
+  finalize_periods();
 }
 
 void tree_t::set_periods(const period_t &period) {
   set_periods(std::vector<period_t>{period});
 }
-dist_t tree_t::get_root_range() const { return _tree->start_range(); }
+
+/**
+ * Use period ranges which were already assigned to the nodes, instead of
+ * assigning them here. `period_firsts` are positions in `periods` once it is
+ * sorted by start time, like `set_periods` would sort it.
+ */
+void tree_t::set_assigned_periods(const std::vector<period_t> &periods,
+                                  std::vector<size_t>          period_firsts,
+                                  std::vector<size_t>          period_counts) {
+  _table.periods = sort_periods(periods);
+
+  _period_firsts = std::move(period_firsts);
+  _period_counts = std::move(period_counts);
+  finalize_periods();
+}
+
+/**
+ * The position in `periods()` of the period with `period_index`.
+ */
+std::optional<size_t> tree_t::find_period(size_t period_index) const {
+  const auto &periods = _table.periods;
+  for (size_t i = 0; i < periods.size(); ++i) {
+    if (periods[i].index() == period_index) { return i; }
+  }
+  LOG_ERROR("The tree has no period with index %lu", period_index);
+  return {};
+}
+
+/**
+ * The nodes with a branch in the period with `period_index`, in preorder.
+ */
+std::optional<std::vector<size_t>>
+tree_t::period_nodes(size_t period_index) const {
+  auto position = find_period(period_index);
+  if (!position.has_value()) { return {}; }
+
+  std::vector<size_t> nodes;
+  for (size_t index = 0; index < node_count(); ++index) {
+    if (_period_firsts[index] <= position.value()
+        && position.value() < _period_firsts[index] + _period_counts[index]) {
+      nodes.push_back(index);
+    }
+  }
+  return nodes;
+}
+
+/**
+ * Replace the model of one period, and return the nodes with a branch in the
+ * period, which are the nodes to give to `resimulate`. Like the models given to
+ * `set_periods`, the model needs its region count set.
+ */
+std::optional<std::vector<size_t>>
+tree_t::set_period_model(size_t                          period_index,
+                         std::shared_ptr<biogeo_model_t> model) {
+  auto position = find_period(period_index);
+  if (!position.has_value()) { return {}; }
+  _table.periods[position.value()].set_model(std::move(model));
+
+  auto nodes = period_nodes(period_index).value();
+  if (_table.endpoint_cache) {
+    for (auto index : nodes) {
+      _table.endpoint_cache->clear(_period_offsets[index] + position.value()
+                                   - _period_firsts[index]);
+    }
+  }
+  return nodes;
+}
+
+/**
+ * Change the length of a branch, and return the nodes to give to
+ * `resimulate`. This is the whole subtree of the node, since all of their
+ * times move. The periods are only assigned again for those nodes. If a branch
+ * ends up past the last period, the tree is no longer ready.
+ */
+std::vector<size_t> tree_t::set_brlen(size_t index, double brlen) {
+  _brlens[index] = brlen;
+
+  bool                have_periods = _period_counts.size() == node_count();
+  bool                moved_slots  = false;
+  std::vector<size_t> nodes;
+  for (size_t n = index; n < index + _subtree_sizes[index]; ++n) {
+    double parent_time
+        = _parents[n] == no_parent ? 0.0 : _abs_times[_parents[n]];
+    _abs_times[n] = parent_time + _brlens[n];
+    nodes.push_back(n);
+
+    if (!have_periods) { continue; }
+    auto count = _period_counts[n];
+    assign_periods(n);
+    moved_slots |= _period_counts[n] != count;
+  }
+
+  /* The slots are numbered by the period counts, so they can move */
+  if (moved_slots) {
+    finalize_periods();
+  } else if (_table.endpoint_cache) {
+    for (auto n : nodes) {
+      for (size_t i = 0; i < _period_counts[n]; ++i) {
+        _table.endpoint_cache->clear(_period_offsets[n] + i);
+      }
+    }
+  }
+  return nodes;
+}
+
+/**
+ * Number the period segments of the branches, for the endpoint cache.
+ */
+void tree_t::finalize_periods() {
+  _period_offsets.resize(_period_counts.size());
+
+  size_t offset = 0;
+  for (size_t index = 0; index < _period_counts.size(); ++index) {
+    _period_offsets[index]  = offset;
+    offset                 += _period_counts[index];
+  }
+  reset_endpoint_cache();
+}
+
+/**
+ * Find the periods covering the branch of a node with two binary searches.
+ * The first period is the first one that ends at or after the start of the
+ * branch, and the last is the first one that ends at or after the end of the
+ * branch. So, a branch which starts exactly on a boundary starts in the
+ * earlier period, where it has a length of 0.
+ */
+void tree_t::assign_periods(size_t index) {
+  const auto &periods = _table.periods;
+
+  auto ends_before = [](const period_t &p, double t) { return p.end() < t; };
+
+  auto first = std::lower_bound(
+      periods.begin(), periods.end(), abs_time_at_start(index), ends_before);
+  if (first == periods.end() || first->start() > abs_time_at_start(index)) {
+    _period_firsts[index] = 0;
+    _period_counts[index] = 0;
+    return;
+  }
+
+  auto last
+      = std::lower_bound(first, periods.end(), abs_time(index), ends_before);
+  if (last == periods.end()) { --last; }
+
+  _period_firsts[index] = first - periods.begin();
+  _period_counts[index] = last - first + 1;
+}
 
 } // namespace bigrig
@@ -1,27 +1,80 @@
 #pragma once
+#include "condition.hpp"
 #include "dist.hpp"
+#include "endpoint.hpp"
+#include "instrument.hpp"
 #include "iterator.hpp"
 #include "model.hpp"
 #include "node.hpp"
+#include "period.hpp"
+#include "result.hpp"
+#include "rng.hpp"
+#include "scheduler.hpp"
+#include "split.hpp"
 
+#include <concepts>
 #include <corax/corax.hpp>
 #include <functional>
+#include <limits>
+#include <memory>
 #include <optional>
+#include <span>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
 
 namespace bigrig {
 /**
- * Top level class around `node_t`.
+ * A set of periods to simulate a tree with, sorted by start time, along with
+ * the endpoint cache for them. The tree keeps its own table, but it can also be
+ * simulated with other tables which have the same period boundaries, e.g. the
+ * same periods with other rates.
+ */
+struct period_table_t {
+  std::vector<period_t> periods;
+
+  /* Only used in endpoint mode, one slot per period of every branch */
+  std::shared_ptr<endpoint_cache_t> endpoint_cache;
+};
+
+/**
+ * The tree which we simulate on.
  *
  * Uses the coraxlib newick parser to parse the tree, but then immediatly
- * converts the tree into `node_t`s.
+ * converts the tree into a set of flat arrays. The nodes are stored in
+ * preorder, so the parent of a node always comes before it, and the first
+ * child of a node is always the next node. This way, the whole tree can be
+ * simulated (and written) with a linear pass over the arrays, without any
+ * recursion.
+ *
+ * The string ids of the nodes, which are used to label the nodes in the output,
+ * are made once when the tree is built, along with an index to find a node by
+ * its string id. So writing a result never has to format the ids again.
+ *
+ * Once the periods are set, the tree is immutable during simulation. The
+ * results of a simulation are written into a `sim_result_t`, so a single tree
+ * can be shared between many replicates and threads.
  */
 class tree_t {
 public:
+  static constexpr size_t no_parent = std::numeric_limits<size_t>::max();
+
+  /**
+   * Default for the smallest subtree, in nodes, that is given its own task
+   * when simulating in parallel.
+   */
+  static constexpr size_t DEFAULT_PARALLEL_CUTOFF = 1024;
+
   explicit tree_t(const std::filesystem::path &tree_filename);
 
   explicit tree_t(const std::string &tree_str);
 
+  tree_t(std::vector<size_t>      parents,
+         std::vector<double>      brlens,
+         std::vector<std::string> labels);
+
   tree_t(const tree_t &)            = delete;
   tree_t &operator=(const tree_t &) = delete;
 
@@ -29,37 +82,283 @@ public:
   tree_t &operator=(tree_t &&) = default;
 
   /**
-   * Simulate the whole tree from an initial dist.
+   * Simulate the whole tree from an initial dist. The results are written into
+   * `result`, which is reset first.
+   *
+   * Because the nodes are in preorder, the split of the parent is always ready
+   * by the time we get to a node.
    */
   void simulate(dist_t                                  initial_distribution,
-                std::uniform_random_bit_generator auto &gen) {
-    LOG_DEBUG("Starting sample with init dist = %lb",
-              static_cast<uint64_t>(initial_distribution));
-    _tree->simulate(initial_distribution, gen, _mode);
+                sim_result_t                           &result,
+                std::uniform_random_bit_generator auto &gen) const {
+    simulate(initial_distribution, result, gen, _table);
+  }
+
+  /**
+   * Simulate the whole tree with a different period table, which has to come
+   * from `make_period_table`.
+   */
+  void simulate(dist_t                                  initial_distribution,
+                sim_result_t                           &result,
+                std::uniform_random_bit_generator auto &gen,
+                const period_table_t                   &table) const {
+    LOG_DEBUG("Starting sample with init dist = %s",
+              initial_distribution.to_str().c_str());
+    result.reset(node_count(), initial_distribution);
+    size_t transitions = 0;
+    for (size_t index = 0; index < node_count(); ++index) {
+      auto dist    = start_dist(index, initial_distribution, result);
+      transitions += simulate_node(index, dist, table, result, result, gen);
+    }
+    count_event(counter_e::TRANSITIONS, transitions);
+    count_event(counter_e::SPLITS, node_count());
+  }
+
+  /**
+   * Simulate the whole tree, conditioned on the ranges of the tips. The tips
+   * are checked as soon as they are simulated, and when a tip fails, the
+   * subtree of its restart root is simulated again, from the same start range.
+   * See `restart_mode_e` for which nodes are restart roots.
+   *
+   * The nodes outside of the restart roots use `gen`, and every attempt at a
+   * restart root gets its own generator, made from a key drawn from `gen`.
+   * Gives up after `max_restarts` restarts, and otherwise returns the number
+   * of restarts.
+   */
+  std::optional<size_t>
+  simulate_conditioned(dist_t                                  root_dist,
+                       sim_result_t                           &result,
+                       std::uniform_random_bit_generator auto &gen,
+                       const period_table_t                   &table,
+                       const conditions_t                     &conditions,
+                       size_t max_restarts) const {
+    LOG_DEBUG("Starting conditioned sample with init dist = %s",
+              root_dist.to_str().c_str());
+    result.reset(node_count(), root_dist);
+    auto key = rng_wrapper_t::make_node_key(gen);
+
+    /* The restart roots never overlap, so only one is active at a time */
+    size_t                     active     = no_parent;
+    size_t                     active_end = 0;
+    size_t                     attempt    = 0;
+    pcg64_fast                 active_gen;
+    sim_result_t::checkpoint_t checkpoint;
+
+    size_t restarts    = 0;
+    size_t simulated   = 0;
+    size_t transitions = 0;
+    size_t index       = 0;
+    while (index < node_count()) {
+      if (index != active && conditions.is_restart_root(index)) {
+        active     = index;
+        active_end = index + subtree_size(index);
+        attempt    = 0;
+        active_gen = rng_wrapper_t::subtree_rng(key, node_id(index), attempt);
+        result.save_checkpoint(checkpoint);
+      }
+
+      auto dist = start_dist(index, root_dist, result);
+      if (index < active_end) {
+        transitions
+            += simulate_node(index, dist, table, result, result, active_gen);
+      } else {
+        transitions += simulate_node(index, dist, table, result, result, gen);
+      }
+      ++simulated;
+
+      if (conditions.accepts(index, result.final_state(index))) {
+        ++index;
+        continue;
+      }
+      if (restarts == max_restarts) { break; }
+      ++restarts;
+      ++attempt;
+      active_gen = rng_wrapper_t::subtree_rng(key, node_id(active), attempt);
+      result.rewind(checkpoint);
+      index = active;
+    }
+    count_event(counter_e::TRANSITIONS, transitions);
+    count_event(counter_e::SPLITS, simulated);
+    count_event(counter_e::RESTARTS, restarts);
+
+    if (index < node_count()) { return {}; }
+    return restarts;
+  }
+
+  /**
+   * Simulate the whole tree, handing independent subtrees to the workers of
+   * `pool`. Subtrees smaller than the parallel cutoff are always simulated on
+   * the worker which reached them.
+   *
+   * Every node gets its own generator, made from the node id and a key drawn
+   * from `gen`, so the results don't depend on the number of threads, the
+   * order the subtrees are run in, or the cutoff. They are not the same as the
+   * results of `simulate` with the same generator, though.
+   */
+  void simulate_parallel(dist_t                                  root_dist,
+                         sim_result_t                           &result,
+                         std::uniform_random_bit_generator auto &gen,
+                         task_pool_t                            &pool) const {
+    simulate_parallel(root_dist, result, gen, pool, _table);
+  }
+
+  void simulate_parallel(dist_t                                  root_dist,
+                         sim_result_t                           &result,
+                         std::uniform_random_bit_generator auto &gen,
+                         task_pool_t                            &pool,
+                         const period_table_t                   &table) const {
+    LOG_DEBUG("Starting parallel sample with init dist = %s",
+              root_dist.to_str().c_str());
+    result.reset(node_count(), root_dist);
+    result.reset_shards(pool.thread_count());
+    auto key = rng_wrapper_t::make_node_key(gen);
+    result.set_node_key(key);
+    pool.run([&](size_t worker) {
+      simulate_subtree(0, root_dist, table, result, key, pool, worker);
+    });
+    result.merge_shards();
+  }
+
+  /**
+   * Simulate the whole tree on this thread, with every node on its own
+   * generator, like `simulate_parallel`. The results are the same as the
+   * results of `simulate_parallel` with the same generator. The key of the
+   * node generators is kept in the result, so that it can be updated with
+   * `resimulate` after the tree or its periods are edited.
+   */
+  void simulate_streams(dist_t                                  root_dist,
+                        sim_result_t                           &result,
+                        std::uniform_random_bit_generator auto &gen) const {
+    simulate_streams(root_dist, result, gen, _table);
+  }
+
+  void simulate_streams(dist_t                                  root_dist,
+                        sim_result_t                           &result,
+                        std::uniform_random_bit_generator auto &gen,
+                        const period_table_t                   &table) const {
+    LOG_DEBUG("Starting streamed sample with init dist = %s",
+              root_dist.to_str().c_str());
+    result.reset(node_count(), root_dist);
+    auto key = rng_wrapper_t::make_node_key(gen);
+    result.set_node_key(key);
+
+    size_t transitions = 0;
+    for (size_t index = 0; index < node_count(); ++index) {
+      auto node_gen  = rng_wrapper_t::node_rng(key, _node_ids[index]);
+      auto dist      = start_dist(index, root_dist, result);
+      transitions   += simulate_node(
+          index, dist, table, result, result, node_gen);
+    }
+    count_event(counter_e::TRANSITIONS, transitions);
+    count_event(counter_e::SPLITS, node_count());
+  }
+
+  std::optional<size_t> resimulate(sim_result_t           &result,
+                                   std::span<const size_t> edited) const {
+    return resimulate(result, edited, _table);
+  }
+
+  std::optional<size_t> resimulate(sim_result_t           &result,
+                                   std::span<const size_t> edited,
+                                   const period_table_t   &table) const;
+
+  /**
+   * Regenerate the transitions on the branch leading to a node, from a result
+   * simulated in lazy events mode with `table`. The generator saved for the
+   * branch is replayed, so `record` gets exactly the transitions that the
+   * simulation drew.
+   */
+  void replay_transitions(
+      size_t                                      index,
+      const sim_result_t                         &result,
+      const period_table_t                       &table,
+      std::invocable<const transition_t &> auto &&record) const {
+    if (_mode == operation_mode_e::ENDPOINT) { return; }
+    auto gen = result.branch_rng(index);
+    simulate_transitions(start_dist(index, result.root_range(), result),
+                         node_periods(index, table),
+                         gen,
+                         _mode,
+                         record);
+  }
+
+  /**
+   * Regenerate the transitions of every node of a lazy events result, so that
+   * it can be written like any other result.
+   */
+  void materialize_transitions(sim_result_t         &result,
+                               const period_table_t &table) const {
+    result.clear_transitions();
+    for (size_t index = 0; index < node_count(); ++index) {
+      result.restore_transitions(index, [&](auto &&record) {
+        replay_transitions(index, result, table, record);
+      });
+    }
   }
 
-  std::optional<dist_t> get_dist_by_string_id(const std::string &key) const;
+  std::optional<dist_t> get_dist_by_string_id(const std::string  &key,
+                                              const sim_result_t &result) const;
+
+  std::optional<size_t> find_string_id(std::string_view key) const;
 
   std::string to_newick() const;
 
+  /**
+   * Append the newick string for the tree to `out`, without the trailing
+   * semicolon. `annotate(out, index)` appends the label of a node, and
+   * anything else that goes after it, e.g. the branch length.
+   *
+   * Since the nodes are in preorder, the string is written with a single pass
+   * over the nodes. A clade is closed at the last leaf of its subtree, which is
+   * the last node of the subtree.
+   */
+  void append_newick(
+      std::string                                                &out,
+      std::invocable<std::string &, size_t> auto &&annotate) const {
+    for (size_t index = 0; index < node_count(); ++index) {
+      auto parent = _parents[index];
+      if (parent != no_parent && index != parent + 1) { out += ','; }
+      if (!is_leaf(index)) {
+        out += '(';
+        continue;
+      }
+      annotate(out, index);
+
+      size_t node = index;
+      while (_parents[node] != no_parent) {
+        parent = _parents[node];
+        if (node + _subtree_sizes[node] != parent + _subtree_sizes[parent]) {
+          break;
+        }
+        out += ')';
+        annotate(out, parent);
+        node = parent;
+      }
+    }
+  }
+
   std::string
   to_newick(std::function<void(std::ostream &, const node_t &)> cb) const;
 
-  std::string to_phylip_body() const;
+  std::ostream &
+  to_newick(std::ostream                                       &os,
+            std::function<void(std::ostream &, const node_t &)> cb) const;
+
+  std::string to_phylip_body(const sim_result_t &result) const;
 
-  std::string to_phylip_body_extended() const;
+  std::string to_phylip_body_extended(const sim_result_t &result) const;
 
-  std::ostream &to_phylip_body(std::ostream &os, bool all = false) const;
+  std::ostream &to_phylip_body(std::ostream       &os,
+                               const sim_result_t &result,
+                               bool                all = false) const;
 
-  size_t node_count() const;
-  size_t leaf_count() const;
+  size_t node_count() const { return _brlens.size(); }
+  size_t leaf_count() const { return _leaf_count; }
 
   bool is_binary() const;
   bool is_valid() const;
   bool is_ready() const;
 
-  size_t region_count() const;
-
   preorder_iterator begin() const;
   preorder_iterator end() const;
 
@@ -67,13 +366,170 @@ public:
 
   void set_periods(const std::vector<period_t> &periods);
   void set_periods(const period_t &periods);
+  void set_assigned_periods(const std::vector<period_t> &periods,
+                            std::vector<size_t>          period_firsts,
+                            std::vector<size_t>          period_counts);
+
+  /**
+   * The periods of the tree, sorted by start time.
+   */
+  const std::vector<period_t> &periods() const { return _table.periods; }
+  const period_table_t        &period_table() const { return _table; }
+
+  std::optional<period_table_t>
+  make_period_table(const std::vector<period_t> &periods) const;
+
+  std::optional<std::vector<size_t>>
+  set_period_model(size_t period_index, std::shared_ptr<biogeo_model_t> model);
+
+  std::optional<std::vector<size_t>> period_nodes(size_t period_index) const;
+
+  std::vector<size_t> set_brlen(size_t index, double brlen);
+
+  void   set_parallel_cutoff(size_t cutoff) { _parallel_cutoff = cutoff; }
+  size_t parallel_cutoff() const { return _parallel_cutoff; }
+
+  /* Per node accessors, by index */
+  size_t             node_id(size_t index) const { return _node_ids[index]; }
+  const std::string &label(size_t index) const { return _labels[index]; }
+  const std::string &string_id(size_t index) const {
+    return is_leaf(index) ? _labels[index] : _inner_ids[_node_ids[index]];
+  }
+  double             brlen(size_t index) const { return _brlens[index]; }
+  double             abs_time(size_t index) const { return _abs_times[index]; }
+  double             abs_time_at_start(size_t index) const {
+    return _abs_times[index] - _brlens[index];
+  }
+  size_t parent(size_t index) const { return _parents[index]; }
+  bool   is_leaf(size_t index) const { return children(index).empty(); }
+
+  /**
+   * Number of nodes in the subtree rooted at a node, including the node. Since
+   * the nodes are in preorder, the subtree is `[index, index + size)`.
+   */
+  size_t subtree_size(size_t index) const { return _subtree_sizes[index]; }
+
+  std::span<const size_t> children(size_t index) const {
+    return {_child_indices.data() + _child_offsets[index],
+            _child_offsets[index + 1] - _child_offsets[index]};
+  }
+
+  /**
+   * The periods covering the branch of a node, clamped to the branch.
+   */
+  branch_periods_t node_periods(size_t index) const {
+    return node_periods(index, _table);
+  }
+
+  branch_periods_t node_periods(size_t                index,
+                                const period_table_t &table) const {
+    return {{table.periods.data() + _period_firsts[index],
+             _period_counts[index]},
+            abs_time_at_start(index),
+            abs_time(index)};
+  }
+
+  /**
+   * Position of the first period of a node in `periods()`.
+   */
+  size_t first_period(size_t index) const { return _period_firsts[index]; }
 
-  dist_t get_root_range() const;
-  
 private:
+  /**
+   * Simulate the branch leading to a node, and then the split at the node.
+   * The transitions and counts go to `recorder`, which is either the result
+   * itself, or one of its shards. Returns the number of transitions, so that
+   * the callers can count them for a whole subtree at once.
+   */
+  size_t simulate_node(size_t                                  index,
+                       dist_t                                  init_dist,
+                       const period_table_t                   &table,
+                       sim_result_t                           &result,
+                       auto                                   &recorder,
+                       std::uniform_random_bit_generator auto &gen) const {
+    LOG_DEBUG("Node sampling with initial_distribution = %s",
+              init_dist.to_str().c_str());
+    auto periods = node_periods(index, table);
+    if constexpr (std::same_as<std::remove_cvref_t<decltype(gen)>,
+                               pcg64_fast>) {
+      if (result.lazy_events()) { result.save_branch_rng(index, gen); }
+    }
+    recorder.start_transitions(index);
+    dist_t final_state;
+    size_t transitions = 0;
+    if (_mode == operation_mode_e::ENDPOINT) {
+      final_state = simulate_endpoint(init_dist,
+                                      periods,
+                                      _period_offsets[index],
+                                      *table.endpoint_cache,
+                                      gen);
+    } else {
+      final_state = simulate_transitions(
+          init_dist, periods, gen, _mode, [&](const transition_t &t) {
+            recorder.add_transition(t);
+            ++transitions;
+          });
+    }
+    recorder.finish_transitions(index);
+    result.set_final_state(index, final_state);
+
+    LOG_DEBUG("Finished sampling with %lu transitions",
+              result.transition_count(index));
+
+    auto split = split_dist(final_state, periods.back().model(), gen, _mode);
+    split.period_index = periods.back().index();
+    result.set_split(index, split);
+    if (!is_leaf(index)) { recorder.count_split(split); }
+    return transitions;
+  }
+
+  void simulate_subtree(size_t                root,
+                        dist_t                root_dist,
+                        const period_table_t &table,
+                        sim_result_t         &result,
+                        pcg_extras::pcg128_t  key,
+                        task_pool_t          &pool,
+                        size_t                worker) const;
+
+  bool is_parallel_root(size_t index) const;
+
+  std::optional<size_t> find_period(size_t period_index) const;
+
+  dist_t start_dist(size_t              index,
+                    dist_t              root_dist,
+                    const sim_result_t &result) const;
+
+  /* The views are into the labels and the inner ids, which never move */
+  using string_id_index_t = std::unordered_map<std::string_view, size_t>;
+
   void convert_tree(corax_utree_t *corax_tree);
+  void add_node(size_t parent, double brlen, const char *label);
+  void finalize_nodes();
+
+  bool validate_periods(size_t index) const;
+  void assign_periods(size_t index);
+  void finalize_periods();
+  void reset_endpoint_cache();
+
+  std::shared_ptr<endpoint_cache_t> make_endpoint_cache() const;
 
-  std::shared_ptr<node_t> _tree;
-  operation_mode_e        _mode = operation_mode_e::FAST;
+  std::vector<double>      _brlens;
+  std::vector<double>      _abs_times;
+  std::vector<size_t>      _parents;
+  std::vector<size_t>      _child_offsets;
+  std::vector<size_t>      _child_indices;
+  std::vector<size_t>      _subtree_sizes;
+  std::vector<size_t>      _node_ids;
+  std::vector<std::string> _labels;
+  std::vector<std::string> _inner_ids;
+  string_id_index_t        _string_id_index;
+  std::vector<size_t>      _period_firsts;
+  std::vector<size_t>      _period_counts;
+  std::vector<size_t>      _period_offsets;
+  std::vector<size_t>      _output_order;
+  period_table_t           _table;
+  size_t                   _leaf_count      = 0;
+  operation_mode_e         _mode            = operation_mode_e::FAST;
+  size_t                   _parallel_cutoff = DEFAULT_PARALLEL_CUTOFF;
 };
 } // namespace bigrig
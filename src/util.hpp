@@ -1,7 +1,13 @@
 #pragma once
 #include <array>
+#include <charconv>
 #include <cstddef>
 #include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
 
 namespace bigrig::util {
 
@@ -39,7 +45,56 @@ constexpr auto NEWICK_EXT = ".nwk";
 constexpr auto YAML_EXT   = ".yaml";
 constexpr auto JSON_EXT   = ".json";
 constexpr auto CSV_EXT    = ".csv";
+constexpr auto BINARY_EXT = ".bgr";
+constexpr auto GZIP_EXT   = ".gz";
 
-constexpr size_t VECTOR_INITIAL_RESERVE = 8;
+/* Helpers for the small comma separated tables that runs can be given */
+
+inline std::string_view trim(std::string_view str) {
+  auto first = str.find_first_not_of(" \t\r");
+  if (first == std::string_view::npos) { return {}; }
+  auto last = str.find_last_not_of(" \t\r");
+  return str.substr(first, last - first + 1);
+}
+
+inline std::vector<std::string_view> split_fields(std::string_view line,
+                                                  char separator = ',') {
+  std::vector<std::string_view> fields;
+  while (true) {
+    auto end = line.find(separator);
+    fields.push_back(trim(line.substr(0, end)));
+    if (end == std::string_view::npos) { break; }
+    line.remove_prefix(end + 1);
+  }
+  return fields;
+}
+
+inline std::optional<double> parse_double(std::string_view str) {
+  double value;
+  auto [end, ec] = std::from_chars(str.data(), str.data() + str.size(), value);
+  if (ec != std::errc{} || end != str.data() + str.size()) { return {}; }
+  return value;
+}
+
+/**
+ * Append a number to a buffer, formatted like a stream with the default flags
+ * would format it, so floating point numbers get 6 significant digits, like
+ * `%g`. This is much cheaper than a stream, and never allocates beyond the
+ * buffer.
+ */
+template <typename T> void append_number(std::string &out, T value) {
+  std::array<char, 32> chars;
+  std::to_chars_result r;
+  if constexpr (std::is_floating_point_v<T>) {
+    r = std::to_chars(chars.data(),
+                      chars.data() + chars.size(),
+                      value,
+                      std::chars_format::general,
+                      6);
+  } else {
+    r = std::to_chars(chars.data(), chars.data() + chars.size(), value);
+  }
+  out.append(chars.data(), r.ptr);
+}
 
 } // namespace bigrig::util
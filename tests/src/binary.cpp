@@ -0,0 +1,213 @@
+#include "binary.hpp"
+#include "result.hpp"
+#include "test_fixtures.hpp"
+#include "tree.hpp"
+
+#include "pcg_random.hpp"
+
+#include <catch2/catch_get_random_seed.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+#include <catch2/matchers/catch_matchers_floating_point.hpp>
+#include <filesystem>
+#include <fstream>
+
+namespace {
+void check_replicate(const bigrig::tree_t             &tree,
+                     const bigrig::sim_result_t       &result,
+                     const bigrig::binary_header_t    &header,
+                     const bigrig::binary_replicate_t &rep) {
+  CHECK(rep.root_range == result.root_range());
+  for (size_t index = 0; index < tree.node_count(); ++index) {
+    CHECK(rep.final_states[index] == result.final_state(index));
+    if (tree.is_leaf(index)) { continue; }
+
+    const auto &split = result.node_split(index);
+    CHECK(rep.splits[index].left == split.left);
+    CHECK(rep.splits[index].right == split.right);
+    CHECK(rep.splits[index].type == split.type);
+    CHECK(rep.splits[index].period_index == split.period_index);
+  }
+
+  for (size_t index = 0; index < tree.node_count(); ++index) {
+    auto expected = result.transitions(index);
+    auto found    = rep.transitions(header, index);
+    REQUIRE(found.size() == expected.size());
+    for (size_t i = 0; i < found.size(); ++i) {
+      CHECK(found[i].initial_state == expected[i].initial_state);
+      CHECK(found[i].final_state == expected[i].final_state);
+      CHECK(found[i].period_index == expected[i].period_index);
+      CHECK_THAT(found[i].waiting_time,
+                 Catch::Matchers::WithinAbs(expected[i].waiting_time, 1e-9));
+    }
+  }
+}
+} // namespace
+
+TEST_CASE("binary round trip", "[binary]") {
+  auto           periods = make_periods();
+  bigrig::tree_t tree(tree_str);
+  tree.set_periods(periods);
+  REQUIRE(tree.is_ready());
+
+  bigrig::dist_t init_dist = {0b0101, 4};
+  pcg64_fast     gen(Catch::getSeed());
+
+  auto filename = temp_filename("bigrig_test_round_trip.bgr");
+
+  constexpr size_t                  replicates = 5;
+  std::vector<bigrig::sim_result_t> results(replicates);
+  {
+    bigrig::binary_writer_t writer;
+    REQUIRE(writer.open(filename, tree, periods, init_dist.regions()));
+    for (size_t i = 0; i < replicates; ++i) {
+      tree.simulate(init_dist, results[i], gen);
+      writer.write(tree, results[i], i, 2 * i);
+    }
+  }
+
+  bigrig::binary_reader_t reader(filename);
+  REQUIRE(reader.ok());
+  REQUIRE(reader.replicate_count() == replicates);
+
+  const auto &header = reader.header();
+  CHECK(header.version == bigrig::binary::VERSION);
+  CHECK(header.region_count == 4);
+  REQUIRE(header.nodes.size() == tree.node_count());
+  for (size_t index = 0; index < tree.node_count(); ++index) {
+    CHECK(header.nodes[index].parent == tree.parent(index));
+    CHECK(header.nodes[index].node_id == tree.node_id(index));
+    CHECK(header.nodes[index].label == tree.label(index));
+    CHECK(header.is_leaf(index) == tree.is_leaf(index));
+    CHECK_THAT(header.nodes[index].abs_time,
+               Catch::Matchers::WithinAbs(tree.abs_time(index), 1e-12));
+  }
+  REQUIRE(header.periods.size() == periods.size());
+  CHECK(header.periods[1].rates.dis == 2.0);
+  CHECK(header.periods[1].clado.sympatry == 2.0);
+
+  /* read the replicates backwards, to make sure they are independent */
+  for (size_t i = replicates; i-- > 0;) {
+    auto rep = reader.replicate(i);
+    CHECK(rep.replicate == i);
+    CHECK(rep.point == 2 * i);
+    check_replicate(tree, results[i], header, rep);
+  }
+
+  std::filesystem::remove(filename);
+}
+
+TEST_CASE("binary append", "[binary]") {
+  auto           periods = make_periods();
+  bigrig::tree_t tree(tree_str);
+  tree.set_periods(periods);
+
+  bigrig::dist_t init_dist = {0b0011, 4};
+  pcg64_fast     gen(Catch::getSeed());
+
+  auto filename = temp_filename("bigrig_test_append.bgr");
+
+  bigrig::sim_result_t first;
+  bigrig::sim_result_t second;
+  tree.simulate(init_dist, first, gen);
+  tree.simulate(init_dist, second, gen);
+
+  {
+    bigrig::binary_writer_t writer;
+    REQUIRE(writer.open(filename, tree, periods, init_dist.regions()));
+    writer.write(tree, first, 0);
+  }
+  {
+    bigrig::binary_writer_t writer;
+    REQUIRE(writer.open_append(filename, tree, periods, init_dist.regions()));
+    writer.write(tree, second, 1);
+  }
+
+  /* the header has to match to append */
+  {
+    const std::string       other_tree_str = "((a:1.0,b:1.0):1.0,c:1.0);";
+    bigrig::tree_t          other_tree(other_tree_str);
+    bigrig::binary_writer_t writer;
+    CHECK_FALSE(
+        writer.open_append(filename, other_tree, periods, init_dist.regions()));
+  }
+
+  bigrig::binary_reader_t reader(filename);
+  REQUIRE(reader.ok());
+  REQUIRE(reader.replicate_count() == 2);
+  check_replicate(tree, first, reader.header(), reader.replicate(0));
+  check_replicate(tree, second, reader.header(), reader.replicate(1));
+
+  std::filesystem::remove(filename);
+}
+
+TEST_CASE("binary truncated", "[binary]") {
+  auto           periods = make_periods();
+  bigrig::tree_t tree(tree_str);
+  tree.set_periods(periods);
+
+  bigrig::dist_t init_dist = {0b0011, 4};
+  pcg64_fast     gen(Catch::getSeed());
+
+  auto filename = temp_filename("bigrig_test_truncated.bgr");
+
+  bigrig::sim_result_t stats;
+  stats.set_stats_only(true);
+  {
+    bigrig::binary_writer_t writer;
+    REQUIRE(writer.open(filename, tree, periods, init_dist.regions()));
+    for (size_t i = 0; i < 3; ++i) {
+      tree.simulate(init_dist, stats, gen);
+      writer.write(tree, stats, i);
+    }
+  }
+
+  /* chop a few bytes off the last record, like a run that was killed */
+  std::filesystem::resize_file(filename,
+                               std::filesystem::file_size(filename) - 3);
+
+  bigrig::binary_reader_t reader(filename);
+  REQUIRE(reader.ok());
+  CHECK(reader.replicate_count() == 2);
+
+  auto rep = reader.replicate(1);
+  CHECK(rep.events.empty());
+  CHECK(rep.period_stats.size() == stats.period_stats().size());
+
+  std::filesystem::remove(filename);
+}
+
+TEST_CASE("binary region count", "[binary]") {
+  auto           periods = make_periods();
+  bigrig::tree_t tree(tree_str);
+  tree.set_periods(periods);
+
+  auto filename = temp_filename("bigrig_test_regions.bgr");
+  {
+    bigrig::binary_writer_t writer;
+    REQUIRE(writer.open(filename, tree, periods, 4));
+    CHECK_FALSE(writer.open_records(
+        temp_filename("bigrig_test_regions_records.bgr"),
+        bigrig::dist_t::MAX_REGIONS));
+  }
+
+  /* The region count comes after the magic and the version */
+  uint32_t region_count
+      = GENERATE(0u,
+                 static_cast<uint32_t>(bigrig::dist_t::MAX_REGIONS),
+                 static_cast<uint32_t>(bigrig::dist_t::MAX_REGIONS + 4),
+                 70'000u);
+  INFO("region count: " << region_count);
+  {
+    std::fstream file(filename,
+                      std::ios::binary | std::ios::in | std::ios::out);
+    file.seekp(8);
+    file.write(reinterpret_cast<const char *>(&region_count),
+               sizeof(region_count));
+  }
+
+  bigrig::binary_reader_t reader(filename);
+  CHECK_FALSE(reader.ok());
+
+  std::filesystem::remove(filename);
+}
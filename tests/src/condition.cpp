@@ -0,0 +1,319 @@
+#include "condition.hpp"
+#include "test_fixtures.hpp"
+#include "tree.hpp"
+
+#include "pcg_random.hpp"
+
+#include <catch2/catch_get_random_seed.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+#include <catch2/matchers/catch_matchers_floating_point.hpp>
+#include <limits>
+#include <map>
+
+namespace {
+bigrig::period_t make_period(double dis, double jump) {
+  bigrig::period_t period{0.0,
+                          std::numeric_limits<double>::infinity(),
+                          {.dis = dis, .ext = 1.0},
+                          {.allopatry = 1.0,
+                           .sympatry  = 1.0,
+                           .copy      = 1.0,
+                           .jump      = jump},
+                          true,
+                          0};
+  period.model_ptr()->set_region_count(4);
+  return period;
+}
+
+bigrig::condition_t make_condition(std::vector<std::string> labels,
+                                   const std::string       &pattern) {
+  return {std::move(labels), bigrig::parse_range_pattern(pattern).value()};
+}
+
+size_t find_label(const bigrig::tree_t &tree, const std::string &label) {
+  for (size_t index = 0; index < tree.node_count(); ++index) {
+    if (tree.label(index) == label) { return index; }
+  }
+  return tree.node_count();
+}
+} // namespace
+
+TEST_CASE("range patterns", "[condition]") {
+  auto pattern = bigrig::parse_range_pattern("1?0?");
+  REQUIRE(pattern.has_value());
+  CHECK(pattern->to_str() == "1?0?");
+  CHECK(pattern->matches(bigrig::dist_t{0b1000, 4}));
+  CHECK(pattern->matches(bigrig::dist_t{0b1101, 4}));
+  CHECK(!pattern->matches(bigrig::dist_t{0b1010, 4}));
+  CHECK(!pattern->matches(bigrig::dist_t{0b0001, 4}));
+
+  CHECK(!bigrig::parse_range_pattern(""));
+  CHECK(!bigrig::parse_range_pattern("1x0?"));
+}
+
+TEST_CASE("condition table", "[condition]") {
+  SECTION("good table") {
+    auto filename   = write_temp_file("bigrig_conditions_good.csv",
+                                "# labels, pattern\n"
+                                "a, 1???\n"
+                                "\n"
+                                "c  e b, ??0?\n");
+    auto conditions = bigrig::read_conditions(filename);
+    REQUIRE(conditions.has_value());
+    REQUIRE(conditions->size() == 2);
+    CHECK((*conditions)[0].labels == std::vector<std::string>{"a"});
+    CHECK((*conditions)[1].labels == std::vector<std::string>{"c", "e", "b"});
+    CHECK((*conditions)[1].pattern.to_str() == "??0?");
+  }
+
+  SECTION("bad tables") {
+    auto contents = GENERATE(as<std::string>{},
+                             "",
+                             "a\n",
+                             "a, 1???, 0\n",
+                             " , 1???\n",
+                             "a, 12??\n");
+    auto filename = write_temp_file("bigrig_conditions_bad.csv", contents);
+    CHECK(!bigrig::read_conditions(filename).has_value());
+  }
+
+  CHECK(!bigrig::read_conditions("/nonexistent/bigrig_conditions.csv"));
+}
+
+TEST_CASE("conditions on a tree", "[condition]") {
+  bigrig::tree_t tree(tree_str);
+  using bigrig::restart_mode_e;
+
+  SECTION("clades and restart roots") {
+    auto conditions = bigrig::make_conditions(
+        tree,
+        {make_condition({"c", "b"}, "1???"), make_condition({"e"}, "???1")},
+        4,
+        restart_mode_e::SUBTREE);
+    REQUIRE(conditions.has_value());
+    CHECK(conditions->conditioned_tip_count() == 3);
+
+    auto e = find_label(tree, "e");
+    auto b = find_label(tree, "b");
+
+    /* The clade of c and b has e in it, so it is the only restart root */
+    size_t clade = tree.parent(b);
+    CHECK(conditions->is_restart_root(clade));
+    CHECK(!conditions->is_restart_root(e));
+    CHECK(!conditions->is_restart_root(0));
+
+    CHECK(conditions->accepts(e, bigrig::dist_t{0b1001, 4}));
+    CHECK(!conditions->accepts(e, bigrig::dist_t{0b1000, 4}));
+    CHECK(!conditions->accepts(e, bigrig::dist_t{0b0001, 4}));
+    CHECK(conditions->accepts(find_label(tree, "a"), bigrig::dist_t{1, 4}));
+
+    auto whole = bigrig::make_conditions(
+        tree, {make_condition({"e"}, "???1")}, 4, restart_mode_e::TREE);
+    REQUIRE(whole.has_value());
+    CHECK(whole->is_restart_root(0));
+    CHECK(!whole->is_restart_root(e));
+  }
+
+  SECTION("bad conditions") {
+    auto conditions = GENERATE(
+        std::vector<bigrig::condition_t>{make_condition({"z"}, "1???")},
+        std::vector<bigrig::condition_t>{make_condition({"a"}, "1??")},
+        std::vector<bigrig::condition_t>{make_condition({"a"}, "1???"),
+                                         make_condition({"a", "j"}, "0???")},
+        std::vector<bigrig::condition_t>{make_condition({"a"}, "0000")});
+    CHECK(!bigrig::make_conditions(tree, conditions, 4, restart_mode_e::TREE));
+  }
+}
+
+TEST_CASE("conditioned simulation", "[condition]") {
+  bigrig::tree_t tree(tree_str);
+  tree.set_periods(make_period(1.0, 0.5));
+  REQUIRE(tree.is_ready());
+
+  auto mode    = GENERATE(bigrig::restart_mode_e::TREE,
+                       bigrig::restart_mode_e::SUBTREE);
+  auto op_mode = GENERATE(bigrig::operation_mode_e::FAST,
+                          bigrig::operation_mode_e::SIM,
+                          bigrig::operation_mode_e::ENDPOINT);
+  tree.set_mode(op_mode);
+
+  auto conditions = bigrig::make_conditions(
+      tree,
+      {make_condition({"c", "b"}, "1???"), make_condition({"a"}, "???1")},
+      4,
+      mode);
+  REQUIRE(conditions.has_value());
+
+  pcg64_fast           gen{Catch::getSeed()};
+  bigrig::sim_result_t result;
+  size_t               restarts = 0;
+  for (size_t i = 0; i < 100; ++i) {
+    auto attempts = tree.simulate_conditioned(bigrig::dist_t{0b0011, 4},
+                                              result,
+                                              gen,
+                                              tree.period_table(),
+                                              *conditions,
+                                              bigrig::DEFAULT_MAX_RESTARTS);
+    REQUIRE(attempts.has_value());
+    restarts += attempts.value();
+
+    for (const auto &label : {"c", "e", "b"}) {
+      auto range = result.final_state(find_label(tree, label));
+      CHECK(range[3]);
+    }
+    CHECK(result.final_state(find_label(tree, "a"))[0]);
+
+    /* The transitions of failed attempts are dropped */
+    if (op_mode == bigrig::operation_mode_e::ENDPOINT) { continue; }
+    for (size_t index = 1; index < tree.node_count(); ++index) {
+      auto transitions = result.transitions(index);
+      auto start       = result.node_split(tree.parent(index));
+      if (!transitions.empty()) {
+        auto initial = transitions.front().initial_state;
+        CHECK((initial == start.left || initial == start.right));
+        CHECK(transitions.back().final_state == result.final_state(index));
+      }
+    }
+  }
+  CHECK(restarts > 0);
+}
+
+TEST_CASE("conditioned simulation gives up", "[condition]") {
+  bigrig::tree_t tree(tree_str);
+  tree.set_periods(make_period(0.0, 0.0));
+  REQUIRE(tree.is_ready());
+
+  /* Without dispersion or jumps, the tips can't reach the highest region */
+  auto conditions = bigrig::make_conditions(
+      tree, {make_condition({"a"}, "1???")}, 4, bigrig::restart_mode_e::TREE);
+  REQUIRE(conditions.has_value());
+
+  pcg64_fast           gen{Catch::getSeed()};
+  bigrig::sim_result_t result;
+  CHECK(!tree.simulate_conditioned(bigrig::dist_t{0b0011, 4},
+                                   result,
+                                   gen,
+                                   tree.period_table(),
+                                   *conditions,
+                                   10));
+}
+
+TEST_CASE("conditioned subtrees use their own streams", "[condition]") {
+  bigrig::tree_t tree(tree_str);
+  tree.set_periods(make_period(1.0, 0.5));
+  REQUIRE(tree.is_ready());
+
+  /* A pattern which always matches still makes the clade a restart root */
+  auto loose  = bigrig::make_conditions(tree,
+                                       {make_condition({"c", "b"}, "????")},
+                                       4,
+                                       bigrig::restart_mode_e::SUBTREE);
+  auto strict = bigrig::make_conditions(tree,
+                                        {make_condition({"c", "b"}, "11??")},
+                                        4,
+                                        bigrig::restart_mode_e::SUBTREE);
+  REQUIRE(loose.has_value());
+  REQUIRE(strict.has_value());
+
+  auto seed = Catch::getSeed();
+  for (size_t i = 0; i < 20; ++i) {
+    pcg64_fast           loose_gen{seed + i}, strict_gen{seed + i};
+    bigrig::sim_result_t loose_result, strict_result;
+    tree.simulate_conditioned(bigrig::dist_t{0b0011, 4},
+                              loose_result,
+                              loose_gen,
+                              tree.period_table(),
+                              *loose,
+                              bigrig::DEFAULT_MAX_RESTARTS);
+    tree.simulate_conditioned(bigrig::dist_t{0b0011, 4},
+                              strict_result,
+                              strict_gen,
+                              tree.period_table(),
+                              *strict,
+                              bigrig::DEFAULT_MAX_RESTARTS);
+
+    /* Only the clade is different */
+    size_t clade = tree.parent(find_label(tree, "b"));
+    for (size_t index = 0; index < tree.node_count(); ++index) {
+      if (clade <= index && index < clade + tree.subtree_size(clade)) {
+        continue;
+      }
+      CHECK(loose_result.final_state(index)
+            == strict_result.final_state(index));
+    }
+  }
+}
+
+TEST_CASE("conditioned stats only", "[condition]") {
+  bigrig::tree_t tree(tree_str);
+  tree.set_periods(make_period(1.0, 0.5));
+  REQUIRE(tree.is_ready());
+
+  auto conditions = bigrig::make_conditions(tree,
+                                            {make_condition({"i"}, "11??"),
+                                             make_condition({"h"}, "??11")},
+                                            4,
+                                            bigrig::restart_mode_e::SUBTREE);
+  REQUIRE(conditions.has_value());
+
+  pcg64_fast           gen{Catch::getSeed()};
+  bigrig::sim_result_t result;
+  result.set_stats_only(true);
+  for (size_t i = 0; i < 20; ++i) {
+    REQUIRE(tree.simulate_conditioned(bigrig::dist_t{0b0011, 4},
+                                      result,
+                                      gen,
+                                      tree.period_table(),
+                                      *conditions,
+                                      bigrig::DEFAULT_MAX_RESTARTS));
+
+    /* The splits of failed attempts are not counted */
+    size_t splits = 0;
+    for (const auto &s : result.period_stats()) {
+      splits += s.singleton_splits + s.allopatric_splits + s.sympatric_splits
+              + s.jump_splits;
+    }
+    CHECK(splits == tree.node_count() - tree.leaf_count());
+  }
+}
+
+TEST_CASE("conditioned tree restarts are exact", "[condition]") {
+  bigrig::tree_t tree(std::string{"((a:0.4,c:0.3):0.2,b:0.5);"});
+  tree.set_periods(make_period(1.0, 0.5));
+  REQUIRE(tree.is_ready());
+
+  auto conditions = bigrig::make_conditions(
+      tree, {make_condition({"a"}, "1???")}, 4, bigrig::restart_mode_e::TREE);
+  REQUIRE(conditions.has_value());
+
+  constexpr size_t     samples = 20000;
+  bigrig::dist_t       root{0b0001, 4};
+  pcg64_fast           gen{Catch::getSeed()};
+  bigrig::sim_result_t result;
+  auto                 a = find_label(tree, "a");
+  auto                 b = find_label(tree, "b");
+
+  /* The ranges of b, when the whole tree is thrown away if a fails */
+  std::map<std::string, double> rejected, conditioned;
+  for (size_t accepted = 0; accepted < samples;) {
+    tree.simulate(root, result, gen);
+    if (!result.final_state(a)[3]) { continue; }
+    rejected[result.final_state(b).to_str()] += 1.0 / samples;
+    ++accepted;
+  }
+
+  for (size_t i = 0; i < samples; ++i) {
+    REQUIRE(tree.simulate_conditioned(root,
+                                      result,
+                                      gen,
+                                      tree.period_table(),
+                                      *conditions,
+                                      bigrig::DEFAULT_MAX_RESTARTS));
+    conditioned[result.final_state(b).to_str()] += 1.0 / samples;
+  }
+
+  for (const auto &[range, freq] : rejected) {
+    CHECK_THAT(conditioned[range], Catch::Matchers::WithinAbs(freq, 0.02));
+  }
+}
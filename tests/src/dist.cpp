@@ -50,8 +50,9 @@ TEST_CASE("dist operations", "[dist]") {
   }
 
   SECTION("addition") {
-    auto f = d + 1;
-    CHECK(f == bigrig::dist_t{0b1010, d.regions()});
+    bigrig::basic_dist_t<1> narrow{0b1001, regions};
+    auto                    f = narrow + 1;
+    CHECK(f == bigrig::basic_dist_t<1>{0b1010, regions});
   }
 
   SECTION("negate bit") {
@@ -88,6 +89,81 @@ TEST_CASE("dist operations", "[dist]") {
   }
 }
 
+TEST_CASE("wide dist", "[dist]") {
+  using wide_dist_t        = bigrig::basic_dist_t<4>;
+  constexpr size_t regions = 200;
+
+  pcg64_fast gen(Catch::getSeed());
+
+  std::string str(regions, '0');
+  for (size_t i = 0; i < regions; i += 3) { str[i] = '1'; }
+  wide_dist_t d{str};
+
+  CHECK(d.regions() == regions);
+  CHECK(d.to_str() == str);
+  CHECK(d.full_region_count() == (regions + 2) / 3);
+  CHECK(d.empty_region_count() == regions - d.full_region_count());
+  CHECK(d.valid_dist());
+  CHECK(d.last_full_region() == regions);
+
+  SECTION("regions across words") {
+    for (size_t i = 0; i < regions; ++i) {
+      CHECK(d[i] == (str[regions - i - 1] == '1'));
+      auto flipped = d.flip_region(i);
+      CHECK((flipped ^ d).full_region_count() == 1);
+      CHECK((flipped ^ d).first_full_region() == i);
+    }
+  }
+
+  SECTION("set and unset index") {
+    size_t full = 0, empty = 0;
+    for (size_t i = 0; i < regions; ++i) {
+      if (d[i]) {
+        CHECK(d.set_index(full++) == i);
+      } else {
+        CHECK(d.unset_index(empty++) == i);
+      }
+    }
+  }
+
+  SECTION("full and random") {
+    auto full = bigrig::make_full_dist<4>(regions);
+    CHECK(full.full());
+    CHECK(full.valid_dist());
+    CHECK((full & d) == d);
+    CHECK((~d & full).full_region_count() == d.empty_region_count());
+
+    for (size_t i = 0; i < 100; ++i) {
+      auto r = bigrig::make_random_dist<4>(regions, gen);
+      CHECK(r.valid_dist(regions));
+      CHECK((bool)r);
+    }
+  }
+}
+
+TEST_CASE("dist select", "[dist]") {
+  static_assert(bigrig::bits::select(0b1011'0000, 2) == 7);
+
+  pcg64_fast gen(Catch::getSeed());
+  for (size_t i = 0; i < 1000; ++i) {
+    uint64_t x = gen();
+
+    size_t k = 0;
+    for (size_t bit = 0; bit < 64; ++bit) {
+      if (!((x >> bit) & 1)) { continue; }
+      CHECK(bigrig::bits::select_broadword(x, k) == bit);
+      CHECK(bigrig::bits::select(x, k) == bit);
+      k++;
+    }
+  }
+
+  bigrig::dist_t d = {0b1001'0110, 8};
+  CHECK(d.set_index(0) == 1);
+  CHECK(d.set_index(3) == 7);
+  CHECK(d.unset_index(0) == 0);
+  CHECK(d.unset_index(3) == 6);
+}
+
 TEST_CASE("spread", "[spread]") {
   constexpr double dis = 1.0;
   constexpr double ext = 1.0;
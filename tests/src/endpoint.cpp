@@ -0,0 +1,119 @@
+#include "endpoint.hpp"
+#include "tree.hpp"
+
+#include "pcg_random.hpp"
+
+#include <catch2/catch_get_random_seed.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+#include <catch2/matchers/catch_matchers_floating_point.hpp>
+#include <limits>
+#include <vector>
+
+namespace {
+bigrig::period_t make_period(double dis, double ext, double length) {
+  return {0.0,
+          length,
+          {.dis = dis, .ext = ext},
+          {.allopatry = 1.0, .sympatry = 1.0, .copy = 1.0, .jump = 1.0},
+          true,
+          0};
+}
+} // namespace
+
+TEST_CASE("endpoint probabilities", "[endpoint]") {
+  size_t regions  = GENERATE(as<size_t>{}, 1, 2, 5, 16);
+  size_t occupied = GENERATE(as<size_t>{}, 1, 2);
+  double length   = GENERATE(0.0, 0.1, 1.0, 100.0);
+  if (occupied > regions) { return; }
+
+  auto period = make_period(1.0, 1.0, length);
+  bigrig::endpoint_distribution_t dist{
+      period.model(), period.length(), occupied, regions};
+
+  double total = 0.0;
+  for (size_t a = 0; a <= occupied; ++a) {
+    for (size_t b = 0; b <= regions - occupied; ++b) {
+      auto p  = dist.probability(a, b);
+      total  += p;
+      CHECK(p >= 0.0);
+      if (a + b == 0) { CHECK(p == 0.0); }
+    }
+  }
+  CHECK_THAT(total, Catch::Matchers::WithinAbs(1.0, 1e-9));
+
+  if (length == 0.0) { CHECK(dist.probability(occupied, 0) == 1.0); }
+}
+
+TEST_CASE("endpoint matches simulation", "[endpoint]") {
+  constexpr size_t regions = 4;
+  constexpr size_t iters   = 20000;
+
+  auto rates  = GENERATE(0.25, 1.0, 3.0);
+  auto period = make_period(rates, rates / 2.0, 1.0);
+
+  bigrig::dist_t init_dist{0b0011, regions};
+  size_t         occupied = init_dist.full_region_count();
+
+  bigrig::endpoint_distribution_t dist{
+      period.model(), period.length(), occupied, regions};
+
+  pcg64_fast gen(Catch::getSeed());
+
+  std::vector<size_t> sim_counts((occupied + 1) * (regions - occupied + 1));
+  std::vector<size_t> endpoint_counts(sim_counts.size());
+
+  auto state = [&](bigrig::dist_t d) {
+    size_t a = (d & init_dist).full_region_count();
+    size_t b = d.full_region_count() - a;
+    return a * (regions - occupied + 1) + b;
+  };
+
+  bigrig::branch_periods_t periods{{&period, 1}, 0.0, period.length()};
+  for (size_t i = 0; i < iters; ++i) {
+    auto sim_dist = bigrig::simulate_transitions(
+        init_dist,
+        periods,
+        gen,
+        bigrig::operation_mode_e::FAST,
+        [](const bigrig::transition_t &) {});
+    sim_counts[state(sim_dist)] += 1;
+
+    auto endpoint_dist = dist.sample(init_dist, gen);
+    CHECK(endpoint_dist.regions() == regions);
+    endpoint_counts[state(endpoint_dist)] += 1;
+  }
+
+  for (size_t a = 0; a <= occupied; ++a) {
+    for (size_t b = 0; b <= regions - occupied; ++b) {
+      auto s   = a * (regions - occupied + 1) + b;
+      auto sim = static_cast<double>(sim_counts[s]) / iters;
+      auto end = static_cast<double>(endpoint_counts[s]) / iters;
+      auto p   = dist.probability(a, b);
+      CHECK_THAT(sim, Catch::Matchers::WithinAbs(p, 0.02));
+      CHECK_THAT(end, Catch::Matchers::WithinAbs(p, 0.02));
+    }
+  }
+}
+
+TEST_CASE("endpoint tree", "[endpoint]") {
+  const std::string tree_str
+      = "((a:0.5,b:0.3):0.4,(c:0.8,(d:0.1,e:0.2):0.6):0.2);";
+
+  bigrig::tree_t tree(tree_str);
+  tree.set_mode(bigrig::operation_mode_e::ENDPOINT);
+  tree.set_periods(
+      make_period(5.0, 5.0, std::numeric_limits<double>::infinity()));
+  REQUIRE(tree.is_ready());
+
+  pcg64_fast           gen(Catch::getSeed());
+  bigrig::sim_result_t result;
+  for (size_t i = 0; i < 10; ++i) {
+    tree.simulate({0b010101, 6}, result, gen);
+    for (const auto &n : tree) {
+      CHECK((bool)result.final_state(n.index()));
+      CHECK(result.final_state(n.index()).regions() == 6);
+      CHECK(result.transitions(n.index()).empty());
+    }
+  }
+}
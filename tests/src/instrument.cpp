@@ -0,0 +1,97 @@
+#include "instrument.hpp"
+#include "test_fixtures.hpp"
+#include "tree.hpp"
+
+#include "pcg_random.hpp"
+
+#include <catch2/catch_get_random_seed.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <limits>
+#include <thread>
+
+namespace {
+bigrig::period_t make_period() {
+  bigrig::period_t period{0.0,
+                          std::numeric_limits<double>::infinity(),
+                          {.dis = 1.0, .ext = 1.0},
+                          {.allopatry = 1.0,
+                           .sympatry  = 1.0,
+                           .copy      = 1.0,
+                           .jump      = 0.0},
+                          true,
+                          0};
+  period.model_ptr()->set_region_count(4);
+  return period;
+}
+} // namespace
+
+TEST_CASE("instrument counters", "[instrument]") {
+  auto before = bigrig::instrument_totals();
+
+  bigrig::count_event(bigrig::counter_e::SPLITS, 3);
+  std::thread other{[] {
+    bigrig::count_event(bigrig::counter_e::SPLITS, 5);
+    bigrig::scoped_phase_t timer{bigrig::phase_e::WRITE_CSV};
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }};
+  other.join();
+
+  auto diff = bigrig::instrument_totals() - before;
+  if constexpr (!bigrig::INSTRUMENT_ENABLED) {
+    CHECK(diff.count(bigrig::counter_e::SPLITS) == 0);
+    CHECK(diff.seconds(bigrig::phase_e::WRITE_CSV) == 0.0);
+    return;
+  }
+
+  /* The counts of a thread are kept after it exits */
+  CHECK(diff.count(bigrig::counter_e::SPLITS) == 8);
+  CHECK(diff.count(bigrig::counter_e::TRANSITIONS) == 0);
+  CHECK(diff.seconds(bigrig::phase_e::WRITE_CSV) >= 1e-3);
+
+  /* The counts of the calling thread don't include the other thread */
+  auto mine = bigrig::thread_instrument_counts();
+  bigrig::count_event(bigrig::counter_e::SPLITS);
+  CHECK((bigrig::thread_instrument_counts() - mine)
+            .count(bigrig::counter_e::SPLITS)
+        == 1);
+}
+
+TEST_CASE("instrument simulation counts", "[instrument]") {
+  bigrig::tree_t tree(tree_str);
+  tree.set_periods(make_period());
+  REQUIRE(tree.is_ready());
+
+  pcg64_fast           gen{Catch::getSeed()};
+  bigrig::sim_result_t result;
+  bigrig::dist_t       root{0b0011, 4};
+
+  for (auto mode :
+       {bigrig::operation_mode_e::FAST, bigrig::operation_mode_e::SIM}) {
+    tree.set_mode(mode);
+    auto before = bigrig::thread_instrument_counts();
+    tree.simulate(root, result, gen);
+    auto diff = bigrig::thread_instrument_counts() - before;
+
+    if constexpr (!bigrig::INSTRUMENT_ENABLED) {
+      CHECK(diff.count(bigrig::counter_e::TRANSITIONS) == 0);
+      continue;
+    }
+
+    size_t transitions = 0;
+    for (size_t index = 0; index < tree.node_count(); ++index) {
+      transitions += result.transition_count(index);
+    }
+    CHECK(diff.count(bigrig::counter_e::TRANSITIONS) == transitions);
+    CHECK(diff.count(bigrig::counter_e::SPLITS) == tree.node_count());
+    CHECK(diff.count(bigrig::counter_e::REJECTION_SAMPLES) == 0);
+  }
+
+  /* Only the reference splitter takes rejection samples */
+  auto before = bigrig::thread_instrument_counts();
+  bigrig::split_dist_rejection_method(root, tree.periods()[0].model(), gen);
+  auto diff = bigrig::thread_instrument_counts() - before;
+  if constexpr (bigrig::INSTRUMENT_ENABLED) {
+    CHECK(diff.count(bigrig::counter_e::REJECTION_SAMPLES) >= 1);
+  }
+}
@@ -0,0 +1,46 @@
+#include "jobs.hpp"
+#include "test_fixtures.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+#include <string>
+
+TEST_CASE("jobs file", "[jobs]") {
+  SECTION("good jobs") {
+    auto filename = write_temp_file(
+        "bigrig_jobs_good.jsonl",
+        "{\"prefix\": \"out/a\"}\n"
+        "\n"
+        "{\"prefix\": \"out/b\", \"seed\": 7, \"replicates\": 3, "
+        "\"root-range\": \"0110\"}\n");
+    auto specs = read_job_specs(filename);
+    REQUIRE(specs.has_value());
+    REQUIRE(specs->size() == 2);
+    CHECK((*specs)[0].prefix == "out/a");
+    CHECK(!(*specs)[0].seed.has_value());
+    CHECK(!(*specs)[0].root_range.has_value());
+    CHECK((*specs)[1].seed == 7);
+    CHECK((*specs)[1].replicates == 3);
+    CHECK((*specs)[1].root_range == bigrig::dist_t{0b0110, 4});
+  }
+
+  SECTION("bad jobs") {
+    auto range = std::string(bigrig::dist_t::MAX_REGIONS, '1');
+    auto contents
+        = GENERATE_COPY(as<std::string>{},
+                        "",
+                        "[\"out/a\"]\n",
+                        "{\"seed\": 7}\n",
+                        "{\"prefix\": \"out/a\", \"sede\": 7}\n",
+                        "{\"prefix\": \"out/a\", \"root-range\": \"01a0\"}\n",
+                        "{\"prefix\": \"out/a\", \"root-range\": \"\"}\n",
+                        "{\"prefix\": \"out/a\", \"root-range\": \"" + range
+                            + "\"}\n",
+                        "{\"prefix\": \"out/a\", \"root-range\": \"" + range
+                            + range + "\"}\n");
+    auto filename = write_temp_file("bigrig_jobs_bad.jsonl", contents);
+    CHECK(!read_job_specs(filename).has_value());
+  }
+
+  CHECK(!read_job_specs("/nonexistent/bigrig_jobs.jsonl"));
+}
@@ -68,3 +68,43 @@ TEST_CASE("model init") {
     CHECK(!model.check_ok(REGIONS));
   }
 }
+
+TEST_CASE("model weight tables") {
+  constexpr size_t REGIONS = 6;
+
+  bigrig::biogeo_model_t model;
+  model.set_params(1.5, 0.5).set_cladogenesis_params(1.0, 2.0, 0.5, 0.25);
+
+  auto check_tables = [&](size_t regions) {
+    for (size_t full = 1; full <= regions; ++full) {
+      bigrig::dist_t dist{(1ul << full) - 1, static_cast<uint16_t>(regions)};
+      CHECK(model.lookup_rate_weight(regions, full)
+            == model.total_rate_weight(dist));
+      if (full == 1) { continue; }
+
+      auto thresholds = model.lookup_split_thresholds(regions, full);
+      CHECK(thresholds.allopatry == model.allopatry_weight(dist));
+      CHECK(thresholds.sympatry
+            == model.allopatry_weight(dist) + model.sympatry_weight(dist));
+      CHECK(thresholds.total == model.total_nonsingleton_weight(dist));
+    }
+    auto singleton = bigrig::make_singleton_dist(regions);
+    CHECK(model.lookup_singleton_jump_probability(regions)
+          == model.jump_weight(singleton)
+                 / model.total_singleton_weight(singleton));
+  };
+
+  SECTION("without a table") { check_tables(REGIONS); }
+
+  SECTION("with a table") {
+    model.set_region_count(REGIONS);
+    check_tables(REGIONS);
+
+    /* tables follow the parameters */
+    model.set_params(3.0, 2.0).set_two_region_duplicity(true);
+    check_tables(REGIONS);
+
+    /* other region counts still work */
+    check_tables(REGIONS - 2);
+  }
+}
@@ -0,0 +1,84 @@
+#include "prepared.hpp"
+#include "test_fixtures.hpp"
+#include "tree.hpp"
+
+#include "pcg_random.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <filesystem>
+
+TEST_CASE("prepared key", "[prepared]") {
+  auto tree_file  = write_temp_file("bigrig_prepared_a.nwk", tree_str);
+  auto other_file = write_temp_file("bigrig_prepared_b.nwk", "((a,b),c);");
+
+  auto key = bigrig::make_prepared_key(tree_file, make_periods(0.5, 1.0));
+  REQUIRE(key.has_value());
+
+  /* only the boundaries matter, not the rates */
+  auto new_rates    = make_periods(0.5, 3.0);
+  auto new_boundary = make_periods(0.6, 1.0);
+  CHECK(key == bigrig::make_prepared_key(tree_file, new_rates));
+  CHECK(key != bigrig::make_prepared_key(tree_file, new_boundary));
+
+  auto other_key = bigrig::make_prepared_key(other_file, new_rates);
+  REQUIRE(other_key.has_value());
+  CHECK(key != other_key);
+  CHECK(key->filename() != other_key->filename());
+}
+
+TEST_CASE("prepared round trip", "[prepared]") {
+  auto periods = make_periods(0.5, 1.0);
+
+  bigrig::tree_t tree(tree_str);
+  tree.set_periods(periods);
+  REQUIRE(tree.is_ready());
+
+  auto filename = temp_filename("bigrig_prepared.bgpt");
+  auto key      = bigrig::prepared_key_t{.tree_hash = 1, .period_hash = 2};
+  REQUIRE(bigrig::write_prepared_tree(filename, tree, key));
+
+  /* a run with different rates, but the same boundaries */
+  auto new_periods = make_periods(0.5, 3.0);
+  auto loaded = bigrig::read_prepared_tree(filename, key, new_periods);
+  REQUIRE(loaded.has_value());
+  REQUIRE(loaded->is_ready());
+
+  CHECK(loaded->to_newick() == tree.to_newick());
+  REQUIRE(loaded->node_count() == tree.node_count());
+  for (size_t index = 0; index < tree.node_count(); ++index) {
+    CHECK(loaded->parent(index) == tree.parent(index));
+    CHECK(loaded->node_id(index) == tree.node_id(index));
+    CHECK(loaded->abs_time(index) == tree.abs_time(index));
+
+    auto expected = tree.node_periods(index);
+    auto found    = loaded->node_periods(index);
+    REQUIRE(found.size() == expected.size());
+    for (size_t i = 0; i < found.size(); ++i) {
+      CHECK(found[i].index() == expected[i].index());
+      CHECK(found[i].start() == expected[i].start());
+      CHECK(found[i].length() == expected[i].length());
+      CHECK(found[i].model().rates().dis
+            == new_periods[found[i].index()].model().rates().dis);
+    }
+  }
+
+  /* simulating on the loaded tree gives the same results */
+  tree.set_periods(new_periods);
+  pcg64_fast           gen_a{42}, gen_b{42};
+  bigrig::sim_result_t result_a, result_b;
+  tree.simulate({0b0101, 4}, result_a, gen_a);
+  loaded->simulate({0b0101, 4}, result_b, gen_b);
+  CHECK(tree.to_phylip_body_extended(result_a)
+        == loaded->to_phylip_body_extended(result_b));
+
+  /* the wrong key, or a broken file, are ignored */
+  auto wrong_key = bigrig::prepared_key_t{.tree_hash = 1, .period_hash = 3};
+  CHECK(!bigrig::read_prepared_tree(filename, wrong_key, periods));
+
+  std::filesystem::resize_file(filename,
+                               std::filesystem::file_size(filename) / 2);
+  CHECK(!bigrig::read_prepared_tree(filename, key, periods));
+
+  CHECK(!bigrig::read_prepared_tree(
+      temp_filename("bigrig_missing.bgpt"), key, periods));
+}
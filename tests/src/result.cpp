@@ -0,0 +1,189 @@
+#include "result.hpp"
+#include "test_fixtures.hpp"
+#include "tree.hpp"
+
+#include "pcg_random.hpp"
+
+#include <catch2/catch_get_random_seed.hpp>
+#include <catch2/catch_test_macros.hpp>
+
+TEST_CASE("result transitions", "[result]") {
+  bigrig::sim_result_t result;
+  bigrig::dist_t       root_range{0b0101, 4};
+
+  result.reset(3, root_range);
+  CHECK(result.node_count() == 3);
+  CHECK(result.root_range() == root_range);
+  CHECK(result.region_count() == 4);
+
+  for (size_t node = 0; node < 3; ++node) {
+    result.start_transitions(node);
+    for (size_t i = 0; i < node; ++i) {
+      result.add_transition({static_cast<double>(i), root_range, root_range});
+    }
+    result.finish_transitions(node);
+  }
+
+  for (size_t node = 0; node < 3; ++node) {
+    auto transitions = result.transitions(node);
+    REQUIRE(transitions.size() == node);
+    for (size_t i = 0; i < node; ++i) {
+      CHECK(transitions[i].waiting_time == static_cast<double>(i));
+    }
+  }
+
+  result.reset(3, root_range);
+  result.start_transitions(0);
+  result.finish_transitions(0);
+  CHECK(result.transitions(0).empty());
+}
+
+TEST_CASE("result reuse", "[result]") {
+  auto period = make_single_period();
+  bigrig::dist_t init_dist = {0b0101, 4};
+
+  bigrig::tree_t tree(small_tree_str);
+  tree.set_periods(period);
+
+  pcg64_fast gen(Catch::getSeed());
+
+  /* simulate once to dirty the result, then check it gives the same answer */
+  bigrig::sim_result_t reused;
+  tree.simulate(init_dist, reused, gen);
+
+  auto                 saved_gen = gen;
+  bigrig::sim_result_t fresh;
+  tree.simulate(init_dist, fresh, gen);
+  tree.simulate(init_dist, reused, saved_gen);
+
+  CHECK(tree.to_phylip_body_extended(fresh)
+        == tree.to_phylip_body_extended(reused));
+  for (const auto &n : tree) {
+    auto lhs = fresh.transitions(n.index());
+    auto rhs = reused.transitions(n.index());
+    REQUIRE(lhs.size() == rhs.size());
+    for (size_t i = 0; i < lhs.size(); ++i) {
+      CHECK(lhs[i].final_state == rhs[i].final_state);
+    }
+    CHECK(fresh.start_range(n.index()) == reused.start_range(n.index()));
+  }
+}
+
+TEST_CASE("result stats only", "[result]") {
+  auto periods = make_periods();
+  bigrig::dist_t init_dist = {0b0101, 4};
+
+  bigrig::tree_t tree(tree_str);
+  tree.set_periods(periods);
+  REQUIRE(tree.is_ready());
+
+  pcg64_fast gen(Catch::getSeed());
+  auto       stats_gen = gen;
+
+  bigrig::sim_result_t full;
+  tree.simulate(init_dist, full, gen);
+
+  bigrig::sim_result_t stats;
+  stats.set_stats_only(true);
+  tree.simulate(init_dist, stats, stats_gen);
+
+  /* count the events from the full result, they should match the stats */
+  std::vector<bigrig::period_stats_t> expected(periods.size());
+  for (const auto &n : tree) {
+    CHECK(stats.transitions(n.index()).empty());
+    CHECK(stats.final_state(n.index()) == full.final_state(n.index()));
+
+    for (const auto &t : full.transitions(n.index())) {
+      if (t.final_state.full_region_count()
+          > t.initial_state.full_region_count()) {
+        expected[t.period_index].dispersions++;
+      } else {
+        expected[t.period_index].extinctions++;
+      }
+    }
+    if (n.is_leaf()) { continue; }
+    const auto &split = full.node_split(n.index());
+    switch (split.type) {
+    case bigrig::split_type_e::singleton:
+      expected[split.period_index].singleton_splits++;
+      break;
+    case bigrig::split_type_e::allopatric:
+      expected[split.period_index].allopatric_splits++;
+      break;
+    case bigrig::split_type_e::sympatric:
+      expected[split.period_index].sympatric_splits++;
+      break;
+    case bigrig::split_type_e::jump:
+      expected[split.period_index].jump_splits++;
+      break;
+    case bigrig::split_type_e::invalid:
+      break;
+    }
+  }
+
+  CHECK(full.period_stats().empty());
+  REQUIRE(stats.period_stats().size() <= periods.size());
+  for (size_t i = 0; i < stats.period_stats().size(); ++i) {
+    const auto &s = stats.period_stats()[i];
+    CHECK(s.dispersions == expected[i].dispersions);
+    CHECK(s.extinctions == expected[i].extinctions);
+    CHECK(s.singleton_splits == expected[i].singleton_splits);
+    CHECK(s.allopatric_splits == expected[i].allopatric_splits);
+    CHECK(s.sympatric_splits == expected[i].sympatric_splits);
+    CHECK(s.jump_splits == expected[i].jump_splits);
+  }
+}
+
+TEST_CASE("result lazy events", "[result]") {
+  auto periods = make_periods();
+  bigrig::dist_t init_dist = {0b0101, 4};
+
+  bigrig::tree_t tree(tree_str);
+  tree.set_periods(periods);
+  REQUIRE(tree.is_ready());
+
+  for (auto mode :
+       {bigrig::operation_mode_e::FAST, bigrig::operation_mode_e::SIM}) {
+    tree.set_mode(mode);
+    pcg64_fast gen(Catch::getSeed());
+    auto       lazy_gen = gen;
+
+    bigrig::sim_result_t full;
+    tree.simulate(init_dist, full, gen);
+
+    bigrig::sim_result_t lazy;
+    lazy.set_lazy_events(true);
+    tree.simulate(init_dist, lazy, lazy_gen);
+
+    /* Nothing is stored, but the rest of the replicate is the same */
+    for (const auto &n : tree) {
+      CHECK(lazy.transitions(n.index()).empty());
+      CHECK(lazy.final_state(n.index()) == full.final_state(n.index()));
+    }
+
+    /* A single branch can be replayed on its own */
+    size_t                            node = tree.node_count() - 1;
+    std::vector<bigrig::transition_t> replayed;
+    tree.replay_transitions(
+        node, lazy, tree.period_table(), [&](const bigrig::transition_t &t) {
+          replayed.push_back(t);
+        });
+    CHECK(replayed.size() == full.transition_count(node));
+
+    /* Materializing twice doesn't duplicate anything */
+    tree.materialize_transitions(lazy, tree.period_table());
+    tree.materialize_transitions(lazy, tree.period_table());
+    for (const auto &n : tree) {
+      auto lhs = full.transitions(n.index());
+      auto rhs = lazy.transitions(n.index());
+      REQUIRE(lhs.size() == rhs.size());
+      for (size_t i = 0; i < lhs.size(); ++i) {
+        CHECK(lhs[i].waiting_time == rhs[i].waiting_time);
+        CHECK(lhs[i].initial_state == rhs[i].initial_state);
+        CHECK(lhs[i].final_state == rhs[i].final_state);
+        CHECK(lhs[i].period_index == rhs[i].period_index);
+      }
+      CHECK(full.start_range(n.index()) == lazy.start_range(n.index()));
+    }
+  }
+}
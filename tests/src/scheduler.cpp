@@ -0,0 +1,289 @@
+#include "rng.hpp"
+#include "scheduler.hpp"
+#include "test_fixtures.hpp"
+#include "tree.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <algorithm>
+#include <atomic>
+#include <catch2/generators/catch_generators.hpp>
+#include <functional>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+
+TEST_CASE("scheduler commit order", "[scheduler]") {
+  constexpr size_t replicate_count = 257;
+
+  size_t thread_count = GENERATE(1, 2, 4, 8);
+
+  bigrig::replicate_scheduler_t scheduler{thread_count};
+  std::vector<size_t>           simulated(replicate_count, 0);
+  std::vector<size_t>           workers(replicate_count, 0);
+  std::vector<size_t>           committed;
+
+  /* Catch2 assertions are not thread safe, so record, and check afterwards */
+  scheduler.run(
+      replicate_count,
+      [&](size_t replicate, size_t worker) {
+        simulated[replicate] += 1;
+        workers[replicate]    = worker;
+      },
+      [&](size_t replicate, size_t) { committed.push_back(replicate); });
+
+  std::vector<size_t> expected(replicate_count);
+  std::iota(expected.begin(), expected.end(), 0);
+
+  CHECK(committed == expected);
+  CHECK(std::all_of(
+      simulated.begin(), simulated.end(), [](size_t c) { return c == 1; }));
+  CHECK(std::all_of(workers.begin(), workers.end(), [&](size_t w) {
+    return w < thread_count;
+  }));
+}
+
+TEST_CASE("scheduler exceptions", "[scheduler]") {
+  size_t thread_count = GENERATE(1, 4);
+
+  bigrig::replicate_scheduler_t scheduler{thread_count};
+  size_t                        committed = 0;
+
+  auto run = [&]() {
+    scheduler.run(
+        100,
+        [](size_t replicate, size_t) {
+          if (replicate == 10) { throw std::runtime_error{"failed"}; }
+        },
+        [&](size_t, size_t) { committed++; });
+  };
+  CHECK_THROWS_AS(run(), std::runtime_error);
+  CHECK(committed <= 10);
+}
+
+TEST_CASE("scheduler queue", "[scheduler]") {
+  constexpr size_t replicate_count = 257;
+
+  size_t thread_count = GENERATE(1, 2, 4);
+  size_t queue_size   = GENERATE(1, 3);
+
+  bigrig::replicate_scheduler_t scheduler{thread_count, queue_size};
+  CHECK(scheduler.slot_count() == thread_count + queue_size);
+
+  std::vector<size_t> simulated(replicate_count, 0);
+  std::vector<size_t> slots(replicate_count, 0);
+  std::vector<size_t> committed;
+  std::vector<size_t> commit_slots;
+
+  scheduler.run(
+      replicate_count,
+      [&](size_t replicate, size_t slot) {
+        simulated[replicate] += 1;
+        slots[replicate]      = slot;
+      },
+      [&](size_t replicate, size_t slot) {
+        committed.push_back(replicate);
+        commit_slots.push_back(slot);
+      });
+
+  std::vector<size_t> expected(replicate_count);
+  std::iota(expected.begin(), expected.end(), 0);
+
+  CHECK(committed == expected);
+  CHECK(commit_slots == slots);
+  CHECK(std::all_of(
+      simulated.begin(), simulated.end(), [](size_t c) { return c == 1; }));
+  CHECK(std::all_of(slots.begin(), slots.end(), [&](size_t s) {
+    return s < scheduler.slot_count();
+  }));
+
+  SECTION("exceptions") {
+    size_t commits = 0;
+    auto   run     = [&](size_t simulate_fail, size_t commit_fail) {
+      scheduler.run(
+          100,
+          [&](size_t replicate, size_t) {
+            if (replicate == simulate_fail) {
+              throw std::runtime_error{"failed"};
+            }
+          },
+          [&](size_t replicate, size_t) {
+            if (replicate == commit_fail) {
+              throw std::runtime_error{"failed"};
+            }
+            commits++;
+          });
+    };
+    CHECK_THROWS_AS(run(10, 100), std::runtime_error);
+    CHECK(commits <= 10);
+
+    commits = 0;
+    CHECK_THROWS_AS(run(100, 10), std::runtime_error);
+    CHECK(commits == 10);
+  }
+}
+
+TEST_CASE("replicate streams", "[scheduler][rng]") {
+  bigrig::rng_wrapper_t::seed(42);
+
+  auto a = bigrig::rng_wrapper_t::replicate_rng(3);
+  auto b = bigrig::rng_wrapper_t::replicate_rng(3);
+  auto c = bigrig::rng_wrapper_t::replicate_rng(4);
+
+  CHECK(a == b);
+  CHECK(!(a == c));
+
+  /* drawing from the global generator doesn't change the streams */
+  bigrig::rng_wrapper_t::rng()();
+  CHECK(bigrig::rng_wrapper_t::replicate_rng(3) == a);
+}
+
+TEST_CASE("replicates are independent of thread count", "[scheduler]") {
+  constexpr size_t  replicate_count = 64;
+  auto period = make_single_period();
+  bigrig::dist_t init_dist = {0b0101, 4};
+
+  bigrig::rng_wrapper_t::seed(1234);
+
+  bigrig::tree_t tree(small_tree_str);
+  tree.set_periods(period);
+
+  auto run_batch = [&](size_t thread_count) {
+    bigrig::replicate_scheduler_t     scheduler{thread_count};
+    std::vector<bigrig::sim_result_t> sim_results(scheduler.thread_count());
+    std::vector<std::string>          results;
+    scheduler.run(
+        replicate_count,
+        [&](size_t replicate, size_t worker) {
+          auto gen = bigrig::rng_wrapper_t::replicate_rng(replicate);
+          tree.simulate(init_dist, sim_results[worker], gen);
+        },
+        [&](size_t, size_t worker) {
+          results.push_back(tree.to_phylip_body_extended(sim_results[worker]));
+        });
+    return results;
+  };
+
+  auto serial   = run_batch(1);
+  auto parallel = run_batch(GENERATE(2, 3, 8));
+
+  CHECK(serial == parallel);
+}
+
+TEST_CASE("task pool runs every task", "[scheduler]") {
+  size_t thread_count = GENERATE(1, 2, 4, 8);
+
+  bigrig::task_pool_t pool{thread_count};
+  std::atomic<size_t> run_count   = 0;
+  std::atomic<bool>   bad_workers = false;
+
+  /* Every task spawns two more, down to a depth of 10 */
+  std::function<void(size_t, size_t)> task = [&](size_t depth, size_t worker) {
+    run_count++;
+    if (worker >= thread_count) { bad_workers = true; }
+    if (depth == 10) { return; }
+    for (size_t i = 0; i < 2; ++i) {
+      pool.spawn([&, depth](size_t w) { task(depth + 1, w); });
+    }
+  };
+
+  for (size_t i = 0; i < 3; ++i) {
+    run_count = 0;
+    pool.run([&](size_t w) { task(0, w); });
+    CHECK(run_count == (1 << 11) - 1);
+  }
+  CHECK(!bad_workers);
+}
+
+TEST_CASE("task pool exceptions", "[scheduler]") {
+  size_t thread_count = GENERATE(1, 4);
+
+  bigrig::task_pool_t pool{thread_count};
+
+  auto run = [&]() {
+    pool.run([&](size_t) {
+      for (size_t i = 0; i < 100; ++i) {
+        pool.spawn([i](size_t) {
+          if (i == 10) { throw std::runtime_error{"failed"}; }
+        });
+      }
+    });
+  };
+  CHECK_THROWS_AS(run(), std::runtime_error);
+
+  /* the pool is still usable afterwards */
+  size_t count = 0;
+  pool.run([&](size_t) { count++; });
+  CHECK(count == 1);
+}
+
+TEST_CASE("parallel tree is independent of threads", "[scheduler][tree]") {
+  constexpr size_t depth = 9;
+
+  std::function<std::string(size_t)> make_subtree = [&](size_t d) {
+    if (d == 0) { return std::string{"t"}; }
+    return "(" + make_subtree(d - 1) + ":0.3," + make_subtree(d - 1) + ":0.2)";
+  };
+
+  auto period = make_single_period();
+  bigrig::dist_t init_dist = {0b0101, 4};
+
+  bigrig::tree_t tree(make_subtree(depth) + ";");
+  tree.set_periods(period);
+  REQUIRE(tree.is_ready());
+  CHECK(tree.subtree_size(0) == tree.node_count());
+
+  bool stats_only = GENERATE(false, true);
+
+  /* Record everything about a result, so that they can be compared */
+  auto run = [&](size_t thread_count, size_t cutoff) {
+    tree.set_parallel_cutoff(cutoff);
+    bigrig::task_pool_t  pool{thread_count};
+    bigrig::sim_result_t result;
+    result.set_stats_only(stats_only);
+
+    std::vector<std::string> records;
+    for (size_t replicate = 0; replicate < 4; ++replicate) {
+      pcg64_fast gen{replicate};
+      tree.simulate_parallel(init_dist, result, gen, pool);
+
+      records.push_back(tree.to_phylip_body_extended(result));
+      for (size_t index = 0; index < tree.node_count(); ++index) {
+        std::string record;
+        for (const auto &t : result.transitions(index)) {
+          record += t.initial_state.to_str() + t.final_state.to_str()
+                  + std::to_string(t.waiting_time) + ",";
+        }
+        records.push_back(record);
+      }
+      for (const auto &s : result.period_stats()) {
+        records.push_back(std::to_string(s.dispersions) + " "
+                          + std::to_string(s.extinctions) + " "
+                          + std::to_string(s.allopatric_splits) + " "
+                          + std::to_string(s.sympatric_splits));
+      }
+    }
+    return records;
+  };
+
+  size_t thread_count = GENERATE(1, 2, 4);
+  size_t cutoff       = GENERATE(0, 16, 100000);
+
+  auto expected = run(1, bigrig::tree_t::DEFAULT_PARALLEL_CUTOFF);
+  CHECK(expected == run(thread_count, cutoff));
+}
+
+TEST_CASE("shard ranges", "[scheduler]") {
+  size_t job_count   = GENERATE(0, 1, 7, 64, 1000);
+  size_t shard_count = GENERATE(1, 2, 3, 8, 100);
+
+  size_t next = 0;
+  for (size_t shard = 0; shard < shard_count; ++shard) {
+    auto [begin, end] = bigrig::shard_range(job_count, shard, shard_count);
+    CHECK(begin == next);
+    CHECK(begin <= end);
+    CHECK(end - begin >= job_count / shard_count);
+    CHECK(end - begin <= job_count / shard_count + 1);
+    next = end;
+  }
+  CHECK(next == job_count);
+}
@@ -0,0 +1,157 @@
+#include "exceptions.hpp"
+#include "simulator.hpp"
+#include "test_fixtures.hpp"
+
+#include <catch2/catch_get_random_seed.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/matchers/catch_matchers_floating_point.hpp>
+#include <limits>
+
+namespace {
+constexpr size_t REGIONS = 6;
+
+std::vector<bigrig::period_t> make_late_jump_periods(double boundary) {
+  std::vector<bigrig::period_t> periods{
+      {0.0,
+       boundary,
+       {.dis = 1.0, .ext = 1.0},
+       {.allopatry = 1.0, .sympatry = 1.0, .copy = 1.0, .jump = 0.0},
+       true,
+       0},
+      {boundary,
+       std::numeric_limits<double>::infinity(),
+       {.dis = 2.0, .ext = 0.5},
+       {.allopatry = 1.0, .sympatry = 2.0, .copy = 1.0, .jump = 1.0},
+       true,
+       1},
+  };
+  for (auto &p : periods) { p.model_ptr()->set_region_count(REGIONS); }
+  return periods;
+}
+
+std::shared_ptr<const bigrig::tree_t> make_tree() {
+  auto tree = std::make_shared<bigrig::tree_t>(tree_str);
+  tree->set_periods(make_late_jump_periods(0.8));
+  return tree;
+}
+} // namespace
+
+TEST_CASE("simulator tips and events", "[simulator]") {
+  auto tree = make_tree();
+  REQUIRE(tree->is_ready());
+
+  bigrig::simulator_t sim{tree};
+  REQUIRE(sim.tip_count() == 10);
+  for (auto index : sim.tip_nodes()) { CHECK(tree->is_leaf(index)); }
+
+  std::vector<bigrig::dist_t>  tips(sim.tip_count());
+  std::vector<bigrig::event_t> events(1024);
+  bigrig::dist_t               root{0b000011, REGIONS};
+
+  auto seed = Catch::getSeed();
+  for (size_t i = 0; i < 20; ++i) {
+    sim.seed(seed + i);
+    auto count = sim.simulate(root, tips, events);
+    REQUIRE(count <= events.size());
+
+    const auto &result = sim.result();
+    for (size_t t = 0; t < sim.tip_count(); ++t) {
+      CHECK(tips[t] == result.final_state(sim.tip_nodes()[t]));
+    }
+
+    size_t expected_count = 0;
+    for (size_t index = 0; index < tree->node_count(); ++index) {
+      expected_count += result.transition_count(index);
+    }
+    CHECK(count == expected_count);
+
+    for (size_t e = 0; e < count; ++e) {
+      const auto &event = events[e];
+      CHECK(event.abs_time >= tree->abs_time_at_start(event.node));
+      CHECK(event.abs_time <= tree->abs_time(event.node));
+      CHECK((event.initial_state ^ event.final_state).full_region_count()
+            == 1);
+    }
+
+    /* Counting the events takes the same draws as keeping them */
+    std::vector<bigrig::dist_t> counted_tips(sim.tip_count());
+    sim.seed(seed + i);
+    CHECK(sim.simulate(root, counted_tips) == count);
+    CHECK(counted_tips == tips);
+  }
+}
+
+TEST_CASE("simulator buffers", "[simulator]") {
+  bigrig::simulator_t sim{make_tree()};
+  bigrig::dist_t      root{0b000011, REGIONS};
+
+  std::vector<bigrig::dist_t> small(sim.tip_count() - 1);
+  CHECK_THROWS_AS(sim.simulate(root, small), bigrig::invalid_buffer);
+
+  std::vector<bigrig::dist_t> tips(sim.tip_count());
+  size_t                      full_count = 0;
+  auto                        seed       = Catch::getSeed();
+  for (size_t i = 0; full_count < 2 && i < 100; ++i) {
+    sim.seed(seed + i);
+    full_count = sim.simulate(root, tips, {});
+  }
+  REQUIRE(full_count >= 2);
+
+  std::vector<bigrig::event_t> full(full_count);
+  sim.seed(seed);
+  sim.simulate(root, tips, full);
+
+  /* A buffer which is too small gets the first events, and the real count */
+  std::vector<bigrig::event_t> truncated(full_count / 2);
+  sim.seed(seed);
+  CHECK(sim.simulate(root, tips, truncated) == full_count);
+  for (size_t e = 0; e < truncated.size(); ++e) {
+    CHECK(truncated[e].abs_time == full[e].abs_time);
+    CHECK(truncated[e].node == full[e].node);
+  }
+}
+
+TEST_CASE("simulator params", "[simulator]") {
+  auto                tree = make_tree();
+  bigrig::simulator_t sim{tree}, other{tree};
+
+  bigrig::sweep_point_t point;
+  point.set(bigrig::sweep_param_e::DISPERSION, 0.0);
+  point.set(bigrig::sweep_param_e::EXTINCTION, 0.0);
+  REQUIRE(sim.set_params(point));
+  CHECK(sim.periods()[0].model().rates().dis == 0.0);
+  CHECK(other.periods()[0].model().rates().dis == 1.0);
+
+  /* Without any anagenesis, nothing happens on the branches */
+  std::vector<bigrig::dist_t> tips(sim.tip_count());
+  bigrig::dist_t              root{0b000011, REGIONS};
+  sim.seed(Catch::getSeed());
+  CHECK(sim.simulate(root, tips) == 0);
+
+  /* The sweep point replaces parameters of the periods, it doesn't stack */
+  bigrig::sweep_point_t back;
+  back.set(bigrig::sweep_param_e::COPY, 2.0);
+  REQUIRE(sim.set_params(back));
+  CHECK(sim.periods()[0].model().rates().dis == 1.0);
+  CHECK(sim.periods()[0].model().cladogenesis_params().copy == 2.0);
+
+  /* Periods need the same boundaries as the tree */
+  CHECK(!sim.set_periods(make_late_jump_periods(0.5)));
+  CHECK(sim.set_periods(make_late_jump_periods(0.8)));
+}
+
+TEST_CASE("simulators share a tree", "[simulator]") {
+  auto                tree = make_tree();
+  bigrig::simulator_t a{tree}, b{tree};
+  bigrig::dist_t      root{0b000011, REGIONS};
+
+  std::vector<bigrig::dist_t> a_tips(a.tip_count()), b_tips(b.tip_count());
+
+  auto seed = Catch::getSeed();
+  a.seed(seed);
+  b.seed(seed);
+  for (size_t i = 0; i < 10; ++i) {
+    CHECK(a.simulate(root, a_tips) == b.simulate(root, b_tips));
+    CHECK(a_tips == b_tips);
+  }
+}
@@ -0,0 +1,80 @@
+#include "sink.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#ifdef BIGRIG_GZIP
+#include <zlib.h>
+#endif
+
+namespace {
+std::string make_contents() {
+  std::string contents;
+  for (size_t i = 0; i < 100000; ++i) {
+    contents += "line " + std::to_string(i) + "\n";
+  }
+  return contents;
+}
+
+std::string read_file(const std::filesystem::path &filename) {
+  std::ifstream     file(filename, std::ios::binary);
+  std::stringstream ss;
+  ss << file.rdbuf();
+  return ss.str();
+}
+} // namespace
+
+TEST_CASE("sink plain", "[sink]") {
+  auto filename = std::filesystem::temp_directory_path() / "bigrig_sink.txt";
+  auto contents = make_contents();
+
+  {
+    bigrig::output_sink_t sink;
+    REQUIRE(sink.open(filename));
+    REQUIRE(sink.is_open());
+
+    /* mix small writes with one which is bigger than the buffer */
+    sink << contents.substr(0, 10);
+    sink.put(contents[10]);
+    sink << contents.substr(11);
+    CHECK(sink.good());
+  }
+
+  CHECK(read_file(filename) == contents);
+  std::filesystem::remove(filename);
+}
+
+TEST_CASE("sink bad path", "[sink]") {
+  bigrig::output_sink_t sink;
+  CHECK_FALSE(sink.open("/this/path/does/not/exist/file.txt"));
+  CHECK_FALSE(sink.is_open());
+  CHECK(sink.fail());
+}
+
+#ifdef BIGRIG_GZIP
+TEST_CASE("sink gzip", "[sink]") {
+  auto filename = std::filesystem::temp_directory_path() / "bigrig_sink.txt.gz";
+  auto contents = make_contents();
+
+  {
+    bigrig::output_sink_t sink;
+    REQUIRE(sink.open(filename, bigrig::compression_type_e::gzip));
+    for (char c : contents) { sink << c; }
+  }
+
+  CHECK(std::filesystem::file_size(filename) < contents.size());
+
+  auto        gz_file = gzopen(filename.c_str(), "rb");
+  std::string decompressed(contents.size() + 1, '\0');
+  REQUIRE(gz_file != nullptr);
+  auto read = gzread(gz_file, decompressed.data(), decompressed.size());
+  gzclose(gz_file);
+  decompressed.resize(read);
+
+  CHECK(decompressed == contents);
+  std::filesystem::remove(filename);
+}
+#endif
@@ -5,6 +5,7 @@
 #include <catch2/matchers/catch_matchers_floating_point.hpp>
 #include <cmath>
 #include <dist.hpp>
+#include <map>
 #include <model.hpp>
 #include <pcg_random.hpp>
 #include <split.hpp>
@@ -429,3 +430,152 @@ TEST_CASE("split index chi2 test", "[sample]") {
     CHECK(chi2 < chi2_lut[df]);
   }
 }
+
+TEST_CASE("exact split distribution", "[sample]") {
+  constexpr size_t REGIONS = 4;
+  constexpr size_t trials  = 40'000;
+  pcg64_fast       gen(Catch::getSeed());
+
+  bigrig::cladogenesis_params_t params
+      = GENERATE(bigrig::cladogenesis_params_t{1.0, 1.0, 1.0, 0.0},
+                 bigrig::cladogenesis_params_t{2.0, 1.0, 0.5, 0.0},
+                 bigrig::cladogenesis_params_t{1.0, 3.0, 1.0, 1.0},
+                 bigrig::cladogenesis_params_t{0.5, 1.0, 2.0, 2.0},
+                 bigrig::cladogenesis_params_t{1.0, 1.0, 0.0, 0.0});
+
+  bigrig::biogeo_model_t model;
+  model.set_params(1.0, 1.0)
+      .set_cladogenesis_params(params)
+      .set_two_region_duplicity(false)
+      .set_region_count(REGIONS);
+  auto norm = params.normalize();
+
+  /*
+   * The distribution of the rejection method, found by classifying every pair
+   * of ranges. The orientation is dropped, since the rejection method only
+   * takes jumps from a singleton in one orientation, and counts copies once.
+   */
+  auto unordered = [](bigrig::dist_t a, bigrig::dist_t b) {
+    auto key = std::make_pair(a.to_str(), b.to_str());
+    if (key.second < key.first) { std::swap(key.first, key.second); }
+    return key;
+  };
+
+  constexpr uint64_t max_dist = (1ul << REGIONS) - 1;
+  for (uint64_t init = 1; init <= max_dist; ++init) {
+    bigrig::dist_t init_dist{init, REGIONS};
+    INFO("init dist: " << init_dist);
+
+    std::map<std::pair<std::string, std::string>, double> expected;
+    double                                                total = 0.0;
+    for (uint64_t l = 1; l <= max_dist; ++l) {
+      for (uint64_t r = 1; r <= max_dist; ++r) {
+        bigrig::dist_t left{l, REGIONS}, right{r, REGIONS};
+
+        double weight = 0.0;
+        switch (bigrig::determine_split_type(init_dist, left, right)) {
+        case bigrig::split_type_e::allopatric:
+          weight = norm.allopatry;
+          break;
+        case bigrig::split_type_e::sympatric:
+          weight = norm.sympatry;
+          break;
+        case bigrig::split_type_e::singleton:
+          weight = norm.copy;
+          break;
+        case bigrig::split_type_e::jump:
+          weight = norm.jump;
+          break;
+        case bigrig::split_type_e::invalid:
+          break;
+        }
+        if (weight == 0.0) { continue; }
+        expected[unordered(left, right)] += weight;
+        total                            += weight;
+      }
+    }
+    /* Without copies or jumps a singleton can only be copied, as in fast mode */
+    if (total == 0.0) {
+      expected[unordered(init_dist, init_dist)] = 1.0;
+      total                                     = 1.0;
+    }
+
+    std::map<std::pair<std::string, std::string>, size_t> counts;
+    for (size_t i = 0; i < trials; ++i) {
+      auto split = bigrig::split_dist_exact(init_dist, model, gen);
+      CHECK(split.top == init_dist);
+      counts[unordered(split.left, split.right)] += 1;
+    }
+
+    for (const auto &[key, count] : counts) {
+      INFO("split: " << key.first << " | " << key.second);
+      CHECK(expected.contains(key));
+    }
+    for (const auto &[key, weight] : expected) {
+      INFO("split: " << key.first << " | " << key.second);
+      CHECK_THAT(static_cast<double>(counts[key]) / trials,
+                 Catch::Matchers::WithinAbs(weight / total, 0.01));
+    }
+  }
+}
+
+TEST_CASE("exact split outcomes without copies or jumps", "[sample]") {
+  constexpr size_t REGIONS = 4;
+
+  bigrig::biogeo_model_t model;
+  model.set_params(1.0, 1.0)
+      .set_cladogenesis_params(1.0, 1.0, 0.0, 0.0)
+      .set_region_count(REGIONS);
+
+  /* A singleton has nothing to pick from, so the table has to give a copy */
+  auto table = model.lookup_split_outcomes(REGIONS, 1);
+  for (size_t column = 0; column < table.aliases.size(); ++column) {
+    INFO("column: " << column);
+    CHECK(table.probs[column] == 0.0);
+    CHECK(table.aliases[column] == 2);
+  }
+  CHECK(table.counts[2] > 0);
+}
+
+TEST_CASE("exact split with many regions", "[sample]") {
+  constexpr size_t trials = 100'000;
+  pcg64_fast       gen(Catch::getSeed());
+
+  bigrig::dist_t init_dist = GENERATE(
+      bigrig::dist_t{0b11'0100'0001, 10},
+      bigrig::dist_t{
+          0b111'1111'1000'0011'0110'1011'1111'0010'1001'0000'0101'0011'1100'1110'0000'0100,
+          63});
+
+  bigrig::biogeo_model_t model;
+  model.set_params(1.0, 1.0)
+      .set_cladogenesis_params(1.0, 2.0, 1.0, 0.1)
+      .set_two_region_duplicity(false)
+      .set_region_count(init_dist.regions());
+
+  std::map<bigrig::split_type_e, size_t> counts;
+  size_t                                 left_smaller = 0;
+  for (size_t i = 0; i < trials; ++i) {
+    auto split = bigrig::split_dist_exact(init_dist, model, gen);
+    CHECK(bigrig::determine_split_type(init_dist, split.left, split.right)
+          == split.type);
+    counts[split.type] += 1;
+    left_smaller += split.left.full_region_count()
+                  < split.right.full_region_count();
+  }
+
+  double total = model.total_nonsingleton_weight(init_dist);
+  CHECK_THAT(static_cast<double>(counts[bigrig::split_type_e::allopatric])
+                 / trials,
+             Catch::Matchers::WithinAbs(
+                 model.allopatry_weight(init_dist) / total, 0.01));
+  CHECK_THAT(static_cast<double>(counts[bigrig::split_type_e::sympatric])
+                 / trials,
+             Catch::Matchers::WithinAbs(
+                 model.sympatry_weight(init_dist) / total, 0.01));
+  CHECK_THAT(
+      static_cast<double>(counts[bigrig::split_type_e::jump]) / trials,
+      Catch::Matchers::WithinAbs(model.jump_weight(init_dist) / total, 0.01));
+  CHECK_THAT(static_cast<double>(left_smaller) / trials,
+             Catch::Matchers::WithinAbs(0.5, 0.01));
+}
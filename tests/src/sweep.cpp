@@ -0,0 +1,185 @@
+#include "sweep.hpp"
+#include "test_fixtures.hpp"
+#include "tree.hpp"
+
+#include "pcg_random.hpp"
+
+#include <catch2/catch_get_random_seed.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+#include <catch2/matchers/catch_matchers_floating_point.hpp>
+
+TEST_CASE("sweep grid", "[sweep]") {
+  auto range = bigrig::make_sweep_range(0.1, 1.0, 4);
+  REQUIRE(range.size() == 4);
+  CHECK(range.front() == 0.1);
+  CHECK(range.back() == 1.0);
+  CHECK_THAT(range[1], Catch::Matchers::WithinAbs(0.4, 1e-12));
+  CHECK(bigrig::make_sweep_range(0.5, 1.0, 1) == std::vector<double>{0.5});
+
+  using bigrig::sweep_param_e;
+  auto points = bigrig::make_sweep_grid({
+      {.param = sweep_param_e::DISPERSION, .values = {1.0, 2.0}},
+      {.param = sweep_param_e::JUMP, .values = {0.0, 0.5, 1.0}},
+  });
+  REQUIRE(points.size() == 6);
+
+  /* The first axis changes the slowest */
+  CHECK(points[0].get(sweep_param_e::DISPERSION) == 1.0);
+  CHECK(points[0].get(sweep_param_e::JUMP) == 0.0);
+  CHECK(points[2].get(sweep_param_e::JUMP) == 1.0);
+  CHECK(points[3].get(sweep_param_e::DISPERSION) == 2.0);
+  CHECK(points[3].get(sweep_param_e::JUMP) == 0.0);
+  CHECK(!points[5].get(sweep_param_e::EXTINCTION).has_value());
+
+  CHECK(bigrig::make_sweep_grid({}).empty());
+}
+
+TEST_CASE("sweep table", "[sweep]") {
+  using bigrig::sweep_param_e;
+
+  SECTION("good table") {
+    auto filename = write_temp_file("bigrig_sweep_good.csv",
+                                "# a comment\n"
+                                "dispersion, extinction, jump\n"
+                                "1.0, 0.5, 0.0\n"
+                                "\n"
+                                "2.0, , 1e-2\n");
+    auto points   = bigrig::read_sweep_table(filename);
+    REQUIRE(points.has_value());
+    REQUIRE(points->size() == 2);
+    CHECK((*points)[0].get(sweep_param_e::EXTINCTION) == 0.5);
+    CHECK((*points)[1].get(sweep_param_e::DISPERSION) == 2.0);
+    CHECK(!(*points)[1].get(sweep_param_e::EXTINCTION).has_value());
+    CHECK((*points)[1].get(sweep_param_e::JUMP) == 0.01);
+    CHECK(!(*points)[1].get(sweep_param_e::COPY).has_value());
+  }
+
+  SECTION("bad tables") {
+    auto contents = GENERATE(as<std::string>{},
+                             "dispersion, speed\n1.0, 2.0\n",
+                             "dispersion, jump\n1.0\n",
+                             "dispersion\nfast\n",
+                             "dispersion\n");
+    auto filename = write_temp_file("bigrig_sweep_bad.csv", contents);
+    CHECK(!bigrig::read_sweep_table(filename).has_value());
+  }
+
+  CHECK(!bigrig::read_sweep_table("/nonexistent/bigrig_sweep.csv"));
+}
+
+TEST_CASE("root prior", "[sweep]") {
+  SECTION("good prior") {
+    auto filename = write_temp_file("bigrig_roots_good.csv",
+                                "# range, weight\n"
+                                "0011, 3.0\n"
+                                "\n"
+                                "1000\n");
+    auto roots    = bigrig::read_root_prior(filename);
+    REQUIRE(roots.has_value());
+    REQUIRE(roots->size() == 2);
+    CHECK((*roots)[0].range == bigrig::dist_t{0b0011, 4});
+    CHECK((*roots)[1].range == bigrig::dist_t{0b1000, 4});
+    CHECK_THAT((*roots)[0].weight, Catch::Matchers::WithinAbs(0.75, 1e-12));
+    CHECK_THAT((*roots)[1].weight, Catch::Matchers::WithinAbs(0.25, 1e-12));
+  }
+
+  SECTION("bad priors") {
+    auto contents = GENERATE(as<std::string>{},
+                             "",
+                             "0011, 1.0, 2.0\n",
+                             "0021\n",
+                             "0011\n011\n",
+                             "0011\n0011\n",
+                             "0011, -1.0\n",
+                             "0011, heavy\n",
+                             "0011, 0.0\n");
+    auto filename = write_temp_file("bigrig_roots_bad.csv", contents);
+    CHECK(!bigrig::read_root_prior(filename).has_value());
+  }
+
+  CHECK(!bigrig::read_root_prior("/nonexistent/bigrig_roots.csv"));
+
+  auto all = bigrig::make_all_root_ranges(3);
+  REQUIRE(all.size() == 7);
+  double total = 0.0;
+  for (size_t i = 0; i < all.size(); ++i) {
+    CHECK(all[i].range == bigrig::dist_t{i + 1, 3});
+    total += all[i].weight;
+  }
+  CHECK_THAT(total, Catch::Matchers::WithinAbs(1.0, 1e-12));
+}
+
+TEST_CASE("sweep periods", "[sweep]") {
+  using bigrig::sweep_param_e;
+
+  auto base = make_periods(0.5);
+  for (auto &p : base) { p.model_ptr()->set_region_count(4); }
+
+  bigrig::sweep_point_t point;
+  point.set(sweep_param_e::EXTINCTION, 0.25);
+  point.set(sweep_param_e::COPY, 3.0);
+
+  auto periods = bigrig::make_sweep_periods(base, point);
+  REQUIRE(periods.size() == base.size());
+  for (size_t i = 0; i < periods.size(); ++i) {
+    CHECK(periods[i].start() == base[i].start());
+    CHECK(periods[i].length() == base[i].length());
+    CHECK(periods[i].index() == base[i].index());
+    CHECK(periods[i].model_ptr() != base[i].model_ptr());
+
+    CHECK(periods[i].model().rates().dis == base[i].model().rates().dis);
+    CHECK(periods[i].model().rates().ext == 0.25);
+    CHECK(periods[i].model().cladogenesis_params().copy == 3.0);
+    CHECK(periods[i].model().cladogenesis_params().jump
+          == base[i].model().cladogenesis_params().jump);
+  }
+  CHECK(base[0].model().rates().ext == 1.0);
+
+  CHECK(bigrig::check_sweep_point(base, point, 4));
+}
+
+TEST_CASE("sweep matches a prepared tree", "[sweep]") {
+  using bigrig::sweep_param_e;
+
+  auto base = make_periods(0.8);
+  for (auto &p : base) { p.model_ptr()->set_region_count(6); }
+
+  bigrig::sweep_point_t point;
+  point.set(sweep_param_e::DISPERSION, 0.3);
+  point.set(sweep_param_e::JUMP, 0.7);
+
+  bigrig::tree_t tree(tree_str);
+  tree.set_periods(base);
+  REQUIRE(tree.is_ready());
+
+  bigrig::tree_t expected_tree(tree_str);
+  expected_tree.set_periods(bigrig::make_sweep_periods(base, point));
+  REQUIRE(expected_tree.is_ready());
+
+  bigrig::sweep_tables_t tables{tree, base, {point}};
+  auto                   table = tables.acquire(0);
+  REQUIRE(table);
+  CHECK(table == tables.acquire(0));
+
+  auto                 seed = Catch::getSeed();
+  bigrig::dist_t       root{0b000011, 6};
+  bigrig::sim_result_t result, expected;
+  for (size_t i = 0; i < 20; ++i) {
+    pcg64_fast gen(seed + i), expected_gen(seed + i);
+    tree.simulate(root, result, gen, *table);
+    expected_tree.simulate(root, expected, expected_gen);
+
+    for (size_t index = 0; index < tree.node_count(); ++index) {
+      CHECK(result.final_state(index) == expected.final_state(index));
+      CHECK(result.transition_count(index) == expected.transition_count(index));
+    }
+  }
+
+  tables.release(0);
+  CHECK(table != tables.acquire(0));
+
+  /* Tables need the same boundaries as the tree */
+  CHECK(!tree.make_period_table(make_periods(0.5)).has_value());
+  CHECK(!tree.make_period_table({base[0]}).has_value());
+}
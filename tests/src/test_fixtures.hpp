@@ -0,0 +1,77 @@
+#pragma once
+
+#include "period.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <vector>
+
+/**
+ * A ten taxa tree with branch lengths, which is shared by most of the tests.
+ */
+inline const std::string tree_str
+    = "((((i:0.7595,g:0.7032):0.4222,d:0.9406):0.3103,(j:0.6265,a:0.7083):0."
+      "9747):0.6039,(((c:0.6288,e:0.0113):0.9947,b:0.0395):0.2410,(h:0.7842,"
+      "f:0.6276):0.9940):0.0541);";
+
+/**
+ * Two periods, split at `boundary`. Jumps are only allowed in the first one.
+ */
+inline std::vector<bigrig::period_t> make_periods(double boundary = 0.5,
+                                                  double dis      = 1.0) {
+  return {
+      {0.0,
+       boundary,
+       {.dis = dis, .ext = 1.0},
+       {.allopatry = 1.0, .sympatry = 1.0, .copy = 1.0, .jump = 1.0},
+       true,
+       0},
+      {boundary,
+       std::numeric_limits<double>::infinity(),
+       {.dis = 2.0, .ext = 0.5},
+       {.allopatry = 1.0, .sympatry = 2.0, .copy = 1.0, .jump = 0.0},
+       true,
+       1},
+  };
+}
+
+/**
+ * A five taxa tree, for the tests which run many replicates.
+ */
+inline const std::string small_tree_str
+    = "((c:0.9295,(a:0.0441,b:0.2992):0.3751):0.8417,(d:0.2104,e:0.2918):0."
+      "1917);";
+
+/**
+ * One period over the whole tree, with every rate and weight set to one.
+ */
+inline bigrig::period_t make_single_period() {
+  return {0.0,
+          std::numeric_limits<double>::infinity(),
+          {.dis = 1.0, .ext = 1.0},
+          {.allopatry = 1.0, .sympatry = 1.0, .copy = 1.0, .jump = 1.0},
+          true,
+          0};
+}
+
+/**
+ * A path in the temp directory, with any file left there by an earlier run
+ * removed.
+ */
+inline std::filesystem::path temp_filename(const std::string &name) {
+  auto filename = std::filesystem::temp_directory_path() / name;
+  std::filesystem::remove(filename);
+  return filename;
+}
+
+/**
+ * Write `contents` to a file in the temp directory, and return its path.
+ */
+inline std::filesystem::path write_temp_file(const std::string &name,
+                                             const std::string &contents) {
+  auto filename = std::filesystem::temp_directory_path() / name;
+  std::ofstream(filename) << contents;
+  return filename;
+}
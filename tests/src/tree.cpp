@@ -1,3 +1,4 @@
+#include "test_fixtures.hpp"
 #include "tree.hpp"
 
 #include "pcg_random.hpp"
@@ -6,6 +7,7 @@
 #include <catch2/catch_get_random_seed.hpp>
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/generators/catch_generators.hpp>
+#include <catch2/matchers/catch_matchers_floating_point.hpp>
 #include <limits>
 
 std::vector<std::string> tree_strings = {};
@@ -118,10 +120,265 @@ TEST_CASE("tree sample", "[tree]") {
 
   pcg64_fast gen(Catch::getSeed());
 
-  tree.simulate(init_dist, gen);
-  for (const auto &n : tree) { CHECK((bool)n->final_state()); }
+  bigrig::sim_result_t result;
+  tree.simulate(init_dist, result, gen);
+  for (const auto &n : tree) { CHECK((bool)result.final_state(n.index())); }
 
   BENCHMARK("sample: " + std::to_string(tree.leaf_count())) {
-    tree.simulate(init_dist, gen);
+    tree.simulate(init_dist, result, gen);
   };
 }
+
+TEST_CASE("tree caterpillar", "[tree]") {
+  constexpr size_t taxa = 5000;
+
+  std::string tree_str = "t0:1.0";
+  for (size_t i = 1; i < taxa; ++i) {
+    tree_str = "(" + tree_str + ",t" + std::to_string(i) + ":1.0):0.5";
+  }
+  tree_str += ";";
+
+  bigrig::tree_t tree(tree_str);
+
+  CHECK(tree.node_count() == 2 * taxa - 1);
+  CHECK(tree.leaf_count() == taxa);
+  CHECK(tree.is_binary());
+
+  std::vector<bool> seen(tree.node_count(), false);
+  bool              parents_first = true;
+  for (const auto &n : tree) {
+    auto parent      = tree.parent(n.index());
+    parents_first   &= parent == bigrig::tree_t::no_parent || seen[parent];
+    seen[n.index()]  = true;
+  }
+  CHECK(parents_first);
+
+  bigrig::tree_t round_trip(tree.to_newick() + ";");
+  CHECK(round_trip.to_newick() == tree.to_newick());
+
+  auto period = make_single_period();
+  tree.set_periods(period);
+  CHECK(tree.is_ready());
+
+  pcg64_fast           gen(Catch::getSeed());
+  bigrig::sim_result_t result;
+  tree.simulate({0b0101, 4}, result, gen);
+
+  bool all_set = true;
+  for (const auto &n : tree) { all_set &= (bool)result.final_state(n.index()); }
+  CHECK(all_set);
+}
+
+TEST_CASE("tree many periods", "[tree]") {
+  constexpr size_t period_count = 300;
+  constexpr double period_width = 0.01;
+
+  const std::string tree_str
+      = "((((i:0.7595,g:0.7032):0.4222,d:0.9406):0.3103,(j:0.6265,a:0.7083):0."
+        "9747):0.6039,(((c:0.6288,e:0.0113):0.9947,b:0.0395):0.2410,(h:0.7842,"
+        "f:0.6276):0.9940):0.0541,k:0.6);";
+
+  /* given out of order, to check that the tree sorts them */
+  std::vector<bigrig::period_t> periods;
+  for (size_t i = period_count; i-- > 0;) {
+    periods.push_back(
+        {i * period_width,
+         i + 1 == period_count ? std::numeric_limits<double>::infinity()
+                               : period_width,
+         {.dis = 1.0, .ext = 1.0},
+         {.allopatry = 1.0, .sympatry = 1.0, .copy = 1.0, .jump = 1.0},
+         true,
+         i});
+  }
+
+  bigrig::tree_t tree(tree_str);
+  tree.set_periods(periods);
+  REQUIRE(tree.is_ready());
+
+  for (size_t index = 0; index < tree.node_count(); ++index) {
+    auto node_periods = tree.node_periods(index);
+    REQUIRE(!node_periods.empty());
+
+    double time  = tree.abs_time_at_start(index);
+    size_t first = node_periods.front().index();
+    size_t i     = 0;
+    for (auto p : node_periods) {
+      CHECK(p.index() == first + i);
+      CHECK_THAT(p.start(), Catch::Matchers::WithinAbs(time, 1e-9));
+      CHECK(p.length() >= 0.0);
+      time += p.length();
+      i++;
+    }
+    CHECK_THAT(time, Catch::Matchers::WithinAbs(tree.abs_time(index), 1e-9));
+
+    /* the branch starts in the period which covers its start */
+    auto front = node_periods.front().period();
+    CHECK(front.start() <= tree.abs_time_at_start(index));
+    CHECK(front.end() >= tree.abs_time_at_start(index));
+  }
+
+  pcg64_fast           gen(Catch::getSeed());
+  bigrig::sim_result_t result;
+  tree.simulate({0b0101, 4}, result, gen);
+  for (const auto &n : tree) { CHECK((bool)result.final_state(n.index())); }
+}
+
+TEST_CASE("tree resimulate", "[tree]") {
+  auto periods = make_periods(1.0);
+  bigrig::dist_t init_dist = {0b0101, 4};
+
+  auto check_same = [](const bigrig::tree_t       &tree,
+                       const bigrig::sim_result_t &lhs,
+                       const bigrig::sim_result_t &rhs) {
+    CHECK(tree.to_phylip_body_extended(lhs)
+          == tree.to_phylip_body_extended(rhs));
+    for (const auto &n : tree) {
+      CHECK(lhs.node_split(n.index()).left == rhs.node_split(n.index()).left);
+      CHECK(lhs.node_split(n.index()).right
+            == rhs.node_split(n.index()).right);
+      auto a = lhs.transitions(n.index());
+      auto b = rhs.transitions(n.index());
+      REQUIRE(a.size() == b.size());
+      for (size_t i = 0; i < a.size(); ++i) {
+        CHECK(a[i].waiting_time == b[i].waiting_time);
+        CHECK(a[i].final_state == b[i].final_state);
+      }
+    }
+  };
+
+  for (auto mode : {bigrig::operation_mode_e::FAST,
+                    bigrig::operation_mode_e::SIM,
+                    bigrig::operation_mode_e::ENDPOINT}) {
+    bigrig::tree_t tree(tree_str);
+    tree.set_mode(mode);
+    tree.set_periods(periods);
+    REQUIRE(tree.is_ready());
+
+    pcg64_fast gen(Catch::getSeed());
+    auto       start = gen;
+
+    bigrig::sim_result_t result;
+    tree.simulate_streams(init_dist, result, gen);
+
+    /* The same streams as the parallel simulation */
+    {
+      auto                 parallel_gen = start;
+      bigrig::task_pool_t  pool{2};
+      bigrig::sim_result_t parallel;
+      tree.simulate_parallel(init_dist, parallel, parallel_gen, pool);
+      check_same(tree, result, parallel);
+    }
+
+    /* Change the model of the last period, and then a branch */
+    auto model = std::make_shared<bigrig::biogeo_model_t>(
+        bigrig::rate_params_t{.dis = 3.0, .ext = 0.2},
+        bigrig::cladogenesis_params_t{
+            .allopatry = 2.0, .sympatry = 1.0, .copy = 1.0, .jump = 1.0},
+        true);
+    auto nodes = tree.set_period_model(1, model);
+    REQUIRE(nodes.has_value());
+    CHECK(nodes->size() < tree.node_count());
+    for (auto index : nodes.value()) {
+      CHECK(tree.abs_time(index) > 1.0);
+    }
+
+    auto simulated = tree.resimulate(result, nodes.value());
+    REQUIRE(simulated.has_value());
+    CHECK(simulated.value() >= nodes->size());
+
+    /*
+     * Compare with a tree which was edited before it simulated anything, so
+     * that nothing stale can be left in its endpoint cache
+     */
+    bigrig::tree_t fresh_tree(tree_str);
+    fresh_tree.set_mode(mode);
+    fresh_tree.set_periods(periods);
+    fresh_tree.set_period_model(1, model);
+
+    bigrig::sim_result_t fresh;
+    auto                 fresh_gen = start;
+    fresh_tree.simulate_streams(init_dist, fresh, fresh_gen);
+    check_same(tree, result, fresh);
+
+    auto subtree = tree.set_brlen(1, 0.25);
+    CHECK(subtree.size() == tree.subtree_size(1));
+    REQUIRE(tree.is_ready());
+    REQUIRE(tree.resimulate(result, subtree).has_value());
+
+    fresh_tree.set_brlen(1, 0.25);
+    fresh_gen = start;
+    fresh_tree.simulate_streams(init_dist, fresh, fresh_gen);
+    check_same(tree, result, fresh);
+  }
+
+  bigrig::tree_t tree(tree_str);
+  tree.set_periods(periods);
+  pcg64_fast gen(Catch::getSeed());
+
+  /* Only results with node generators can be simulated again */
+  bigrig::sim_result_t result;
+  tree.simulate(init_dist, result, gen);
+  CHECK(!tree.resimulate(result, std::vector<size_t>{0}).has_value());
+
+  result.set_stats_only(true);
+  tree.simulate_streams(init_dist, result, gen);
+  CHECK(!tree.resimulate(result, std::vector<size_t>{0}).has_value());
+
+  CHECK(!tree.set_period_model(7, periods[0].model_ptr()).has_value());
+}
+
+TEST_CASE("tree string ids", "[tree]") {
+  const std::string tree_str
+      = "(((c:0.9295,(a:0.0441,b:0.2992):0.3751):0.8417,(d:0.2104,e:1e-5):0."
+        "1917):0.1,f:123456.7):0.5;";
+  auto period = make_single_period();
+
+  bigrig::tree_t tree(tree_str);
+  tree.set_periods(period);
+  REQUIRE(tree.is_ready());
+
+  for (size_t index = 0; index < tree.node_count(); ++index) {
+    const auto &id = tree.string_id(index);
+    CHECK(id
+          == (tree.is_leaf(index) ? tree.label(index)
+                                  : std::to_string(tree.node_id(index))));
+    CHECK(tree.find_string_id(id) == index);
+  }
+  CHECK(!tree.find_string_id("x").has_value());
+
+  pcg64_fast           gen(Catch::getSeed());
+  bigrig::sim_result_t result;
+  tree.simulate({0b0101, 4}, result, gen);
+  CHECK(tree.get_dist_by_string_id("b", result)
+        == result.final_state(tree.find_string_id("b").value()));
+
+  /* The buffer writer gives the same string as the stream writer */
+  auto stream_newick = tree.to_newick([](std::ostream &os, const auto &n) {
+    os << n.string_id() << ":" << n.brlen();
+  });
+  CHECK(tree.to_newick() == stream_newick);
+
+  auto stream_nhx
+      = tree.to_newick([&result](std::ostream &os, const bigrig::node_t &n) {
+          os << n.string_id() << "[&&NHX:";
+          if (n.is_leaf()) {
+            os << "dist=" << result.final_state(n.index());
+          } else {
+            os << result.node_split(n.index()).to_nhx_string();
+          }
+          os << "]";
+        });
+  std::string nhx;
+  tree.append_newick(nhx, [&](std::string &out, size_t index) {
+    out += tree.string_id(index);
+    out += "[&&NHX:";
+    if (tree.is_leaf(index)) {
+      out += "dist=";
+      result.final_state(index).append_to(out);
+    } else {
+      result.node_split(index).append_nhx(out);
+    }
+    out += "]";
+  });
+  CHECK(nhx == stream_nhx);
+}